@@ -0,0 +1,292 @@
+# <pep8-80 compliant>
+
+"""Generate synthetic BOGLE scenes for benchmarking.
+
+Writes a .bgl scene file along with the .bgg geometries and .png textures it
+uses, laid out like an assets directory: the scene at the top and the rest in
+the geometries/ and textures/ subdirectories. The amount of everything is
+configurable so that load times can be measured for scenes of any shape
+without needing real art assets. Only the python standard library is needed.
+
+Example:
+
+    python3 BOGLE/generate_scene.py --objects 10000 --depth 8 \\
+        --meshes 200 --vertices 4096 --materials 50 --textures 100 \\
+        --lights 8 --animations 10 /tmp/bench_assets big
+
+"""
+
+import argparse
+import math
+import os
+import random
+import struct
+import zlib
+
+
+BOGLE_VERSION = 1
+OBJECT_TREE_MAXIMUM_DEPTH = 256
+UBER_TEXTURES = 8  # Ambient, emissive, diffuse, ... opacity
+LIGHT_TYPES = 3  # Spot, directional, point
+IDENTITY = (1, 0, 0, 0,
+            0, 1, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 0, 1)
+
+
+def string(s):
+    data = s.encode('utf-8')
+    return struct.pack('<I', len(data)) + data
+
+
+def translation(x, y, z):
+    return (1, 0, 0, 0,
+            0, 1, 0, 0,
+            0, 0, 1, 0,
+            x, y, z, 1)
+
+
+def png(width, height, rng):
+    """A noisy RGB png, so that it doesn't compress to nothing."""
+    rows = bytearray()
+    base = [rng.randrange(256) for _ in range(3)]
+    for y in range(height):
+        rows.append(0)  # No filter
+        for x in range(width):
+            noise = rng.randrange(64)
+            rows.append((base[0] ^ x ^ noise) & 0xff)
+            rows.append((base[1] ^ y ^ noise) & 0xff)
+            rows.append((base[2] ^ (x + y)) & 0xff)
+
+    def chunk(kind, data):
+        return (struct.pack('>I', len(data)) + kind + data +
+                struct.pack('>I', zlib.crc32(kind + data) & 0xffffffff))
+
+    header = struct.pack('>IIBBBBB', width, height, 8, 2, 0, 0, 0)
+    return (b'\x89PNG\r\n\x1a\n' + chunk(b'IHDR', header) +
+            chunk(b'IDAT', zlib.compress(bytes(rows), 6)) +
+            chunk(b'IEND', b''))
+
+
+def bgg(nvertices, rng):
+    """A wavy grid with about the given amount of vertices."""
+    side = max(2, int(math.sqrt(nvertices)))
+    vertices = bytearray()
+    for j in range(side):
+        for i in range(side):
+            u = i / (side - 1)
+            v = j / (side - 1)
+            h = 0.1 * math.sin(u * 6.28 + rng.random())
+            vertices += struct.pack('<3f2f3f3f3f3f3f',
+                                    u - 0.5, h, v - 0.5,
+                                    u, v,
+                                    0, 1, 0,
+                                    1, 0, 0,
+                                    0, 0, 1,
+                                    0, 0, 0,
+                                    1, 0, 0)
+    indices = []
+    for j in range(side - 1):
+        for i in range(side - 1):
+            a = j * side + i
+            b = a + 1
+            c = a + side
+            d = c + 1
+            indices += (a, c, b, b, c, d)
+
+    return (struct.pack('<II', side * side, len(indices)) + bytes(vertices) +
+            struct.pack('<%dI' % len(indices), *indices))
+
+
+def object_tree(parents):
+    """The scene tree string from each object's parent, None for root."""
+    children = [[] for _ in parents]
+    roots = []
+    for idx, parent in enumerate(parents):
+        (roots if parent is None else children[parent]).append(idx)
+
+    out = []
+    stack = [iter(roots)]
+    while stack:
+        idx = next(stack[-1], None)
+        if idx is None:
+            stack.pop()
+            if stack:
+                out.append('}')
+            continue
+        out.append(str(idx))
+        if children[idx]:
+            out.append('{')
+            stack.append(iter(children[idx]))
+    return (' '.join(out) + '\0').encode('ascii')
+
+
+def generate(args):
+    rng = random.Random(args.seed)
+    geometries = os.path.join(args.output, 'geometries')
+    textures = os.path.join(args.output, 'textures')
+    os.makedirs(geometries, exist_ok=True)
+    os.makedirs(textures, exist_ok=True)
+
+    for i in range(args.meshes):
+        with open(os.path.join(geometries, 'mesh%d.bgg' % i), 'wb') as f:
+            f.write(bgg(args.vertices, rng))
+    for i in range(args.textures):
+        with open(os.path.join(textures, 'tex%d.png' % i), 'wb') as f:
+            f.write(png(args.texture_size, args.texture_size, rng))
+
+    # Objects: lights first, then the camera, then the meshes. Meshes are
+    # grouped in chains 'depth' objects long, each one the child of the
+    # previous, and spread over the cells along the X axis.
+    nmeshobjs = args.objects
+    nobjs = args.lights + 1 + nmeshobjs
+
+    # Chains can't cross cells, keep cell ranges aligned to them
+    depth = max(1, min(args.depth, OBJECT_TREE_MAXIMUM_DEPTH - 1))
+    ncells = min(args.cells, -(-nmeshobjs // depth))
+    per_cell = 0
+    if ncells > 0:
+        per_cell = max(depth, nmeshobjs // ncells // depth * depth)
+
+    out = bytearray()
+    out += b'BOGLE'
+    out += struct.pack('<B', BOGLE_VERSION)
+    out += struct.pack('<7I', 1, args.meshes, args.materials, args.lights,
+                       args.animations, nobjs, ncells)
+    out += struct.pack('<4f', 0.1, 0.1, 0.1, 1)
+
+    # Camera
+    out += struct.pack('<B', 0) + string('camera')
+    out += struct.pack('<IIfffB', 1920, 1080, 0.1, 1000, 1.0, 1)
+
+    # Geometries
+    for i in range(args.meshes):
+        out += struct.pack('<B', 0) + string('mesh%d' % i)
+        out += string('mesh%d' % i)
+
+    # Materials
+    for i in range(args.materials):
+        out += struct.pack('<BB', 0, 0) + string('material%d' % i)
+        color = [rng.random() for _ in range(3)] + [1]
+        out += struct.pack('<16f', *(color * 4))  # Ambient, emissive, ...
+        out += struct.pack('<8f', 1, 32, 0, 0, 1, 1, 1, 0)
+        out += struct.pack('<B', 0)
+        for slot in range(UBER_TEXTURES):
+            # A diffuse and a normal texture for every material
+            if args.textures > 0 and slot in (2, 5):
+                name = 'tex%d' % ((2 * i + (slot == 5)) % args.textures)
+                out += string(name)
+            else:
+                out += struct.pack('<I', 0)
+
+    # Lights
+    for i in range(args.lights):
+        out += struct.pack('<B', i % LIGHT_TYPES) + string('light%d' % i)
+        out += struct.pack('<4f3fff', 1, 1, 1, 1, 0, 0.1, 1, 10, 0.5)
+
+    # Animation collections
+    for i in range(args.animations):
+        out += struct.pack('<B', 0) + string('armature%d' % i)
+        out += struct.pack('<I', args.clips)
+        out += struct.pack('<16f', *IDENTITY)
+        out += struct.pack('<I', args.bones)
+        for b in range(args.bones):
+            out += struct.pack('<3f4fI', 0, 0.2, 0, 0, 0, 0, 1, b)
+        for c in range(args.clips):
+            out += string('clip%d' % c)
+            out += struct.pack('<I', args.keyframes)
+            for k in range(args.keyframes):
+                out += struct.pack('<f3f', k / 24, 0, 0, 0)
+                angle = 0.1 * k
+                rotation = (0, math.sin(angle / 2), 0, math.cos(angle / 2))
+                out += struct.pack('<4f', *rotation) * args.bones
+
+    # Instances
+    parents = []
+    for i in range(args.lights):
+        out += string('light%d' % i)
+        out += struct.pack('<5I', 0, 0, 0, i + 1, 0)
+        out += struct.pack('<16f', *translation(0, 10, i))
+        parents.append(None)
+
+    out += string('camera')
+    out += struct.pack('<5I', 1, 0, 0, 0, 0)
+    out += struct.pack('<16f', *translation(0, 2, 0))
+    parents.append(None)
+
+    first = len(parents)
+    for i in range(nmeshobjs):
+        cell = min(i // per_cell, ncells - 1) if ncells > 0 else 0
+        if i % depth == 0:
+            x = cell * args.cell_size + rng.random() * args.cell_size
+            z = rng.random() * args.cell_size
+            model = translation(x, 0, z)
+            parents.append(None)
+        else:
+            model = translation(0, 1, 0)
+            parents.append(first + i - 1)
+
+        geometry = i % args.meshes + 1 if args.meshes > 0 else 0
+        material = i % args.materials + 1 if args.materials > 0 else 0
+        animation = 0
+        if args.animations > 0 and i % args.animated_every == 0:
+            animation = (i // args.animated_every) % args.animations + 1
+        out += string('object%d' % i)
+        out += struct.pack('<5I', 0, geometry, material, 0, animation)
+        out += struct.pack('<16f', *model)
+
+    out += object_tree(parents)
+
+    for c in range(ncells):
+        start = c * per_cell
+        end = nmeshobjs if c == ncells - 1 else (c + 1) * per_cell
+        out += struct.pack('<3f', c * args.cell_size, -1, 0)
+        out += struct.pack('<3f', (c + 1) * args.cell_size, depth + 1,
+                           args.cell_size)
+        out += struct.pack('<II', first + start, end - start)
+
+    with open(os.path.join(args.output, args.name + '.bgl'), 'wb') as f:
+        f.write(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('output', help='assets directory to write to')
+    parser.add_argument('name', help='scene name, without extension')
+    parser.add_argument('--objects', type=int, default=1000,
+                        help='mesh objects in the scene')
+    parser.add_argument('--depth', type=int, default=4,
+                        help='depth of the object hierarchies')
+    parser.add_argument('--meshes', type=int, default=50,
+                        help='distinct geometries')
+    parser.add_argument('--vertices', type=int, default=1024,
+                        help='vertices per geometry')
+    parser.add_argument('--materials', type=int, default=20)
+    parser.add_argument('--textures', type=int, default=20,
+                        help='distinct png textures')
+    parser.add_argument('--texture-size', type=int, default=256)
+    parser.add_argument('--lights', type=int, default=4)
+    parser.add_argument('--animations', type=int, default=2,
+                        help='animation collections')
+    parser.add_argument('--clips', type=int, default=2,
+                        help='animations per collection')
+    parser.add_argument('--bones', type=int, default=16)
+    parser.add_argument('--keyframes', type=int, default=30)
+    parser.add_argument('--animated-every', type=int, default=10,
+                        help='give every Nth object an animation collection')
+    parser.add_argument('--cells', type=int, default=0,
+                        help='streaming cells, 0 for none')
+    parser.add_argument('--cell-size', type=float, default=100)
+    parser.add_argument('--seed', type=int, default=30)
+    args = parser.parse_args()
+
+    if args.objects > 0 and (args.meshes == 0) != (args.materials == 0):
+        parser.error('objects with a geometry need a material')
+    if args.animated_every <= 0:
+        parser.error('--animated-every must be positive')
+
+    generate(args)
+
+
+if __name__ == '__main__':
+    main()
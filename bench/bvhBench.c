@@ -0,0 +1,397 @@
+#include <thirty/bvh.h>
+#include <thirty/util.h>
+
+/*
+ * Cost of the bounding volume hierarchy's queries next to going through every
+ * object's box, like the engine did before it, and of keeping the tree up to
+ * date. Objects are random boxes spread evenly in a cube that grows with
+ * their count, so queries of the same size find about as many objects at
+ * every count. Every query's results are checked against the brute force
+ * version's, which they must match.
+ *
+ * Usage: bvhBench [QUERIES] [RUNS]
+ *
+ * Reports the best of RUNS runs at 1000, 10000 and 100000 objects, in
+ * microseconds: "build" builds the tree from scratch, "refit" moves a tenth
+ * of the objects, "churn" removes and inserts back a tenth of them, and the
+ * rest run QUERIES queries of each kind with the tree and without it.
+ */
+
+#define DEFAULT_QUERIES 1000
+#define DEFAULT_RUNS 5
+#define SPACING 4.0f  // between objects
+#define QUERY_SIZE 10.0f  // side of boxes, diameter of spheres
+#define FRUSTUM_FAR 50.0f
+#define RAY_LENGTH 1000.0f
+
+static const size_t counts[] = {1000, 10000, 100000};
+
+enum test {
+        TEST_BUILD,
+        TEST_REFIT,
+        TEST_CHURN,
+        TEST_FRUSTUM,
+        TEST_BOX,
+        TEST_SPHERE,
+        TEST_RAY,
+        TEST_TOTAL,
+};
+
+static const char *const testNames[TEST_TOTAL] = {
+        [TEST_BUILD] = "build",
+        [TEST_REFIT] = "refit",
+        [TEST_CHURN] = "churn",
+        [TEST_FRUSTUM] = "frustum",
+        [TEST_BOX] = "box",
+        [TEST_SPHERE] = "sphere",
+        [TEST_RAY] = "ray",
+};
+
+struct query {
+        vec4s planes[6];
+        vec3s min, max;  // box
+        vec3s center;  // sphere
+        vec3s origin, direction;  // ray
+};
+
+struct data {
+        size_t count;
+        size_t nqueries;
+        size_t *idxs;
+        vec3s *mins;
+        vec3s *maxs;
+        struct query *queries;
+        struct bvh bvh;
+        struct growingArray results;
+        struct growingArray expected;
+        size_t hits;  // of all of the rays
+        float distances;
+};
+
+static float randomFloat(void) {
+        return (float)rand() / (float)RAND_MAX;
+}
+
+static vec3s randomPoint(const float side) {
+        return (vec3s){{randomFloat() * side, randomFloat() * side,
+                        randomFloat() * side}};
+}
+
+static vec3s randomDirection(void) {
+        return glms_vec3_normalize((vec3s){{
+                randomFloat() * 2 - 1, randomFloat() * 2 - 1,
+                randomFloat() * 2 - 1}});
+}
+
+static void initData(struct data *const data, const size_t count,
+                     const size_t nqueries) {
+        data->count = count;
+        data->nqueries = nqueries;
+        data->idxs = smallocarray(count, sizeof(size_t));
+        data->mins = smallocarray(count, sizeof(vec3s));
+        data->maxs = smallocarray(count, sizeof(vec3s));
+        data->queries = smallocarray(nqueries, sizeof(struct query));
+        bvh_init(&data->bvh);
+        growingArray_init(&data->results, sizeof(size_t), 64);
+        growingArray_init(&data->expected, sizeof(size_t), 64);
+
+        const float side = cbrtf((float)count) * SPACING;
+        for (size_t i=0; i<count; i++) {
+                data->idxs[i] = i + 1;
+                data->mins[i] = randomPoint(side);
+                data->maxs[i] = glms_vec3_add(data->mins[i],
+                                              glms_vec3_adds(randomPoint(1.5f),
+                                                             0.5f));
+        }
+
+        const mat4s projection = glms_perspective(glm_rad(60), 16.0f / 9.0f,
+                                                  0.1f, FRUSTUM_FAR);
+        for (size_t i=0; i<nqueries; i++) {
+                struct query *const query = &data->queries[i];
+                const vec3s eye = randomPoint(side);
+                const mat4s view = glms_look(eye, randomDirection(),
+                                             (vec3s){{0, 1, 0}});
+                glms_frustum_planes(glms_mat4_mul(projection, view),
+                                    query->planes);
+                query->min = randomPoint(side);
+                query->max = glms_vec3_adds(query->min, QUERY_SIZE);
+                query->center = randomPoint(side);
+                query->origin = randomPoint(side);
+                query->direction = randomDirection();
+        }
+}
+
+static void freeData(struct data *const data) {
+        growingArray_destroy(&data->expected);
+        growingArray_destroy(&data->results);
+        bvh_free(&data->bvh);
+        free(data->queries);
+        free(data->maxs);
+        free(data->mins);
+        free(data->idxs);
+}
+
+// The same tests as bvh.c's, one box at a time
+
+static bool outsideFrustum(const vec3s min, const vec3s max,
+                           const vec4s planes[6]) {
+        for (size_t p=0; p<6; p++) {
+                vec3s far;
+                for (size_t axis=0; axis<3; axis++) {
+                        far.raw[axis] = planes[p].raw[axis] > 0 ?
+                                max.raw[axis] : min.raw[axis];
+                }
+                if (glms_vec3_dot(glms_vec3(planes[p]), far) +
+                    planes[p].w < 0) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static float rayEnters(const vec3s min, const vec3s max, const vec3s origin,
+                       const vec3s inverse, const float maxDistance) {
+        float enter = 0;
+        float exit = maxDistance;
+        for (size_t axis=0; axis<3; axis++) {
+                const float t1 = (min.raw[axis] - origin.raw[axis]) *
+                        inverse.raw[axis];
+                const float t2 = (max.raw[axis] - origin.raw[axis]) *
+                        inverse.raw[axis];
+                enter = fmaxf(enter, fminf(t1, t2));
+                exit = fminf(exit, fmaxf(t1, t2));
+        }
+        return enter <= exit ? enter : -1;
+}
+
+static void bruteForce(struct data *const data, const enum test test,
+                       const struct query *const query) {
+        const float radius = QUERY_SIZE / 2;
+        const vec3s inverse = glms_vec3_div(glms_vec3_one(),
+                                            query->direction);
+        float closest = RAY_LENGTH;
+        size_t hit = 0;
+        for (size_t i=0; i<data->count; i++) {
+                const vec3s min = data->mins[i];
+                const vec3s max = data->maxs[i];
+                bool pass = false;
+                switch (test) {
+                case TEST_FRUSTUM:
+                        pass = !outsideFrustum(min, max, query->planes);
+                        break;
+                case TEST_BOX:
+                        pass = min.x <= query->max.x &&
+                                max.x >= query->min.x &&
+                                min.y <= query->max.y &&
+                                max.y >= query->min.y &&
+                                min.z <= query->max.z &&
+                                max.z >= query->min.z;
+                        break;
+                case TEST_SPHERE:
+                        pass = glms_vec3_distance2(
+                                query->center, glms_vec3_maxv(
+                                        min, glms_vec3_minv(query->center,
+                                                            max))) <=
+                                radius * radius;
+                        break;
+                case TEST_RAY: {
+                        const float enter = rayEnters(
+                                min, max, query->origin, inverse, closest);
+                        if (enter >= 0) {
+                                closest = enter;
+                                hit = data->idxs[i];
+                        }
+                        break;
+                }
+                case TEST_BUILD:
+                case TEST_REFIT:
+                case TEST_CHURN:
+                case TEST_TOTAL:
+                default:
+                        assert(false);
+                        break;
+                }
+                if (pass) {
+                        size_t *const result = growingArray_append(
+                                &data->expected);
+                        *result = data->idxs[i];
+                }
+        }
+        if (test == TEST_RAY) {
+                data->hits += hit != 0;
+                data->distances += hit != 0 ? closest : 0;
+        }
+}
+
+static void query(struct data *const data, const enum test test,
+                  const struct query *const query) {
+        float distance;
+        size_t hit;
+        switch (test) {
+        case TEST_FRUSTUM:
+                bvh_queryFrustum(&data->bvh, query->planes, &data->results);
+                break;
+        case TEST_BOX:
+                bvh_queryBox(&data->bvh, query->min, query->max,
+                             &data->results);
+                break;
+        case TEST_SPHERE:
+                bvh_querySphere(&data->bvh, query->center, QUERY_SIZE / 2,
+                                &data->results);
+                break;
+        case TEST_RAY:
+                hit = bvh_queryRay(&data->bvh, query->origin,
+                                   query->direction, RAY_LENGTH, &distance);
+                data->hits += hit != 0;
+                data->distances += hit != 0 ? distance : 0;
+                break;
+        case TEST_BUILD:
+        case TEST_REFIT:
+        case TEST_CHURN:
+        case TEST_TOTAL:
+        default:
+                assert(false);
+                break;
+        }
+}
+
+static void update(struct data *const data, const enum test test) {
+        const size_t step = 10;  // a tenth of the objects
+        switch (test) {
+        case TEST_BUILD:
+                bvh_build(&data->bvh, data->idxs, data->mins, data->maxs,
+                          data->count);
+                break;
+        case TEST_REFIT:
+                // Back and forth, so that runs are the same
+                for (size_t i=0; i<data->count; i+=step) {
+                        const vec3s offset = {{SPACING, 0, 0}};
+                        bvh_set(&data->bvh, data->idxs[i],
+                                glms_vec3_add(data->mins[i], offset),
+                                glms_vec3_add(data->maxs[i], offset));
+                }
+                for (size_t i=0; i<data->count; i+=step) {
+                        bvh_set(&data->bvh, data->idxs[i], data->mins[i],
+                                data->maxs[i]);
+                }
+                break;
+        case TEST_CHURN:
+                for (size_t i=0; i<data->count; i+=step) {
+                        bvh_remove(&data->bvh, data->idxs[i]);
+                }
+                for (size_t i=0; i<data->count; i+=step) {
+                        bvh_set(&data->bvh, data->idxs[i], data->mins[i],
+                                data->maxs[i]);
+                }
+                break;
+        case TEST_FRUSTUM:
+        case TEST_BOX:
+        case TEST_SPHERE:
+        case TEST_RAY:
+        case TEST_TOTAL:
+        default:
+                assert(false);
+                break;
+        }
+}
+
+static int compareIdxs(const void *const a, const void *const b,
+                       void *const args) {
+        const size_t *const idxA = a;
+        const size_t *const idxB = b;
+        (void)args;
+        return (*idxA > *idxB) - (*idxA < *idxB);
+}
+
+// Best of the runs, in microseconds, with the tree or without it. Only the
+// last run's results are kept.
+static uint64_t timeTest(struct data *const data, const enum test test,
+                         const bool bruteForceIt, const long runs) {
+        uint64_t best = UINT64_MAX;
+        for (long run=0; run<runs; run++) {
+                growingArray_clear(bruteForceIt ?
+                                   &data->expected : &data->results);
+                data->hits = 0;
+                data->distances = 0;
+                const uint64_t start = time_micros();
+                if (test == TEST_BUILD || test == TEST_REFIT ||
+                    test == TEST_CHURN) {
+                        update(data, test);
+                } else {
+                        for (size_t i=0; i<data->nqueries; i++) {
+                                if (bruteForceIt) {
+                                        bruteForce(data, test,
+                                                   &data->queries[i]);
+                                } else {
+                                        query(data, test, &data->queries[i]);
+                                }
+                        }
+                }
+                const uint64_t elapsed = time_micros() - start;
+                if (elapsed < best) {
+                        best = elapsed;
+                }
+        }
+        return best;
+}
+
+int main(const int argc, char *argv[]) {
+        if (argc > 3) {
+                fprintf(stderr, "Usage: %s [QUERIES] [RUNS]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+        const long nqueries = argc >= 2 ? strtol(argv[1], NULL, 10)
+                : DEFAULT_QUERIES;
+        if (nqueries <= 0) {
+                bail("Invalid number of queries: %s\n", argv[1]);
+        }
+        const long runs = argc == 3 ? strtol(argv[2], NULL, 10) : DEFAULT_RUNS;
+        if (runs <= 0) {
+                bail("Invalid number of runs: %s\n", argv[2]);
+        }
+
+        srand(1);
+        printf("count\ttest\tbvh_us\tbrute_force_us\tspeedup\tcheck\n");
+        bool allMatch = true;
+        for (size_t c=0; c<sizeof(counts)/sizeof(*counts); c++) {
+                struct data data;
+                initData(&data, counts[c], (size_t)nqueries);
+
+                for (enum test test=0; test<TEST_TOTAL; test++) {
+                        const uint64_t bvh = timeTest(&data, test, false,
+                                                      runs);
+                        if (test == TEST_BUILD || test == TEST_REFIT ||
+                            test == TEST_CHURN) {
+                                printf("%zu\t%s\t%lu\t-\t-\t-\n", data.count,
+                                       testNames[test], (unsigned long)bvh);
+                                continue;
+                        }
+
+                        const size_t hits = data.hits;
+                        const float distances = data.distances;
+                        const uint64_t brute = timeTest(&data, test, true,
+                                                        runs);
+                        growingArray_sort(&data.results, compareIdxs, NULL);
+                        growingArray_sort(&data.expected, compareIdxs, NULL);
+                        // Ties may hit different boxes at the same distance
+                        const bool match = test == TEST_RAY ?
+                                hits == data.hits &&
+                                memcmp(&distances, &data.distances,
+                                       sizeof(distances)) == 0 :
+                                data.results.length == data.expected.length &&
+                                memcmp(data.results.data, data.expected.data,
+                                       data.results.length *
+                                       sizeof(size_t)) == 0;
+                        allMatch = allMatch && match;
+                        printf("%zu\t%s\t%lu\t%lu\t%.1f\t%s\n",
+                               data.count, testNames[test],
+                               (unsigned long)bvh, (unsigned long)brute,
+                               bvh == 0 ? 0 : (double)brute / (double)bvh,
+                               match ? "ok" : "MISMATCH");
+                }
+
+                freeData(&data);
+        }
+
+        return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,224 @@
+#include <thirty/object.h>
+#include <thirty/util.h>
+
+/*
+ * Cost of getting objects' components through object_getComponent, which
+ * switches on the type at runtime and calls out to the dsutils module, next
+ * to the inlined per-type accessors like object_getTransform. Objects are
+ * visited in random order, like the render sort does, with a transform,
+ * geometry and material each, and a camera slot that's empty.
+ *
+ * Usage: componentBench [COUNT] [RUNS]
+ *
+ * Reports the best of RUNS runs, in nanoseconds per object: "lookup" gets the
+ * four components of every object, "sort" sorts the objects by geometry and
+ * material like cmpobj in scene.c. Both versions must get the same results.
+ */
+
+#define DEFAULT_COUNT 100000
+#define DEFAULT_RUNS 5
+
+enum test {
+        TEST_LOOKUP,
+        TEST_SORT,
+        TEST_TOTAL,
+};
+
+static const char *const testNames[TEST_TOTAL] = {
+        [TEST_LOOKUP] = "lookup",
+        [TEST_SORT] = "sort",
+};
+
+struct data {
+        size_t count;
+        struct varSizeGrowingArray components;
+        struct object *objects;
+        const struct object **order;  // random
+        const struct object **sorted;
+};
+
+// A handful of shared geometries and materials, like a real scene has
+#define SHARED_COMPONENTS 64
+
+static void initData(struct data *const data, const size_t count) {
+        data->count = count;
+        componentCollection_initCollection(&data->components);
+        data->objects = smallocarray(count, sizeof(struct object));
+        data->order = smallocarray(count, sizeof(const struct object*));
+        data->sorted = smallocarray(count, sizeof(const struct object*));
+
+        size_t geometries[SHARED_COMPONENTS];
+        size_t materials[SHARED_COMPONENTS];
+        for (size_t i=0; i<SHARED_COMPONENTS; i++) {
+                const struct component *comp = componentCollection_create(
+                        &data->components, NULL, COMPONENT_GEOMETRY);
+                geometries[i] = comp->idx + 1;
+                comp = componentCollection_create(
+                        &data->components, NULL, COMPONENT_MATERIAL_UBER);
+                materials[i] = comp->idx + 1;
+        }
+
+        for (size_t i=0; i<count; i++) {
+                struct object *const object = &data->objects[i];
+                object->idx = i + 1;
+                object->componentsMemory = &data->components;
+                componentCollection_init(&object->components);
+                const struct component *const trans =
+                        componentCollection_create(&data->components, NULL,
+                                                   COMPONENT_TRANSFORM);
+                object->components.transform = trans->idx + 1;
+                object->components.geometry =
+                        geometries[(size_t)rand() % SHARED_COMPONENTS];
+                object->components.material =
+                        materials[(size_t)rand() % SHARED_COMPONENTS];
+                data->order[i] = object;
+        }
+
+        for (size_t i=count-1; i>0; i--) {
+                const size_t j = (size_t)rand() % (i + 1);
+                const struct object *const tmp = data->order[i];
+                data->order[i] = data->order[j];
+                data->order[j] = tmp;
+        }
+}
+
+static void freeData(struct data *const data) {
+        free(data->sorted);
+        free(data->order);
+        free(data->objects);
+        // Never initialized, only their memory is there
+        varSizeGrowingArray_destroy(&data->components);
+}
+
+static int cmpRuntime(const void *const a, const void *const b) {
+        const struct object *const obj1 = *(const struct object *const *)a;
+        const struct object *const obj2 = *(const struct object *const *)b;
+        const void *const geo1 = object_getComponent(obj1, COMPONENT_GEOMETRY);
+        const void *const geo2 = object_getComponent(obj2, COMPONENT_GEOMETRY);
+        if (geo1 != geo2) {
+                return geo1 < geo2 ? -1 : 1;
+        }
+        const void *const mat1 = object_getComponent(obj1, COMPONENT_MATERIAL);
+        const void *const mat2 = object_getComponent(obj2, COMPONENT_MATERIAL);
+        return (mat1 > mat2) - (mat1 < mat2);
+}
+
+static int cmpInline(const void *const a, const void *const b) {
+        const struct object *const obj1 = *(const struct object *const *)a;
+        const struct object *const obj2 = *(const struct object *const *)b;
+        const void *const geo1 = object_getGeometry(obj1);
+        const void *const geo2 = object_getGeometry(obj2);
+        if (geo1 != geo2) {
+                return geo1 < geo2 ? -1 : 1;
+        }
+        const void *const mat1 = object_getMaterial(obj1);
+        const void *const mat2 = object_getMaterial(obj2);
+        return (mat1 > mat2) - (mat1 < mat2);
+}
+
+// Something from every component, so that none of it can be left out
+static uintptr_t runTest(struct data *const data, const enum test test,
+                         const bool inlined) {
+        uintptr_t check = 0;
+        switch (test) {
+        case TEST_LOOKUP:
+                for (size_t i=0; i<data->count; i++) {
+                        const struct object *const object = data->order[i];
+                        if (inlined) {
+                                check += (uintptr_t)object_getTransform(object);
+                                check ^= (uintptr_t)object_getGeometry(object);
+                                check += (uintptr_t)object_getMaterial(object);
+                                check ^= (uintptr_t)object_getCamera(object);
+                        } else {
+                                check += (uintptr_t)object_getComponent(
+                                        object, COMPONENT_TRANSFORM);
+                                check ^= (uintptr_t)object_getComponent(
+                                        object, COMPONENT_GEOMETRY);
+                                check += (uintptr_t)object_getComponent(
+                                        object, COMPONENT_MATERIAL);
+                                check ^= (uintptr_t)object_getComponent(
+                                        object, COMPONENT_CAMERA);
+                        }
+                }
+                break;
+        case TEST_SORT:
+                memcpy(data->sorted, data->order,
+                       data->count * sizeof(const struct object*));
+                qsort(data->sorted, data->count,
+                      sizeof(const struct object*),
+                      inlined ? cmpInline : cmpRuntime);
+                for (size_t i=0; i<data->count; i++) {
+                        check = check * 31 + data->sorted[i]->idx;
+                }
+                break;
+        case TEST_TOTAL:
+        default:
+                assert(false);
+                break;
+        }
+        return check;
+}
+
+// Best of the runs, in microseconds
+static uint64_t timeTest(struct data *const data, const enum test test,
+                         const bool inlined, const long runs,
+                         uintptr_t *const check) {
+        uint64_t best = UINT64_MAX;
+        for (long run=0; run<runs; run++) {
+                const uint64_t start = time_micros();
+                *check = runTest(data, test, inlined);
+                const uint64_t elapsed = time_micros() - start;
+                if (elapsed < best) {
+                        best = elapsed;
+                }
+        }
+        return best;
+}
+
+static void printResult(const char *const test, const char *const version,
+                        const uint64_t micros, const size_t count,
+                        const char *const check) {
+        printf("%s\t%s\t%.2f\t%s\n", test, version,
+               (double)micros * 1000.0 / (double)count, check);
+}
+
+int main(const int argc, char *argv[]) {
+        if (argc > 3) {
+                fprintf(stderr, "Usage: %s [COUNT] [RUNS]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        const long count = argc >= 2 ? strtol(argv[1], NULL, 10)
+                : DEFAULT_COUNT;
+        if (count <= 0) {
+                bail("Invalid count: %s\n", argv[1]);
+        }
+        const long runs = argc == 3 ? strtol(argv[2], NULL, 10) : DEFAULT_RUNS;
+        if (runs <= 0) {
+                bail("Invalid number of runs: %s\n", argv[2]);
+        }
+
+        srand(1);
+        struct data data;
+        initData(&data, (size_t)count);
+
+        printf("test\tversion\tns_per_object\tcheck\n");
+        bool allMatch = true;
+        for (enum test test=0; test<TEST_TOTAL; test++) {
+                uintptr_t expected;
+                uintptr_t check;
+                const uint64_t runtime = timeTest(&data, test, false, runs,
+                                                  &expected);
+                printResult(testNames[test], "getComponent", runtime,
+                            data.count, "-");
+                const uint64_t inlined = timeTest(&data, test, true, runs,
+                                                  &check);
+                const bool match = check == expected;
+                printResult(testNames[test], "inline", inlined, data.count,
+                            match ? "ok" : "MISMATCH");
+                allMatch = allMatch && match;
+        }
+
+        freeData(&data);
+        return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,207 @@
+#define _DEFAULT_SOURCE  // getrusage
+
+#include <thirty/game.h>
+#include <thirty/util.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/*
+ * Headless end-to-end scene load benchmark. Loads a BOGLE scene the same way
+ * the game does, through scene_initFromFile, scene_load and
+ * scene_awaitAsyncLoaders, with an invisible window providing the OpenGL
+ * context, and reports how long each phase took and how much memory was in
+ * use. Scenes can be made with BOGLE/generate_scene.py.
+ *
+ * Usage: loadBench ASSETS_DIR SCENE.bgl [RUNS]
+ *
+ * The scene path is relative to the assets directory, which is where the
+ * geometries and textures directories are looked for.
+ */
+
+#define DEFAULT_RUNS 5
+
+enum phase {
+        PHASE_STEPS,  // scene_load, parsing and creating everything
+        PHASE_READS,  // waiting for the async loader's reads
+        PHASE_UPLOADS,  // async loader callbacks: decoding and GL uploads
+        PHASE_GPU,  // glFinish, whatever the driver still had queued
+        PHASE_UNLOAD,  // scene_unload
+        PHASE_TOTAL,
+};
+
+static const char *const phaseNames[PHASE_TOTAL] = {
+        [PHASE_STEPS] = "steps",
+        [PHASE_READS] = "reads",
+        [PHASE_UPLOADS] = "uploads",
+        [PHASE_GPU] = "gpu",
+        [PHASE_UNLOAD] = "unload",
+};
+
+struct run {
+        uint64_t micros[PHASE_TOTAL];
+        size_t bytesRead;
+        long rssLoaded;  // KiB resident once loaded
+};
+
+static long residentKiB(void) {
+        FILE *const f = sfopen("/proc/self/statm", "r");
+        long size;
+        long resident;
+        if (fscanf(f, "%ld %ld", &size, &resident) != 2) {
+                die("Can't read /proc/self/statm\n");
+        }
+        sfclose(f);
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long peakResidentKiB(void) {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+                perror("getrusage");
+                die(NULL);
+        }
+        return usage.ru_maxrss;
+}
+
+static void error_callback(const int error, const char *const msg) {
+        fprintf(stderr, "GLFW error %d: %s\n", error, msg);
+}
+
+static GLFWwindow *initContext(void) {
+        glfwSetErrorCallback(error_callback);
+        if (!glfwInit()) {
+                die("Failed to initialize GLFW.\n");
+        }
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        GLFWwindow *const window = glfwCreateWindow(64, 64, "", NULL, NULL);
+        if (window == NULL) {
+                glfwTerminate();
+                die("Failed to create GLFW window.\n");
+        }
+        glfwMakeContextCurrent(window);
+
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+                glfwTerminate();
+                die("Failed to initialize GLAD.\n");
+        }
+        return window;
+}
+
+static void runOnce(struct game *const game, const char *const filename,
+                    struct run *const run) {
+        memset(run, 0, sizeof(*run));
+
+        // Objects find their scene through the game
+        growingArray_clear(&game->scenes);
+        struct scene *const scene = game_createScene(game);
+        scene_initFromFile(scene, game, filename);
+
+        uint64_t start = time_micros();
+        while (!scene_load(scene)) {
+        }
+        run->micros[PHASE_STEPS] = time_micros() - start;
+
+        // Reaping a read runs its callback, the rest of the time is spent
+        // waiting for reads to finish
+        for (;;) {
+                const size_t before = scene->totalSizeFinishedAsyncLoad;
+                start = time_micros();
+                const bool done = scene_awaitAsyncLoaders(scene);
+                const uint64_t elapsed = time_micros() - start;
+                if (before != scene->totalSizeFinishedAsyncLoad) {
+                        run->micros[PHASE_UPLOADS] += elapsed;
+                } else {
+                        run->micros[PHASE_READS] += elapsed;
+                }
+                if (done) {
+                        break;
+                }
+        }
+        run->bytesRead = scene->totalSizeFinishedAsyncLoad;
+
+        start = time_micros();
+        glFinish();
+        run->micros[PHASE_GPU] = time_micros() - start;
+        run->rssLoaded = residentKiB();
+
+        start = time_micros();
+        scene_unload(scene);
+        run->micros[PHASE_UNLOAD] = time_micros() - start;
+
+        scene_free(scene);
+}
+
+int main(const int argc, char *argv[]) {
+        if (argc < 3 || argc > 4) {
+                fprintf(stderr, "Usage: %s ASSETS_DIR SCENE.bgl [RUNS]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+        const long runs = argc == 4 ? strtol(argv[3], NULL, 10) : DEFAULT_RUNS;
+        if (runs <= 0) {
+                bail("Invalid number of runs: %s\n", argv[3]);
+        }
+        if (chdir(argv[1]) != 0) {
+                perror(argv[1]);
+                return EXIT_FAILURE;
+        }
+
+        GLFWwindow *const window = initContext();
+        eventBroker_startup(0);
+
+        // Scenes only use the game's list of scenes while loading, nothing
+        // else in it
+        static struct game game;
+        game.window = window;
+        growingArray_init(&game.scenes, sizeof(struct scene), 1);
+
+        const long rssStart = residentKiB();
+        printf("run");
+        for (enum phase p=0; p<PHASE_TOTAL; p++) {
+                printf("\t%s_ms", phaseNames[p]);
+        }
+        printf("\ttotal_ms\tread_MiB\trss_loaded_MiB\n");
+
+        uint64_t sums[PHASE_TOTAL] = {0};
+        uint64_t best = UINT64_MAX;
+        for (long i=0; i<runs; i++) {
+                struct run run;
+                runOnce(&game, argv[2], &run);
+
+                uint64_t total = 0;
+                printf("%ld", i);
+                for (enum phase p=0; p<PHASE_TOTAL; p++) {
+                        printf("\t%.3f", (double)run.micros[p] / 1000.0);
+                        sums[p] += run.micros[p];
+                        total += run.micros[p];
+                }
+                if (total < best) {
+                        best = total;
+                }
+                printf("\t%.3f\t%.2f\t%.2f\n", (double)total / 1000.0,
+                       (double)run.bytesRead / (1024.0 * 1024.0),
+                       (double)(run.rssLoaded - rssStart) / 1024.0);
+        }
+
+        uint64_t total = 0;
+        printf("mean");
+        for (enum phase p=0; p<PHASE_TOTAL; p++) {
+                printf("\t%.3f", (double)sums[p] / (double)runs / 1000.0);
+                total += sums[p];
+        }
+        printf("\t%.3f\n", (double)total / (double)runs / 1000.0);
+        printf("best total: %.3f ms\n", (double)best / 1000.0);
+        printf("peak rss: %.2f MiB (%.2f MiB before loading)\n",
+               (double)peakResidentKiB() / 1024.0, (double)rssStart / 1024.0);
+
+        growingArray_destroy(&game.scenes);
+        eventBroker_shutdown();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,349 @@
+#include <thirty/vectorMath.h>
+#include <thirty/util.h>
+
+/*
+ * Throughput of the batched vector math kernels, at every instruction set
+ * level the CPU supports, next to the same work done one matrix at a time
+ * with cglm like the engine used to. Matrices are random affine ones, the
+ * hierarchy test gives each one a random parent earlier in the array like a
+ * flattened scene. Every kernel's results are also checked against the
+ * scalar version's, which they must match exactly. Frustum culling is done on
+ * random boxes scattered in and around a camera's frustum.
+ *
+ * Usage: mathBench [COUNT] [RUNS]
+ *
+ * Reports the best of RUNS runs over COUNT matrices, in milliseconds per
+ * million matrices (or points) and millions per second. A million matrices
+ * don't fit in cache, so the default mostly measures memory bandwidth, counts
+ * of a few thousand show the kernels' own speed.
+ */
+
+#define DEFAULT_COUNT 1000000
+#define DEFAULT_RUNS 5
+
+enum kernel {
+        KERNEL_MUL,
+        KERNEL_MUL_INDIRECT,  // hierarchy propagation
+        KERNEL_INV_AFFINE,
+        KERNEL_TRANSFORM_POINTS,
+        KERNEL_COMPOSE_TRS,
+        KERNEL_CULL_FRUSTUM,
+        KERNEL_TOTAL,
+};
+
+static const char *const kernelNames[KERNEL_TOTAL] = {
+        [KERNEL_MUL] = "mul",
+        [KERNEL_MUL_INDIRECT] = "mulIndirect",
+        [KERNEL_INV_AFFINE] = "invAffine",
+        [KERNEL_TRANSFORM_POINTS] = "transformPoints",
+        [KERNEL_COMPOSE_TRS] = "composeTRS",
+        [KERNEL_CULL_FRUSTUM] = "cullFrustum",
+};
+
+static const char *const levelNames[] = {
+        [VECTORMATH_SCALAR] = "scalar",
+        [VECTORMATH_SSE4] = "sse4.1",
+        [VECTORMATH_AVX2] = "avx2",
+        [VECTORMATH_AVX512] = "avx512",
+};
+
+struct data {
+        size_t count;
+        mat4s *a;
+        mat4s *b;
+        mat4s *out;
+        mat4s *expected;  // the scalar version's results
+        const mat4s **parents;  // for the hierarchy
+        const mat4s **locals;
+        mat4s **worlds;
+        vec3s *points;
+        vec3s *pointsOut;
+        vec3s *pointsExpected;
+        struct trsArrays trs;
+        struct boundsArrays bounds;
+        vec4s planes[6];
+        bool *visible;
+        bool *visibleExpected;
+};
+
+static float randomFloat(void) {
+        return (float)rand() / (float)RAND_MAX * 2 - 1;
+}
+
+static versors randomRotation(void) {
+        return glms_quat_normalize((versors){{
+                randomFloat(), randomFloat(), randomFloat(),
+                randomFloat()}});
+}
+
+static vec3s randomVec3(void) {
+        return (vec3s){{randomFloat(), randomFloat(), randomFloat()}};
+}
+
+static vec3s randomScale(void) {
+        return (vec3s){{1 + randomFloat() / 2, 1 + randomFloat() / 2,
+                        1 + randomFloat() / 2}};
+}
+
+static void initData(struct data *const data, const size_t count) {
+        data->count = count;
+        data->a = smallocarray(count, sizeof(mat4s));
+        data->b = smallocarray(count, sizeof(mat4s));
+        data->out = smallocarray(count, sizeof(mat4s));
+        data->expected = smallocarray(count, sizeof(mat4s));
+        data->parents = smallocarray(count, sizeof(const mat4s*));
+        data->locals = smallocarray(count, sizeof(const mat4s*));
+        data->worlds = smallocarray(count, sizeof(mat4s*));
+        data->points = smallocarray(count, sizeof(vec3s));
+        data->pointsOut = smallocarray(count, sizeof(vec3s));
+        data->pointsExpected = smallocarray(count, sizeof(vec3s));
+        trsArrays_init(&data->trs, count);
+        boundsArrays_init(&data->bounds, count);
+        data->visible = smallocarray(count, sizeof(bool));
+        data->visibleExpected = smallocarray(count, sizeof(bool));
+
+        // Model matrices like the scene's, which keeps the hierarchy's
+        // products from blowing up
+        for (size_t i=0; i<count; i++) {
+                trsArrays_set(&data->trs, i, randomVec3(), randomRotation(),
+                              randomScale());
+                data->points[i] = randomVec3();
+                const vec3s extents = randomScale();
+                boundsArrays_set(&data->bounds, i,
+                                 glms_vec3_scale(randomVec3(), 4), extents,
+                                 glms_vec3_norm(extents));
+        }
+
+        // Looking down -Z from inside the boxes' cube
+        const mat4s view = glms_lookat((vec3s){{0, 0, 2}}, (vec3s){{0, 0, 0}},
+                                       (vec3s){{0, 1, 0}});
+        const mat4s projection = glms_perspective(glm_rad(45), 1, 0.1f, 3);
+        glms_frustum_planes(glms_mat4_mul(projection, view), data->planes);
+        vectorMath_setMaxLevel(VECTORMATH_SCALAR);
+        vectorMath_composeTRS(&data->trs, data->a, count);
+        for (size_t i=0; i<count; i++) {
+                data->b[i] = data->a[count-1-i];
+        }
+
+        for (size_t i=0; i<count; i++) {
+                data->parents[i] = i == 0 ? data->a :
+                        &data->out[(size_t)rand() % i];
+                data->locals[i] = &data->b[i];
+                data->worlds[i] = &data->out[i];
+        }
+}
+
+static void freeData(struct data *const data) {
+        free(data->visibleExpected);
+        free(data->visible);
+        boundsArrays_free(&data->bounds);
+        trsArrays_free(&data->trs);
+        free(data->pointsExpected);
+        free(data->pointsOut);
+        free(data->points);
+        free(data->worlds);
+        free(data->locals);
+        free(data->parents);
+        free(data->expected);
+        free(data->out);
+        free(data->b);
+        free(data->a);
+}
+
+static void runKernel(struct data *const data, const enum kernel kernel) {
+        const size_t n = data->count;
+        switch (kernel) {
+        case KERNEL_MUL:
+                vectorMath_mul(data->a, data->b, data->out, n);
+                break;
+        case KERNEL_MUL_INDIRECT:
+                vectorMath_mulIndirect(data->parents, data->locals,
+                                       data->worlds, n);
+                break;
+        case KERNEL_INV_AFFINE:
+                vectorMath_invAffine(data->a, data->out, n);
+                break;
+        case KERNEL_TRANSFORM_POINTS:
+                vectorMath_transformPoints(data->a[0], data->points,
+                                           data->pointsOut, n);
+                break;
+        case KERNEL_COMPOSE_TRS:
+                vectorMath_composeTRS(&data->trs, data->out, n);
+                break;
+        case KERNEL_CULL_FRUSTUM:
+                vectorMath_cullFrustum(data->planes, &data->bounds,
+                                       data->visible, n);
+                break;
+        case KERNEL_TOTAL:
+        default:
+                assert(false);
+                break;
+        }
+}
+
+// The same work, one cglm call per matrix
+static void runCglm(struct data *const data, const enum kernel kernel) {
+        const size_t n = data->count;
+        switch (kernel) {
+        case KERNEL_MUL:
+                for (size_t i=0; i<n; i++) {
+                        data->out[i] = glms_mat4_mul(data->a[i], data->b[i]);
+                }
+                break;
+        case KERNEL_MUL_INDIRECT:
+                for (size_t i=0; i<n; i++) {
+                        *data->worlds[i] = glms_mat4_mul(*data->parents[i],
+                                                         *data->locals[i]);
+                }
+                break;
+        case KERNEL_INV_AFFINE:
+                for (size_t i=0; i<n; i++) {
+                        data->out[i] = glms_mat4_inv(data->a[i]);
+                }
+                break;
+        case KERNEL_TRANSFORM_POINTS:
+                for (size_t i=0; i<n; i++) {
+                        data->pointsOut[i] = glms_mat4_mulv3(
+                                data->a[0], data->points[i], 1);
+                }
+                break;
+        case KERNEL_COMPOSE_TRS:
+                for (size_t i=0; i<n; i++) {
+                        const struct trsArrays *const trs = &data->trs;
+                        mat4s m = glms_translate_make((vec3s){{
+                                trs->px[i], trs->py[i], trs->pz[i]}});
+                        m = glms_quat_rotate(m, (versors){{
+                                trs->rx[i], trs->ry[i], trs->rz[i],
+                                trs->rw[i]}});
+                        data->out[i] = glms_scale(m, (vec3s){{
+                                trs->sx[i], trs->sy[i], trs->sz[i]}});
+                }
+                break;
+        case KERNEL_CULL_FRUSTUM:
+                for (size_t i=0; i<n; i++) {
+                        const struct boundsArrays *const bounds =
+                                &data->bounds;
+                        const vec3s center = {{
+                                bounds->cx[i], bounds->cy[i], bounds->cz[i]}};
+                        const vec3s extents = {{
+                                bounds->ex[i], bounds->ey[i], bounds->ez[i]}};
+                        vec3s box[2] = {
+                                glms_vec3_sub(center, extents),
+                                glms_vec3_add(center, extents),
+                        };
+                        data->visible[i] = glms_aabb_frustum(box,
+                                                             data->planes);
+                }
+                break;
+        case KERNEL_TOTAL:
+        default:
+                assert(false);
+                break;
+        }
+}
+
+static bool matchesExpected(const struct data *const data,
+                            const enum kernel kernel) {
+        if (kernel == KERNEL_TRANSFORM_POINTS) {
+                return memcmp(data->pointsOut, data->pointsExpected,
+                              data->count * sizeof(vec3s)) == 0;
+        }
+        if (kernel == KERNEL_CULL_FRUSTUM) {
+                return memcmp(data->visible, data->visibleExpected,
+                              data->count * sizeof(bool)) == 0;
+        }
+        return memcmp(data->out, data->expected,
+                      data->count * sizeof(mat4s)) == 0;
+}
+
+static void saveExpected(struct data *const data, const enum kernel kernel) {
+        if (kernel == KERNEL_TRANSFORM_POINTS) {
+                memcpy(data->pointsExpected, data->pointsOut,
+                       data->count * sizeof(vec3s));
+        } else if (kernel == KERNEL_CULL_FRUSTUM) {
+                memcpy(data->visibleExpected, data->visible,
+                       data->count * sizeof(bool));
+        } else {
+                memcpy(data->expected, data->out,
+                       data->count * sizeof(mat4s));
+        }
+}
+
+// Best of the runs, in microseconds. A negative level means cglm.
+static uint64_t timeKernel(struct data *const data, const enum kernel kernel,
+                           const int level, const long runs) {
+        uint64_t best = UINT64_MAX;
+        for (long run=0; run<runs; run++) {
+                const uint64_t start = time_micros();
+                if (level < 0) {
+                        runCglm(data, kernel);
+                } else {
+                        runKernel(data, kernel);
+                }
+                const uint64_t elapsed = time_micros() - start;
+                if (elapsed < best) {
+                        best = elapsed;
+                }
+        }
+        return best;
+}
+
+static void printResult(const char *const kernel, const char *const level,
+                        const uint64_t micros, const size_t count,
+                        const char *const check) {
+        const double millions = (double)count / 1e6;
+        const double ms = (double)micros / 1000.0;
+        printf("%s\t%s\t%.3f\t%.1f\t%s\n", kernel, level, ms / millions,
+               micros == 0 ? 0 : millions / (ms / 1000.0), check);
+}
+
+int main(const int argc, char *argv[]) {
+        if (argc > 3) {
+                fprintf(stderr, "Usage: %s [COUNT] [RUNS]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+        const long count = argc >= 2 ? strtol(argv[1], NULL, 10)
+                : DEFAULT_COUNT;
+        if (count <= 0) {
+                bail("Invalid count: %s\n", argv[1]);
+        }
+        const long runs = argc == 3 ? strtol(argv[2], NULL, 10) : DEFAULT_RUNS;
+        if (runs <= 0) {
+                bail("Invalid number of runs: %s\n", argv[2]);
+        }
+
+        srand(1);
+        struct data data;
+        initData(&data, (size_t)count);
+
+        vectorMath_setMaxLevel(VECTORMATH_AVX512);
+        const enum vectorMathLevel supported = vectorMath_level();
+
+        printf("kernel\tlevel\tms_per_million\tmillions_per_s\tcheck\n");
+        bool allMatch = true;
+        for (enum kernel kernel=0; kernel<KERNEL_TOTAL; kernel++) {
+                const uint64_t cglm = timeKernel(&data, kernel, -1, runs);
+                printResult(kernelNames[kernel], "cglm", cglm,
+                            data.count, "-");
+
+                for (int level=VECTORMATH_SCALAR; level<=(int)supported;
+                     level++) {
+                        vectorMath_setMaxLevel((enum vectorMathLevel)level);
+                        const uint64_t micros = timeKernel(
+                                &data, kernel, level, runs);
+                        const char *check = "ok";
+                        if (level == VECTORMATH_SCALAR) {
+                                saveExpected(&data, kernel);
+                                check = "-";
+                        } else if (!matchesExpected(&data, kernel)) {
+                                check = "MISMATCH";
+                                allMatch = false;
+                        }
+                        printResult(kernelNames[kernel], levelNames[level],
+                                    micros, data.count, check);
+                }
+        }
+
+        freeData(&data);
+        return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,277 @@
+#include <thirty/renderQueue.h>
+#include <thirty/object.h>
+#include <thirty/util.h>
+
+/*
+ * Cost of putting the objects of a frame in render order with the render
+ * queue next to sorting all of them with a comparison function and qsort,
+ * like the engine did before it. Objects get random keys, mostly opaque, with
+ * a material shared by about twenty of them and a geometry shared by about
+ * fifty, at random distances. The comparison function only compares the keys,
+ * so it's cheaper than the engine's was, which went through the objects'
+ * components. Every order is checked against qsort's.
+ *
+ * Usage: renderQueueBench [RUNS]
+ *
+ * Reports the best of RUNS runs at 1000, 10000 and 100000 objects, in
+ * microseconds: "sort" sorts the keys alone, "still" orders a frame where
+ * nothing moved since the last one, "few" one where one object in a hundred
+ * moved a bit, and "moved" one where every object's distance to the camera
+ * changed a bit, like when the camera moves.
+ */
+
+#define DEFAULT_RUNS 20
+#define MAX_DEPTH 1000.0f
+#define MOVE 1.0f  // most an object's distance changes between frames
+#define FEW 100  // one in this many objects moves in the few test
+
+static const size_t counts[] = {1000, 10000, 100000};
+
+enum test {
+        TEST_SORT,
+        TEST_STILL,
+        TEST_FEW,
+        TEST_MOVED,
+        TEST_TOTAL,
+};
+
+static const char *const testNames[TEST_TOTAL] = {
+        [TEST_SORT] = "sort",
+        [TEST_STILL] = "still",
+        [TEST_FEW] = "few",
+        [TEST_MOVED] = "moved",
+};
+
+// Objects of the test, with idx i+1 as 0 is the root's
+struct data {
+        size_t count;
+        unsigned *stages;
+        size_t *materials;
+        size_t *geometries;
+        float *depths;
+        uint64_t *keys;
+        size_t *moved;  // since the last frame
+        size_t nmoved;
+        struct renderItem *items;
+        struct renderItem *scratch;
+        struct renderQueue queue;
+        struct growingArray sorted;  // by qsort
+};
+
+static float randomFloat(void) {
+        return (float)rand() / (float)RAND_MAX;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void packKeys(struct data *const data) {
+        for (size_t i=0; i<data->count; i++) {
+                data->keys[i] = renderQueue_pack(
+                        data->stages[i], 0, data->materials[i],
+                        data->geometries[i], data->depths[i]);
+        }
+}
+
+__attribute__((access (write_only, 1)))
+__attribute__((nonnull))
+static void initData(struct data *const data, const size_t count) {
+        data->count = count;
+        data->stages = smallocarray(count, sizeof(unsigned));
+        data->materials = smallocarray(count, sizeof(size_t));
+        data->geometries = smallocarray(count, sizeof(size_t));
+        data->depths = smallocarray(count, sizeof(float));
+        data->keys = smallocarray(count, sizeof(uint64_t));
+        data->moved = smallocarray(count, sizeof(size_t));
+        data->nmoved = 0;
+        data->items = smallocarray(count, sizeof(struct renderItem));
+        data->scratch = smallocarray(count, sizeof(struct renderItem));
+        renderQueue_init(&data->queue);
+        growingArray_init(&data->sorted, sizeof(struct renderItem), count);
+
+        const size_t nmaterials = count / 20 + 1;
+        const size_t ngeometries = count / 50 + 1;
+        for (size_t i=0; i<count; i++) {
+                data->stages[i] = randomFloat() < 0.9f ?
+                        RENDER_OPAQUE_OBJECTS : RENDER_TRANSPARENT_OBJECTS;
+                data->materials[i] = (size_t)rand() % nmaterials;
+                data->geometries[i] = (size_t)rand() % ngeometries;
+                data->depths[i] = randomFloat() * MAX_DEPTH;
+        }
+        packKeys(data);
+        for (size_t i=0; i<count; i++) {
+                renderQueue_set(&data->queue, i + 1, data->keys[i]);
+        }
+        renderQueue_order(&data->queue);
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void freeData(struct data *const data) {
+        growingArray_destroy(&data->sorted);
+        renderQueue_free(&data->queue);
+        free(data->scratch);
+        free(data->items);
+        free(data->moved);
+        free(data->keys);
+        free(data->depths);
+        free(data->geometries);
+        free(data->materials);
+        free(data->stages);
+}
+
+// Objects move a bit towards or away from the camera, one in every the given
+// number of them
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void move(struct data *const data, const size_t every) {
+        data->nmoved = 0;
+        for (size_t i=0; i<data->count; i++) {
+                if ((size_t)rand() % every == 0) {
+                        data->moved[data->nmoved++] = i;
+                        data->depths[i] = glm_clamp(
+                                data->depths[i] +
+                                (randomFloat() * 2 - 1) * MOVE,
+                                0, MAX_DEPTH);
+                }
+        }
+        packKeys(data);
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull (1, 2)))
+static int compareKeys(const void *const a, const void *const b,
+                       void *const args) {
+        const struct renderItem *const itemA = a;
+        const struct renderItem *const itemB = b;
+        (void)args;
+        return (itemA->key > itemB->key) - (itemA->key < itemB->key);
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void queue(struct data *const data, const enum test test) {
+        if (test == TEST_SORT) {
+                for (size_t i=0; i<data->count; i++) {
+                        data->items[i].key = data->keys[i];
+                        data->items[i].object = i;
+                }
+                renderQueue_sort(data->items, data->scratch, data->count);
+                return;
+        }
+
+        // What the scene does for the objects it queued as changed
+        if (test == TEST_FEW || test == TEST_MOVED) {
+                for (size_t m=0; m<data->nmoved; m++) {
+                        const size_t i = data->moved[m];
+                        renderQueue_set(&data->queue, i + 1, data->keys[i]);
+                }
+        }
+        renderQueue_order(&data->queue);
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void qsortIt(struct data *const data) {
+        growingArray_clear(&data->sorted);
+        for (size_t i=0; i<data->count; i++) {
+                struct renderItem *const item = growingArray_append(
+                        &data->sorted);
+                item->key = data->keys[i];
+                item->object = i;
+        }
+        growingArray_sort(&data->sorted, compareKeys, NULL);
+}
+
+// Best of the runs, in microseconds, with the queue or with qsort. Objects
+// are moved before each run of the few and moved tests, out of the time
+// taken.
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static uint64_t timeTest(struct data *const data, const enum test test,
+                         const bool withQsort, const long runs) {
+        uint64_t best = UINT64_MAX;
+        for (long run=0; run<runs; run++) {
+                if (test == TEST_FEW) {
+                        move(data, FEW);
+                } else if (test == TEST_MOVED) {
+                        move(data, 1);
+                }
+                const uint64_t start = time_micros();
+                if (withQsort) {
+                        qsortIt(data);
+                } else {
+                        queue(data, test);
+                }
+                const uint64_t elapsed = time_micros() - start;
+                if (elapsed < best) {
+                        best = elapsed;
+                }
+        }
+        return best;
+}
+
+// Whether the queue's last order has the same keys as qsort's
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static bool check(const struct data *const data, const enum test test) {
+        const struct renderItem *const items = test == TEST_SORT ?
+                data->items : data->queue.items.data;
+        const struct renderItem *const expected = data->sorted.data;
+        if (test != TEST_SORT && data->queue.items.length != data->count) {
+                return false;
+        }
+        const size_t offset = test == TEST_SORT ? 0 : 1;
+        for (size_t i=0; i<data->count; i++) {
+                if (items[i].key != expected[i].key ||
+                    data->keys[items[i].object - offset] != items[i].key) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+int main(const int argc, char *argv[]) {
+        if (argc > 2) {
+                fprintf(stderr, "Usage: %s [RUNS]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+        const long runs = argc == 2 ? strtol(argv[1], NULL, 10)
+                : DEFAULT_RUNS;
+        if (runs <= 0) {
+                bail("Invalid number of runs: %s\n", argv[1]);
+        }
+
+        srand(1);
+        printf("count\ttest\tqueue_us\tqsort_us\tspeedup\tsorts\tcheck\n");
+        bool allMatch = true;
+        for (size_t c=0; c<sizeof(counts)/sizeof(*counts); c++) {
+                struct data data;
+                initData(&data, counts[c]);
+
+                for (enum test test=0; test<TEST_TOTAL; test++) {
+                        const size_t sorts = data.queue.sorts;
+                        const uint64_t queued = timeTest(&data, test, false,
+                                                         runs);
+                        const size_t queueSorts = data.queue.sorts - sorts;
+
+                        // Same keys as the queue's last run
+                        qsortIt(&data);
+                        const bool match = check(&data, test);
+                        const uint64_t qsorted = timeTest(&data, test, true,
+                                                          runs);
+
+                        allMatch = allMatch && match;
+                        printf("%zu\t%s\t%lu\t%lu\t%.1f\t%zu\t%s\n",
+                               data.count, testNames[test],
+                               (unsigned long)queued, (unsigned long)qsorted,
+                               queued == 0 ? 0 :
+                               (double)qsorted / (double)queued,
+                               queueSorts, match ? "ok" : "MISMATCH");
+                }
+
+                freeData(&data);
+        }
+
+        return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
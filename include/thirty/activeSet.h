@@ -0,0 +1,99 @@
+#ifndef ACTIVESET_H
+#define ACTIVESET_H
+
+#include <thirty/dsutils.h>
+#include <stdint.h>
+
+struct scene;  // scene.h includes this header
+struct object;
+
+/*
+ * The objects of a scene that have anything to do when the scene updates:
+ * those with an onUpdate callback or an animation collection. Updating a
+ * scene only visits these, so objects that just sit there cost nothing per
+ * frame.
+ *
+ * Like the hierarchy, the set is built from all of the scene's objects the
+ * first time it's needed, and then kept up to date as objects are given
+ * callbacks or animations through object_setOnUpdate and object_setComponent
+ * and as they're removed from the scene. It's kept in the hierarchy's order,
+ * parents before children, sorting it again before an update whenever
+ * something changed.
+ */
+
+struct activeSet {
+        struct growingArray idxs;  // active objects, ACTIVESET_NONE if removed
+        struct growingArray slots;  // position of each object in idxs, by idx
+        bool valid;
+        bool sorted;  // in hierarchy order, and without removed entries
+};
+
+/*
+ * Removed entries of idxs, and slot of the objects that aren't in the set.
+ */
+#define ACTIVESET_NONE SIZE_MAX
+
+/*
+ * Initialize an empty, invalid, set.
+ */
+void activeSet_init(struct activeSet *set)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Mark the set as out of date, so that it's built again from all of the
+ * scene's objects the next time activeSet_update is called.
+ */
+void activeSet_invalidate(struct activeSet *set)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Mark the set's order as out of date, for when objects move in the
+ * hierarchy.
+ */
+void activeSet_invalidateOrder(struct activeSet *set)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Build the scene's set if it's invalid, or sort it if it isn't in hierarchy
+ * order. Updates the hierarchy too.
+ */
+void activeSet_update(struct scene *scene)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Add the object to the set or take it out of it, depending on whether it has
+ * anything to update now. Does nothing if the set is invalid.
+ */
+void activeSet_refresh(struct activeSet *set, const struct object *object)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Take an object that's being removed from the scene out of the set. Does
+ * nothing if the set is invalid.
+ */
+void activeSet_remove(struct activeSet *set, size_t idx)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Give an object a new idx, which must not be in use, when the scene's objects
+ * are compacted. Does nothing if the set is invalid.
+ */
+void activeSet_move(struct activeSet *set, size_t from, size_t to)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Free all resources used by the set.
+ */
+void activeSet_free(struct activeSet *set)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* ACTIVESET_H */
@@ -24,13 +24,16 @@ void animation_initFromFile(struct animation *anim, FILE *f, size_t nbones)
 
 /*
  * Use animation data and a timestamp to create a posed skeleton for the right
- * animation frame and bind its bones to the given shader.
+ * animation frame and compute its skinning matrices into out, one per bone.
+ * Without an animation, or before its first frame, it's the bind pose.
  */
-void animation_bindBones(const struct animation *anim,
-                         const struct skeleton *skel,
-                         float timestamp, enum shaders shader)
+void animation_skinningMatrices(const struct animation *anim,
+                                const struct skeleton *skel,
+                                float timestamp, mat4s *out)
         __attribute__((access (read_only, 1)))
-        __attribute__((nonnull (2)));
+        __attribute__((access (read_only, 2)))
+        __attribute__((access (write_only, 4)))
+        __attribute__((nonnull (2, 4)));
 
 /*
  * Free resources used by an animation, deinitializing it.
@@ -80,12 +80,13 @@ void animationCollection_setBindPose(struct animationCollection *col)
         __attribute__((nonnull));
 
 /*
- * Bind the skeleton's bones to the given shader such that an object will be
- * drawn with the correct pose, if any.
+ * Compute the skinning matrices of the skeleton's bones into out, one per
+ * bone, such that an object will be drawn with the correct pose, if any.
  */
-void animationCollection_bindBones(const struct animationCollection *col,
-                                   enum shaders shader)
+void animationCollection_skinningMatrices(
+        const struct animationCollection *col, mat4s *out)
         __attribute__((access (read_only, 1)))
+        __attribute__((access (write_only, 2)))
         __attribute__((nonnull));
 
 /*
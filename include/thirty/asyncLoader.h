@@ -23,6 +23,10 @@ void asyncLoader_enqueueRead(const char *filepath, asyncLoader_cb callback,
 // zero otherwise.
 bool asyncLoader_await(size_t *sizePtr);
 
+// Blocking. Reaps every operation, calling their callbacks, and sleeps while
+// the next one is still being read.
+void asyncLoader_finish(void);
+
 // Returns the total size of all enqueued reads
 size_t asyncLoader_totalSize(void);
 
@@ -0,0 +1,89 @@
+#ifndef BONEPALETTE_H
+#define BONEPALETTE_H
+
+#include <thirty/dsutils.h>
+
+struct animationCollection;
+
+// After the materials' textures, see material_textureType
+#define BONEPALETTE_TEXTURE_UNIT 9
+
+/*
+ * The skinning matrices of every animated object drawn in a frame, one after
+ * the other in a single texture buffer uploaded with a single call. Each
+ * animation collection's matrices are computed once per frame, and all the
+ * objects sharing it, like the copies of a prefab, share them too. Shaders
+ * read them with:
+ *
+ *     uniform samplerBuffer bones;  // four texels per matrix, by column
+ *     uniform int boneOffset;  // of the object's first bone
+ *
+ *     mat4 bone(int i) {
+ *             int texel = (boneOffset + i) * 4;
+ *             return mat4(texelFetch(bones, texel),
+ *                         texelFetch(bones, texel + 1),
+ *                         texelFetch(bones, texel + 2),
+ *                         texelFetch(bones, texel + 3));
+ *     }
+ *
+ * So skeletons aren't limited by the size of a uniform array.
+ */
+
+struct bonePalette {
+        unsigned buffer;
+        unsigned texture;
+        size_t capacity;  // matrices the OpenGL buffer can hold
+        struct growingArray matrices;  // of the frame
+        struct growingArray offsets;  // by animation collection idx
+        size_t frame;
+};
+
+/*
+ * Initialize an empty palette, creating its buffer in OpenGL.
+ */
+void bonePalette_init(struct bonePalette *palette)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Start a new frame, without any matrices.
+ */
+void bonePalette_begin(struct bonePalette *palette)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Add the matrices of the given animation collection to the frame, unless
+ * they already are.
+ */
+void bonePalette_add(struct bonePalette *palette,
+                     const struct animationCollection *col)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Upload the frame's matrices and bind the buffer.
+ */
+void bonePalette_end(struct bonePalette *palette)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Return the offset of the first matrix of the given animation collection,
+ * added during this frame, to be set as the boneOffset uniform.
+ */
+size_t bonePalette_offset(const struct bonePalette *palette,
+                          const struct animationCollection *col)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Free all resources used by the palette, including the OpenGL ones.
+ */
+void bonePalette_free(struct bonePalette *palette)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* BONEPALETTE_H */
@@ -0,0 +1,193 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <thirty/dsutils.h>
+#include <cglm/struct.h>
+#include <stdint.h>
+
+struct scene;  // scene.h includes this header
+struct object;
+
+/*
+ * A bounding volume hierarchy over the world bounds of a scene's objects with
+ * geometry, for finding the objects in some region of space without going
+ * through all of them: those in a frustum, touching a box or a sphere, or the
+ * closest one along a ray. It's a binary tree of boxes aligned to the world
+ * axes, each one containing its two children's, with an object at each leaf.
+ *
+ * Like the active set, it's built from all of the scene's objects the first
+ * time it's needed, see scene_getBVH, with a top down build that splits boxes
+ * where the surface area heuristic says that queries will be cheaper. It's
+ * then kept up to date as objects move, which refits their leaves' boxes and
+ * those above, and as they're created and removed, which inserts leaves next
+ * to the ones that grow the least and takes them out. Since that makes the
+ * tree worse over time, it's built again from scratch once the heuristic's
+ * cost grows too much from what it was after the last build.
+ *
+ * An object's bounds are its geometry's, see geometry_worldBounds, even if
+ * that isn't loaded. A geometry that was never loaded has no size, so the
+ * object is a point at the geometry's origin until it's loaded.
+ */
+
+struct bvhNode {
+        vec3s min;
+        vec3s max;
+        size_t parent;  // BVH_NONE for the root, next free node if unused
+        size_t left;  // BVH_NONE for leaves
+        size_t right;
+        size_t object;  // idx of the leaves' object
+};
+
+struct bvh {
+        struct growingArray nodes;
+        struct growingArray leaves;  // node of each object, by idx
+        size_t root;
+        size_t freeNode;  // first unused node
+        size_t count;  // objects
+        double area;  // sum of the internal nodes' surface area
+        double builtCost;  // area over the root's, after the last build
+        bool valid;
+};
+
+/*
+ * No node, like the root's parent, and the leaf of objects that aren't in the
+ * tree.
+ */
+#define BVH_NONE SIZE_MAX
+
+/*
+ * Initialize an empty, invalid, tree.
+ */
+void bvh_init(struct bvh *bvh)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Mark the tree as out of date, so that it's built again from all of the
+ * scene's objects the next time bvh_update is called.
+ */
+void bvh_invalidate(struct bvh *bvh)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Build the scene's tree if it's invalid, or build it again if it got too
+ * much worse since the last time. The objects' world matrices must be up to
+ * date.
+ */
+void bvh_update(struct scene *scene)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Build a valid tree from scratch with the given objects' bounds, replacing
+ * whatever it had.
+ */
+void bvh_build(struct bvh *bvh, const size_t *idxs, const vec3s *mins,
+               const vec3s *maxs, size_t n)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 2, 5)))
+        __attribute__((access (read_only, 3, 5)))
+        __attribute__((access (read_only, 4, 5)))
+        __attribute__((nonnull));
+
+/*
+ * Build the tree again from the bounds it has now.
+ */
+void bvh_rebuild(struct bvh *bvh)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Set the bounds of an object, inserting it if it isn't in the tree yet or
+ * refitting its leaf if it is. The tree must be valid.
+ */
+void bvh_set(struct bvh *bvh, size_t idx, vec3s min, vec3s max)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Update the object's bounds from its geometry and world matrix, inserting
+ * it, refitting it or taking it out of the tree depending on whether it has a
+ * geometry now. Does nothing if the tree is invalid.
+ */
+void bvh_refresh(struct bvh *bvh, const struct object *object)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Whether the object is in the tree.
+ */
+bool bvh_contains(const struct bvh *bvh, size_t idx)
+        __attribute__((access (read_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Take an object out of the tree, if it's there. Does nothing if the tree is
+ * invalid.
+ */
+void bvh_remove(struct bvh *bvh, size_t idx)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Give an object a new idx, which must not be in use, when the scene's objects
+ * are compacted. Does nothing if the tree is invalid.
+ */
+void bvh_move(struct bvh *bvh, size_t from, size_t to)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Append to results (of size_t) the idxs of the objects whose box may be
+ * inside of the frustum with the given planes, as given by
+ * glms_frustum_planes.
+ */
+void bvh_queryFrustum(const struct bvh *bvh, const vec4s planes[6],
+                      struct growingArray *results)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((access (read_write, 3)))
+        __attribute__((nonnull));
+
+/*
+ * Append to results (of size_t) the idxs of the objects whose box touches the
+ * given one.
+ */
+void bvh_queryBox(const struct bvh *bvh, vec3s min, vec3s max,
+                  struct growingArray *results)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_write, 4)))
+        __attribute__((nonnull));
+
+/*
+ * Append to results (of size_t) the idxs of the objects whose box touches the
+ * given sphere.
+ */
+void bvh_querySphere(const struct bvh *bvh, vec3s center, float radius,
+                     struct growingArray *results)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_write, 4)))
+        __attribute__((nonnull));
+
+/*
+ * Return the idx of the object whose box the given ray hits first, no farther
+ * than maxDistance times the direction's length from the origin, and store
+ * in distance how many times the direction's length it is. Rays starting
+ * inside of a box hit it at distance 0. Return 0 when nothing is hit.
+ */
+size_t bvh_queryRay(const struct bvh *bvh, vec3s origin, vec3s direction,
+                    float maxDistance, float *distance)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (write_only, 5)))
+        __attribute__((nonnull));
+
+/*
+ * Free all resources used by the tree.
+ */
+void bvh_free(struct bvh *bvh)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* BVH_H */
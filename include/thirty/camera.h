@@ -38,7 +38,7 @@ size_t camera_initFromFile(struct camera *cam, FILE *f, enum componentType type,
         __attribute__((nonnull));
 
 /*
- * Obtain a camera's view matrix.
+ * Obtain a camera's view matrix from its world matrix, which must be affine.
  */
 mat4s camera_viewMatrix(const struct camera *cam, mat4s model)
         __attribute__((access (read_only, 1)))
@@ -0,0 +1,64 @@
+#ifndef CAMERABUFFER_H
+#define CAMERABUFFER_H
+
+#include <cglm/struct.h>
+
+/*
+ * The main camera's matrices for a frame, computed once and kept in a uniform
+ * buffer bound to SHADER_BLOCK_CAMERA, shared by every program that declares
+ * it:
+ *
+ *     layout (std140) uniform Camera {
+ *             mat4 view;
+ *             mat4 projection;
+ *             mat4 viewProjection;
+ *             mat4 invView;
+ *             mat4 skyboxViewProjection;  // view without its translation
+ *             vec4 cameraPosition;  // world space
+ *     };
+ *
+ * Draws then only set their model matrix. The buffer is only uploaded again
+ * when the camera moved or its projection changed.
+ */
+
+// std140 layout of the Camera block
+struct cameraBufferData {
+        mat4s view;
+        mat4s projection;
+        mat4s viewProjection;
+        mat4s invView;
+        mat4s skyboxViewProjection;
+        vec4s cameraPosition;
+};
+
+struct cameraBuffer {
+        unsigned ubo;
+        struct cameraBufferData data;  // as it is in the buffer
+        bool uploaded;
+};
+
+/*
+ * Initialize the buffer, creating it in OpenGL. It's uploaded on the first
+ * update.
+ */
+void cameraBuffer_init(struct cameraBuffer *buffer)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Set the frame's camera from its world matrix, which must be affine, and its
+ * projection matrix, upload it if it changed and bind the buffer.
+ */
+void cameraBuffer_update(struct cameraBuffer *buffer, mat4s cameraModel,
+                         mat4s projection)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Free all resources used by the buffer, including the OpenGL one.
+ */
+void cameraBuffer_free(struct cameraBuffer *buffer)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* CAMERABUFFER_H */
@@ -0,0 +1,89 @@
+#ifndef COMPACTION_H
+#define COMPACTION_H
+
+#include <thirty/dsutils.h>
+
+struct scene;  // scene.h includes this header
+
+/*
+ * Compaction of a scene's storage, see scene_compact. Removed objects leave
+ * holes in the scene's array that are only filled again by new objects, and
+ * components are never removed at all, so a scene that changes a lot ends up
+ * with much of its memory unused. Compacting it moves the objects and
+ * components that are alive down into dense storage, keeping their order,
+ * fixes up everything that refers to them by idx, frees the components no
+ * object uses and shrinks the arrays to fit.
+ *
+ * It's done in steps of bounded time, and the scene is kept consistent after
+ * each one so that it can be updated and drawn in between:
+ *
+ * - Objects are moved one by one into the first hole, fixing up their links,
+ *   their components' owner, their names, the hierarchy, the active set and
+ *   the streaming cells as they go.
+ * - The objects' and prefabs' references to components are gathered.
+ * - Components are moved one by one, fixing up the references to each, and
+ *   the ones without references are freed.
+ *
+ * Creating or removing objects, or giving them components, in between steps
+ * sends the compaction back to the objects, which only has to go over what
+ * changed.
+ */
+
+enum compactionPhase {
+        COMPACTION_OBJECTS,
+        COMPACTION_MARK,
+        COMPACTION_COMPONENTS,
+};
+
+struct compaction {
+        enum compactionPhase phase;
+        size_t nextObject;  // next object to gather references from
+        size_t generation;  // changes each time components are moved or freed
+
+        // References to each of the components that existed when they were
+        // gathered, as lists in 'refs'. Newer components are kept.
+        struct growingArray firstRefs;  // by component idx, ref plus one
+        struct growingArray refs;
+        struct vgaCompaction components;
+};
+
+/*
+ * Initialize the compaction of a scene, it starts with the objects.
+ */
+void compaction_init(struct compaction *compaction)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Go back to the objects, because the scene's objects or their components
+ * changed.
+ */
+void compaction_restart(struct compaction *compaction)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Return whether the compaction is in the middle of moving components, which
+ * must not be read by the async loader meanwhile.
+ */
+bool compaction_movingComponents(const struct compaction *compaction)
+        __attribute__((access (read_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Take a step in compacting the scene, see scene_compact.
+ */
+bool compaction_step(struct scene *scene, unsigned long micros,
+                     size_t *reclaimed)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (write_only, 3)))
+        __attribute__((nonnull));
+
+/*
+ * Free all resources used by the compaction.
+ */
+void compaction_free(struct compaction *compaction)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* COMPACTION_H */
@@ -2,6 +2,7 @@
 #define COMPONENT_H
 
 #include <stddef.h>
+#include <stdbool.h>
 
 /*
  * Defines a component. Components are attached to objects through a
@@ -39,6 +40,8 @@ struct component {
         char *name;
         size_t object;
         struct game *game;
+        bool borrowed;  // name and other heap data owned by someone else
+                        // (e.g. a baked scene image), not free'd with it
 } __attribute__((aligned (COMPONENT_STRUCT_ALIGNMENT)));
 
 /*
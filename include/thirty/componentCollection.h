@@ -29,6 +29,11 @@ struct componentCollection {
  */
 void componentCollection_initCollection(struct varSizeGrowingArray *components);
 
+/*
+ * Return the size of the struct of a component of the given type.
+ */
+size_t componentCollection_sizeOf(enum componentType type);
+
 /*
  * Allocate memory for a component of the given type and return it. Of course,
  * different types will have different sizes.
@@ -54,6 +59,22 @@ size_t componentCollection_idxByName(struct varSizeGrowingArray *components,
  */
 void *componentCollection_compByIdx(struct varSizeGrowingArray *components, size_t idx);
 
+/*
+ * Return the component in a slot of a collection, which holds its idx plus
+ * one, or NULL if the slot is empty. Unlike componentCollection_get, it's
+ * inlined and doesn't look at the type at runtime, see the object_get*
+ * accessors in object.h.
+ */
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static inline void *componentCollection_getSlot(
+        const struct varSizeGrowingArray *const components, const size_t slot) {
+        if (slot == 0) {
+                return NULL;
+        }
+        return varSizeGrowingArray_at(components, slot - 1);
+}
+
 /*
  * Initialize a component collection.
  */
@@ -99,12 +120,24 @@ bool componentCollection_hasComponent(
         __attribute__((nonnull));
 
 /*
- * Update all components in the collection. To be called once per frame.
+ * Update all components in the collection for the given object. To be called
+ * once per frame. Components shared between objects are only updated for the
+ * one they were last given to, so that they don't advance once per object,
+ * see scene_handOffAnimation.
  */
 void componentCollection_update(
         struct varSizeGrowingArray *components,
         struct componentCollection *collection,
-        float timeDelta)
+        size_t object, float timeDelta)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Free a component's resources and leave it as a removed component, without
+ * type or name, which lookups by name skip. Used when compacting a scene, no
+ * object may be using it.
+ */
+void componentCollection_remove(struct component *component)
         __attribute__((access (read_write, 1)))
         __attribute__((nonnull));
 
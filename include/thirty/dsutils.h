@@ -17,6 +17,24 @@ typedef bool (*foreach_sized_cb)(void *, size_t, void *);
 typedef int (*cmp_cb)(const void *, const void *, void *);
 
 
+/*
+ * Callbacks for compacting arrays a part at a time. They receive an element,
+ * its current position and the one it's moved to. For growingArray_compact it
+ * is called once the element has been moved and returns whether to go on. For
+ * varSizeGrowingArray_compact it's called with the element still in place,
+ * also receiving its size, and decides what to do with it.
+ */
+typedef bool (*moved_cb)(void *, size_t, size_t, void *);
+
+enum compactAction {
+        COMPACT_KEEP,  // move it down, to the given position
+        COMPACT_DROP,  // the callback already freed anything it owned
+        COMPACT_STOP,  // leave it and the rest for the next call
+};
+typedef enum compactAction (*compact_cb)(void *, size_t, size_t, size_t,
+                                         void *);
+
+
 struct gaDeletedNodes {
         struct gaDeletedNodes *next;
         void *ptr;
@@ -39,6 +57,16 @@ void growingArray_init(struct growingArray *ga,
         __attribute__((access (write_only, 1)))
         __attribute__((nonnull));
 
+/*
+ * Initialize a growing array holding a copy of the given count elements of
+ * itemSize bytes each. The buffer can be freed after this call.
+ */
+void growingArray_initFromBuffer(struct growingArray *ga, size_t itemSize,
+                                 const void *buffer, size_t count)
+        __attribute__((access (write_only, 1)))
+        __attribute__((access (read_only, 3)))
+        __attribute__((nonnull (1)));
+
 /*
  * Allocate space (if needed) for a new element for the array, then return a
  * pointer to the newly allocated element. The calling code can then write
@@ -53,6 +81,14 @@ void *growingArray_append(struct growingArray *ga)
         __attribute__((nonnull))
         __attribute__((returns_nonnull));
 
+/*
+ * Make room for count more elements at once, so that appending them doesn't
+ * reallocate the array and pointers to its elements stay valid meanwhile.
+ */
+void growingArray_reserve(struct growingArray *ga, size_t count)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
 /*
  * Remove an element from the array. This does not alter the position of other
  * elements. The removed element's position will be reused in future calls to
@@ -134,6 +170,24 @@ void growingArray_sort(struct growingArray *ga, cmp_cb cmp, void *args)
         __attribute__((access (read_write, 3)))
         __attribute__((nonnull (1,2)));
 
+/*
+ * Take a step in compacting the array: move the elements after its first hole
+ * down into the holes before them, keeping them in order, calling moved for
+ * each one. Stops early if moved returns false, the array is left with its
+ * holes all after the elements moved so far and a later call goes on from
+ * there. Once no elements are left after a hole, the holes at the end are
+ * dropped, the array's memory is shrunk to fit and true is returned.
+ * Reclaimed is set to the bytes given back by this call.
+ *
+ * Elements can be appended and removed between calls, but moving elements
+ * invalidates pointers to them.
+ */
+bool growingArray_compact(struct growingArray *ga, moved_cb moved, void *args,
+                          size_t *reclaimed)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (write_only, 4)))
+        __attribute__((nonnull (1,2,4)));
+
 /*
  * Search array for an element that compares equal to the given key. This is
  * the same cmp as growingArray_sort. The key will be the first parameter in
@@ -209,6 +263,20 @@ void varSizeGrowingArray_init(struct varSizeGrowingArray *vga,
         __attribute__((access (write_only, 1)))
         __attribute__((nonnull));
 
+/*
+ * Initialize with a copy of the raw memory of another varSizeGrowingArray with
+ * the same alignment: size bytes of data and the count end offsets of each
+ * element. The buffers can be freed after this call.
+ */
+void varSizeGrowingArray_initFromBuffer(struct varSizeGrowingArray *vga,
+                                        size_t alignment,
+                                        const void *data, size_t size,
+                                        const size_t *offsets, size_t count)
+        __attribute__((access (write_only, 1)))
+        __attribute__((access (read_only, 3, 4)))
+        __attribute__((access (read_only, 5, 6)))
+        __attribute__((nonnull (1)));
+
 /*
  * Similar to growingArray, but the size of the element to append must be
  * given.
@@ -219,6 +287,16 @@ void *varSizeGrowingArray_append(struct varSizeGrowingArray *vga,
         __attribute__((nonnull))
         __attribute__((returns_nonnull));
 
+/*
+ * Make room for count more elements of the given size at once, so that
+ * appending them doesn't reallocate the array and pointers to its elements
+ * stay valid meanwhile.
+ */
+void varSizeGrowingArray_reserve(struct varSizeGrowingArray *vga,
+                                 size_t count, size_t size)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
 /*
  * Get nth element. If s is not NULL, it will hold its size. Return a pointer
  * to it.
@@ -229,6 +307,21 @@ void *varSizeGrowingArray_get(const struct varSizeGrowingArray *vga,
         __attribute__((nonnull (1)))
         __attribute__((returns_nonnull));
 
+/*
+ * Get nth element, which must exist, like varSizeGrowingArray_get but inlined
+ * into the caller: just two loads, for hot paths.
+ */
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+__attribute__((returns_nonnull))
+static inline void *varSizeGrowingArray_at(
+        const struct varSizeGrowingArray *const vga, const size_t n) {
+        // Offsets are where each element ends
+        const size_t *const offsets = vga->offsets.data;
+        const size_t offset = n == 0 ? 0 : offsets[n-1];
+        return (char*)vga->data + offset + sizeof(size_t) + vga->padding;
+}
+
 /*
  * Similar to growingArray's foreach, but the callback also receives the size
  * of the current element.
@@ -238,6 +331,44 @@ void varSizeGrowingArray_foreach(const struct varSizeGrowingArray *vga,
         __attribute__((access (read_only, 1)))
         __attribute__((nonnull (1)));
 
+/*
+ * Progress of a varSizeGrowingArray being compacted.
+ */
+struct vgaCompaction {
+        size_t next;  // first element not looked at yet
+        size_t kept;  // elements kept so far, where the next one goes
+        size_t end;  // bytes used by them
+};
+
+/*
+ * Start compacting an array from its first element.
+ */
+void varSizeGrowingArray_compactInit(struct vgaCompaction *compaction)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Take a step in compacting the array: go through its elements in order,
+ * calling cb with each one, and either move it down into the space left by
+ * the dropped ones before it or drop it, as cb says. Once cb says to stop the
+ * array is left usable: the dropped elements that haven't been moved over
+ * yet still take up positions, holding a copy of the last one dropped, and a
+ * later call goes on from there. After the last element the dropped ones are
+ * gone, the array's memory is shrunk to fit, the compaction is reset and
+ * true is returned. Reclaimed is set to the bytes given back by this call.
+ *
+ * Elements can be appended between calls, they're looked at too. Moving
+ * elements changes their positions and invalidates pointers to them.
+ */
+bool varSizeGrowingArray_compact(struct varSizeGrowingArray *vga,
+                                 struct vgaCompaction *compaction,
+                                 compact_cb cb, void *args,
+                                 size_t *reclaimed)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_write, 2)))
+        __attribute__((access (write_only, 5)))
+        __attribute__((nonnull (1,2,3,5)));
+
 /*
  * Deallocate everything.
  */
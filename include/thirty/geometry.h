@@ -4,6 +4,7 @@
 #include <thirty/component.h>
 #include <thirty/vertex.h>
 #include <thirty/dsutils.h>
+#include <thirty/instanceBuffer.h>
 #include <glad/glad.h>
 
 /*
@@ -11,11 +12,23 @@
  * geometry component will be drawn.
  */
 
+/*
+ * Bounds of a mesh in model space, computed from its vertices when they're
+ * uploaded: a box and a sphere around the box's center.
+ */
+struct geometryBounds {
+        vec3s center;
+        vec3s extents;  // half the size of the box
+        float radius;
+};
+
 struct geometry {
         struct component base;
         GLuint vao, vbo, ibo;
         int nindices;
         bool loaded;
+        char *path;  // .bgg file the data is read from, NULL if none
+        struct geometryBounds bounds;  // of the last data uploaded
 };
 
 /*
@@ -34,6 +47,34 @@ void geometry_initFromArray(struct geometry *geometry,
         __attribute__((access (read_only, 5, 6)))
         __attribute__((nonnull));
 
+/*
+ * Upload new vertex and index data for an already initialized geometry,
+ * replacing whatever it had. The arrays can be freed afterwards.
+ */
+void geometry_upload(struct geometry *geometry,
+                     const struct vertex *vertices,
+                     size_t nvertices,
+                     const unsigned *indices,
+                     size_t nindices)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 2, 3)))
+        __attribute__((access (read_only, 4, 5)))
+        __attribute__((nonnull));
+
+/*
+ * Read back a loaded geometry's vertex and index data from OpenGL. The
+ * returned arrays are dynamically allocated and must be freed by the caller.
+ */
+void geometry_readback(const struct geometry *geometry,
+                       struct vertex **vertices, size_t *nvertices,
+                       unsigned **indices, size_t *nindices)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (write_only, 2)))
+        __attribute__((access (write_only, 3)))
+        __attribute__((access (write_only, 4)))
+        __attribute__((access (write_only, 5)))
+        __attribute__((nonnull));
+
 /*
  * Initializes a geometry to be a 1x1x1 cube. 
  */
@@ -69,7 +110,9 @@ void geometry_initPlane(struct geometry *geo, const char *name)
         __attribute__((nonnull));
 
 /*
- * Initialize a geometry from a BOGLE file positioned at the correct offset.
+ * Initialize a geometry from a BOGLE file positioned at the correct offset. It
+ * only remembers which .bgg file holds its data, use geometry_loadFile to
+ * actually load it.
  */
 size_t geometry_initFromFile(struct geometry *geometry, FILE *f, enum componentType type,
                              struct varSizeGrowingArray *components)
@@ -78,6 +121,29 @@ size_t geometry_initFromFile(struct geometry *geometry, FILE *f, enum componentT
         __attribute__((access (read_write, 4)))
         __attribute__((nonnull));
 
+/*
+ * Enqueue a read of the geometry's .bgg file in the async loader, which must
+ * be initialized. The data is uploaded when the read is reaped, so this can
+ * also be used to load a geometry again after geometry_unload.
+ */
+void geometry_loadFile(const struct geometry *geometry,
+                       struct varSizeGrowingArray *components)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_write, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Transform the bounds of a geometry by the given model matrix, giving a box
+ * aligned to the world axes and a sphere, both around the same center, that
+ * contain the transformed mesh. Unloading a geometry keeps its bounds, and
+ * one that was never loaded has empty ones at its origin.
+ */
+void geometry_worldBounds(const struct geometry *geometry, mat4s model,
+                          struct geometryBounds *bounds)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (write_only, 3)))
+        __attribute__((nonnull));
+
 /*
  * Draw the geometry using OpenGL, using whatever shader is set.
  */
@@ -85,6 +151,26 @@ void geometry_draw(const struct geometry *geometry)
         __attribute__((access (read_only, 1)))
         __attribute__((nonnull));
 
+/*
+ * Draw count instances of the geometry using OpenGL, using whatever shader is
+ * set, each one with its model matrix from the instance buffer, starting with
+ * the one at first.
+ */
+void geometry_drawInstanced(const struct geometry *geometry,
+                            const struct instanceBuffer *instances,
+                            size_t first, size_t count)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Release the geometry's OpenGL buffers, if any. It stays initialized and
+ * won't be drawn until data is uploaded again.
+ */
+void geometry_unload(struct geometry *geometry)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
 /*
  * Free all resources used by the geometry, deinitializing it.
  */
@@ -0,0 +1,110 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <thirty/dsutils.h>
+#include <stdint.h>
+
+struct scene;  // scene.h includes this header
+
+/*
+ * A flattened copy of a scene's object tree, for passes that need to visit
+ * every object with parents before children (updates, transform propagation,
+ * gathering objects for rendering) without chasing the links between
+ * objects. Objects are laid out in an array in depth first pre-order,
+ * root first, along with the position of each one's parent in that same
+ * array. Iterating it from the start thus always reaches a parent before any
+ * of its children.
+ *
+ * Each object's subtree is a contiguous range of that array, starting at its
+ * position and ending at its entry in ends, so whatever needs to reach an
+ * object's descendants only has to go through that range.
+ *
+ * The order is built from the object tree the first time it's needed, which
+ * takes time in proportion to the number of objects. After that, it's kept
+ * up to date by the scene functions as objects are created, removed or
+ * reparented: the subtree involved is spliced into its new place, and only the
+ * objects it's moved past get their entries patched, along with the ends of
+ * the ancestors on both sides. Creating objects under the last subtree, like
+ * under the root or when instantiating a prefab, and removing the last object
+ * don't move any others. Changing the objects' links directly requires
+ * calling hierarchy_invalidate, so that the order is built again.
+ */
+
+struct hierarchy {
+        struct growingArray idxs;  // object idx at each position
+        struct growingArray parents;  // position of each one's parent
+        struct growingArray ends;  // position after each one's subtree
+        struct growingArray positions;  // position of each object, by idx
+        bool valid;
+};
+
+/*
+ * Root is always at position 0, and is its own parent. Removed objects' idxs
+ * have this position.
+ */
+#define HIERARCHY_NONE SIZE_MAX
+
+/*
+ * Initialize an empty, invalid, hierarchy.
+ */
+void hierarchy_init(struct hierarchy *hierarchy)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Mark the hierarchy as out of date, so that it's built again from scratch the
+ * next time hierarchy_update is called.
+ */
+void hierarchy_invalidate(struct hierarchy *hierarchy)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Build the hierarchy from the scene's object tree if it's invalid.
+ */
+void hierarchy_update(struct scene *scene)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Add a new childless object as the last child of the given parent. Does
+ * nothing if the hierarchy is invalid, it will be added when it's built.
+ */
+void hierarchy_add(struct hierarchy *hierarchy, size_t idx, size_t parent)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Remove an object, its children are moved to its parent. Does nothing if the
+ * hierarchy is invalid.
+ */
+void hierarchy_remove(struct hierarchy *hierarchy, size_t idx)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Move an object, along with all of its descendants, to the end of a new
+ * parent's subtree. The parent must not be one of them. Does nothing if the
+ * hierarchy is invalid.
+ */
+void hierarchy_reparent(struct hierarchy *hierarchy, size_t idx, size_t parent)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Give an object a new idx, which must not be in use, when the scene's objects
+ * are compacted. Its position doesn't change. Does nothing if the hierarchy is
+ * invalid.
+ */
+void hierarchy_move(struct hierarchy *hierarchy, size_t from, size_t to)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Free all resources used by the hierarchy.
+ */
+void hierarchy_free(struct hierarchy *hierarchy)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* HIERARCHY_H */
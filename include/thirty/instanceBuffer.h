@@ -0,0 +1,69 @@
+#ifndef INSTANCEBUFFER_H
+#define INSTANCEBUFFER_H
+
+#include <thirty/dsutils.h>
+#include <cglm/struct.h>
+
+/*
+ * The model matrices of every object drawn with instancing in a frame, one
+ * after the other in a single vertex buffer uploaded with a single call. Each
+ * run of objects sharing a geometry and a material takes a range of it, and
+ * geometry_drawInstanced feeds that range to the vertex shader one matrix per
+ * instance, in four attributes from INSTANCEBUFFER_MODEL_ATTRIB on:
+ *
+ *     uniform mat4 model;
+ *     uniform bool instanced;
+ *     layout (location = 7) in mat4 instanceModel;
+ *
+ *     mat4 objectModel() {
+ *             return instanced ? instanceModel : model;
+ *     }
+ *
+ * Objects drawn one at a time keep using the model uniform.
+ */
+
+// After the vertex's attributes, see geometry_upload
+#define INSTANCEBUFFER_MODEL_ATTRIB 7
+
+struct instanceBuffer {
+        unsigned buffer;
+        size_t capacity;  // matrices the OpenGL buffer can hold
+        struct growingArray models;  // of the frame
+};
+
+/*
+ * Initialize an empty buffer, creating it in OpenGL.
+ */
+void instanceBuffer_init(struct instanceBuffer *instances)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Start a new frame, without any matrices.
+ */
+void instanceBuffer_begin(struct instanceBuffer *instances)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Add a model matrix to the frame, returning its position in the buffer.
+ */
+size_t instanceBuffer_add(struct instanceBuffer *instances, mat4s model)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Upload the frame's matrices.
+ */
+void instanceBuffer_end(struct instanceBuffer *instances)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Free all resources used by the buffer, including the OpenGL one.
+ */
+void instanceBuffer_free(struct instanceBuffer *instances)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* INSTANCEBUFFER_H */
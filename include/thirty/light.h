@@ -46,26 +46,6 @@ size_t light_initFromFile(struct light *light, FILE *f, enum componentType type,
         __attribute__((access (read_write, 4)))
         __attribute__((nonnull));
 
-/*
- * Update shader with light info. Which is the index of the light in the shader.
- */
-void light_updateShader(const struct light *light,
-                        size_t which, mat4s view, mat4s model,
-                        enum shaders shader)
-        __attribute__((access (read_only, 1)))
-        __attribute__((nonnull));
-
-/*
- * Set all lights in the shader starting with the given which as disabled.
- */
-void light_updateShaderDisabled(size_t which, enum shaders shader)
-        __attribute__((nonnull));
-
-/*
- * Update shader's global ambient lighting
- */
-void light_updateGlobalAmbient(enum shaders shader, vec4s globalAmbientLight);
-
 /*
  * Free all resources used by the light, deinitializing it.
  */
@@ -0,0 +1,112 @@
+#ifndef LIGHTBUFFER_H
+#define LIGHTBUFFER_H
+
+#include <thirty/light.h>
+#include <cglm/struct.h>
+
+/*
+ * The lights of a frame, packed into a uniform buffer bound to
+ * SHADER_BLOCK_LIGHTS and shared by every program that declares it:
+ *
+ *     struct Light {
+ *             vec4 color;
+ *             vec4 position_ws;
+ *             vec4 position_vs;
+ *             vec4 direction_ws;
+ *             vec4 direction_vs;
+ *             float attenuation_constant;
+ *             float attenuation_linear;
+ *             float attenuation_quadratic;
+ *             float intensity;
+ *             float angle;
+ *             uint type;
+ *             bool enabled;
+ *     };
+ *
+ *     layout (std140) uniform Lights {
+ *             vec4 globalAmbient;
+ *             uint nlights;
+ *             Light lights[NUM_LIGHTS];
+ *     };
+ *
+ * Lights are packed in the order they're given every frame, and a light is
+ * only packed again when its parameters, its model matrix or the view matrix
+ * changed since the last frame. Everything that changed is uploaded with a
+ * single buffer update.
+ */
+
+// std140 layout of struct Light
+struct lightBufferLight {
+        vec4s color;
+        vec4s position_ws;
+        vec4s position_vs;
+        vec4s direction_ws;
+        vec4s direction_vs;
+        float attenuation_constant;
+        float attenuation_linear;
+        float attenuation_quadratic;
+        float intensity;
+        float angle;
+        uint32_t type;
+        uint32_t enabled;
+        uint32_t padding;
+};
+
+// std140 layout of the Lights block
+struct lightBufferData {
+        vec4s globalAmbient;
+        uint32_t nlights;
+        uint32_t padding[3];
+        struct lightBufferLight lights[NUM_LIGHTS];
+};
+
+struct lightBuffer {
+        unsigned ubo;
+        struct lightBufferData data;  // as it is in the buffer
+        mat4s models[NUM_LIGHTS];  // the packed lights'
+        mat4s view;  // the packed lights'
+        bool stale[NUM_LIGHTS];  // packed for another view
+        size_t dirtyStart;  // bytes of data to upload
+        size_t dirtyEnd;
+};
+
+/*
+ * Initialize the buffer with no lights, creating it in OpenGL.
+ */
+void lightBuffer_init(struct lightBuffer *buffer)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Start the lights of a new frame, seen from the given view matrix.
+ */
+void lightBuffer_begin(struct lightBuffer *buffer, mat4s view,
+                       vec4s globalAmbient)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Set the light in the given slot, with the given model matrix.
+ */
+void lightBuffer_set(struct lightBuffer *buffer, size_t which,
+                     const struct light *light, mat4s model)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 3)))
+        __attribute__((nonnull));
+
+/*
+ * Finish the frame's lights, the ones in slots from nlights on are disabled,
+ * upload what changed and bind the buffer.
+ */
+void lightBuffer_end(struct lightBuffer *buffer, size_t nlights)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Free all resources used by the buffer, including the OpenGL one.
+ */
+void lightBuffer_free(struct lightBuffer *buffer)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* LIGHTBUFFER_H */
@@ -103,6 +103,15 @@ void material_unsetTexture(struct material *material,
         __attribute__((access (write_only, 1)))
         __attribute__((nonnull));
 
+/*
+ * Return the material's texture for the given slot, or NULL if the material
+ * type doesn't support it.
+ */
+struct texture *material_getTexture(struct material *material,
+                                    enum material_textureType tex)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
 /*
  * Return whether the material is considered "transparent", meaning that it
  * should be rendered in the transparent pass.
@@ -112,7 +121,13 @@ bool material_isTransparent(const struct material *material)
         __attribute__((nonnull));
 
 /*
- * Update the associated shader's parameters with the material.
+ * Return how many times material_uber_update found that a material went from
+ * opaque to transparent or back, which changes the objects' render order.
+ */
+size_t material_stageChanges(void);
+
+/*
+ * Bind the material's parameters for the associated shader.
  */
 void material_updateShader(const struct material *material)
         __attribute__((access (read_only, 1)))
@@ -163,6 +178,8 @@ struct material_uber {
         float specularScale;
         float alphaThreshold;
         bool alphaBlendingMode;
+
+        size_t block;  // slot of its parameters, see materialBuffer.h
 };
 
 /*
@@ -185,6 +202,23 @@ void material_uber_initFromFile(struct material_uber *material, FILE *f,
         __attribute__((access (read_write, 2)))
         __attribute__((nonnull));
 
+/*
+ * Give the material its own slot in the material buffer with its current
+ * parameters. Already called by the init functions, the slot is freed by
+ * material_free.
+ */
+void material_uber_initBlock(struct material_uber *material)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Upload the material's parameters again, after changing them. Textures are
+ * picked up on their own when they finish loading.
+ */
+void material_uber_update(const struct material_uber *material)
+        __attribute__((access (read_only, 1)))
+        __attribute__((nonnull));
+
 
 /*
  * This material is used for the skybox. As such it's very simple and only has
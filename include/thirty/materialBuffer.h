@@ -0,0 +1,99 @@
+#ifndef MATERIALBUFFER_H
+#define MATERIALBUFFER_H
+
+#include <cglm/struct.h>
+
+/*
+ * The parameters of every uber material, each in its own slot of a single
+ * uniform buffer. Slots are filled when materials are loaded or edited, and
+ * using a material is only a matter of binding its slot's range to
+ * SHADER_BLOCK_MATERIAL, for every program that declares it:
+ *
+ *     layout (std140) uniform Material {
+ *             vec4 ambientColor;
+ *             vec4 emissiveColor;
+ *             vec4 diffuseColor;
+ *             vec4 specularColor;
+ *             float opacity;
+ *             float specularPower;
+ *             float reflectance;
+ *             float refraction;
+ *             float indexOfRefraction;
+ *             float bumpIntensity;
+ *             float specularScale;
+ *             float alphaThreshold;
+ *             bool hasAmbientTexture;
+ *             bool hasEmissiveTexture;
+ *             bool hasDiffuseTexture;
+ *             bool hasSpecularTexture;
+ *             bool hasNormalTexture;
+ *             bool hasBumpTexture;
+ *             bool hasOpacityTexture;
+ *             bool alphaBlendingMode;
+ *     } material;
+ *
+ * Slots changed since the last bind are uploaded with a single buffer update
+ * right before binding, so the buffer only needs an OpenGL context then.
+ */
+
+// std140 layout of the Material block
+struct materialBlock {
+        vec4s ambientColor;
+        vec4s emissiveColor;
+        vec4s diffuseColor;
+        vec4s specularColor;
+        float opacity;
+        float specularPower;
+        float reflectance;
+        float refraction;
+        float indexOfRefraction;
+        float bumpIntensity;
+        float specularScale;
+        float alphaThreshold;
+        uint32_t hasAmbientTexture;
+        uint32_t hasEmissiveTexture;
+        uint32_t hasDiffuseTexture;
+        uint32_t hasSpecularTexture;
+        uint32_t hasNormalTexture;
+        uint32_t hasBumpTexture;
+        uint32_t hasOpacityTexture;
+        uint32_t alphaBlendingMode;
+};
+
+// Distance between slots, the largest offset alignment OpenGL allows
+#define MATERIALBUFFER_STRIDE 256
+
+/*
+ * Take a free slot, and return it.
+ */
+size_t materialBuffer_add(void);
+
+/*
+ * Get the block in the given slot, to change it call materialBuffer_update
+ * afterwards.
+ */
+struct materialBlock *materialBuffer_get(size_t slot)
+        __attribute__((returns_nonnull));
+
+/*
+ * Have the given slot uploaded again on the next bind.
+ */
+void materialBuffer_update(size_t slot);
+
+/*
+ * Bind the given slot, uploading all changed slots first.
+ */
+void materialBuffer_bind(size_t slot);
+
+/*
+ * Free the given slot, so that it can be taken again.
+ */
+void materialBuffer_remove(size_t slot);
+
+/*
+ * Free all resources used by the buffer, including the OpenGL one. All slots
+ * must have been removed.
+ */
+void materialBuffer_destroy(void);
+
+#endif /* MATERIALBUFFER_H */
@@ -4,9 +4,13 @@
 #include <thirty/componentCollection.h>
 #include <thirty/eventBroker.h>
 #include <thirty/dsutils.h>
+#include <thirty/bonePalette.h>
+#include <thirty/instanceBuffer.h>
 
 #define OBJECT_TREE_MAXIMUM_DEPTH 256
 
+struct scene;  // scene.h includes this header
+
 /*
  * This module offers an implementation of an object. Objects follow a tree
  * organization and each object has one parent (except the root object) and can
@@ -15,21 +19,44 @@
  * behavior when trying to draw it and will probably crash. The onUpdate method
  * will be fired with the scene's update event. It's automatically registered
  * and it's register parameter is the object struct itself.
+ *
+ * The object struct only holds what updating and drawing the scene needs, so
+ * that going over many objects wastes little of each cache line. The rest,
+ * like its name, is kept by its scene apart from the objects, see
+ * struct objectInfo. The scene and game an object belongs to are found
+ * through the component memory it points to, which is its scene's.
  */
 
 struct object {
         size_t idx;
-        char *name;
-        size_t scene;
-        struct game *game;
-        
+
+        // Links to other objects of the scene, by idx. Root can't be anyone's
+        // child or sibling, so 0 means there's none.
         size_t parent;
-        struct growingArray children;
+        size_t firstChild;
+        size_t nextSibling;
+        size_t prevSibling;
 
         struct componentCollection components;
         struct varSizeGrowingArray *componentsMemory;
         
-        eventBrokerCallback onUpdate;
+        eventBrokerCallback onUpdate;  // set with object_setOnUpdate
+
+        // Whether onUpdate can run at the same time as other objects' when
+        // the scene updates in parallel, see scene_setParallelUpdate. It can
+        // if it only touches its own object and components, doesn't create,
+        // remove or reparent objects, doesn't fire events or change anything
+        // else that's shared, and doesn't need other objects to have been
+        // updated before it, not even its parent.
+        bool threadSafe;
+};
+
+/*
+ * The parts of an object that are seldom needed, kept by its scene by idx.
+ */
+struct objectInfo {
+        char *name;  // NULL once the object is removed
+        bool borrowed;  // name owned by someone else, not free'd with it
 };
 
 enum renderStage {
@@ -40,50 +67,58 @@ enum renderStage {
 
 /*
  * Initialize an empty object with default paramters. WARNING! This object has
- * no parent or children defined! Use object_addChild for that.
+ * no parent or children defined! It's linked into the tree by the scene, see
+ * scene_createObject and scene_setParent, which also keeps its name.
  */
-void object_initEmpty(struct object *object, struct game *game, size_t scene,
-                      const char *name, struct varSizeGrowingArray *components)
+void object_initEmpty(struct object *object, struct game *game,
+                      struct varSizeGrowingArray *components)
         __attribute__((access (write_only, 1)))
         __attribute__((access (read_write, 2)))
-        __attribute__((access (read_only, 4)))
-        __attribute__((access (read_write, 5)))
+        __attribute__((access (read_write, 3)))
         __attribute__((nonnull));
 
 /*
  * Initialize object from a file pointer. Does not set parent or children. This
  * is expected to be a BOGLE file that's already pointing at an object header,
- * and it will read all of the header and the data.
+ * and it will read all of the header and the data. Return the object's name,
+ * for the scene to keep, which must be free'd.
  */
-void object_initFromFile(struct object *object, struct game *game,
-                         struct varSizeGrowingArray *components,
-                         size_t scene, size_t idxOffset,
-                         unsigned ncams, unsigned ngeos,
-                         unsigned nmats, unsigned nlights,
-                         unsigned nanims, FILE *f)
+char *object_initFromFile(struct object *object, struct game *game,
+                          struct varSizeGrowingArray *components,
+                          size_t idxOffset,
+                          unsigned ncams, unsigned ngeos,
+                          unsigned nmats, unsigned nlights,
+                          unsigned nanims, FILE *f)
         __attribute__((access (write_only, 1)))
         __attribute__((access (read_only, 2)))
         __attribute__((access (read_write, 3)))
-        __attribute__((access (read_write, 11)))
-        __attribute__((nonnull));
+        __attribute__((access (read_write, 10)))
+        __attribute__((nonnull))
+        __attribute__((returns_nonnull));
 
 /*
- * Set parent-child relationship between two objects.
+ * Return the scene the object belongs to.
  */
-void object_addChild(struct object *parent, struct object *child)
-        __attribute__((access (read_write, 1)))
-        __attribute__((access (read_write, 2)))
-        __attribute__((nonnull));
+struct scene *object_getScene(const struct object *object)
+        __attribute__((access (read_only, 1)))
+        __attribute__((nonnull))
+        __attribute__((returns_nonnull));
 
 /*
- * Unset parent-child relationship between two objects. The child MUST be the
- * parent's child. The child's parent is set to 0.
+ * Return the game the object belongs to.
  */
-void object_removeChild(struct object *parent, struct object *child)
-        __attribute__((access (read_write, 1)))
-        __attribute__((access (read_write, 2)))
+struct game *object_getGame(const struct object *object)
+        __attribute__((access (read_only, 1)))
         __attribute__((nonnull));
 
+/*
+ * Return the object's name.
+ */
+const char *object_getName(const struct object *object)
+        __attribute__((access (read_only, 1)))
+        __attribute__((nonnull))
+        __attribute__((returns_nonnull));
+
 /*
  * Assign a component to the object's component collection.
  */
@@ -92,6 +127,15 @@ void object_setComponent(struct object *object, struct component *comp)
         __attribute__((access (read_write, 2)))
         __attribute__((nonnull));
 
+/*
+ * Set the callback run each time the scene updates, or NULL for none. Objects
+ * without one, or an animation collection, aren't visited at all when
+ * updating, so this must be used instead of setting onUpdate directly.
+ */
+void object_setOnUpdate(struct object *object, eventBrokerCallback onUpdate)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull (1)));
+
 /*
  * Retrieve the component in the object's collection, or NULL if there's no
  * component in that slot.
@@ -100,6 +144,59 @@ void *object_getComponent(const struct object *object,
                           enum componentType type)
         __attribute__((access (read_only, 1)))
         __attribute__((nonnull));
+
+/*
+ * Like object_getComponent for each of the slots, but resolved at compile
+ * time and inlined: a direct indexed load, for the engine's hot paths.
+ */
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static inline struct transform *object_getTransform(
+        const struct object *const object) {
+        return componentCollection_getSlot(object->componentsMemory,
+                                           object->components.transform);
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static inline struct camera *object_getCamera(
+        const struct object *const object) {
+        return componentCollection_getSlot(object->componentsMemory,
+                                           object->components.camera);
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static inline struct geometry *object_getGeometry(
+        const struct object *const object) {
+        return componentCollection_getSlot(object->componentsMemory,
+                                           object->components.geometry);
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static inline struct material *object_getMaterial(
+        const struct object *const object) {
+        return componentCollection_getSlot(object->componentsMemory,
+                                           object->components.material);
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static inline struct light *object_getLight(
+        const struct object *const object) {
+        return componentCollection_getSlot(object->componentsMemory,
+                                           object->components.light);
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static inline struct animationCollection *object_getAnimationCollection(
+        const struct object *const object) {
+        return componentCollection_getSlot(
+                object->componentsMemory,
+                object->components.animationCollection);
+}
 /*
  * Update all of object's components.
  */
@@ -108,26 +205,50 @@ void object_update(struct object *object, float timeDelta)
         __attribute__((nonnull));
 
 /*
- * Draw an object. Use the given model amtrix, which should be evaluated, and a
- * view and projection matrix. The rest of parameters are better explained in
- * scene_draw
+ * Draw an object. Use the given model amtrix, which should be evaluated, the
+ * frame's camera, see cameraBuffer.h, and the frame's bone palette, where the
+ * object's animation collection, if any, was added. The rest of parameters are
+ * better explained in scene_draw
  */
 bool object_draw(const struct object *object, mat4s model,
-                 mat4s view, mat4s projection,
+                 const struct bonePalette *bones,
                  enum renderStage *lastRenderStage,
                  const struct material **lastMaterial,
                  enum shaders *lastShader)
         __attribute__((access (read_only, 1)))
+        __attribute__((access (read_only, 3)))
+        __attribute__((access (read_write, 4)))
         __attribute__((access (read_write, 5)))
         __attribute__((access (read_write, 6)))
-        __attribute__((access (read_write, 7)))
         __attribute__((nonnull));
 
 /*
- * Free any resources used by the object, deinitializing it.
+ * Whether the object can be drawn along with others sharing its geometry and
+ * material, with object_drawInstanced. It must have a loaded geometry, and
+ * neither be the skybox nor be skinned, since those need uniforms of their
+ * own.
  */
-void object_free(struct object *object)
+bool object_isInstanceable(const struct object *object)
         __attribute__((access (read_only, 1)))
         __attribute__((nonnull));
 
+/*
+ * Draw count copies of an instanceable object's geometry with its material in
+ * a single call, each one with its model matrix from the given range of the
+ * frame's instance buffer. Like object_draw, but for every object of a run
+ * sharing a geometry and a material.
+ */
+void object_drawInstanced(const struct object *object,
+                          const struct instanceBuffer *instances,
+                          size_t first, size_t count,
+                          enum renderStage *lastRenderStage,
+                          const struct material **lastMaterial,
+                          enum shaders *lastShader)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((access (read_write, 5)))
+        __attribute__((access (read_write, 6)))
+        __attribute__((access (read_write, 7)))
+        __attribute__((nonnull));
+
 #endif /* OBJECT_H */
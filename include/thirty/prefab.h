@@ -0,0 +1,53 @@
+#ifndef PREFAB_H
+#define PREFAB_H
+
+#include <thirty/componentCollection.h>
+#include <thirty/eventBroker.h>
+#include <thirty/dsutils.h>
+
+struct scene;  // scene.h includes this header
+
+/*
+ * A copy of a subtree of a scene's objects, taken once, to make any amount of
+ * copies of it cheaply with scene_instantiatePrefab. Prefabs belong to the
+ * scene they were taken from, see scene_createPrefab.
+ *
+ * Each copy of an object gets its own transform, starting out like the
+ * original's, while every other component is shared with the original by
+ * reference: copies only cost the objects themselves and their transforms,
+ * which are allocated for all copies at once, and their names are the
+ * prefab's. Shared animation collections keep being updated by the original,
+ * and all of its copies show the same animation.
+ */
+
+struct prefabNode {
+        char *name;
+        size_t parent;  // node, those come before their children
+        struct componentCollection components;  // without transform
+        struct transform transform;  // the copies' start out as this one
+        eventBrokerCallback onUpdate;
+        bool threadSafe;
+};
+
+struct prefab {
+        struct growingArray nodes;  // the subtree's root first
+};
+
+/*
+ * Take a copy of the object with the given idx, which can't be root, and of
+ * all of its descendants.
+ */
+void prefab_init(struct prefab *prefab, struct scene *scene, size_t idx)
+        __attribute__((access (write_only, 1)))
+        __attribute__((access (read_write, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Free all resources used by the prefab. The components it refers to belong
+ * to the scene.
+ */
+void prefab_free(struct prefab *prefab)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* PREFAB_H */
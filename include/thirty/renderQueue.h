@@ -0,0 +1,158 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <thirty/dsutils.h>
+#include <cglm/struct.h>
+#include <stdint.h>
+
+struct scene;  // scene.h includes this header
+struct object;
+
+/*
+ * The order a scene's objects with geometry and material are drawn in, as a
+ * list of compact items that each carry a 64 bit key, so that sorting them is
+ * only a matter of comparing integers. From the most significant bits to the
+ * least:
+ *
+ *     stage     2 bits  opaque objects, then transparent ones, then the skybox
+ *     shader    6 bits
+ *     material 20 bits  component idx
+ *     geometry 18 bits  component idx, only for opaque objects
+ *     depth    18 bits  distance to the camera, closest first
+ *
+ * Component idxs that don't fit wrap around, which only means that some
+ * materials or geometries may not be grouped together. The depth is the top
+ * of the float's bits, so its precision is relative to the distance.
+ *
+ * Like the bounding volume hierarchy, it's built from all of the scene's
+ * objects the first time it's needed, see renderQueue_update, and then kept
+ * from frame to frame. Objects whose key may have changed are queued by the
+ * scene: when they're created or removed, given a geometry or a material, or
+ * moved. Only those get their key computed again, unless the camera moved or
+ * a material went from opaque to transparent or back, and items are only
+ * sorted again, with a radix sort, when a new key is out of order with its
+ * neighbors'. Removed objects leave a hole in their place, which keeps the
+ * order, until the items are sorted again or there are too many of them.
+ */
+
+struct renderItem {
+        uint64_t key;
+        size_t object;  // idx, RENDERQUEUE_NONE for a hole
+};
+
+struct renderQueue {
+        struct growingArray items;  // sorted once renderQueue_order is called
+        struct growingArray slots;  // item of each object, by idx
+        struct growingArray scratch;  // for sorting
+        struct growingArray stale;  // idxs of objects whose key may change
+        vec4s eye;  // camera position the depths are from
+        size_t materialChanges;  // see material_stageChanges
+        size_t holes;  // items of removed objects
+        bool sorted;  // no key is out of order
+        bool valid;
+        size_t sorts;  // times the items had to be sorted
+};
+
+/*
+ * No item, like the slot of objects that aren't in the queue, and the object
+ * of a hole.
+ */
+#define RENDERQUEUE_NONE SIZE_MAX
+
+/*
+ * Initialize an empty, invalid, queue.
+ */
+void renderQueue_init(struct renderQueue *queue)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Mark the queue as out of date, so that it's built again from all of the
+ * scene's objects the next time renderQueue_update is called.
+ */
+void renderQueue_invalidate(struct renderQueue *queue)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Build the scene's queue if it's invalid, or compute the keys of the objects
+ * queued since the last call again, all of them if the camera or a material's
+ * stage changed, and put the items in order. The objects' world matrices must
+ * be up to date.
+ */
+void renderQueue_update(struct scene *scene, vec4s eye)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Queue an object whose key may have changed, or which may now have to be
+ * drawn or not, for the next renderQueue_update. Does nothing if the queue is
+ * invalid.
+ */
+void renderQueue_refresh(struct renderQueue *queue, size_t idx)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Set the key of an object's item, adding it if it doesn't have one yet.
+ */
+void renderQueue_set(struct renderQueue *queue, size_t idx, uint64_t key)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Take an object's item out of the queue, if it has one.
+ */
+void renderQueue_remove(struct renderQueue *queue, size_t idx)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Give an object a new idx, which must not be in use, when the scene's objects
+ * are compacted.
+ */
+void renderQueue_move(struct renderQueue *queue, size_t from, size_t to)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Sort the items if some key is out of order, and drop the holes if they
+ * were sorted or there are too many of them.
+ */
+void renderQueue_order(struct renderQueue *queue)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Return the key of an item with the given parts, as described above. The
+ * stage is an enum renderStage, and the geometry is ignored unless it's
+ * opaque.
+ */
+uint64_t renderQueue_pack(unsigned stage, unsigned shader, size_t material,
+                          size_t geometry, float depth);
+
+/*
+ * Return the key of an object with geometry and material, at the given
+ * distance to the camera.
+ */
+uint64_t renderQueue_key(const struct object *object, float depth)
+        __attribute__((access (read_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Sort n items by key with a radix sort, using scratch, of the same size, as
+ * temporary storage. Items with the same key keep their order.
+ */
+void renderQueue_sort(struct renderItem *items, struct renderItem *scratch,
+                      size_t n)
+        __attribute__((access (read_write, 1, 3)))
+        __attribute__((access (write_only, 2, 3)));
+
+/*
+ * Free all resources used by the queue.
+ */
+void renderQueue_free(struct renderQueue *queue)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* RENDERQUEUE_H */
@@ -2,6 +2,30 @@
 #define SCENE_H
 
 #include <thirty/object.h>
+#include <thirty/hierarchy.h>
+#include <thirty/activeSet.h>
+#include <thirty/streaming.h>
+#include <thirty/compaction.h>
+#include <thirty/prefab.h>
+#include <thirty/snapshot.h>
+#include <thirty/bvh.h>
+#include <thirty/renderQueue.h>
+#include <thirty/vectorMath.h>
+
+/*
+ * Working lists of scene_updateTransforms, kept from call to call so that
+ * they're only allocated as they grow.
+ */
+struct transformLists {
+        struct growingArray roots;  // positions of the subtrees to do
+        struct growingArray updates;  // transforms in them
+        struct growingArray moved;  // transforms that are dirty
+        struct growingArray models;  // their new model matrices
+        struct trsArrays trs;  // their position, rotation and scale
+        struct growingArray parentWorlds;  // operands of each product
+        struct growingArray localModels;
+        struct growingArray worlds;
+};
 
 /*
  * A scene contains a collection of objects (all children of 'root'). The scene
@@ -17,6 +41,7 @@ struct scene {
         
         struct object root;
         struct growingArray objects;
+        struct growingArray objectInfo;  // by idx, root's first
         
         struct varSizeGrowingArray components;
 
@@ -25,8 +50,24 @@ struct scene {
 
         struct growingArray loadingStack;
         size_t totalSizeFinishedAsyncLoad;
+        uint64_t loadDeadline;  // time_micros() deadline, 0 when unbounded
         bool loading;
         bool loaded;
+
+        void *image;  // mapping of the scene image it was loaded from, if any
+        size_t imageSize;
+
+        struct streaming streaming;  // cells, if the scene is partitioned
+        struct hierarchy hierarchy;  // objects with parents before children
+        struct growingArray dirtyTransforms;  // idxs, see scene_queueTransform
+        struct transformLists transformLists;
+        struct activeSet active;  // objects with something to update
+        struct bvh bvh;  // objects' world bounds, see scene_getBVH
+        struct renderQueue renderQueue;  // objects drawn, in order
+        struct compaction compaction;  // see scene_compact
+        struct growingArray prefabs;
+        bool parallelUpdate;  // see scene_setParallelUpdate
+        bool updatingInParallel;  // objects are being updated by the workers
 };
 
 typedef bool(*scene_loadCallback)(struct scene*, void*);
@@ -52,6 +93,15 @@ void scene_initFromFile(struct scene *scene, struct game *game, const char *file
         __attribute__((access (read_only, 2)))
         __attribute__((nonnull));
 
+/*
+ * Initialize a scene from a baked scene image, see sceneImage.h.
+ */
+void scene_initFromImage(struct scene *scene, struct game *game,
+                         const char *filename)
+        __attribute__((access (write_only, 1)))
+        __attribute__((access (read_only, 3)))
+        __attribute__((nonnull));
+
 /*
  * Take a step in loading a scene. It will load everything defined either in
  * the BOGLE file or through the scene_addLoadingStep functions. It returns
@@ -64,6 +114,28 @@ bool scene_load(struct scene *scene)
         __attribute__((access (read_write, 1)))
         __attribute__((nonnull));
 
+/*
+ * Take a step in loading a scene, like scene_load followed by
+ * scene_awaitAsyncLoaders, but spending roughly at most the given amount of
+ * microseconds in it. Parsing, object creation and GL uploads are all spread
+ * over as many calls as needed. Meant to be called once per frame, it returns
+ * true once the scene is completely loaded, async loads included.
+ */
+bool scene_loadBudget(struct scene *scene, unsigned long micros)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Return whether the current loading step should yield because the budget
+ * given to scene_loadBudget has run out. Loading steps doing a lot of work
+ * should check this regularly and, if it returns true, add themselves again
+ * with scene_addLoadingStep and return false. It always returns false when
+ * loading through scene_load.
+ */
+bool scene_loadBudgetExceeded(const struct scene *scene)
+        __attribute__((access (read_only, 1)))
+        __attribute__((nonnull));
+
 /*
  * Unload a scene, freeing all resources. The scene is NOT deinitialized and
  * can be loaded again with a call to scene_load.
@@ -123,14 +195,85 @@ void scene_removeObject(struct scene *scene, struct object *object)
         __attribute__((nonnull));
 
 /*
- * Get an object's absolute transform by going up the scene tree until root. If
- * at any point an object doesn't have a transform component, returns the
- * identity matrix. Otherwise returnsthe result of multiplying the transforms
- * of every object up to the root.
+ * Take a copy of an object and all of its descendants to be instantiated many
+ * times later, see prefab.h, and return its idx among the scene's prefabs.
+ * Changes to the objects afterwards don't affect the prefab, except for those
+ * made to the components they share with it. The object can't be root.
+ */
+size_t scene_createPrefab(struct scene *scene, size_t object_idx)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Create count copies of a prefab's objects under the given parent, all at
+ * once. If models isn't NULL it holds the model matrix of each copy's root,
+ * otherwise they're all where the prefab's root was. If idxs isn't NULL it's
+ * filled with the idx of each copy's root. Like scene_createObject, this
+ * might invalidate any object pointers.
+ */
+void scene_instantiatePrefab(struct scene *scene, size_t prefab,
+                             size_t parent_idx, size_t count,
+                             const mat4s *models, size_t *idxs)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 5, 4)))
+        __attribute__((access (write_only, 6, 4)))
+        __attribute__((nonnull (1)));
+
+/*
+ * Move an object, with all of its descendants, to a new parent. Reparenting
+ * objects of a scene should be done through here, so that its flattened
+ * hierarchy is kept up to date. The new parent can't be one of the object's
+ * descendants. The object can't be root.
+ */
+void scene_setParent(struct scene *scene, struct object *object,
+                     size_t parent_idx)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_write, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Let the scene know that the transform of the object with the given idx is
+ * dirty, so that its world matrix and those of its descendants are recomputed
+ * on the next scene_updateTransforms. The transform_* functions and
+ * reparenting do this already, code setting the dirty flag itself must call
+ * this too. Queuing the root makes the whole scene be looked through.
+ */
+void scene_queueTransform(struct scene *scene, size_t object_idx)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Shared animation collections only advance through the object they were
+ * last given to, see componentCollection_update. Before that object is
+ * removed or given another animation collection, this gives the one it
+ * advances to another object using it, if any, so that it keeps playing for
+ * the others. scene_removeObject and object_setComponent do this already.
+ */
+void scene_handOffAnimation(struct scene *scene, const struct object *object)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Recompute the cached world matrices of the objects whose transform was
+ * queued as dirty since the last call, along with those of all of their
+ * descendants. Only their subtrees are gone through, so nothing is done for
+ * the objects that didn't move. Called by scene_update and before drawing.
+ */
+void scene_updateTransforms(struct scene *scene)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Get an object's absolute transform, the result of multiplying the transforms
+ * of every object up to the root. If at any point an object doesn't have a
+ * transform component, returns the identity matrix. The cached world matrix
+ * is returned unless the object or one of its ancestors moved since the last
+ * update, in which case the cache is refreshed first.
  */
 mat4s scene_getObjectAbsoluteTransform(struct scene *scene,
                                        const struct object *object)
-        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_write, 1)))
         __attribute__((access (read_only, 2)))
         __attribute__((nonnull));
 
@@ -165,19 +308,112 @@ size_t scene_setSkybox(struct scene *scene, const char *basename)
         __attribute__((nonnull));
 
 /*
- * Update all objects in the scene, to be called once per frame.
+ * Update the objects in the scene, to be called once per frame. Only objects
+ * with an onUpdate callback or an animation collection are visited, see
+ * activeSet.h. Parents are updated before their children. This also streams
+ * the scene's cells in and out around the main camera, see streaming.h.
+ *
+ * When updating in parallel, objects marked as thread safe are updated first,
+ * all at the same time on the thread pool, in no particular order. The rest
+ * are updated afterwards on the calling thread, parents before children.
  */
 void scene_update(struct scene *scene, float timeDelta)
         __attribute__((access (read_write, 1)))
         __attribute__((nonnull));
 
 /*
- * Draw the scene using OpenGL.
+ * Turn updating the scene's objects in parallel on or off, it's off by
+ * default. Turning it on starts the thread pool if it isn't running yet. Only
+ * objects whose threadSafe flag is set run in parallel, see object.h for what
+ * that promises.
  */
-void scene_draw(const struct scene *scene)
-        __attribute__((access (read_only, 1)))
+void scene_setParallelUpdate(struct scene *scene, bool parallel)
+        __attribute__((access (read_write, 1)))
         __attribute__((nonnull));
 
+/*
+ * Take a step in compacting the scene's storage, spending roughly at most the
+ * given amount of microseconds in it, or as long as it takes if it's 0. The
+ * objects and components in use are moved down into dense storage, keeping
+ * their order, the components no object uses are freed, including those not
+ * given to any object yet, and the arrays are shrunk to fit, see
+ * compaction.h. Meant to be called once in a while, between frames, until it
+ * returns true. The scene can be used as usual in between calls. If reclaimed
+ * isn't NULL it's set to the bytes of memory given back during this call.
+ *
+ * Objects and components get new idxs, so idxs and pointers kept from before
+ * a call are no longer valid after it. Streaming stands still from the moment
+ * the first component is moved until it's all done. The scene must be loaded.
+ */
+bool scene_compact(struct scene *scene, unsigned long micros,
+                   size_t *reclaimed)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (write_only, 3)))
+        __attribute__((nonnull (1)));
+
+/*
+ * Take a snapshot of the runtime state of the scene, see snapshot.h, into the
+ * given snapshot, replacing whatever it had. If since isn't NULL, it must be
+ * a full snapshot of the same scene and only what changed since then is
+ * taken. The scene must be loaded, not split into cells and not in the middle
+ * of moving components, see scene_compact.
+ */
+void scene_snapshot(const struct scene *scene, struct snapshot *snapshot,
+                    const struct snapshot *since)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_write, 2)))
+        __attribute__((access (read_only, 3)))
+        __attribute__((nonnull (1, 2)));
+
+/*
+ * Put the scene back in the state of the given full snapshot, and then of the
+ * given delta taken against it if it isn't NULL. Objects created since are
+ * removed, and removed ones come back with the same idxs. Pointers to objects
+ * are no longer valid after it. Bails if they weren't taken from this scene
+ * or its components were compacted since.
+ */
+void scene_restore(struct scene *scene, const struct snapshot *snapshot,
+                   const struct snapshot *delta)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((access (read_only, 3)))
+        __attribute__((nonnull (1, 2)));
+
+/*
+ * Return the scene's bounding volume hierarchy, building it if it's the first
+ * time, for querying which objects are in some region of space. Transforms
+ * are updated first, so the objects' bounds are up to date. The tree is only
+ * valid until the scene changes.
+ */
+const struct bvh *scene_getBVH(struct scene *scene)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull))
+        __attribute__((returns_nonnull));
+
+/*
+ * Counters of what a call to scene_draw did.
+ */
+struct sceneDrawStats {
+        size_t visible;  // objects with geometry that were drawn
+        size_t culled;  // objects with geometry outside of the camera's view
+        size_t draws;  // calls drawing them, one per run sharing a mesh
+};
+
+/*
+ * Draw the scene using OpenGL. The cached world matrices of the objects are
+ * used, so they must be up to date, see scene_updateTransforms. Objects whose
+ * bounds are outside of the main camera's frustum are skipped, as found by
+ * the scene's bounding volume hierarchy, see scene_getBVH, and opaque objects
+ * sharing their geometry and material are drawn together with instancing, see
+ * instanceBuffer.h. The order they're drawn in is kept in the scene from
+ * frame to frame, see renderQueue.h. If stats isn't NULL, the frame's
+ * counters are stored there.
+ */
+void scene_draw(struct scene *scene, struct sceneDrawStats *stats)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (write_only, 2)))
+        __attribute__((nonnull (1)));
+
 /*
  * Free all resources used by the scene, deinitializing it and all its objects.
  */
@@ -0,0 +1,70 @@
+#ifndef SCENE_IMAGE_H
+#define SCENE_IMAGE_H
+
+#include <thirty/scene.h>
+
+/*
+ * Baked scene images. A scene image is a memory dump of a fully loaded scene:
+ * its objects and components are stored exactly as the runtime lays them
+ * out, with every pointer replaced by an offset into the image, along with
+ * the raw vertex, index and pixel data of its geometries and textures. Loading
+ * one is a matter of mapping the file, copying the object and component
+ * arrays, fixing up the pointers and handing the mapped data to OpenGL. There
+ * is no parsing and no image decoding involved.
+ *
+ * Images are specific to the build that produced them: they are only valid
+ * for the same architecture and the same struct layouts. Nothing produces them
+ * automatically, a game that wants them has to load its scenes from BOGLE
+ * files and call sceneImage_bake itself. Version mismatches are detected and
+ * rejected, and so is anything else that doesn't add up: every offset, count
+ * and idx in an image is checked against what it refers to before it's used.
+ *
+ * Strings and animation data are used in place from the mapping, components
+ * and objects loaded from an image are marked as borrowed for that reason. The
+ * mapping is owned by the scene and released when it's unloaded. Function
+ * pointers such as the objects' onUpdate callbacks can't be baked, they must
+ * be set again after loading.
+ */
+
+/*
+ * Bake a scene image from a scene that has finished loading, including all of
+ * its async loads, and write it to the given file. Needs a current OpenGL
+ * context since geometry and texture data is read back from it. The scene may
+ * not have any removed objects nor be partitioned in cells.
+ */
+void sceneImage_bake(const struct scene *scene, const char *filename)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Load a scene image into the scene: map it and fix up its objects and
+ * components. GPU resources are uploaded afterwards with sceneImage_upload.
+ * Used by the loading steps added by scene_initFromImage, so there should be
+ * no need to call it directly.
+ */
+void sceneImage_load(struct scene *scene, const char *filename)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Upload the geometries and textures of the scene's image to OpenGL, starting
+ * from the given resource, which should initially be 0 and is advanced as
+ * they are uploaded. Stops early when the scene's loading budget runs out (see
+ * scene_loadBudget). Returns true once everything has been uploaded.
+ */
+bool sceneImage_upload(struct scene *scene, size_t *next)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_write, 2)))
+        __attribute__((nonnull));
+
+/*
+ * Release the scene's image mapping, if it has one. Called by scene_unload
+ * once nothing uses it anymore.
+ */
+void sceneImage_release(struct scene *scene)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* SCENE_IMAGE_H */
@@ -34,6 +34,35 @@ enum shaders {
         SHADER_TOTAL
 };
 
+/*
+ * Uniforms the engine sets on every draw. Their locations are looked up once,
+ * when the shader is linked, and the shader_setUniform* functions take them
+ * by this enum instead of by name. Uniforms a shader doesn't have are
+ * silently ignored, like for the setters by name.
+ */
+
+enum shaderUniform {
+        SHADER_UNIFORM_MODEL,  // the rest of the matrices are per frame
+        SHADER_UNIFORM_BONEOFFSET,  // see bonePalette.h
+        SHADER_UNIFORM_INSTANCED,  // see instanceBuffer.h
+
+        SHADER_UNIFORM_TOTAL
+};
+
+/*
+ * Uniform blocks shared by all programs that declare them, each one bound to
+ * the binding point of the same value when the program is linked. The buffers
+ * behind them are kept by the modules that fill them, and their layouts are
+ * described there.
+ */
+enum shaderBlock {
+        SHADER_BLOCK_LIGHTS,  // see lightBuffer.h
+        SHADER_BLOCK_CAMERA,  // see cameraBuffer.h
+        SHADER_BLOCK_MATERIAL,  // see materialBuffer.h
+
+        SHADER_BLOCK_TOTAL
+};
+
 /*
  * Use the given shader. This might collect, compile and link the shader.
  */
@@ -111,4 +140,23 @@ void shader_setMat4(enum shaders shader,
         __attribute__((access (read_only, 2)))
         __attribute__((nonnull));
 
+/*
+ * Set a uniform of the given shader, like the functions above but without
+ * looking it up by name. Int, unsigned and bool uniforms remember their value,
+ * and setting one to the value it already has does nothing, so they must not
+ * be set by name too.
+ */
+void shader_setUniformBool(enum shaders shader, enum shaderUniform uniform,
+                           bool value);
+void shader_setUniformInt(enum shaders shader, enum shaderUniform uniform,
+                          int value);
+void shader_setUniformUInt(enum shaders shader, enum shaderUniform uniform,
+                           unsigned value);
+void shader_setUniformFloat(enum shaders shader, enum shaderUniform uniform,
+                            float value);
+void shader_setUniformVec4(enum shaders shader, enum shaderUniform uniform,
+                           vec4s value);
+void shader_setUniformMat4(enum shaders shader, enum shaderUniform uniform,
+                           mat4s value);
+
 #endif
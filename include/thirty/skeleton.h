@@ -42,11 +42,12 @@ void skeleton_initFromKeyframe(struct skeleton *skel,
         __attribute__((nonnull));
 
 /*
- * Bind a skeleton's bones to the given shader, using absolute and bind inverse
- * matrices.
+ * Compute a skeleton's skinning matrices into out, one per bone, using
+ * absolute and bind inverse matrices.
  */
-void skeleton_bindBones(const struct skeleton *skel, enum shaders shader)
+void skeleton_skinningMatrices(const struct skeleton *skel, mat4s *out)
         __attribute__((access (read_only, 1)))
+        __attribute__((access (write_only, 2)))
         __attribute__((nonnull));
 
 /*
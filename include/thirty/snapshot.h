@@ -0,0 +1,79 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+
+struct scene;  // scene.h includes this header
+
+/*
+ * Snapshots of the runtime state of a scene, see scene_snapshot and
+ * scene_restore: its objects, including the ones spawned after loading it,
+ * with their tree links, components, names and update callbacks, the
+ * position, rotation and scale of every transform and the playback state of
+ * every animation collection. Everything else the scene loaded, like
+ * geometries and materials, is referred to by idx and must still be there
+ * when restoring, so restoring is only a matter of copying records back and
+ * takes milliseconds even for big scenes.
+ *
+ * A snapshot is a compact binary blob made of sections of fixed size records,
+ * each with its own version, and can be copied around or written to a file as
+ * is. It's only valid for the same build and the same run of the program,
+ * since callbacks are stored as function pointers, and for the same scene as
+ * long as its components haven't been compacted since.
+ *
+ * A snapshot can be full or a delta that only holds what changed since a full
+ * one, which is much smaller when most of the scene stays put. Deltas are
+ * always restored on top of the full snapshot they were taken against.
+ */
+
+struct snapshot {
+        char *data;
+        size_t size;
+        size_t capacity;
+};
+
+/*
+ * Initialize an empty snapshot, to be taken with scene_snapshot.
+ */
+void snapshot_init(struct snapshot *snapshot)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Initialize a snapshot from a copy of the given blob, as previously found in
+ * another snapshot's data and size.
+ */
+void snapshot_initFromBuffer(struct snapshot *snapshot, const void *data,
+                             size_t size)
+        __attribute__((access (write_only, 1)))
+        __attribute__((access (read_only, 2, 3)))
+        __attribute__((nonnull));
+
+/*
+ * Take a snapshot of the scene, see scene_snapshot.
+ */
+void snapshot_take(const struct scene *scene, struct snapshot *snapshot,
+                   const struct snapshot *since)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_write, 2)))
+        __attribute__((access (read_only, 3)))
+        __attribute__((nonnull (1, 2)));
+
+/*
+ * Restore a snapshot into the scene, see scene_restore.
+ */
+void snapshot_restore(struct scene *scene, const struct snapshot *snapshot,
+                      const struct snapshot *delta)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((access (read_only, 3)))
+        __attribute__((nonnull (1, 2)));
+
+/*
+ * Free all resources used by the snapshot.
+ */
+void snapshot_free(struct snapshot *snapshot)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,166 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include <thirty/dsutils.h>
+#include <cglm/struct.h>
+
+struct scene;  // scene.h includes this header
+
+/*
+ * World partitioning for scenes too big to be kept in memory all at once. A
+ * scene can be split into cells: axis aligned boxes in world space, each one
+ * owning a range of the scene's objects. The streaming manager loads the
+ * geometries of the cells close to the main camera and unloads the ones that
+ * are far away, using the async loader for reading them and spreading the GL
+ * uploads over frames.
+ *
+ * Cells are loaded when the camera gets closer than the load radius and only
+ * unloaded once it's farther than the unload radius, which should be bigger so
+ * that moving around a cell's border doesn't load and unload it over and
+ * over. The total size of the cells' geometries is kept within the memory
+ * budget: cells in between both radii are evicted early, farthest first, to
+ * make room for closer ones, and cells that still don't fit aren't loaded.
+ *
+ * Only geometries are streamed. Objects, materials, textures and everything
+ * else stay resident, and so do geometries used by objects outside of any
+ * cell. Geometries shared between cells are loaded only once.
+ */
+
+#define STREAMING_DEFAULT_LOAD_RADIUS 100.0F
+#define STREAMING_DEFAULT_UNLOAD_RADIUS 150.0F
+#define STREAMING_DEFAULT_MEMORY_BUDGET (256 * 1024 * 1024)
+
+enum cellState {
+        CELL_UNLOADED,
+        CELL_LOADING,
+        CELL_LOADED,
+};
+
+struct cell {
+        vec3s min;
+        vec3s max;
+        size_t firstObject;  // idx of the first object of the cell
+        size_t nobjects;
+
+        // Range in the streaming manager's cellGeometries list
+        size_t firstGeometry;
+        size_t ngeometries;
+        size_t size;  // bytes of all of its geometries
+
+        enum cellState state;
+        float distance;  // to the camera, as of the last update
+};
+
+struct streaming {
+        struct growingArray cells;
+        struct growingArray geometries;  // sorted by component idx
+        struct growingArray cellGeometries;  // idx into 'geometries'
+        struct growingArray candidates;  // scratch space, cells to load
+
+        float loadRadius;
+        float unloadRadius;
+        size_t memoryBudget;
+        size_t residentSize;  // bytes of streamed geometries loaded or loading
+
+        size_t camera;  // object idx, 0 until one is found
+        bool reading;  // whether the async loader is running for us
+};
+
+/*
+ * Initialize an empty streaming manager, without cells, with the default
+ * radii and budget.
+ */
+void streaming_init(struct streaming *streaming)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Change the streaming parameters. The unload radius must not be smaller than
+ * the load radius. The budget is in bytes.
+ */
+void streaming_configure(struct streaming *streaming, float loadRadius,
+                         float unloadRadius, size_t memoryBudget)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Add a cell with the given world space bounds owning the given range of
+ * objects. All cells must be added before calling streaming_prepare.
+ */
+void streaming_addCell(struct streaming *streaming, vec3s min, vec3s max,
+                       size_t firstObject, size_t nobjects)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Gather the geometries used by the objects of every cell, once all of the
+ * scene's objects and cells exist. The cells start unloaded.
+ */
+void streaming_prepare(struct scene *scene)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Return whether the given geometry component is streamed, that is, loaded
+ * and unloaded along with the cells using it.
+ */
+bool streaming_isStreamed(const struct streaming *streaming, size_t component)
+        __attribute__((access (read_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Decide which cells should be loaded and unloaded given the position of the
+ * main camera, unload the ones that must go and enqueue the reads of the ones
+ * that must come in. The async loader must be initialized. Used while loading
+ * the scene, so that the cells around the starting position are loaded along
+ * with it.
+ */
+void streaming_request(struct scene *scene)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Stream cells in and out, to be called once per frame after the scene is
+ * loaded. Like streaming_request, but it manages the async loader itself and
+ * reaps finished reads, uploading them, for at most around the given amount of
+ * microseconds.
+ */
+void streaming_update(struct scene *scene, unsigned long micros)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Give an object a new, lower, idx when the scene's objects are compacted,
+ * which happens in idx order. Every idx between both must be free. The cells'
+ * ranges are kept around their objects.
+ */
+void streaming_moveObject(struct streaming *streaming, size_t from, size_t to)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Make the cells' ranges end at the last object once the scene's objects are
+ * compacted.
+ */
+void streaming_trimCells(struct streaming *streaming, size_t nobjects)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Give a component a new, lower, idx when the scene's components are
+ * compacted, which keeps them in order. No reads may be pending.
+ */
+void streaming_moveComponent(struct streaming *streaming,
+                             size_t from, size_t to)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Wait for any pending reads and free all resources used by the streaming
+ * manager. The geometries themselves are freed with the scene's components.
+ */
+void streaming_free(struct streaming *streaming)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+#endif /* STREAMING_H */
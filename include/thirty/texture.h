@@ -37,6 +37,41 @@ void texture_load(struct texture *tex, void *buff, size_t size)
  */
 void texture_loadCubeMap(struct texture *text, void *buffs[6], size_t sizes[6]);
 
+/*
+ * Read back a loaded texture's RGBA pixels from OpenGL. Cube maps return their
+ * six faces one after the other, in the same order as texture_loadCubeMap. The
+ * returned buffer is dynamically allocated and must be freed by the caller.
+ */
+void *texture_readPixels(const struct texture *tex,
+                         int *width, int *height, size_t *size)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (write_only, 2)))
+        __attribute__((access (write_only, 3)))
+        __attribute__((access (write_only, 4)))
+        __attribute__((nonnull))
+        __attribute__((returns_nonnull));
+
+/*
+ * Store in size how many bytes of RGBA pixels, with every face for cube maps,
+ * a texture of the given type and dimensions takes. Return false, leaving
+ * size alone, if the dimensions aren't positive or the size doesn't fit.
+ */
+bool texture_pixelsSize(const struct texture *tex, int width, int height,
+                        size_t *size)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (write_only, 4)))
+        __attribute__((nonnull));
+
+/*
+ * Load a texture from raw RGBA pixels as returned by texture_readPixels,
+ * replacing whatever it had. No image decoding takes place.
+ */
+void texture_loadPixels(struct texture *tex, int width, int height,
+                        const void *pixels)
+        __attribute__((access (read_write, 1)))
+        __attribute__((access (read_only, 4)))
+        __attribute__((nonnull));
+
 /*
  * Bind the texture to use for OpenGL
  */
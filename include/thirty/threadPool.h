@@ -0,0 +1,48 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * A pool of worker threads to split loops over. There's a single pool, shared
+ * by everything, which is only started when something asks for it. The thread
+ * that calls threadPool_parallelFor works too, and it doesn't return until
+ * the whole loop is done, so the workers are idle, asleep, between loops.
+ */
+
+/*
+ * A part of a loop, from first up to but not including last. Several of them
+ * run at the same time on different threads.
+ */
+typedef void(*threadPool_job)(void *args, size_t first, size_t last);
+
+/*
+ * Start the pool with the given amount of workers, or with one less than the
+ * amount of online CPUs if it's 0, since the calling thread works as well.
+ * Does nothing if it's already running.
+ */
+void threadPool_init(size_t threads);
+
+/*
+ * Return the amount of workers, 0 if the pool isn't running.
+ */
+size_t threadPool_threads(void);
+
+/*
+ * Run a loop of count iterations split in chunks of chunkSize, calling job on
+ * each chunk from the workers and from the calling thread, and wait for all of
+ * them to finish. If the pool isn't running the whole loop runs on the calling
+ * thread. Jobs can't start loops of their own.
+ */
+void threadPool_parallelFor(threadPool_job job, void *args,
+                            size_t count, size_t chunkSize)
+        __attribute__((nonnull (1)));
+
+/*
+ * Stop the workers and free all resources used by the pool. Does nothing if
+ * it isn't running.
+ */
+void threadPool_destroy(void);
+
+#endif /* THREADPOOL_H */
@@ -4,14 +4,38 @@
 #include <thirty/component.h>
 #include <cglm/struct.h>
 
+struct scene;
+
 /*
  * This component implements the transform (model) matrix of an object. Every
  * object should have this component.
+ *
+ * A transform is stored as a position, a rotation and a scale relative to the
+ * object's parent, applied in that order: scale first, then rotation, then
+ * translation. Shear can't be represented, matrices with it lose it when
+ * turned into a transform. Rotating something with a non uniform scale rotates
+ * it in its parent's space, after scaling.
+ *
+ * The model matrix composed from them and the world matrix, the product of all
+ * the model matrices from the root down to the object, are cached in the
+ * component and only recomputed when it's dirty: the transform_* functions
+ * below mark it as such, and so does changing the object's parent. The first
+ * time it gets dirty it's queued on its object's scene, which recomputes the
+ * queued matrices, along with the world matrices of all of their descendants,
+ * once per update, see scene_updateTransforms. Code changing the position,
+ * rotation or scale directly must set the dirty flag and queue it itself, see
+ * scene_queueTransform.
  */
 
 struct transform {
         struct component base;
-        mat4s model;
+        vec3s position;  // relative to the parent
+        versors rotation;  // unit quaternion
+        vec3s scale;
+        mat4s model;  // cached, valid only when not dirty
+        mat4s world;  // cached, valid only when not dirty
+        bool dirty;  // changed since model and world were last computed
+        struct scene *scene;  // queued on when it gets dirty, if any
 };
 
 void transform_init(struct transform *trans, mat4s model)
@@ -29,6 +53,14 @@ void transform_initFromFile(struct transform *trans, FILE *f,
  */
 void transform_reset(struct transform *trans);
 
+/*
+ * Set the transform from a model matrix, decomposing it into position,
+ * rotation and scale.
+ */
+void transform_setMatrix(struct transform *trans, mat4s model)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
 /*
  * Translate object model matrix by given vector.
  */
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <dirent.h>
@@ -70,6 +71,12 @@ bool is_safe_multiply(const size_t a, const size_t b)
 float clamp_angle(float angle, float min, float max)
         __attribute__((const));
 
+/*
+ * Return a monotonic timestamp in microseconds, only meaningful when compared
+ * to other timestamps.
+ */
+uint64_t time_micros(void);
+
 /*
  * Exit program.
  * Exit using a call to exit with EXIT_FAILURE as the exit code.
@@ -172,6 +179,13 @@ void sfclose(FILE *stream)
         __attribute__((access (read_write, 1)))
         __attribute__((nonnull));
 
+/*
+ * Return the size in bytes of the file at the given path.
+ */
+size_t sfilesize(const char *pathname)
+        __attribute__((access (read_only, 1)))
+        __attribute__((nonnull));
+
 
 /*
  * Check whether the given filepath is accessible for the given operations in
@@ -0,0 +1,177 @@
+#ifndef VECTORMATH_H
+#define VECTORMATH_H
+
+#include <cglm/struct.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Batched vector math kernels, working on whole arrays of data per call
+ * instead of one element at a time like cglm. Kernels have SSE4.1 versions and,
+ * where the wider registers pay off, AVX2 and AVX-512 ones. The best one the
+ * CPU supports is picked at runtime, with a scalar fallback for everything
+ * else, including non x86 builds. All of them give the same results.
+ */
+
+enum vectorMathLevel {
+        VECTORMATH_SCALAR,
+        VECTORMATH_SSE4,
+        VECTORMATH_AVX2,
+        VECTORMATH_AVX512,
+};
+
+/*
+ * Position, rotation and scale of a batch of transforms, as a structure of
+ * arrays so that the kernels can load the same member of several transforms
+ * at once. Each of the pointers points to an array of 'capacity' floats, all
+ * of them living in one allocation.
+ */
+struct trsArrays {
+        float *px, *py, *pz;
+        float *rx, *ry, *rz, *rw;  // rotation quaternion
+        float *sx, *sy, *sz;
+        size_t capacity;
+};
+
+/*
+ * Initialize the arrays with room for the given amount of transforms.
+ */
+void trsArrays_init(struct trsArrays *trs, size_t capacity)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Make room for at least the given amount of transforms. The contents are
+ * lost if the arrays need to grow.
+ */
+void trsArrays_reserve(struct trsArrays *trs, size_t capacity)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Store a transform at the given index.
+ */
+void trsArrays_set(struct trsArrays *trs, size_t i,
+                   vec3s position, versors rotation, vec3s scale)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+void trsArrays_free(struct trsArrays *trs)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * World space bounds of a batch of objects, each a box aligned to the axes
+ * and a sphere around the same center, as a structure of arrays like
+ * trsArrays.
+ */
+struct boundsArrays {
+        float *cx, *cy, *cz;  // center
+        float *ex, *ey, *ez;  // half the size of the box
+        float *r;  // radius of the sphere
+        size_t capacity;
+};
+
+/*
+ * Initialize the arrays with room for the given amount of bounds.
+ */
+void boundsArrays_init(struct boundsArrays *bounds, size_t capacity)
+        __attribute__((access (write_only, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Make room for at least the given amount of bounds. The contents are lost if
+ * the arrays need to grow.
+ */
+void boundsArrays_reserve(struct boundsArrays *bounds, size_t capacity)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Store bounds at the given index.
+ */
+void boundsArrays_set(struct boundsArrays *bounds, size_t i,
+                      vec3s center, vec3s extents, float radius)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+void boundsArrays_free(struct boundsArrays *bounds)
+        __attribute__((access (read_write, 1)))
+        __attribute__((nonnull));
+
+/*
+ * Return the instruction set the kernels use on this machine.
+ */
+enum vectorMathLevel vectorMath_level(void);
+
+/*
+ * Don't use anything above the given instruction set, even if the CPU
+ * supports it. Meant for benchmarks and for comparing the versions' results.
+ */
+void vectorMath_setMaxLevel(enum vectorMathLevel level);
+
+/*
+ * Compose the first n transforms into model matrices, out[i] being
+ * translate(position) * rotate(rotation) * scale(scale) for the ith one.
+ * Rotations must be unit quaternions.
+ */
+void vectorMath_composeTRS(const struct trsArrays *trs, mat4s *out, size_t n)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (write_only, 2, 3)))
+        __attribute__((nonnull));
+
+/*
+ * Multiply n pairs of matrices, out[i] = a[i] * b[i]. out may be a or b.
+ */
+void vectorMath_mul(const mat4s *a, const mat4s *b, mat4s *out, size_t n)
+        __attribute__((access (read_only, 1, 4)))
+        __attribute__((access (read_only, 2, 4)))
+        __attribute__((access (write_only, 3, 4)))
+        __attribute__((nonnull));
+
+/*
+ * Like vectorMath_mul, but every operand is reached through a pointer, for
+ * matrices that live inside other structures. The products are done in
+ * order, and one's result may be an operand of a later one, so passing
+ * parents before children propagates a whole hierarchy in one call.
+ */
+void vectorMath_mulIndirect(const mat4s *const *a, const mat4s *const *b,
+                            mat4s *const *out, size_t n)
+        __attribute__((access (read_only, 1, 4)))
+        __attribute__((access (read_only, 2, 4)))
+        __attribute__((access (read_only, 3, 4)))
+        __attribute__((nonnull));
+
+/*
+ * Invert n affine matrices, those whose last row is 0, 0, 0, 1, like every
+ * model matrix. The last row isn't even read. out may be m.
+ */
+void vectorMath_invAffine(const mat4s *m, mat4s *out, size_t n)
+        __attribute__((access (read_only, 1, 3)))
+        __attribute__((access (write_only, 2, 3)))
+        __attribute__((nonnull));
+
+/*
+ * Transform n points by an affine matrix, w being 1. out may be points.
+ */
+void vectorMath_transformPoints(mat4s m, const vec3s *points, vec3s *out,
+                                size_t n)
+        __attribute__((access (read_only, 2, 4)))
+        __attribute__((access (write_only, 3, 4)))
+        __attribute__((nonnull));
+
+/*
+ * Test the first n bounds against the six planes of a frustum, as given by
+ * glms_frustum_planes, and set visible[i] to whether the ith one may be
+ * inside of it. Bounds are only outside when all of the box or all of the
+ * sphere is behind one of the planes. Return how many are visible.
+ */
+size_t vectorMath_cullFrustum(const vec4s planes[6],
+                              const struct boundsArrays *bounds,
+                              bool *visible, size_t n)
+        __attribute__((access (read_only, 1)))
+        __attribute__((access (read_only, 2)))
+        __attribute__((access (write_only, 3, 4)))
+        __attribute__((nonnull));
+
+#endif /* VECTORMATH_H */
@@ -0,0 +1,171 @@
+#include <thirty/activeSet.h>
+#include <thirty/scene.h>
+#include <thirty/util.h>
+
+#define ACTIVESET_INITIAL_CAPACITY 16
+
+void activeSet_init(struct activeSet *const set) {
+        growingArray_init(&set->idxs, sizeof(size_t),
+                          ACTIVESET_INITIAL_CAPACITY);
+        growingArray_init(&set->slots, sizeof(size_t),
+                          ACTIVESET_INITIAL_CAPACITY);
+        set->valid = false;
+        set->sorted = false;
+}
+
+void activeSet_invalidate(struct activeSet *const set) {
+        set->valid = false;
+}
+
+void activeSet_invalidateOrder(struct activeSet *const set) {
+        set->sorted = false;
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static bool needsUpdate(const struct object *const object) {
+        return object->onUpdate != NULL ||
+                object_getAnimationCollection(object) != NULL;
+}
+
+// Return the slot entry of the given object, making room for it if it's a new
+// one
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+__attribute__((returns_nonnull))
+static size_t *slotOf(struct activeSet *const set, const size_t idx) {
+        while (set->slots.length <= idx) {
+                size_t *const slot = growingArray_append(&set->slots);
+                *slot = ACTIVESET_NONE;
+        }
+        return growingArray_get(&set->slots, idx);
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void append(struct activeSet *const set, const size_t idx) {
+        *slotOf(set, idx) = set->idxs.length;
+        size_t *const idxPtr = growingArray_append(&set->idxs);
+        *idxPtr = idx;
+}
+
+struct activeEntry {
+        size_t position;  // in the hierarchy
+        size_t idx;
+};
+
+static int compareEntries(const void *const a, const void *const b) {
+        const struct activeEntry *const entryA = a;
+        const struct activeEntry *const entryB = b;
+        return (entryA->position > entryB->position) -
+                (entryA->position < entryB->position);
+}
+
+// Put the set in hierarchy order, dropping removed entries
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void sort(struct activeSet *const set,
+                 const struct hierarchy *const hierarchy) {
+        const size_t *const idxs = set->idxs.data;
+        const size_t *const positions = hierarchy->positions.data;
+        struct activeEntry *const entries = smallocarray(
+                set->idxs.length, sizeof(*entries));
+        size_t n = 0;
+        for (size_t i=0; i<set->idxs.length; i++) {
+                if (idxs[i] != ACTIVESET_NONE) {
+                        entries[n].position = positions[idxs[i]];
+                        entries[n].idx = idxs[i];
+                        n++;
+                }
+        }
+        qsort(entries, n, sizeof(*entries), compareEntries);
+
+        growingArray_clear(&set->idxs);
+        for (size_t i=0; i<n; i++) {
+                append(set, entries[i].idx);
+        }
+        free(entries);
+        set->sorted = true;
+}
+
+void activeSet_update(struct scene *const scene) {
+        struct activeSet *const set = &scene->active;
+        if (!scene->hierarchy.valid) {
+                // Rebuilding it may change the order
+                set->sorted = false;
+        }
+        hierarchy_update(scene);
+
+        if (set->valid) {
+                if (!set->sorted) {
+                        sort(set, &scene->hierarchy);
+                }
+                return;
+        }
+
+        growingArray_clear(&set->idxs);
+        growingArray_clear(&set->slots);
+        const size_t *const idxs = scene->hierarchy.idxs.data;
+        for (size_t i=0; i<scene->hierarchy.idxs.length; i++) {
+                if (needsUpdate(scene_getObjectFromIdxConst(scene, idxs[i]))) {
+                        append(set, idxs[i]);
+                }
+        }
+        set->valid = true;
+        set->sorted = true;
+}
+
+void activeSet_refresh(struct activeSet *const set,
+                       const struct object *const object) {
+        if (!set->valid) {
+                return;
+        }
+
+        size_t *const slot = slotOf(set, object->idx);
+        const bool active = *slot != ACTIVESET_NONE;
+        if (needsUpdate(object) && !active) {
+                // Objects can end up anywhere in the hierarchy
+                append(set, object->idx);
+                set->sorted = false;
+        } else if (!needsUpdate(object) && active) {
+                activeSet_remove(set, object->idx);
+        }
+}
+
+void activeSet_remove(struct activeSet *const set, const size_t idx) {
+        if (!set->valid || idx >= set->slots.length) {
+                return;
+        }
+
+        // Leave a hole, scene_update may be going through the set right now
+        size_t *const slot = growingArray_get(&set->slots, idx);
+        if (*slot != ACTIVESET_NONE) {
+                size_t *const idxPtr = growingArray_get(&set->idxs, *slot);
+                *idxPtr = ACTIVESET_NONE;
+                *slot = ACTIVESET_NONE;
+                set->sorted = false;
+        }
+}
+
+void activeSet_move(struct activeSet *const set,
+                    const size_t from, const size_t to) {
+        if (!set->valid) {
+                return;
+        }
+
+        size_t *const fromSlot = slotOf(set, from);
+        const size_t slot = *fromSlot;
+        *fromSlot = ACTIVESET_NONE;
+        *slotOf(set, to) = slot;
+        if (slot != ACTIVESET_NONE) {
+                size_t *const idx = growingArray_get(&set->idxs, slot);
+                *idx = to;
+        }
+}
+
+void activeSet_free(struct activeSet *const set) {
+        growingArray_destroy(&set->idxs);
+        growingArray_destroy(&set->slots);
+        set->valid = false;
+}
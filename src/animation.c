@@ -15,11 +15,11 @@ void animation_initFromFile(struct animation *const anim,
         }
 }
 
-void animation_bindBones(const struct animation *const anim,
-                         const struct skeleton *const skel,
-                         const float timestamp, const enum shaders shader) {
+void animation_skinningMatrices(const struct animation *const anim,
+                                const struct skeleton *const skel,
+                                const float timestamp, mat4s *const out) {
         if (anim == NULL) { // No animation: bind pose
-                skeleton_bindBones(skel, shader);
+                skeleton_skinningMatrices(skel, out);
                 return;
         }
         
@@ -29,9 +29,10 @@ void animation_bindBones(const struct animation *const anim,
                 struct keyframe *keyframe = anim->keyframes + i;
                 if (keyframe->timestamp > timestamp) {
                         if (i == 0) {
-                                // Animation's first frame takes place before
+                                // Animation's first frame takes place after
                                 // the current timestamp, so don't begin
-                                // playing the animation yet?
+                                // playing the animation yet
+                                skeleton_skinningMatrices(skel, out);
                                 return;
                         }
                         prev = keyframe - 1;
@@ -44,7 +45,7 @@ void animation_bindBones(const struct animation *const anim,
                (prev != NULL && next != NULL));
         if (prev == NULL) {
                 // No frames in this animation, don't do anything.
-                skeleton_bindBones(skel, shader);
+                skeleton_skinningMatrices(skel, out);
                 return;
         }
 
@@ -55,7 +56,7 @@ void animation_bindBones(const struct animation *const anim,
 
         struct skeleton posedSkeleton;
         skeleton_initFromKeyframe(&posedSkeleton, skel, &result);
-        skeleton_bindBones(&posedSkeleton, shader);
+        skeleton_skinningMatrices(&posedSkeleton, out);
         skeleton_free(&posedSkeleton);
 
         keyframe_free(&result);
@@ -67,15 +67,15 @@ void animationCollection_setBindPose(struct animationCollection *col) {
         col->current = 0;
 }
 
-void animationCollection_bindBones(const struct animationCollection *const col,
-                                   const enum shaders shader) {
+void animationCollection_skinningMatrices(
+        const struct animationCollection *const col, mat4s *const out) {
         assert(col->base.type == COMPONENT_ANIMATIONCOLLECTION);
         
         if (col->current > 0) {
-                animation_bindBones(&col->animations[col->current-1],
-                                    &col->skeleton, col->time, shader);
+                animation_skinningMatrices(&col->animations[col->current-1],
+                                           &col->skeleton, col->time, out);
         } else {
-                animation_bindBones(NULL, &col->skeleton, 0.0F, shader);
+                animation_skinningMatrices(NULL, &col->skeleton, 0.0F, out);
         }
 }
 
@@ -101,7 +101,12 @@ void animationCollection_update(struct animationCollection *const col,
 void animationCollection_free(struct animationCollection *col) {
         assert(col->base.type == COMPONENT_ANIMATIONCOLLECTION);
         
+        // Borrowed collections point into memory they don't own
+        const bool borrowed = col->base.borrowed;
         component_free(&col->base);
+        if (borrowed) {
+                return;
+        }
         skeleton_free(&col->skeleton);
         for (size_t i=0; i<col->nanimations; i++) {
                 animation_free(&col->animations[i]);
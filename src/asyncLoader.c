@@ -19,6 +19,7 @@ struct loader {
 
 static sem_t semaphore;
 static pthread_mutex_t mutex;
+static pthread_cond_t readFinished;  // a worker finished a read
 static struct growingArray queue;
 static size_t tail;
 static size_t reapTail;
@@ -55,6 +56,7 @@ static void *worker(void *args) {
                 {
                         struct loader *ptr = growingArray_get(&queue, idx);
                         ptr->finished = true;
+                        pthread_cond_broadcast(&readFinished);
                 }
                 pthread_mutex_unlock(&mutex);
         }
@@ -69,6 +71,7 @@ void asyncLoader_init(void) {
         
         sem_init(&semaphore, 0, 0);
         pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&readFinished, NULL);
         
         for (int i=0; i<THREADS; i++) {
                 pthread_create(&threads[i], NULL, worker, NULL);
@@ -143,6 +146,25 @@ bool asyncLoader_await(size_t *sizePtr) {
         return true;
 }
 
+void asyncLoader_finish(void) {
+        size_t size;
+        do {
+                // Sleep until the next read to reap is done, if it isn't
+                pthread_mutex_lock(&mutex);
+                {
+                        while (reapTail < queue.length) {
+                                const struct loader *const ptr =
+                                        growingArray_get(&queue, reapTail);
+                                if (ptr->finished) {
+                                        break;
+                                }
+                                pthread_cond_wait(&readFinished, &mutex);
+                        }
+                }
+                pthread_mutex_unlock(&mutex);
+        } while (asyncLoader_await(&size));
+}
+
 size_t asyncLoader_totalSize(void) {
         return totalSize;
 }
@@ -157,6 +179,7 @@ void asyncLoader_destroy(void) {
                 assert(ret == PTHREAD_CANCELED);
         }
 
+        pthread_cond_destroy(&readFinished);
         pthread_mutex_destroy(&mutex);
         sem_destroy(&semaphore);
 
@@ -0,0 +1,104 @@
+#include <thirty/bonePalette.h>
+#include <thirty/animationCollection.h>
+#include <thirty/util.h>
+
+#define BONEPALETTE_INITIAL_MATRICES 256
+#define BONEPALETTE_INITIAL_COLLECTIONS 16
+
+// Where a collection's matrices are, valid only in the frame it was added
+struct bonePaletteOffset {
+        size_t frame;
+        size_t offset;
+};
+
+void bonePalette_init(struct bonePalette *const palette) {
+        growingArray_init(&palette->matrices, sizeof(mat4s),
+                          BONEPALETTE_INITIAL_MATRICES);
+        growingArray_init(&palette->offsets, sizeof(struct bonePaletteOffset),
+                          BONEPALETTE_INITIAL_COLLECTIONS);
+        palette->frame = 0;
+        palette->capacity = BONEPALETTE_INITIAL_MATRICES;
+
+        glGenBuffers(1, &palette->buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, palette->buffer);
+        glBufferData(GL_TEXTURE_BUFFER,
+                     (GLsizeiptr)(palette->capacity * sizeof(mat4s)), NULL,
+                     GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glGenTextures(1, &palette->texture);
+        glActiveTexture(GL_TEXTURE0 + BONEPALETTE_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, palette->texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, palette->buffer);
+}
+
+void bonePalette_begin(struct bonePalette *const palette) {
+        palette->frame++;
+        growingArray_clear(&palette->matrices);
+}
+
+void bonePalette_add(struct bonePalette *const palette,
+                     const struct animationCollection *const col) {
+        const size_t idx = col->base.idx;
+        while (palette->offsets.length <= idx) {
+                struct bonePaletteOffset *const offset = growingArray_append(
+                        &palette->offsets);
+                offset->frame = 0;
+                offset->offset = 0;
+        }
+        struct bonePaletteOffset *const offset = growingArray_get(
+                &palette->offsets, idx);
+        if (offset->frame == palette->frame) {
+                return;
+        }
+        offset->frame = palette->frame;
+        offset->offset = palette->matrices.length;
+
+        const size_t nbones = col->skeleton.nbones;
+        growingArray_reserve(&palette->matrices, nbones);
+        for (size_t i=0; i<nbones; i++) {
+                growingArray_append(&palette->matrices);
+        }
+        if (nbones > 0) {
+                animationCollection_skinningMatrices(
+                        col, growingArray_get(&palette->matrices,
+                                              offset->offset));
+        }
+}
+
+void bonePalette_end(struct bonePalette *const palette) {
+        const size_t count = palette->matrices.length;
+        glBindBuffer(GL_TEXTURE_BUFFER, palette->buffer);
+        if (count > palette->capacity) {
+                while (palette->capacity < count) {
+                        palette->capacity *= 2;
+                }
+                glBufferData(GL_TEXTURE_BUFFER,
+                             (GLsizeiptr)(palette->capacity * sizeof(mat4s)),
+                             NULL, GL_STREAM_DRAW);
+        }
+        if (count > 0) {
+                glBufferSubData(GL_TEXTURE_BUFFER, 0,
+                                (GLsizeiptr)(count * sizeof(mat4s)),
+                                palette->matrices.data);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glActiveTexture(GL_TEXTURE0 + BONEPALETTE_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, palette->texture);
+}
+
+size_t bonePalette_offset(const struct bonePalette *const palette,
+                          const struct animationCollection *const col) {
+        const struct bonePaletteOffset *const offset = growingArray_get(
+                &palette->offsets, col->base.idx);
+        assert(offset->frame == palette->frame);
+        return offset->offset;
+}
+
+void bonePalette_free(struct bonePalette *const palette) {
+        glDeleteTextures(1, &palette->texture);
+        glDeleteBuffers(1, &palette->buffer);
+        growingArray_destroy(&palette->matrices);
+        growingArray_destroy(&palette->offsets);
+}
@@ -0,0 +1,792 @@
+#include <thirty/bvh.h>
+#include <thirty/scene.h>
+#include <thirty/util.h>
+
+#define BVH_INITIAL_CAPACITY 16
+#define BVH_BINS 16  // candidate splits per axis when building
+#define BVH_REBUILD_FACTOR 1.5  // of the cost after the last build
+
+// Half the surface area, which is just as good for comparing costs
+__attribute__((const))
+static float area(const vec3s min, const vec3s max) {
+        const vec3s size = glms_vec3_sub(max, min);
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+// Nodes are never removed from the array, so it has no holes and can be
+// indexed directly, which queries and builds do a lot
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+__attribute__((returns_nonnull))
+static inline struct bvhNode *node(const struct bvh *const bvh,
+                                   const size_t n) {
+        assert(n < bvh->nodes.length);
+        return (struct bvhNode*)bvh->nodes.data + n;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static size_t allocNode(struct bvh *const bvh) {
+        size_t n = bvh->freeNode;
+        if (n != BVH_NONE) {
+                bvh->freeNode = node(bvh, n)->parent;
+        } else {
+                growingArray_append(&bvh->nodes);
+                n = bvh->nodes.length - 1;
+        }
+        struct bvhNode *const new = node(bvh, n);
+        new->parent = BVH_NONE;
+        new->left = BVH_NONE;
+        new->right = BVH_NONE;
+        new->object = 0;
+        return n;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void freeNode(struct bvh *const bvh, const size_t n) {
+        struct bvhNode *const old = node(bvh, n);
+        if (old->left != BVH_NONE) {
+                bvh->area -= area(old->min, old->max);
+        }
+        old->parent = bvh->freeNode;
+        bvh->freeNode = n;
+}
+
+// Change the box of a node, keeping track of the internal nodes' area
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void setBox(struct bvh *const bvh, const size_t n, const vec3s min,
+                   const vec3s max) {
+        struct bvhNode *const changed = node(bvh, n);
+        if (changed->left != BVH_NONE) {
+                bvh->area += area(min, max) - area(changed->min, changed->max);
+        }
+        changed->min = min;
+        changed->max = max;
+}
+
+// Make the boxes from the given node up to the root fit their children again,
+// stopping as soon as one doesn't change
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void refit(struct bvh *const bvh, size_t n) {
+        while (n != BVH_NONE) {
+                const struct bvhNode *const current = node(bvh, n);
+                const struct bvhNode *const left = node(bvh, current->left);
+                const struct bvhNode *const right = node(bvh, current->right);
+                const vec3s min = glms_vec3_minv(left->min, right->min);
+                const vec3s max = glms_vec3_maxv(left->max, right->max);
+                if (memcmp(&min, &current->min, sizeof(min)) == 0 &&
+                    memcmp(&max, &current->max, sizeof(max)) == 0) {
+                        return;
+                }
+                setBox(bvh, n, min, max);
+                n = current->parent;
+        }
+}
+
+// Replace the parent's link to a child with another node
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void replaceChild(struct bvh *const bvh, const size_t parent,
+                         const size_t child, const size_t with) {
+        node(bvh, with)->parent = parent;
+        if (parent == BVH_NONE) {
+                bvh->root = with;
+                return;
+        }
+        struct bvhNode *const p = node(bvh, parent);
+        if (p->left == child) {
+                p->left = with;
+        } else {
+                assert(p->right == child);
+                p->right = with;
+        }
+}
+
+// Find the node whose sibling a new leaf should be: going down from the root
+// while making the leaf a child's sibling instead of this node's is cheaper,
+// counting what the new parent costs and how much every box above grows
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static size_t findSibling(const struct bvh *const bvh, const vec3s min,
+                          const vec3s max) {
+        size_t n = bvh->root;
+        float inherited = 0;  // growth of the boxes above
+        while (true) {
+                const struct bvhNode *const current = node(bvh, n);
+                if (current->left == BVH_NONE) {
+                        return n;
+                }
+
+                const float currentArea = area(current->min, current->max);
+                const float combined = area(
+                        glms_vec3_minv(current->min, min),
+                        glms_vec3_maxv(current->max, max));
+                const float here = combined + inherited;
+                inherited += combined - currentArea;
+
+                float childCost[2];
+                const size_t children[2] = {current->left, current->right};
+                for (size_t i=0; i<2; i++) {
+                        const struct bvhNode *const child = node(
+                                bvh, children[i]);
+                        const float childArea = area(child->min, child->max);
+                        const float grown = area(
+                                glms_vec3_minv(child->min, min),
+                                glms_vec3_maxv(child->max, max));
+                        // Leaves get a new parent, internal nodes just grow
+                        childCost[i] = inherited + (child->left == BVH_NONE ?
+                                                    grown : grown - childArea);
+                }
+
+                if (here <= childCost[0] && here <= childCost[1]) {
+                        return n;
+                }
+                n = childCost[0] <= childCost[1] ? children[0] : children[1];
+        }
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static size_t *leafOf(struct bvh *const bvh, const size_t idx) {
+        while (bvh->leaves.length <= idx) {
+                size_t *const leaf = growingArray_append(&bvh->leaves);
+                *leaf = BVH_NONE;
+        }
+        return growingArray_get(&bvh->leaves, idx);
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void insert(struct bvh *const bvh, const size_t idx, const vec3s min,
+                   const vec3s max) {
+        const size_t leaf = allocNode(bvh);
+        struct bvhNode *const leafNode = node(bvh, leaf);
+        leafNode->min = min;
+        leafNode->max = max;
+        leafNode->object = idx;
+        *leafOf(bvh, idx) = leaf;
+        bvh->count++;
+
+        if (bvh->root == BVH_NONE) {
+                bvh->root = leaf;
+                return;
+        }
+
+        const size_t sibling = findSibling(bvh, min, max);
+        const size_t parent = allocNode(bvh);
+        const size_t grandParent = node(bvh, sibling)->parent;
+        replaceChild(bvh, grandParent, sibling, parent);
+        struct bvhNode *const parentNode = node(bvh, parent);
+        parentNode->left = sibling;
+        parentNode->right = leaf;
+        // Counted as internal from now on
+        parentNode->min = min;
+        parentNode->max = min;
+        node(bvh, sibling)->parent = parent;
+        node(bvh, leaf)->parent = parent;
+        refit(bvh, parent);
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void removeLeaf(struct bvh *const bvh, const size_t leaf) {
+        const size_t parent = node(bvh, leaf)->parent;
+        if (parent == BVH_NONE) {
+                bvh->root = BVH_NONE;
+        } else {
+                const struct bvhNode *const parentNode = node(bvh, parent);
+                const size_t sibling = parentNode->left == leaf ?
+                        parentNode->right : parentNode->left;
+                const size_t grandParent = parentNode->parent;
+                replaceChild(bvh, grandParent, parent, sibling);
+                freeNode(bvh, parent);
+                if (grandParent != BVH_NONE) {
+                        refit(bvh, grandParent);
+                }
+        }
+        freeNode(bvh, leaf);
+        bvh->count--;
+}
+
+void bvh_init(struct bvh *const bvh) {
+        growingArray_init(&bvh->nodes, sizeof(struct bvhNode),
+                          BVH_INITIAL_CAPACITY);
+        growingArray_init(&bvh->leaves, sizeof(size_t), BVH_INITIAL_CAPACITY);
+        bvh->root = BVH_NONE;
+        bvh->freeNode = BVH_NONE;
+        bvh->count = 0;
+        bvh->area = 0;
+        bvh->builtCost = 0;
+        bvh->valid = false;
+}
+
+void bvh_invalidate(struct bvh *const bvh) {
+        bvh->valid = false;
+}
+
+// How much worse than a fresh build the tree is for queries
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static double cost(const struct bvh *const bvh) {
+        if (bvh->root == BVH_NONE) {
+                return 0;
+        }
+        const struct bvhNode *const root = node(bvh, bvh->root);
+        const float rootArea = area(root->min, root->max);
+        return rootArea > 0 ? bvh->area / rootArea : 0;
+}
+
+
+/// Building ///
+
+// A range of leaves still to be split, and where the node made of them goes
+struct buildTask {
+        size_t parent;  // BVH_NONE for the root
+        bool right;
+        size_t first;
+        size_t count;
+};
+
+struct bin {
+        vec3s min;
+        vec3s max;
+        size_t count;
+};
+
+// Which bin a leaf's center falls into
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static size_t binOf(const struct bvhNode *const leaf, const size_t axis,
+                    const float start, const float scale) {
+        const float center = (leaf->min.raw[axis] + leaf->max.raw[axis]) / 2;
+        const float bin = (center - start) * scale;
+        if (bin <= 0) {
+                return 0;
+        }
+        return bin >= BVH_BINS - 1 ? BVH_BINS - 1 : (size_t)bin;
+}
+
+// Return where to split the range of leaves, after putting those going to
+// the first half before the rest, and store the range's bounds
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((access (write_only, 5)))
+__attribute__((access (write_only, 6)))
+__attribute__((nonnull))
+static size_t split(const struct bvh *const bvh, size_t *const order,
+                    const size_t first, const size_t count,
+                    vec3s *const min, vec3s *const max) {
+        const struct bvhNode *const leaf = node(bvh, order[first]);
+        *min = leaf->min;
+        *max = leaf->max;
+        vec3s centerMin = glms_vec3_scale(glms_vec3_add(leaf->min, leaf->max),
+                                          0.5f);
+        vec3s centerMax = centerMin;
+        for (size_t i=first+1; i<first+count; i++) {
+                const struct bvhNode *const other = node(bvh, order[i]);
+                *min = glms_vec3_minv(*min, other->min);
+                *max = glms_vec3_maxv(*max, other->max);
+                const vec3s center = glms_vec3_scale(
+                        glms_vec3_add(other->min, other->max), 0.5f);
+                centerMin = glms_vec3_minv(centerMin, center);
+                centerMax = glms_vec3_maxv(centerMax, center);
+        }
+
+        // Along the axis the centers are most spread on
+        const vec3s spread = glms_vec3_sub(centerMax, centerMin);
+        size_t axis = 0;
+        if (spread.y > spread.raw[axis]) {
+                axis = 1;
+        }
+        if (spread.z > spread.raw[axis]) {
+                axis = 2;
+        }
+        const size_t half = first + count / 2;
+        if (spread.raw[axis] <= 0) {
+                return half;
+        }
+        const float start = centerMin.raw[axis];
+        const float scale = BVH_BINS / spread.raw[axis];
+
+        struct bin bins[BVH_BINS];
+        for (size_t b=0; b<BVH_BINS; b++) {
+                bins[b].count = 0;
+        }
+        for (size_t i=first; i<first+count; i++) {
+                const struct bvhNode *const other = node(bvh, order[i]);
+                struct bin *const bin = &bins[binOf(other, axis, start,
+                                                    scale)];
+                if (bin->count == 0) {
+                        bin->min = other->min;
+                        bin->max = other->max;
+                } else {
+                        bin->min = glms_vec3_minv(bin->min, other->min);
+                        bin->max = glms_vec3_maxv(bin->max, other->max);
+                }
+                bin->count++;
+        }
+
+        // Cost of splitting after each bin: the area of each side times how
+        // many leaves it has, sweeping from the right and then the left
+        float rightCosts[BVH_BINS];
+        vec3s sideMin = *min;
+        vec3s sideMax = *max;
+        size_t sideCount = 0;
+        for (size_t b=BVH_BINS-1; b>0; b--) {
+                if (bins[b].count > 0) {
+                        if (sideCount == 0) {
+                                sideMin = bins[b].min;
+                                sideMax = bins[b].max;
+                        }
+                        sideMin = glms_vec3_minv(sideMin, bins[b].min);
+                        sideMax = glms_vec3_maxv(sideMax, bins[b].max);
+                        sideCount += bins[b].count;
+                }
+                rightCosts[b - 1] = sideCount == 0 ? 0 :
+                        area(sideMin, sideMax) * (float)sideCount;
+        }
+        size_t best = BVH_BINS;
+        float bestCost = 0;
+        sideCount = 0;
+        for (size_t b=0; b<BVH_BINS-1; b++) {
+                if (bins[b].count > 0) {
+                        if (sideCount == 0) {
+                                sideMin = bins[b].min;
+                                sideMax = bins[b].max;
+                        }
+                        sideMin = glms_vec3_minv(sideMin, bins[b].min);
+                        sideMax = glms_vec3_maxv(sideMax, bins[b].max);
+                        sideCount += bins[b].count;
+                }
+                if (sideCount == 0 || sideCount == count) {
+                        continue;
+                }
+                const float splitCost = area(sideMin, sideMax) *
+                        (float)sideCount + rightCosts[b];
+                if (best == BVH_BINS || splitCost < bestCost) {
+                        best = b;
+                        bestCost = splitCost;
+                }
+        }
+        if (best == BVH_BINS) {
+                return half;
+        }
+
+        size_t middle = first;
+        for (size_t i=first; i<first+count; i++) {
+                if (binOf(node(bvh, order[i]), axis, start, scale) <= best) {
+                        const size_t swap = order[middle];
+                        order[middle] = order[i];
+                        order[i] = swap;
+                        middle++;
+                }
+        }
+        assert(middle > first && middle < first + count);
+        return middle;
+}
+
+void bvh_build(struct bvh *const bvh, const size_t *const idxs,
+               const vec3s *const mins, const vec3s *const maxs,
+               const size_t n) {
+        growingArray_clear(&bvh->nodes);
+        growingArray_clear(&bvh->leaves);
+        bvh->root = BVH_NONE;
+        bvh->freeNode = BVH_NONE;
+        bvh->count = n;
+        bvh->area = 0;
+        bvh->valid = true;
+
+        // Leaves first, so that leaf i is node i
+        if (n > 0) {
+                growingArray_reserve(&bvh->nodes, n * 2 - 1);
+        }
+        size_t *const order = smallocarray(n, sizeof(size_t));
+        for (size_t i=0; i<n; i++) {
+                const size_t leaf = allocNode(bvh);
+                struct bvhNode *const leafNode = node(bvh, leaf);
+                leafNode->min = mins[i];
+                leafNode->max = maxs[i];
+                leafNode->object = idxs[i];
+                *leafOf(bvh, idxs[i]) = leaf;
+                order[i] = leaf;
+        }
+
+        // Top down, without recursing since badly spread objects can make
+        // for very deep trees
+        struct growingArray tasks;
+        growingArray_init(&tasks, sizeof(struct buildTask),
+                          BVH_INITIAL_CAPACITY);
+        if (n > 0) {
+                struct buildTask *const task = growingArray_append(&tasks);
+                task->parent = BVH_NONE;
+                task->right = false;
+                task->first = 0;
+                task->count = n;
+        }
+        while (tasks.length > 0) {
+                const struct buildTask task =
+                        *(struct buildTask*)growingArray_peek(&tasks);
+                growingArray_pop(&tasks);
+
+                size_t built = order[task.first];
+                if (task.count > 1) {
+                        vec3s min, max;
+                        const size_t middle = split(bvh, order, task.first,
+                                                    task.count, &min, &max);
+                        built = allocNode(bvh);
+                        struct bvhNode *const internal = node(bvh, built);
+                        internal->min = min;
+                        internal->max = max;
+                        bvh->area += area(min, max);
+
+                        struct buildTask *const left = growingArray_append(
+                                &tasks);
+                        left->parent = built;
+                        left->right = false;
+                        left->first = task.first;
+                        left->count = middle - task.first;
+                        struct buildTask *const right = growingArray_append(
+                                &tasks);
+                        right->parent = built;
+                        right->right = true;
+                        right->first = middle;
+                        right->count = task.first + task.count - middle;
+                }
+
+                node(bvh, built)->parent = task.parent;
+                if (task.parent == BVH_NONE) {
+                        bvh->root = built;
+                } else if (task.right) {
+                        node(bvh, task.parent)->right = built;
+                } else {
+                        node(bvh, task.parent)->left = built;
+                }
+        }
+        growingArray_destroy(&tasks);
+        free(order);
+
+        bvh->builtCost = cost(bvh);
+}
+
+void bvh_rebuild(struct bvh *const bvh) {
+        size_t *const idxs = smallocarray(bvh->count, sizeof(size_t));
+        vec3s *const mins = smallocarray(bvh->count, sizeof(vec3s));
+        vec3s *const maxs = smallocarray(bvh->count, sizeof(vec3s));
+        size_t n = 0;
+        const size_t *const leaves = bvh->leaves.data;
+        for (size_t idx=0; idx<bvh->leaves.length; idx++) {
+                if (leaves[idx] != BVH_NONE) {
+                        const struct bvhNode *const leaf = node(
+                                bvh, leaves[idx]);
+                        idxs[n] = idx;
+                        mins[n] = leaf->min;
+                        maxs[n] = leaf->max;
+                        n++;
+                }
+        }
+        assert(n == bvh->count);
+        bvh_build(bvh, idxs, mins, maxs, n);
+        free(maxs);
+        free(mins);
+        free(idxs);
+}
+
+// Store the object's world bounds, return whether it has any
+__attribute__((access (read_only, 1)))
+__attribute__((access (write_only, 2)))
+__attribute__((access (write_only, 3)))
+__attribute__((nonnull))
+static bool objectBounds(const struct object *const object,
+                         vec3s *const min, vec3s *const max) {
+        const struct geometry *const geometry = object_getGeometry(object);
+        const struct transform *const trans = object_getTransform(object);
+        if (object->idx == 0 || geometry == NULL || trans == NULL) {
+                return false;
+        }
+        struct geometryBounds bounds;
+        geometry_worldBounds(geometry, trans->world, &bounds);
+        *min = glms_vec3_sub(bounds.center, bounds.extents);
+        *max = glms_vec3_add(bounds.center, bounds.extents);
+        return true;
+}
+
+void bvh_update(struct scene *const scene) {
+        struct bvh *const bvh = &scene->bvh;
+        if (bvh->valid) {
+                if (cost(bvh) > bvh->builtCost * BVH_REBUILD_FACTOR) {
+                        bvh_rebuild(bvh);
+                }
+                return;
+        }
+
+        hierarchy_update(scene);
+        const size_t length = scene->hierarchy.idxs.length;
+        const size_t *const objectIdxs = scene->hierarchy.idxs.data;
+        size_t *const idxs = smallocarray(length, sizeof(size_t));
+        vec3s *const mins = smallocarray(length, sizeof(vec3s));
+        vec3s *const maxs = smallocarray(length, sizeof(vec3s));
+        size_t n = 0;
+        for (size_t i=0; i<length; i++) {
+                if (objectBounds(scene_getObjectFromIdxConst(
+                                         scene, objectIdxs[i]),
+                                 &mins[n], &maxs[n])) {
+                        idxs[n] = objectIdxs[i];
+                        n++;
+                }
+        }
+        bvh_build(bvh, idxs, mins, maxs, n);
+        free(maxs);
+        free(mins);
+        free(idxs);
+}
+
+void bvh_set(struct bvh *const bvh, const size_t idx, const vec3s min,
+             const vec3s max) {
+        assert(bvh->valid);
+        const size_t leaf = *leafOf(bvh, idx);
+        if (leaf == BVH_NONE) {
+                insert(bvh, idx, min, max);
+                return;
+        }
+        setBox(bvh, leaf, min, max);
+        const size_t parent = node(bvh, leaf)->parent;
+        if (parent != BVH_NONE) {
+                refit(bvh, parent);
+        }
+}
+
+void bvh_refresh(struct bvh *const bvh, const struct object *const object) {
+        if (!bvh->valid) {
+                return;
+        }
+        vec3s min, max;
+        if (objectBounds(object, &min, &max)) {
+                bvh_set(bvh, object->idx, min, max);
+        } else {
+                bvh_remove(bvh, object->idx);
+        }
+}
+
+bool bvh_contains(const struct bvh *const bvh, const size_t idx) {
+        if (idx >= bvh->leaves.length) {
+                return false;
+        }
+        const size_t *const leaf = growingArray_get(&bvh->leaves, idx);
+        return *leaf != BVH_NONE;
+}
+
+void bvh_remove(struct bvh *const bvh, const size_t idx) {
+        if (!bvh->valid || !bvh_contains(bvh, idx)) {
+                return;
+        }
+        size_t *const leaf = growingArray_get(&bvh->leaves, idx);
+        removeLeaf(bvh, *leaf);
+        *leaf = BVH_NONE;
+}
+
+void bvh_move(struct bvh *const bvh, const size_t from, const size_t to) {
+        if (!bvh->valid || !bvh_contains(bvh, from)) {
+                return;
+        }
+        size_t *const fromLeaf = growingArray_get(&bvh->leaves, from);
+        const size_t leaf = *fromLeaf;
+        *fromLeaf = BVH_NONE;
+        size_t *const toLeaf = leafOf(bvh, to);
+        assert(*toLeaf == BVH_NONE);
+        *toLeaf = leaf;
+        node(bvh, leaf)->object = to;
+}
+
+
+/// Queries ///
+
+// All of them go through the tree without a stack, using the parent links:
+// coming from a node's parent it's tested and, if it passes, its left child is
+// next, coming from its left child the right one is, and coming from its right
+// child or failing the test its parent is.
+
+enum frustumTest {
+        FRUSTUM_OUTSIDE,
+        FRUSTUM_PARTIAL,
+        FRUSTUM_INSIDE,
+};
+
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static enum frustumTest testFrustum(const struct bvhNode *const box,
+                                    const vec4s planes[6]) {
+        enum frustumTest result = FRUSTUM_INSIDE;
+        for (size_t p=0; p<6; p++) {
+                // The corners farthest along and against the plane's normal
+                vec3s far, near;
+                for (size_t axis=0; axis<3; axis++) {
+                        const bool positive = planes[p].raw[axis] > 0;
+                        far.raw[axis] = positive ?
+                                box->max.raw[axis] : box->min.raw[axis];
+                        near.raw[axis] = positive ?
+                                box->min.raw[axis] : box->max.raw[axis];
+                }
+                const vec3s normal = glms_vec3(planes[p]);
+                if (glms_vec3_dot(normal, far) + planes[p].w < 0) {
+                        return FRUSTUM_OUTSIDE;
+                }
+                if (glms_vec3_dot(normal, near) + planes[p].w < 0) {
+                        result = FRUSTUM_PARTIAL;
+                }
+        }
+        return result;
+}
+
+void bvh_queryFrustum(const struct bvh *const bvh, const vec4s planes[6],
+                      struct growingArray *const results) {
+        size_t inside = BVH_NONE;  // node everything below of is inside
+        size_t previous = BVH_NONE;
+        size_t current = bvh->root;
+        while (current != BVH_NONE) {
+                const struct bvhNode *const n = node(bvh, current);
+                size_t next = n->parent;
+                if (previous == n->parent) {
+                        bool pass = true;
+                        if (inside == BVH_NONE) {
+                                const enum frustumTest test = testFrustum(
+                                        n, planes);
+                                pass = test != FRUSTUM_OUTSIDE;
+                                if (test == FRUSTUM_INSIDE) {
+                                        inside = current;
+                                }
+                        }
+                        if (pass && n->left == BVH_NONE) {
+                                size_t *const result = growingArray_append(
+                                        results);
+                                *result = n->object;
+                        } else if (pass) {
+                                next = n->left;
+                        }
+                } else if (previous == n->left) {
+                        next = n->right;
+                }
+                if (next == n->parent && inside == current) {
+                        inside = BVH_NONE;
+                }
+                previous = current;
+                current = next;
+        }
+}
+
+void bvh_queryBox(const struct bvh *const bvh, const vec3s min,
+                  const vec3s max, struct growingArray *const results) {
+        size_t previous = BVH_NONE;
+        size_t current = bvh->root;
+        while (current != BVH_NONE) {
+                const struct bvhNode *const n = node(bvh, current);
+                size_t next = n->parent;
+                if (previous == n->parent) {
+                        const bool pass =
+                                n->min.x <= max.x && n->max.x >= min.x &&
+                                n->min.y <= max.y && n->max.y >= min.y &&
+                                n->min.z <= max.z && n->max.z >= min.z;
+                        if (pass && n->left == BVH_NONE) {
+                                size_t *const result = growingArray_append(
+                                        results);
+                                *result = n->object;
+                        } else if (pass) {
+                                next = n->left;
+                        }
+                } else if (previous == n->left) {
+                        next = n->right;
+                }
+                previous = current;
+                current = next;
+        }
+}
+
+void bvh_querySphere(const struct bvh *const bvh, const vec3s center,
+                     const float radius, struct growingArray *const results) {
+        const float radius2 = radius * radius;
+        size_t previous = BVH_NONE;
+        size_t current = bvh->root;
+        while (current != BVH_NONE) {
+                const struct bvhNode *const n = node(bvh, current);
+                size_t next = n->parent;
+                if (previous == n->parent) {
+                        // Distance to the closest point of the box
+                        const vec3s closest = glms_vec3_maxv(
+                                n->min, glms_vec3_minv(center, n->max));
+                        const bool pass = glms_vec3_distance2(
+                                center, closest) <= radius2;
+                        if (pass && n->left == BVH_NONE) {
+                                size_t *const result = growingArray_append(
+                                        results);
+                                *result = n->object;
+                        } else if (pass) {
+                                next = n->left;
+                        }
+                } else if (previous == n->left) {
+                        next = n->right;
+                }
+                previous = current;
+                current = next;
+        }
+}
+
+// Return the distance along the ray at which it enters the box, or a negative
+// one if it doesn't before maxDistance
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static float rayEnters(const struct bvhNode *const box, const vec3s origin,
+                       const vec3s inverse, const float maxDistance) {
+        float enter = 0;
+        float exit = maxDistance;
+        for (size_t axis=0; axis<3; axis++) {
+                const float t1 = (box->min.raw[axis] - origin.raw[axis]) *
+                        inverse.raw[axis];
+                const float t2 = (box->max.raw[axis] - origin.raw[axis]) *
+                        inverse.raw[axis];
+                // Parallel rays give NaN on the box's sides, which these
+                // ignore
+                enter = fmaxf(enter, fminf(t1, t2));
+                exit = fminf(exit, fmaxf(t1, t2));
+        }
+        return enter <= exit ? enter : -1;
+}
+
+size_t bvh_queryRay(const struct bvh *const bvh, const vec3s origin,
+                    const vec3s direction, const float maxDistance,
+                    float *const distance) {
+        const vec3s inverse = glms_vec3_div(glms_vec3_one(), direction);
+        size_t hit = 0;
+        float closest = maxDistance;
+        size_t previous = BVH_NONE;
+        size_t current = bvh->root;
+        while (current != BVH_NONE) {
+                const struct bvhNode *const n = node(bvh, current);
+                size_t next = n->parent;
+                if (previous == n->parent) {
+                        // Boxes behind the closest hit so far can't have a
+                        // closer one
+                        const float enter = rayEnters(n, origin, inverse,
+                                                      closest);
+                        if (enter >= 0 && n->left == BVH_NONE) {
+                                hit = n->object;
+                                closest = enter;
+                        } else if (enter >= 0) {
+                                next = n->left;
+                        }
+                } else if (previous == n->left) {
+                        next = n->right;
+                }
+                previous = current;
+                current = next;
+        }
+        *distance = closest;
+        return hit;
+}
+
+void bvh_free(struct bvh *const bvh) {
+        growingArray_destroy(&bvh->nodes);
+        growingArray_destroy(&bvh->leaves);
+}
@@ -1,4 +1,5 @@
 #include <thirty/camera.h>
+#include <thirty/vectorMath.h>
 #include <thirty/util.h>
 
 void camera_init(struct camera *const cam, const char *const name,
@@ -48,7 +49,9 @@ size_t camera_initFromFile(struct camera *const cam, FILE *const f,
 
 mat4s camera_viewMatrix(const struct camera *const cam, mat4s model) {
         assert(cam->base.type == COMPONENT_CAMERA);
-        return glms_mat4_inv(model);
+        mat4s view;
+        vectorMath_invAffine(&model, &view, 1);
+        return view;
 }
 
 mat4s camera_projectionMatrix(const struct camera *const cam) {
@@ -0,0 +1,46 @@
+#include <thirty/cameraBuffer.h>
+#include <thirty/shader.h>
+#include <thirty/vectorMath.h>
+#include <thirty/util.h>
+
+void cameraBuffer_init(struct cameraBuffer *const buffer) {
+        memset(&buffer->data, 0, sizeof(buffer->data));
+        buffer->uploaded = false;
+
+        glGenBuffers(1, &buffer->ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer->ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(buffer->data), NULL,
+                     GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void cameraBuffer_update(struct cameraBuffer *const buffer,
+                         const mat4s cameraModel, const mat4s projection) {
+        struct cameraBufferData *const data = &buffer->data;
+        if (!buffer->uploaded ||
+            memcmp(&cameraModel, &data->invView, sizeof(cameraModel)) != 0 ||
+            memcmp(&projection, &data->projection, sizeof(projection)) != 0) {
+                // The camera's world matrix is the inverse of the view
+                data->invView = cameraModel;
+                vectorMath_invAffine(&cameraModel, &data->view, 1);
+                data->projection = projection;
+                data->viewProjection = glms_mat4_mul(projection, data->view);
+                data->cameraPosition = cameraModel.col[3];
+
+                mat4s skyboxView = data->view;
+                skyboxView.col[3] = (vec4s){{0, 0, 0, 1}};
+                data->skyboxViewProjection = glms_mat4_mul(projection,
+                                                           skyboxView);
+
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer->ubo);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(*data), data);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                buffer->uploaded = true;
+        }
+        glBindBufferBase(GL_UNIFORM_BUFFER, SHADER_BLOCK_CAMERA, buffer->ubo);
+}
+
+void cameraBuffer_free(struct cameraBuffer *const buffer) {
+        glDeleteBuffers(1, &buffer->ubo);
+        buffer->ubo = 0;
+}
@@ -0,0 +1,321 @@
+#include <thirty/compaction.h>
+#include <thirty/scene.h>
+#include <thirty/util.h>
+
+#define COMPACTION_INITIAL_CAPACITY 64
+#define COMPACTION_CHECK_INTERVAL 64  // items between looks at the clock
+
+// A field of a component collection holding a component's idx plus one
+struct componentRef {
+        size_t *field;
+        size_t next;  // next reference to the same component, plus one
+};
+
+// Time left for the current step
+struct budget {
+        uint64_t deadline;  // 0 when unbounded
+        unsigned count;
+};
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static bool budgetExceeded(struct budget *const budget) {
+        if (budget->deadline == 0 ||
+            ++budget->count % COMPACTION_CHECK_INTERVAL != 0) {
+                return false;
+        }
+        return time_micros() >= budget->deadline;
+}
+
+#define COLLECTION_FIELDS 6
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (write_only, 2)))
+__attribute__((nonnull))
+static void collectionFields(struct componentCollection *const collection,
+                             size_t *fields[COLLECTION_FIELDS]) {
+        fields[0] = &collection->transform;
+        fields[1] = &collection->camera;
+        fields[2] = &collection->geometry;
+        fields[3] = &collection->material;
+        fields[4] = &collection->light;
+        fields[5] = &collection->animationCollection;
+}
+
+void compaction_init(struct compaction *const compaction) {
+        compaction->phase = COMPACTION_OBJECTS;
+        compaction->nextObject = 0;
+        compaction->generation = 0;
+        growingArray_init(&compaction->firstRefs, sizeof(size_t),
+                          COMPACTION_INITIAL_CAPACITY);
+        growingArray_init(&compaction->refs, sizeof(struct componentRef),
+                          COMPACTION_INITIAL_CAPACITY);
+        varSizeGrowingArray_compactInit(&compaction->components);
+}
+
+void compaction_restart(struct compaction *const compaction) {
+        // Components already moved stay where they are
+        compaction->phase = COMPACTION_OBJECTS;
+}
+
+bool compaction_movingComponents(const struct compaction *const compaction) {
+        // Once some are moved, until all are
+        return compaction->components.next > 0;
+}
+
+struct objectMovedArgs {
+        struct scene *scene;
+        struct budget *budget;
+};
+
+// Fix up everything referring to an object that was moved to a lower idx
+static bool objectMoved(void *const element, size_t from, size_t to,
+                        void *const vargs) {
+        const struct objectMovedArgs *const args = vargs;
+        struct scene *const scene = args->scene;
+        struct object *const object = element;
+
+        // Positions to idxs, idx 0 is root
+        from++;
+        to++;
+        assert(object->idx == from);
+        object->idx = to;
+
+        struct object *const parent = scene_getObjectFromIdx(
+                scene, object->parent);
+        if (parent->firstChild == from) {
+                parent->firstChild = to;
+        }
+        if (object->prevSibling != 0) {
+                scene_getObjectFromIdx(scene, object->prevSibling)
+                        ->nextSibling = to;
+        }
+        if (object->nextSibling != 0) {
+                scene_getObjectFromIdx(scene, object->nextSibling)
+                        ->prevSibling = to;
+        }
+        size_t child = object->firstChild;
+        while (child != 0) {
+                struct object *const childObject = scene_getObjectFromIdx(
+                        scene, child);
+                childObject->parent = to;
+                child = childObject->nextSibling;
+        }
+
+        // Shared components keep the last object they were given to
+        size_t *fields[COLLECTION_FIELDS];
+        collectionFields(&object->components, fields);
+        for (size_t i=0; i<COLLECTION_FIELDS; i++) {
+                if (*fields[i] == 0) {
+                        continue;
+                }
+                struct component *const component =
+                        componentCollection_compByIdx(&scene->components,
+                                                      *fields[i] - 1);
+                if (component->object == from) {
+                        component->object = to;
+                }
+        }
+
+        struct objectInfo *const infos = scene->objectInfo.data;
+        infos[to] = infos[from];
+        infos[from].name = NULL;
+        infos[from].borrowed = false;
+
+        // It was queued under the idx it had
+        const struct transform *const trans = object_getTransform(object);
+        if (trans != NULL && trans->dirty) {
+                scene_queueTransform(scene, to);
+        }
+        hierarchy_move(&scene->hierarchy, from, to);
+        activeSet_move(&scene->active, from, to);
+        bvh_move(&scene->bvh, from, to);
+        renderQueue_move(&scene->renderQueue, from, to);
+        streaming_moveObject(&scene->streaming, from, to);
+        return !budgetExceeded(args->budget);
+}
+
+// Add the references of a collection to the lists
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((nonnull))
+static void addRefs(struct compaction *const compaction,
+                    struct componentCollection *const collection) {
+        size_t *const firstRefs = compaction->firstRefs.data;
+        size_t *fields[COLLECTION_FIELDS];
+        collectionFields(collection, fields);
+        for (size_t i=0; i<COLLECTION_FIELDS; i++) {
+                const size_t component = *fields[i];
+                if (component == 0 ||
+                    component > compaction->firstRefs.length) {
+                        continue;
+                }
+                struct componentRef *const ref = growingArray_append(
+                        &compaction->refs);
+                ref->field = fields[i];
+                ref->next = firstRefs[component - 1];
+                firstRefs[component - 1] = compaction->refs.length;
+        }
+}
+
+// Start gathering references to the components that exist now
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void startMark(struct scene *const scene) {
+        struct compaction *const compaction = &scene->compaction;
+        growingArray_clear(&compaction->refs);
+        growingArray_clear(&compaction->firstRefs);
+        for (size_t i=0; i<scene->components.offsets.length; i++) {
+                size_t *const first = growingArray_append(
+                        &compaction->firstRefs);
+                *first = 0;
+        }
+        compaction->nextObject = 0;
+        compaction->phase = COMPACTION_MARK;
+
+        // Prefabs are few and small, they're done right away
+        growingArray_foreach_START(&scene->prefabs, struct prefab *, prefab)
+                struct prefabNode *const nodes = prefab->nodes.data;
+                for (size_t i=0; i<prefab->nodes.length; i++) {
+                        addRefs(compaction, &nodes[i].components);
+                }
+        growingArray_foreach_END;
+}
+
+// Gather the objects' references to components, return whether it's done
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((nonnull))
+static bool mark(struct scene *const scene, struct budget *const budget) {
+        struct compaction *const compaction = &scene->compaction;
+
+        // Objects have no holes now, and root is 0
+        while (compaction->nextObject <= scene->objects.length) {
+                if (budgetExceeded(budget)) {
+                        return false;
+                }
+                addRefs(compaction, &scene_getObjectFromIdx(
+                                scene, compaction->nextObject)->components);
+                compaction->nextObject++;
+        }
+        return true;
+}
+
+struct componentMovedArgs {
+        struct scene *scene;
+        struct budget *budget;
+};
+
+// Drop a component nothing refers to, or fix up the references to it
+static enum compactAction compactComponent(void *const element,
+                                           const size_t size,
+                                           const size_t from, const size_t to,
+                                           void *const vargs) {
+        const struct componentMovedArgs *const args = vargs;
+        struct scene *const scene = args->scene;
+        struct compaction *const compaction = &scene->compaction;
+        struct component *const component = element;
+        (void)size;
+
+        if (budgetExceeded(args->budget)) {
+                return COMPACT_STOP;
+        }
+
+        if (from < compaction->firstRefs.length) {
+                const size_t *const firstRefs = compaction->firstRefs.data;
+                size_t ref = firstRefs[from];
+                if (ref == 0 &&
+                    !streaming_isStreamed(&scene->streaming, from)) {
+                        componentCollection_remove(component);
+                        compaction->generation++;
+                        return COMPACT_DROP;
+                }
+
+                while (ref != 0) {
+                        const struct componentRef *const componentRef =
+                                growingArray_get(&compaction->refs, ref - 1);
+                        *componentRef->field = to + 1;
+                        ref = componentRef->next;
+                }
+        }
+        // Otherwise it was created after gathering references, keep it
+
+        if (from != to) {
+                streaming_moveComponent(&scene->streaming, from, to);
+                // Its objects' keys have the idx it had
+                if (component->type == COMPONENT_GEOMETRY ||
+                    component->type == COMPONENT_MATERIAL ||
+                    component->type == COMPONENT_MATERIAL_SKYBOX) {
+                        renderQueue_invalidate(&scene->renderQueue);
+                }
+                compaction->generation++;
+        }
+        component->idx = to;
+        return COMPACT_KEEP;
+}
+
+bool compaction_step(struct scene *const scene, const unsigned long micros,
+                     size_t *const reclaimed) {
+        struct compaction *const compaction = &scene->compaction;
+        struct budget budget = {
+                .deadline = micros == 0 ? 0 : time_micros() + micros,
+                .count = 0,
+        };
+        size_t stepReclaimed;
+        *reclaimed = 0;
+
+        if (compaction->phase == COMPACTION_OBJECTS) {
+                struct objectMovedArgs args = {
+                        .scene = scene,
+                        .budget = &budget,
+                };
+                const bool done = growingArray_compact(
+                        &scene->objects, objectMoved, &args, &stepReclaimed);
+                *reclaimed += stepReclaimed;
+                if (!done) {
+                        return false;
+                }
+                streaming_trimCells(&scene->streaming, scene->objects.length);
+                while (scene->objectInfo.length > scene->objects.length + 1) {
+                        growingArray_pop(&scene->objectInfo);
+                }
+                startMark(scene);
+        }
+
+        if (compaction->phase == COMPACTION_MARK) {
+                if (!mark(scene, &budget)) {
+                        return false;
+                }
+                compaction->phase = COMPACTION_COMPONENTS;
+        }
+
+        assert(compaction->phase == COMPACTION_COMPONENTS);
+        // Reads in flight refer to components by idx, and no more will be
+        // started once components start moving
+        if (scene->streaming.reading) {
+                assert(!compaction_movingComponents(compaction));
+                return false;
+        }
+        struct componentMovedArgs args = {
+                .scene = scene,
+                .budget = &budget,
+        };
+        const bool done = varSizeGrowingArray_compact(
+                &scene->components, &compaction->components,
+                compactComponent, &args, &stepReclaimed);
+        *reclaimed += stepReclaimed;
+        if (!done) {
+                return false;
+        }
+
+        // Ready for the next time
+        growingArray_clear(&compaction->refs);
+        growingArray_clear(&compaction->firstRefs);
+        compaction->phase = COMPACTION_OBJECTS;
+        return true;
+}
+
+void compaction_free(struct compaction *const compaction) {
+        growingArray_destroy(&compaction->firstRefs);
+        growingArray_destroy(&compaction->refs);
+}
@@ -3,9 +3,12 @@
 
 void component_init(struct component *const component, const char *const name) {
         component->name = sstrdup(name);
+        component->borrowed = false;
 }
 
 void component_free(struct component *const component) {
-        free(component->name);
+        if (!component->borrowed) {
+                free(component->name);
+        }
         component->name = NULL;
 }
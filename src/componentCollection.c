@@ -10,51 +10,47 @@ void componentCollection_initCollection(struct varSizeGrowingArray *components)
                                  COMPONENTS_MIN_SIZE);
 }
 
-void *componentCollection_create(struct varSizeGrowingArray *components, struct game *game,
-                                 const enum componentType type) {
-        size_t size;
+size_t componentCollection_sizeOf(const enum componentType type) {
         switch(type) {
         case COMPONENT_TRANSFORM:
-                size = sizeof(struct transform);
-                break;
+                return sizeof(struct transform);
                 
         case COMPONENT_CAMERA:
-                size = sizeof(struct camera);
-                break;
+                return sizeof(struct camera);
                 
         case COMPONENT_GEOMETRY:
-                size = sizeof(struct geometry);
-                break;
+                return sizeof(struct geometry);
                 
         case COMPONENT_MATERIAL_UBER:
-                size = sizeof(struct material_uber);
-                break;
+                return sizeof(struct material_uber);
                 
         case COMPONENT_MATERIAL_SKYBOX:
-                size = sizeof(struct material_skybox);
-                break;
+                return sizeof(struct material_skybox);
                 
         case COMPONENT_LIGHT_SPOT:
         case COMPONENT_LIGHT_DIRECTION:
         case COMPONENT_LIGHT_POINT:
-                size = sizeof(struct light);
-                break;
+                return sizeof(struct light);
                 
         case COMPONENT_ANIMATIONCOLLECTION:
-                size = sizeof(struct animationCollection);
-                break;
+                return sizeof(struct animationCollection);
         
         case COMPONENT_TOTAL:
         default:
                 dbg("comp: %u", type);
                 assert_fail();
         }
+}
 
+void *componentCollection_create(struct varSizeGrowingArray *components, struct game *game,
+                                 const enum componentType type) {
+        const size_t size = componentCollection_sizeOf(type);
         void *ptr = varSizeGrowingArray_append(components, size);
         assert(components->offsets.length > 0);
         ((struct component*)ptr)->type = type;
         ((struct component*)ptr)->idx = components->offsets.length - 1;
         ((struct component*)ptr)->game = game;
+        ((struct component*)ptr)->borrowed = false;
         return ptr;
 }
 
@@ -71,6 +67,10 @@ static bool findComponent(void *const item, const size_t size,
         (void)size;
 
         args->idx++;
+        if (comp->type == COMPONENT_TOTAL) {
+                // Removed
+                return true;
+        }
         if ((args->type == COMPONENT_TOTAL || args->type == comp->type) &&
             strcmp(comp->name, args->name) == 0) {
                 args->found = true;
@@ -98,7 +98,7 @@ size_t componentCollection_idxByName(struct varSizeGrowingArray *components,
 
 void *componentCollection_compByIdx(struct varSizeGrowingArray *components,
                                     const size_t idx) {
-        return varSizeGrowingArray_get(components, idx, NULL);
+        return varSizeGrowingArray_at(components, idx);
 }
 
 void componentCollection_init(struct componentCollection *const collection) {
@@ -238,10 +238,10 @@ bool componentCollection_hasComponent(
 
 void componentCollection_update(struct varSizeGrowingArray *components,
                                 struct componentCollection *const collection,
-                                const float timeDelta) {
+                                const size_t object, const float timeDelta) {
         struct animationCollection *anim = componentCollection_get(components,
                 collection, COMPONENT_ANIMATIONCOLLECTION);
-        if (anim != NULL) {
+        if (anim != NULL && anim->base.object == object) {
                 animationCollection_update(anim, timeDelta);
         }
 }
@@ -287,6 +287,16 @@ static bool freeComponent(void *compPtr, size_t size, void *args) {
         return true;
 }
 
+void componentCollection_remove(struct component *const component) {
+        // Removed components are freed along with the collection too, which
+        // must do nothing
+        static char removedName[] = "";
+        freeComponent(component, 0, NULL);
+        component->type = COMPONENT_TOTAL;
+        component->name = removedName;
+        component->borrowed = true;
+}
+
 void componentCollection_freeCollection(struct varSizeGrowingArray *components) {
         varSizeGrowingArray_foreach(components, freeComponent, NULL);
         varSizeGrowingArray_destroy(components);
@@ -13,6 +13,18 @@ void growingArray_init(struct growingArray *const ga,
         ga->fragLength = 0;
 }
 
+void growingArray_initFromBuffer(struct growingArray *const ga,
+                                 const size_t itemSize,
+                                 const void *const buffer,
+                                 const size_t count) {
+        growingArray_init(ga, itemSize, count > 0 ? count : 1);
+        if (count > 0) {
+                memcpy(ga->data, buffer, count * itemSize);
+        }
+        ga->length = count;
+        ga->fragLength = count;
+}
+
 #define growingArrayAddress(ga, n)              \
         (void *const)((char *const)(ga)->data + ((n) * (ga)->itemSize))
 
@@ -35,27 +47,40 @@ void *growingArray_append(struct growingArray *const ga) {
         return ptr;
 }
 
+void growingArray_reserve(struct growingArray *const ga, const size_t count) {
+        // Holes may be reused, but there might not be any
+        const size_t needed = ga->fragLength + count;
+        if (needed <= ga->capacity) {
+                return;
+        }
+        if (ga->capacity == 0) {
+                ga->capacity = 1;
+        }
+        while (ga->capacity < needed) {
+                ga->capacity *= 2;
+        }
+        ga->data = sreallocarray(ga->data, ga->capacity, ga->itemSize);
+}
+
 void growingArray_remove(struct growingArray *ga, size_t n) {
-        if (n == ga->fragLength - 1) {
+        if (n == ga->fragLength - 1 && ga->deletedNodes == NULL) {
                 growingArray_pop(ga);
                 return;
         }
         assert(n < ga->fragLength);
 
-        struct gaDeletedNodes *dn = ga->deletedNodes;
-        if (dn != NULL) {
-                while (dn->next != NULL) {
-                        dn = dn->next;
-                }
-                dn->next = smalloc(sizeof(*dn));
-                dn = dn->next;
-        } else {
-                dn = smalloc(sizeof(*dn));
-                ga->deletedNodes = dn;
+        // Keep the holes in order, iterating the array relies on it
+        void *const ptr = growingArrayAddress(ga, n);
+        struct gaDeletedNodes **next = &ga->deletedNodes;
+        while (*next != NULL && (char*)(*next)->ptr < (char*)ptr) {
+                next = &(*next)->next;
         }
+        assert(*next == NULL || (*next)->ptr != ptr);
 
-        dn->next = NULL;
-        dn->ptr = growingArrayAddress(ga, n);
+        struct gaDeletedNodes *const dn = smalloc(sizeof(*dn));
+        dn->next = *next;
+        dn->ptr = ptr;
+        *next = dn;
         ga->length--;
 }
 
@@ -92,10 +117,18 @@ void growingArray_foreach(const struct growingArray *const ga,
         }
 }
 
-static void freeDeletedNodes(struct growingArray *const ga) {
-        for (struct gaDeletedNodes *n = ga->deletedNodes; n != NULL; n = n->next) {
+// Return the amount of nodes free'd
+static size_t freeDeletedNodes(struct growingArray *const ga) {
+        size_t count = 0;
+        struct gaDeletedNodes *n = ga->deletedNodes;
+        while (n != NULL) {
+                struct gaDeletedNodes *const next = n->next;
                 free(n);
+                n = next;
+                count++;
         }
+        ga->deletedNodes = NULL;
+        return count;
 }
 
 struct sort_cmp_ignore_del_args {
@@ -126,6 +159,71 @@ void growingArray_sort(struct growingArray *const ga,
         freeDeletedNodes(ga);
 }
 
+// Give back the capacity that isn't used, return how many bytes
+static size_t shrink(struct growingArray *const ga) {
+        const size_t capacity = ga->fragLength > 0 ? ga->fragLength : 1;
+        if (ga->capacity <= capacity) {
+                return 0;
+        }
+        const size_t reclaimed = (ga->capacity - capacity) * ga->itemSize;
+        ga->data = sreallocarray(ga->data, capacity, ga->itemSize);
+        ga->capacity = capacity;
+        return reclaimed;
+}
+
+bool growingArray_compact(struct growingArray *const ga,
+                          const moved_cb moved, void *const args,
+                          size_t *const reclaimed) {
+        *reclaimed = 0;
+        if (ga->deletedNodes != NULL) {
+                // Elements go to 'to', the first hole. The holes are kept
+                // between it and 'from' as elements are moved, and were
+                // left like that by the previous call, if any.
+                const size_t itemSize = ga->itemSize;
+                size_t to = (size_t)((char*)ga->deletedNodes->ptr -
+                                     (char*)ga->data) / itemSize;
+                size_t from = to;
+                struct gaDeletedNodes *dn = ga->deletedNodes;
+                bool more = true;
+                while (more && from < ga->fragLength) {
+                        if (dn != NULL && dn->ptr == growingArrayAddress(
+                                    ga, from)) {
+                                dn = dn->next;
+                        } else {
+                                memcpy(growingArrayAddress(ga, to),
+                                       growingArrayAddress(ga, from),
+                                       itemSize);
+                                more = moved(growingArrayAddress(ga, to),
+                                             from, to, args);
+                                to++;
+                        }
+                        from++;
+                }
+
+                // As many holes were passed as there are between both now
+                size_t hole = to;
+                for (struct gaDeletedNodes *n = ga->deletedNodes; n != dn;
+                     n = n->next) {
+                        n->ptr = growingArrayAddress(ga, hole);
+                        hole++;
+                }
+                assert(hole == from);
+
+                if (from < ga->fragLength) {
+                        return false;
+                }
+
+                // Only holes at the end are left
+                *reclaimed += freeDeletedNodes(ga) *
+                        sizeof(struct gaDeletedNodes);
+                ga->fragLength = to;
+                assert(ga->fragLength == ga->length);
+        }
+
+        *reclaimed += shrink(ga);
+        return true;
+}
+
 static void *bsearch_r(const void *key, void *base,
                        size_t num, size_t size, cmp_cb cmp, void *args) {
 	char *pivot;
@@ -221,6 +319,23 @@ void varSizeGrowingArray_init(struct varSizeGrowingArray *const vga,
         growingArray_init(&vga->offsets, sizeof(size_t), cap);
 }
 
+void varSizeGrowingArray_initFromBuffer(struct varSizeGrowingArray *const vga,
+                                        const size_t alignment,
+                                        const void *const data,
+                                        const size_t size,
+                                        const size_t *const offsets,
+                                        const size_t count) {
+        varSizeGrowingArray_init(vga, alignment, size > 0 ? size : 1, 0);
+        // Replace the empty offsets array with the copy
+        growingArray_destroy(&vga->offsets);
+        growingArray_initFromBuffer(&vga->offsets, sizeof(size_t),
+                                    offsets, count);
+        if (size > 0) {
+                memcpy(vga->data, data, size);
+        }
+        assert(count == 0 || offsets[count-1] == size);
+}
+
 void *varSizeGrowingArray_append(struct varSizeGrowingArray *const vga,
                                  const size_t size) {
         size_t offset;
@@ -254,6 +369,31 @@ void *varSizeGrowingArray_append(struct varSizeGrowingArray *const vga,
         return (void*)(((char*)ptr)+sizeof(size_t)+vga->padding);
 }
 
+void varSizeGrowingArray_reserve(struct varSizeGrowingArray *const vga,
+                                 const size_t count, const size_t size) {
+        size_t offset = 0;
+        if (vga->offsets.length > 0) {
+                const size_t *const off = growingArray_get(
+                        &vga->offsets, vga->offsets.length-1);
+                offset = *off;
+        }
+        const size_t needed = offset +
+                count * (sizeof(size_t) + vga->padding + size);
+
+        bool change = false;
+        while (needed > vga->capacity) {
+                if (vga->capacity == 0) {
+                        vga->capacity = 1;
+                }
+                vga->capacity *= 2;
+                change = true;
+        }
+        if (change) {
+                vga->data = srealloc(vga->data, vga->capacity);
+        }
+        growingArray_reserve(&vga->offsets, count);
+}
+
 void *varSizeGrowingArray_get(const struct varSizeGrowingArray *const vga,
                               const size_t n, size_t *const s) {
         assert(n < vga->offsets.length);
@@ -276,18 +416,103 @@ void *varSizeGrowingArray_get(const struct varSizeGrowingArray *const vga,
 void varSizeGrowingArray_foreach(const struct varSizeGrowingArray *const vga,
                                  const foreach_sized_cb fun,
                                  void *const args) {
-        char *ptr = vga->data;
+        // Go by the offsets, elements aren't all one after the other while
+        // the array is being compacted
         for (size_t i=0; i<vga->offsets.length; i++) {
-                size_t size = *((size_t*)((void*)ptr));
-                ptr += sizeof(size_t) + vga->padding;
-                void *dataPtr = (void*)ptr;
+                size_t size;
+                void *const dataPtr = varSizeGrowingArray_get(vga, i, &size);
                 if (!fun(dataPtr, size, args)) {
                         break;
                 }
-                ptr += size;
         }
 }
 
+void varSizeGrowingArray_compactInit(struct vgaCompaction *const compaction) {
+        compaction->next = 0;
+        compaction->kept = 0;
+        compaction->end = 0;
+}
+
+bool varSizeGrowingArray_compact(struct varSizeGrowingArray *const vga,
+                                 struct vgaCompaction *const compaction,
+                                 const compact_cb cb, void *const args,
+                                 size_t *const reclaimed) {
+        *reclaimed = 0;
+        char *const data = vga->data;
+        size_t *const offsets = vga->offsets.data;
+        const size_t header = sizeof(size_t) + vga->padding;
+
+        // The elements dropped but not yet moved over all point to a single
+        // copy of one of them, placed where the next kept one will go. It
+        // must be put back there after moving anything.
+        char *filler = NULL;
+        size_t fillerSize = 0;
+        if (compaction->kept < compaction->next) {
+                fillerSize = header + *(size_t*)(void*)(data + compaction->end);
+                filler = smalloc(fillerSize);
+                memcpy(filler, data + compaction->end, fillerSize);
+        }
+
+        size_t start = compaction->next == 0 ? 0 :
+                offsets[compaction->next - 1];
+        while (compaction->next < vga->offsets.length) {
+                const size_t entryEnd = offsets[compaction->next];
+                const size_t entrySize = entryEnd - start;
+                char *const entry = data + start;
+                const size_t size = *(size_t*)(void*)entry;
+
+                const enum compactAction action = cb(
+                        entry + header, size, compaction->next,
+                        compaction->kept, args);
+                if (action == COMPACT_STOP) {
+                        break;
+                }
+                if (action == COMPACT_KEEP) {
+                        if (compaction->end != start) {
+                                memmove(data + compaction->end, entry,
+                                        entrySize);
+                        }
+                        compaction->end += entrySize;
+                        offsets[compaction->kept] = compaction->end;
+                        compaction->kept++;
+                } else {
+                        assert(action == COMPACT_DROP);
+                        filler = srealloc(filler, entrySize);
+                        memcpy(filler, entry, entrySize);
+                        fillerSize = entrySize;
+                }
+                compaction->next++;
+                start = entryEnd;
+        }
+
+        if (compaction->next < vga->offsets.length) {
+                // Dropped elements take up no space, they all start at the
+                // filler, which fits since it's one of them
+                if (compaction->kept < compaction->next) {
+                        memcpy(data + compaction->end, filler, fillerSize);
+                        for (size_t i=compaction->kept;
+                             i+1<compaction->next; i++) {
+                                offsets[i] = compaction->end;
+                        }
+                }
+                free(filler);
+                return false;
+        }
+        free(filler);
+
+        vga->offsets.length = compaction->kept;
+        vga->offsets.fragLength = compaction->kept;
+        *reclaimed += shrink(&vga->offsets);
+        const size_t capacity = compaction->end > 0 ? compaction->end : 1;
+        if (vga->capacity > capacity) {
+                *reclaimed += vga->capacity - capacity;
+                vga->data = srealloc(vga->data, capacity);
+                vga->capacity = capacity;
+        }
+        varSizeGrowingArray_compactInit(compaction);
+        return true;
+}
+
 void varSizeGrowingArray_destroy(struct varSizeGrowingArray *const vga) {
         vga->capacity = 0;
         free(vga->data);
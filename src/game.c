@@ -1,5 +1,7 @@
 #include <thirty/game.h>
 #include <thirty/util.h>
+#include <thirty/threadPool.h>
+#include <thirty/materialBuffer.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wfloat-equal"
@@ -22,6 +24,7 @@
 #define FUNCTION_SIZE 256
 #define DEFAULT_CLEARCOLOR {.x=0.2F, .y=0.3F, .z=0.3F, .w=1.0F}
 #define STARTING_TIMEDELTA (1.0F/60.0F)
+#define SCENE_LOAD_BUDGET 8000  // microseconds per frame spent loading a scene
 
 static void onFramebufferSizeChanged(void *registerArgs, void *fireArgs) {
         (void)registerArgs;
@@ -141,7 +144,8 @@ static void doUpdateScene(const size_t sceneIdx,
 static void doDrawScene(const size_t sceneIdx,
                         struct growingArray *scenes) {
         struct scene *scene = growingArray_get(scenes, sceneIdx);
-        scene_draw(scene);
+        scene_updateTransforms(scene);
+        scene_draw(scene, NULL);
 
 #ifndef NDEBUG
         const GLenum error = glGetError();
@@ -377,15 +381,15 @@ static void doChangeScene(struct game *const game) {
         }
 
         if (game->inScene) {
+                // Loading may take several frames, don't keep using (or
+                // unloading) the old scene in the meantime.
                 scene_unload(game_getCurrentScene(game));
+                game->inScene = false;
         }
         
         if (game->sceneMustChange) {
                 struct scene *scene = game_getSceneFromIdx(game, game->sceneToChangeTo);
-                if (!scene_load(scene)) {
-                        return;
-                }
-                if (!scene_awaitAsyncLoaders(scene)) {
+                if (!scene_loadBudget(scene, SCENE_LOAD_BUDGET)) {
                         return;
                 }
                 
@@ -570,8 +574,10 @@ void game_free(struct game *const game) {
                 scene_free(scene);
         growingArray_foreach_END;
         growingArray_destroy(&game->scenes);
+        materialBuffer_destroy();
         
         eventBroker_shutdown();
+        threadPool_destroy();
         enet_deinitialize();
         nk_glfw3_shutdown(&game->uiData.glfw);
         glfwTerminate();
@@ -16,6 +16,42 @@ static void geometry_init(struct geometry *const geometry) {
         geometry->vao = 0;
         geometry->vbo = 0;
         geometry->ibo = 0;
+        geometry->loaded = false;
+        geometry->path = NULL;
+        memset(&geometry->bounds, 0, sizeof(geometry->bounds));
+}
+
+// The box is the tightest one, the sphere isn't but it's close enough for
+// culling and only needs another pass
+__attribute__((access (write_only, 1)))
+__attribute__((access (read_only, 2, 3)))
+__attribute__((nonnull))
+static void computeBounds(struct geometryBounds *const bounds,
+                          const struct vertex *const vertices,
+                          const size_t nvertices) {
+        if (nvertices == 0) {
+                memset(bounds, 0, sizeof(*bounds));
+                return;
+        }
+
+        vec3s min = vertices[0].vert;
+        vec3s max = vertices[0].vert;
+        for (size_t i=1; i<nvertices; i++) {
+                min = glms_vec3_minv(min, vertices[i].vert);
+                max = glms_vec3_maxv(max, vertices[i].vert);
+        }
+        bounds->center = glms_vec3_scale(glms_vec3_add(min, max), 0.5f);
+        bounds->extents = glms_vec3_scale(glms_vec3_sub(max, min), 0.5f);
+
+        float radius2 = 0;
+        for (size_t i=0; i<nvertices; i++) {
+                const float d2 = glms_vec3_distance2(bounds->center,
+                                                     vertices[i].vert);
+                if (d2 > radius2) {
+                        radius2 = d2;
+                }
+        }
+        bounds->radius = sqrtf(radius2);
 }
 
 void geometry_initFromArray(struct geometry *const geometry,
@@ -24,11 +60,22 @@ void geometry_initFromArray(struct geometry *const geometry,
                             const size_t nvertices,
                             const unsigned *const indices,
                             const size_t nindices) {
-        assert(nindices <= INT_MAX);
         assert(geometry->base.type == COMPONENT_GEOMETRY);
 
         component_init((struct component *)geometry, name);
         geometry_init(geometry);
+        geometry_upload(geometry, vertices, nvertices, indices, nindices);
+}
+
+void geometry_upload(struct geometry *const geometry,
+                     const struct vertex *const vertices,
+                     const size_t nvertices,
+                     const unsigned *const indices,
+                     const size_t nindices) {
+        assert(nindices <= INT_MAX);
+        assert(geometry->base.type == COMPONENT_GEOMETRY);
+
+        geometry_unload(geometry);
         
         glGenVertexArrays(1, &geometry->vao);
         glBindVertexArray(geometry->vao);
@@ -65,6 +112,7 @@ void geometry_initFromArray(struct geometry *const geometry,
         
         glBindVertexArray(0);
         geometry->nindices = (const int)nindices;
+        computeBounds(&geometry->bounds, vertices, nvertices);
         geometry->loaded = true;
 }
 
@@ -1251,7 +1299,6 @@ void geometry_initPlane(struct geometry *geo, const char *name) {
 struct readGeometryFileArgs {
         struct varSizeGrowingArray *components;
         size_t geometryIdx;
-        char *name;
 };
 
 static void readGeometryFile(void *const data, const size_t len, void *const vargs) {
@@ -1278,14 +1325,12 @@ static void readGeometryFile(void *const data, const size_t len, void *const var
 
         struct geometry *geometry = varSizeGrowingArray_get(args->components,
                                                             args->geometryIdx, NULL);
-        geometry_initFromArray(geometry, args->name,
-                               vertices, header.vertlen,
-                               indices, header.indlen);
+        geometry_upload(geometry, vertices, header.vertlen,
+                        indices, header.indlen);
 
         free(vertices);
         free(indices);
         free(data);
-        free(args->name);
         free(args);
 }
 
@@ -1293,6 +1338,7 @@ size_t geometry_initFromFile(struct geometry *const geometry, FILE *const f,
                              const enum componentType type,
                              struct varSizeGrowingArray *const components) {
         assert(type == COMPONENT_GEOMETRY);
+        (void)components;
 
         char *name = strfile(f);
         
@@ -1310,20 +1356,79 @@ size_t geometry_initFromFile(struct geometry *const geometry, FILE *const f,
                 die("Cannot read geometry file");
         }
 
-        geometry->loaded = false;
-        struct readGeometryFileArgs *args = smalloc(sizeof(*args));
-        args->components = components;
-        args->geometryIdx = geometry->base.idx;
-        args->name = name;
-
-        asyncLoader_enqueueRead(path, readGeometryFile, args);
+        component_init((struct component *)geometry, name);
+        geometry_init(geometry);
+        geometry->path = path;
         
+        free(name);
         free(filename);
-        free(path);
         
         return sizeof(struct geometry);
 }
 
+void geometry_loadFile(const struct geometry *const geometry,
+                       struct varSizeGrowingArray *const components) {
+        assert(geometry->base.type == COMPONENT_GEOMETRY);
+        assert(geometry->path != NULL);
+
+        struct readGeometryFileArgs *args = smalloc(sizeof(*args));
+        args->components = components;
+        args->geometryIdx = geometry->base.idx;
+
+        asyncLoader_enqueueRead(geometry->path, readGeometryFile, args);
+}
+
+void geometry_readback(const struct geometry *const geometry,
+                       struct vertex **const vertices,
+                       size_t *const nvertices,
+                       unsigned **const indices,
+                       size_t *const nindices) {
+        assert(geometry->base.type == COMPONENT_GEOMETRY);
+        assert(geometry->loaded);
+
+        // Use the copy target so that no VAO state is disturbed
+        GLint size;
+        glBindBuffer(GL_COPY_READ_BUFFER, geometry->vbo);
+        glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+        assert(size >= 0);
+        *nvertices = (size_t)size / sizeof(**vertices);
+        *vertices = smallocarray(*nvertices, sizeof(**vertices));
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, size, *vertices);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, geometry->ibo);
+        glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+        assert(size >= 0);
+        *nindices = (size_t)size / sizeof(**indices);
+        *indices = smallocarray(*nindices, sizeof(**indices));
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, size, *indices);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void geometry_worldBounds(const struct geometry *const geometry,
+                          const mat4s model,
+                          struct geometryBounds *const bounds) {
+        assert(geometry->base.type == COMPONENT_GEOMETRY);
+        const struct geometryBounds *const local = &geometry->bounds;
+
+        // Each axis of the world box gets as much of the local box's extents
+        // as the rotated and scaled axes project onto it
+        bounds->center = glms_mat4_mulv3(model, local->center, 1);
+        for (size_t row=0; row<3; row++) {
+                bounds->extents.raw[row] =
+                        fabsf(model.raw[0][row]) * local->extents.x +
+                        fabsf(model.raw[1][row]) * local->extents.y +
+                        fabsf(model.raw[2][row]) * local->extents.z;
+        }
+
+        // Non uniform scale stretches the sphere, grow it to the widest axis
+        const float scale2 = glm_max(
+                glms_vec3_norm2(glms_vec3(model.col[0])),
+                glm_max(glms_vec3_norm2(glms_vec3(model.col[1])),
+                        glms_vec3_norm2(glms_vec3(model.col[2]))));
+        bounds->radius = local->radius * sqrtf(scale2);
+}
+
 void geometry_draw(const struct geometry *const geometry) {
         assert(geometry->base.type == COMPONENT_GEOMETRY);
         
@@ -1334,10 +1439,41 @@ void geometry_draw(const struct geometry *const geometry) {
         }
 }
 
-void geometry_free(struct geometry *const geometry) {
+void geometry_drawInstanced(const struct geometry *const geometry,
+                            const struct instanceBuffer *const instances,
+                            const size_t first, const size_t count) {
+        assert(geometry->base.type == COMPONENT_GEOMETRY);
+        assert(first + count <= instances->models.length);
+        assert(count <= INT_MAX);
+
+        if (!geometry->loaded) {
+                return;
+        }
+
+        // The VAO keeps where the instances are, point it at this range
+        glBindVertexArray(geometry->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instances->buffer);
+        for (unsigned i=0; i<4; i++) {
+                const unsigned attrib = INSTANCEBUFFER_MODEL_ATTRIB + i;
+                glEnableVertexAttribArray(attrib);
+                glVertexAttribPointer(
+                        attrib, 4, GL_FLOAT, GL_FALSE, sizeof(mat4s),
+                        (const void *)(first * sizeof(mat4s) +
+                                       i * sizeof(vec4s)));
+                glVertexAttribDivisor(attrib, 1);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->ibo);
+        glDrawElementsInstanced(GL_TRIANGLES, geometry->nindices,
+                                GL_UNSIGNED_INT, 0, (GLsizei)count);
+
+        // Drawing it alone doesn't need them
+        for (unsigned i=0; i<4; i++) {
+                glDisableVertexAttribArray(INSTANCEBUFFER_MODEL_ATTRIB + i);
+        }
+}
+
+void geometry_unload(struct geometry *const geometry) {
         assert(geometry->base.type == COMPONENT_GEOMETRY);
-        
-        component_free((struct component*)geometry);
 
         if (geometry->loaded) {
                 glDeleteBuffers(1, &geometry->vbo);
@@ -1349,5 +1485,16 @@ void geometry_free(struct geometry *const geometry) {
                 geometry->vbo = 0;
                 geometry->ibo = 0;
                 geometry->vao = 0;
+                geometry->loaded = false;
+        }
+}
+
+void geometry_free(struct geometry *const geometry) {
+        assert(geometry->base.type == COMPONENT_GEOMETRY);
+        
+        if (!geometry->base.borrowed) {
+                free(geometry->path);
         }
+        component_free((struct component*)geometry);
+        geometry_unload(geometry);
 }
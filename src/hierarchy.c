@@ -0,0 +1,283 @@
+#include <thirty/hierarchy.h>
+#include <thirty/scene.h>
+#include <thirty/util.h>
+
+#define HIERARCHY_INITIAL_CAPACITY 64
+
+void hierarchy_init(struct hierarchy *const hierarchy) {
+        growingArray_init(&hierarchy->idxs, sizeof(size_t),
+                          HIERARCHY_INITIAL_CAPACITY);
+        growingArray_init(&hierarchy->parents, sizeof(size_t),
+                          HIERARCHY_INITIAL_CAPACITY);
+        growingArray_init(&hierarchy->ends, sizeof(size_t),
+                          HIERARCHY_INITIAL_CAPACITY);
+        growingArray_init(&hierarchy->positions, sizeof(size_t),
+                          HIERARCHY_INITIAL_CAPACITY);
+        hierarchy->valid = false;
+}
+
+void hierarchy_invalidate(struct hierarchy *const hierarchy) {
+        hierarchy->valid = false;
+}
+
+// Return the position entry of the given object, making room for it if it's
+// a new one
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+__attribute__((returns_nonnull))
+static size_t *positionOf(struct hierarchy *const hierarchy, const size_t idx) {
+        while (hierarchy->positions.length <= idx) {
+                size_t *const position = growingArray_append(
+                        &hierarchy->positions);
+                *position = HIERARCHY_NONE;
+        }
+        return growingArray_get(&hierarchy->positions, idx);
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void append(struct hierarchy *const hierarchy,
+                   const size_t idx, const size_t parent) {
+        *positionOf(hierarchy, idx) = hierarchy->idxs.length;
+        size_t *const idxPtr = growingArray_append(&hierarchy->idxs);
+        *idxPtr = idx;
+        size_t *const parentPtr = growingArray_append(&hierarchy->parents);
+        *parentPtr = parent;
+        size_t *const end = growingArray_append(&hierarchy->ends);
+        *end = hierarchy->idxs.length;
+}
+
+// Grow or shrink by the given amounts the subtree of the object at the given
+// position, and those of all of its ancestors, which contain it
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void resizeSubtrees(struct hierarchy *const hierarchy, size_t position,
+                           const size_t removed, const size_t added) {
+        const size_t *const parents = hierarchy->parents.data;
+        size_t *const ends = hierarchy->ends.data;
+        while (true) {
+                ends[position] = ends[position] - removed + added;
+                if (position == 0) {
+                        break;
+                }
+                position = parents[position];
+        }
+}
+
+// Where a position ends up once the range [lo, hi) is rotated so that the part
+// from mid on comes first
+static size_t rotated(const size_t position, const size_t lo,
+                      const size_t mid, const size_t hi) {
+        if (position < lo || position >= hi) {
+                return position;
+        }
+        return position >= mid ? position - (mid - lo) : position + (hi - mid);
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void reverse(struct hierarchy *const hierarchy, size_t from,
+                    size_t to) {
+        size_t *const idxs = hierarchy->idxs.data;
+        size_t *const parents = hierarchy->parents.data;
+        size_t *const ends = hierarchy->ends.data;
+        while (from + 1 < to) {
+                to--;
+                size_t tmp = idxs[from];
+                idxs[from] = idxs[to];
+                idxs[to] = tmp;
+                tmp = parents[from];
+                parents[from] = parents[to];
+                parents[to] = tmp;
+                tmp = ends[from];
+                ends[from] = ends[to];
+                ends[to] = tmp;
+                from++;
+        }
+}
+
+// Move the subtree in [start, end) so that it begins where dest was, which
+// isn't inside it, shifting the objects in between, and patch the positions,
+// parents and ends that refer to any of them. The moved subtree's root keeps
+// its parent, and the ends of its old and new ancestors are left to the
+// caller. Only the objects between the two places are visited, plus the
+// children of its ancestors that come after them.
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void moveSubtree(struct hierarchy *const hierarchy, const size_t start,
+                        const size_t end, const size_t dest) {
+        assert(dest <= start || dest >= end);
+        if (dest == start || dest == end) {
+                return;
+        }
+        const size_t lo = dest < start ? dest : start;
+        const size_t mid = dest < start ? start : end;
+        const size_t hi = dest < start ? end : dest;
+
+        size_t *const idxs = hierarchy->idxs.data;
+        size_t *const parents = hierarchy->parents.data;
+        size_t *const ends = hierarchy->ends.data;
+        size_t *const positions = hierarchy->positions.data;
+        const size_t length = hierarchy->idxs.length;
+
+        // Only ancestors' subtrees reach past the range, and going from one
+        // subtree to the next after it finds their children there, closest
+        // ancestor first
+        for (size_t i=hi; i<length && parents[i]>=lo; i=ends[i]) {
+                parents[i] = rotated(parents[i], lo, mid, hi);
+        }
+
+        // Sizes move along with the subtrees, unlike ends
+        for (size_t i=lo; i<hi; i++) {
+                ends[i] -= i;
+        }
+        reverse(hierarchy, lo, mid);
+        reverse(hierarchy, mid, hi);
+        reverse(hierarchy, lo, hi);
+        for (size_t i=lo; i<hi; i++) {
+                positions[idxs[i]] = i;
+                parents[i] = rotated(parents[i], lo, mid, hi);
+                ends[i] += i;
+        }
+}
+
+void hierarchy_update(struct scene *const scene) {
+        struct hierarchy *const hierarchy = &scene->hierarchy;
+        if (hierarchy->valid) {
+                return;
+        }
+
+        growingArray_clear(&hierarchy->idxs);
+        growingArray_clear(&hierarchy->parents);
+        growingArray_clear(&hierarchy->ends);
+        growingArray_clear(&hierarchy->positions);
+
+        // Depth first, so that each subtree ends up in one contiguous run
+        append(hierarchy, 0, 0);
+        size_t idx = scene->root.firstChild;
+        while (idx != 0) {
+                const struct object *object = scene_getObjectFromIdxConst(
+                        scene, idx);
+                append(hierarchy, idx, *positionOf(hierarchy, object->parent));
+                if (object->firstChild != 0) {
+                        idx = object->firstChild;
+                        continue;
+                }
+
+                // Next sibling of the object or of its closest ancestor that
+                // has one
+                while (object->idx != 0 && object->nextSibling == 0) {
+                        object = scene_getObjectFromIdxConst(
+                                scene, object->parent);
+                }
+                idx = object->nextSibling;
+        }
+
+        // Children come after their parents, so going backwards each
+        // subtree's end is known by the time its parent's is needed
+        const size_t *const parents = hierarchy->parents.data;
+        size_t *const ends = hierarchy->ends.data;
+        for (size_t i=hierarchy->idxs.length-1; i>0; i--) {
+                if (ends[i] > ends[parents[i]]) {
+                        ends[parents[i]] = ends[i];
+                }
+        }
+
+        hierarchy->valid = true;
+}
+
+void hierarchy_add(struct hierarchy *const hierarchy,
+                   const size_t idx, const size_t parent) {
+        if (!hierarchy->valid) {
+                return;
+        }
+
+        // Appended, then moved to the end of its parent's subtree
+        const size_t parentPosition = *positionOf(hierarchy, parent);
+        assert(parentPosition != HIERARCHY_NONE);
+        const size_t dest = *(const size_t*)growingArray_get(&hierarchy->ends,
+                                                             parentPosition);
+        append(hierarchy, idx, parentPosition);
+        const size_t last = hierarchy->idxs.length - 1;
+        moveSubtree(hierarchy, last, last + 1, dest);
+        resizeSubtrees(hierarchy, parentPosition, 0, 1);
+}
+
+void hierarchy_remove(struct hierarchy *const hierarchy, const size_t idx) {
+        if (!hierarchy->valid) {
+                return;
+        }
+
+        const size_t position = *positionOf(hierarchy, idx);
+        assert(position != HIERARCHY_NONE && position != 0);
+        size_t *const parents = hierarchy->parents.data;
+        size_t *const ends = hierarchy->ends.data;
+        const size_t parent = parents[position];
+
+        // Its children go to its parent, right where they are, and it's left
+        // childless at the end, where it can be popped
+        for (size_t child=position+1; child<ends[position];
+             child=ends[child]) {
+                parents[child] = parent;
+        }
+        ends[position] = position + 1;
+        moveSubtree(hierarchy, position, position + 1,
+                    hierarchy->idxs.length);
+        growingArray_pop(&hierarchy->idxs);
+        growingArray_pop(&hierarchy->parents);
+        growingArray_pop(&hierarchy->ends);
+        *positionOf(hierarchy, idx) = HIERARCHY_NONE;
+        resizeSubtrees(hierarchy, parent, 1, 0);
+}
+
+void hierarchy_reparent(struct hierarchy *const hierarchy,
+                        const size_t idx, const size_t parent) {
+        if (!hierarchy->valid) {
+                return;
+        }
+
+        const size_t position = *positionOf(hierarchy, idx);
+        const size_t parentPosition = *positionOf(hierarchy, parent);
+        assert(position != HIERARCHY_NONE && position != 0);
+        assert(parentPosition != HIERARCHY_NONE);
+        const size_t *const idxs = hierarchy->idxs.data;
+        size_t *const parents = hierarchy->parents.data;
+        const size_t *const ends = hierarchy->ends.data;
+        const size_t *const positions = hierarchy->positions.data;
+        assert(parentPosition < position || parentPosition >= ends[position]);
+        if (parents[position] == parentPosition) {
+                return;
+        }
+
+        // The whole subtree goes to the end of the new parent's
+        const size_t size = ends[position] - position;
+        const size_t oldParent = idxs[parents[position]];
+        moveSubtree(hierarchy, position, ends[position],
+                    ends[parentPosition]);
+        parents[positions[idx]] = positions[parent];
+        resizeSubtrees(hierarchy, positions[oldParent], size, 0);
+        resizeSubtrees(hierarchy, positions[parent], 0, size);
+}
+
+void hierarchy_move(struct hierarchy *const hierarchy,
+                    const size_t from, const size_t to) {
+        if (!hierarchy->valid) {
+                return;
+        }
+
+        size_t *const fromPosition = positionOf(hierarchy, from);
+        const size_t position = *fromPosition;
+        assert(position != HIERARCHY_NONE && position != 0);
+        *fromPosition = HIERARCHY_NONE;
+        *positionOf(hierarchy, to) = position;
+        size_t *const idx = growingArray_get(&hierarchy->idxs, position);
+        *idx = to;
+}
+
+void hierarchy_free(struct hierarchy *const hierarchy) {
+        growingArray_destroy(&hierarchy->idxs);
+        growingArray_destroy(&hierarchy->parents);
+        growingArray_destroy(&hierarchy->ends);
+        growingArray_destroy(&hierarchy->positions);
+        hierarchy->valid = false;
+}
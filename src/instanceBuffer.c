@@ -0,0 +1,56 @@
+#include <thirty/instanceBuffer.h>
+#include <glad/glad.h>
+#include <thirty/util.h>
+
+#define INSTANCEBUFFER_INITIAL_MATRICES 256
+
+void instanceBuffer_init(struct instanceBuffer *const instances) {
+        growingArray_init(&instances->models, sizeof(mat4s),
+                          INSTANCEBUFFER_INITIAL_MATRICES);
+        instances->capacity = INSTANCEBUFFER_INITIAL_MATRICES;
+
+        glGenBuffers(1, &instances->buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instances->buffer);
+        glBufferData(GL_ARRAY_BUFFER,
+                     (GLsizeiptr)(instances->capacity * sizeof(mat4s)), NULL,
+                     GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void instanceBuffer_begin(struct instanceBuffer *const instances) {
+        growingArray_clear(&instances->models);
+}
+
+size_t instanceBuffer_add(struct instanceBuffer *const instances,
+                          const mat4s model) {
+        mat4s *const slot = growingArray_append(&instances->models);
+        *slot = model;
+        return instances->models.length - 1;
+}
+
+void instanceBuffer_end(struct instanceBuffer *const instances) {
+        const size_t count = instances->models.length;
+        if (count == 0) {
+                return;
+        }
+
+        // Orphan the last frame's storage instead of waiting for the draws
+        // still reading from it
+        glBindBuffer(GL_ARRAY_BUFFER, instances->buffer);
+        while (instances->capacity < count) {
+                instances->capacity *= 2;
+        }
+        glBufferData(GL_ARRAY_BUFFER,
+                     (GLsizeiptr)(instances->capacity * sizeof(mat4s)),
+                     NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0,
+                        (GLsizeiptr)(count * sizeof(mat4s)),
+                        instances->models.data);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void instanceBuffer_free(struct instanceBuffer *const instances) {
+        glDeleteBuffers(1, &instances->buffer);
+        instances->buffer = 0;
+        growingArray_destroy(&instances->models);
+}
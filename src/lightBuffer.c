@@ -0,0 +1,132 @@
+#include <thirty/lightBuffer.h>
+#include <thirty/util.h>
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void markDirty(struct lightBuffer *const buffer, const size_t start,
+                      const size_t size) {
+        if (start < buffer->dirtyStart) {
+                buffer->dirtyStart = start;
+        }
+        if (start + size > buffer->dirtyEnd) {
+                buffer->dirtyEnd = start + size;
+        }
+}
+
+void lightBuffer_init(struct lightBuffer *const buffer) {
+        memset(&buffer->data, 0, sizeof(buffer->data));
+        memset(buffer->models, 0, sizeof(buffer->models));
+        memset(&buffer->view, 0, sizeof(buffer->view));
+        for (size_t i=0; i<NUM_LIGHTS; i++) {
+                buffer->stale[i] = true;
+        }
+        buffer->dirtyStart = sizeof(buffer->data);
+        buffer->dirtyEnd = 0;
+
+        glGenBuffers(1, &buffer->ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer->ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(buffer->data), &buffer->data,
+                     GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void lightBuffer_begin(struct lightBuffer *const buffer, const mat4s view,
+                       const vec4s globalAmbient) {
+        // View space positions of all lights have to be computed again
+        if (memcmp(&view, &buffer->view, sizeof(view)) != 0) {
+                buffer->view = view;
+                for (size_t i=0; i<NUM_LIGHTS; i++) {
+                        buffer->stale[i] = true;
+                }
+        }
+
+        if (memcmp(&globalAmbient, &buffer->data.globalAmbient,
+                   sizeof(globalAmbient)) != 0) {
+                buffer->data.globalAmbient = globalAmbient;
+                markDirty(buffer, offsetof(struct lightBufferData,
+                                           globalAmbient),
+                          sizeof(globalAmbient));
+        }
+}
+
+void lightBuffer_set(struct lightBuffer *const buffer, const size_t which,
+                     const struct light *const light, const mat4s model) {
+        assert(light->base.type == COMPONENT_LIGHT_DIRECTION ||
+               light->base.type == COMPONENT_LIGHT_POINT ||
+               light->base.type == COMPONENT_LIGHT_SPOT);
+        assert(which < NUM_LIGHTS);
+
+        struct lightBufferLight *const packed = &buffer->data.lights[which];
+        struct lightBufferLight new = *packed;
+        new.enabled = light->enabled;
+        new.color = light->color;
+        new.attenuation_constant = light->attenuation_constant;
+        new.attenuation_linear = light->attenuation_linear;
+        new.attenuation_quadratic = light->attenuation_quadratic;
+        new.intensity = light->intensity;
+        new.angle = light->angle;
+        new.type = (uint32_t)(light->base.type - COMPONENT_LIGHT);
+
+        // Positions are kept for as long as the light and the camera don't
+        // move, disabled lights don't have any
+        if (light->enabled && (buffer->stale[which] ||
+                               memcmp(&model, &buffer->models[which],
+                                      sizeof(model)) != 0)) {
+                // Lights point down their -Z axis. The model matrix may be
+                // scaled, so normalize instead of decomposing it.
+                new.position_ws = model.col[3];
+                new.direction_ws = glms_vec4(
+                        glms_vec3_normalize(glms_vec3(
+                                glms_vec4_scale(model.col[2], -1))), 0);
+                new.position_vs = glms_mat4_mulv(buffer->view,
+                                                 new.position_ws);
+                new.direction_vs = glms_mat4_mulv(buffer->view,
+                                                  new.direction_ws);
+                buffer->models[which] = model;
+                buffer->stale[which] = false;
+        }
+
+        if (memcmp(&new, packed, sizeof(new)) != 0) {
+                *packed = new;
+                markDirty(buffer, offsetof(struct lightBufferData, lights) +
+                          which * sizeof(*packed), sizeof(*packed));
+        }
+}
+
+void lightBuffer_end(struct lightBuffer *const buffer, const size_t nlights) {
+        assert(nlights <= NUM_LIGHTS);
+        for (size_t i=nlights; i<NUM_LIGHTS; i++) {
+                struct lightBufferLight *const packed =
+                        &buffer->data.lights[i];
+                if (packed->enabled) {
+                        packed->enabled = false;
+                        markDirty(buffer,
+                                  offsetof(struct lightBufferData, lights) +
+                                  i * sizeof(*packed), sizeof(*packed));
+                }
+        }
+        if (buffer->data.nlights != nlights) {
+                buffer->data.nlights = (uint32_t)nlights;
+                markDirty(buffer, offsetof(struct lightBufferData, nlights),
+                          sizeof(buffer->data.nlights));
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer->ubo);
+        if (buffer->dirtyStart < buffer->dirtyEnd) {
+                glBufferSubData(GL_UNIFORM_BUFFER,
+                                (GLintptr)buffer->dirtyStart,
+                                (GLsizeiptr)(buffer->dirtyEnd -
+                                             buffer->dirtyStart),
+                                (const char*)&buffer->data +
+                                buffer->dirtyStart);
+                buffer->dirtyStart = sizeof(buffer->data);
+                buffer->dirtyEnd = 0;
+        }
+        glBindBufferBase(GL_UNIFORM_BUFFER, SHADER_BLOCK_LIGHTS, buffer->ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void lightBuffer_free(struct lightBuffer *const buffer) {
+        glDeleteBuffers(1, &buffer->ubo);
+        buffer->ubo = 0;
+}
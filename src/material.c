@@ -1,5 +1,6 @@
 #include <thirty/material.h>
 #include <thirty/asyncLoader.h>
+#include <thirty/materialBuffer.h>
 #include <thirty/util.h>
 
 #define getTextureInfo(cnst, material, tex, textureType)                \
@@ -286,6 +287,14 @@ void material_unsetTexture(struct material *const material,
         }
 }
 
+struct texture *material_getTexture(struct material *const material,
+                                    const enum material_textureType tex) {
+        assert(material->base.type == COMPONENT_MATERIAL_SKYBOX ||
+               material->base.type == COMPONENT_MATERIAL_UBER);
+
+        return getVarTextureInfo(material, tex, NULL);
+}
+
 bool material_isTransparent(const struct material *const material) {
         assert(material->base.type == COMPONENT_MATERIAL_SKYBOX ||
                material->base.type == COMPONENT_MATERIAL_UBER);
@@ -297,6 +306,23 @@ bool material_isTransparent(const struct material *const material) {
         return false;
 }
 
+// Whether the material's textures are loaded, return whether it changed
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((nonnull))
+static bool packTextures(const struct material_uber *const material,
+                         struct materialBlock *const block) {
+        const struct materialBlock old = *block;
+        block->hasAmbientTexture = material->ambientTexture.loaded;
+        block->hasEmissiveTexture = material->emissiveTexture.loaded;
+        block->hasDiffuseTexture = material->diffuseTexture.loaded;
+        block->hasSpecularTexture = material->specularTexture.loaded;
+        block->hasNormalTexture = material->normalTexture.loaded;
+        block->hasBumpTexture = material->bumpTexture.loaded;
+        block->hasOpacityTexture = material->opacityTexture.loaded;
+        return memcmp(&old, block, sizeof(old)) != 0;
+}
+
 void material_updateShader(const struct material *const material) {
         assert(material->base.type == COMPONENT_MATERIAL_SKYBOX ||
                material->base.type == COMPONENT_MATERIAL_UBER);
@@ -304,49 +330,12 @@ void material_updateShader(const struct material *const material) {
         if (material->base.type == COMPONENT_MATERIAL_UBER) {
                 const struct material_uber *const mat =
                         (const struct material_uber*)material;
-                shader_setVec4(material->shader, "material.ambientColor",
-                               mat->ambientColor);
-                shader_setVec4(material->shader, "material.emissiveColor",
-                               mat->emissiveColor);
-                shader_setVec4(material->shader, "material.diffuseColor",
-                               mat->diffuseColor);
-                shader_setVec4(material->shader, "material.specularColor",
-                               mat->specularColor);
-        
-                shader_setFloat(material->shader, "material.opacity",
-                                mat->opacity);
-                shader_setFloat(material->shader, "material.specularPower",
-                                mat->specularPower);
-                shader_setFloat(material->shader, "material.reflectance",
-                               mat->reflectance);
-                shader_setFloat(material->shader, "material.refraction",
-                               mat->refraction);
-                shader_setFloat(material->shader, "material.indexOfRefraction",
-                                mat->indexOfRefraction);
-
-                shader_setBool(material->shader, "material.hasAmbientTexture",
-                               mat->ambientTexture.loaded);
-                shader_setBool(material->shader, "material.hasEmissiveTexture",
-                               mat->emissiveTexture.loaded);
-                shader_setBool(material->shader, "material.hasDiffuseTexture",
-                               mat->diffuseTexture.loaded);
-                shader_setBool(material->shader, "material.hasSpecularTexture",
-                               mat->specularTexture.loaded);
-                shader_setBool(material->shader, "material.hasNormalTexture",
-                               mat->normalTexture.loaded);
-                shader_setBool(material->shader, "material.hasBumpTexture",
-                               mat->bumpTexture.loaded);
-                shader_setBool(material->shader, "material.hasOpacityTexture",
-                               mat->opacityTexture.loaded);
-        
-                shader_setFloat(material->shader, "material.bumpIntensity",
-                                mat->bumpIntensity);
-                shader_setFloat(material->shader, "material.specularScale",
-                                mat->specularScale);
-                shader_setFloat(material->shader, "material.alphaThreshold",
-                                mat->alphaThreshold);
-                shader_setBool(material->shader, "material.alphaBlendingMode",
-                               mat->alphaBlendingMode);
+                // Textures are loaded asynchronously, and only that changes
+                // without a call to material_uber_update
+                if (packTextures(mat, materialBuffer_get(mat->block))) {
+                        materialBuffer_update(mat->block);
+                }
+                materialBuffer_bind(mat->block);
         }
 }
 
@@ -373,6 +362,10 @@ void material_free(struct material *const material) {
              tex < MATERIAL_TEXTURE_TOTAL; tex++) {
                 material_unsetTexture(material, tex);
         }
+        if (material->base.type == COMPONENT_MATERIAL_UBER) {
+                materialBuffer_remove(
+                        ((const struct material_uber*)material)->block);
+        }
 }
 
 __attribute__((access (write_only, 1)))
@@ -412,6 +405,7 @@ void material_uber_initDefaults(struct material_uber *const material,
         material->alphaBlendingMode = false;
 
         uberInitTexturesEmpty(material);
+        material_uber_initBlock(material);
 }
 
 void material_uber_initFromFile(struct material_uber *const material, FILE *const f,
@@ -438,6 +432,7 @@ void material_uber_initFromFile(struct material_uber *const material, FILE *cons
         material->alphaBlendingMode = alphaBlendingMode;
         
         uberInitTexturesEmpty(material);
+        material_uber_initBlock(material);
 
         for (enum material_textureType tex = MATERIAL_TEXTURE_AMBIENT;
              tex < MATERIAL_TEXTURE_TOTAL; tex++) {
@@ -460,6 +455,43 @@ void material_uber_initFromFile(struct material_uber *const material, FILE *cons
         }
 }
 
+void material_uber_initBlock(struct material_uber *const material) {
+        material->block = materialBuffer_add();
+        material_uber_update(material);
+}
+
+// Times a material went from opaque to transparent or back
+static size_t stageChanges = 0;
+
+size_t material_stageChanges(void) {
+        return stageChanges;
+}
+
+void material_uber_update(const struct material_uber *const material) {
+        assert(material->base.base.type == COMPONENT_MATERIAL_UBER);
+
+        struct materialBlock *const block = materialBuffer_get(
+                material->block);
+        if ((block->alphaBlendingMode != 0) != material->alphaBlendingMode) {
+                stageChanges++;
+        }
+        block->ambientColor = material->ambientColor;
+        block->emissiveColor = material->emissiveColor;
+        block->diffuseColor = material->diffuseColor;
+        block->specularColor = material->specularColor;
+        block->opacity = material->opacity;
+        block->specularPower = material->specularPower;
+        block->reflectance = material->reflectance;
+        block->refraction = material->refraction;
+        block->indexOfRefraction = material->indexOfRefraction;
+        block->bumpIntensity = material->bumpIntensity;
+        block->specularScale = material->specularScale;
+        block->alphaThreshold = material->alphaThreshold;
+        block->alphaBlendingMode = material->alphaBlendingMode;
+        packTextures(material, block);
+        materialBuffer_update(material->block);
+}
+
 void material_skybox_init(struct material_skybox *const material,
                           const char *name, const enum shaders shader) {
         material_init(&material->base, name, shader,
@@ -0,0 +1,111 @@
+#include <thirty/materialBuffer.h>
+#include <thirty/shader.h>
+#include <thirty/dsutils.h>
+#include <thirty/util.h>
+
+#define MATERIALBUFFER_INITIAL_SLOTS 16
+
+// Slots in memory, with holes for the free ones
+static struct growingArray slots;
+static bool initialized;
+
+static unsigned ubo;
+static size_t capacity;  // in slots, of the OpenGL buffer
+static size_t dirtyStart = SIZE_MAX;  // slots to upload
+static size_t dirtyEnd;
+
+size_t materialBuffer_add(void) {
+        if (!initialized) {
+                growingArray_init(&slots, MATERIALBUFFER_STRIDE,
+                                  MATERIALBUFFER_INITIAL_SLOTS);
+                initialized = true;
+        }
+
+        // Free slots are the array's holes, which are filled first
+        void *const block = growingArray_append(&slots);
+        memset(block, 0, MATERIALBUFFER_STRIDE);
+        const size_t slot = (size_t)((char*)block - (char*)slots.data) /
+                MATERIALBUFFER_STRIDE;
+        materialBuffer_update(slot);
+        return slot;
+}
+
+struct materialBlock *materialBuffer_get(const size_t slot) {
+        assert(initialized);
+        return growingArray_get(&slots, slot);
+}
+
+void materialBuffer_update(const size_t slot) {
+        if (slot < dirtyStart) {
+                dirtyStart = slot;
+        }
+        if (slot + 1 > dirtyEnd) {
+                dirtyEnd = slot + 1;
+        }
+}
+
+static void upload(void) {
+        if (ubo == 0) {
+                GLint alignment;
+                glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+                if (alignment <= 0 || MATERIALBUFFER_STRIDE % alignment != 0) {
+                        die("Unsupported uniform buffer offset alignment: "
+                            "%d\n", alignment);
+                }
+                glGenBuffers(1, &ubo);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+
+        // Everything again if it doesn't fit
+        if (slots.fragLength > capacity) {
+                capacity = slots.capacity;
+                glBufferData(GL_UNIFORM_BUFFER,
+                             (GLsizeiptr)(capacity * MATERIALBUFFER_STRIDE),
+                             NULL, GL_DYNAMIC_DRAW);
+                dirtyStart = 0;
+                dirtyEnd = slots.fragLength;
+        }
+        if (dirtyEnd > slots.fragLength) {
+                dirtyEnd = slots.fragLength;
+        }
+        if (dirtyStart < dirtyEnd) {
+                glBufferSubData(GL_UNIFORM_BUFFER,
+                                (GLintptr)(dirtyStart * MATERIALBUFFER_STRIDE),
+                                (GLsizeiptr)((dirtyEnd - dirtyStart) *
+                                             MATERIALBUFFER_STRIDE),
+                                (const char*)slots.data +
+                                dirtyStart * MATERIALBUFFER_STRIDE);
+        }
+        dirtyStart = SIZE_MAX;
+        dirtyEnd = 0;
+}
+
+void materialBuffer_bind(const size_t slot) {
+        assert(initialized && slot < slots.fragLength);
+        if (dirtyStart < dirtyEnd || ubo == 0) {
+                upload();
+        }
+        glBindBufferRange(GL_UNIFORM_BUFFER, SHADER_BLOCK_MATERIAL, ubo,
+                          (GLintptr)(slot * MATERIALBUFFER_STRIDE),
+                          sizeof(struct materialBlock));
+}
+
+void materialBuffer_remove(const size_t slot) {
+        assert(initialized);
+        growingArray_remove(&slots, slot);
+}
+
+void materialBuffer_destroy(void) {
+        if (!initialized) {
+                return;
+        }
+        if (ubo != 0) {
+                glDeleteBuffers(1, &ubo);
+                ubo = 0;
+        }
+        capacity = 0;
+        dirtyStart = SIZE_MAX;
+        dirtyEnd = 0;
+        growingArray_destroy(&slots);
+        initialized = false;
+}
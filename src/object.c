@@ -1,20 +1,23 @@
 #include <thirty/object.h>
+#include <thirty/game.h>
 #include <thirty/util.h>
 
 void object_initEmpty(struct object *const object, struct game *const game,
-                      const size_t scene, const char *const name,
                       struct varSizeGrowingArray *components) {
-        object->game = game;
-        object->name = sstrdup(name);
-        object->scene = scene;
         object->componentsMemory = components;
-        growingArray_init(&object->children, sizeof(size_t), 1);
+        object->parent = 0;
+        object->firstChild = 0;
+        object->nextSibling = 0;
+        object->prevSibling = 0;
         componentCollection_init(&object->components);
         object->onUpdate = NULL;
+        object->threadSafe = false;
 
         struct transform *trans = componentCollection_create(components, game, COMPONENT_TRANSFORM);
-        object_setComponent(object, &trans->base);
+        componentCollection_set(components, &object->components, object->idx,
+                                COMPONENT_TRANSFORM, trans->base.idx);
         transform_init(trans, GLMS_MAT4_IDENTITY);
+        trans->scene = object_getScene(object);
 }
 
 static inline void assign_idx(struct object *const object,
@@ -29,16 +32,15 @@ static inline void assign_idx(struct object *const object,
         }
 }
 
-void object_initFromFile(struct object *const object,
-                         struct game *const game, struct varSizeGrowingArray *components,
-                         const size_t scene, const size_t idxOffset,
-                         const unsigned ncams, const unsigned ngeos,
-                         const unsigned nmats, const unsigned nlights,
-                         const unsigned nanims,
-                         FILE *const f) {
+char *object_initFromFile(struct object *const object,
+                          struct game *const game, struct varSizeGrowingArray *components,
+                          const size_t idxOffset,
+                          const unsigned ncams, const unsigned ngeos,
+                          const unsigned nmats, const unsigned nlights,
+                          const unsigned nanims,
+                          FILE *const f) {
         char *name = strfile(f);
-        object_initEmpty(object, game, scene, name, components);
-        free(name);
+        object_initEmpty(object, game, components);
 
         size_t offset = idxOffset;
         assign_idx(object, COMPONENT_CAMERA, offset, f);
@@ -55,36 +57,60 @@ void object_initFromFile(struct object *const object,
 
         mat4s model;
         sfread(model.raw, sizeof(float), sizeof(model) / sizeof(float), f);
-        struct transform *trans = object_getComponent(
-                object, COMPONENT_TRANSFORM);
-        trans->model = model;
+        struct transform *trans = object_getTransform(object);
+        transform_setMatrix(trans, model);
+        return name;
 }
 
-void object_addChild(struct object *parent, struct object *child) {
-        size_t *const child_idx_ptr = growingArray_append(&parent->children);
-        *child_idx_ptr = child->idx;
-        child->parent = parent->idx;
+struct scene *object_getScene(const struct object *const object) {
+        // Objects point into their scene for their components
+        return (struct scene*)(void*)((char*)object->componentsMemory -
+                                      offsetof(struct scene, components));
 }
 
-void object_removeChild(struct object *parent, struct object *child) {
-        child->parent = 0;
-
-        size_t n = 0;
-        bool found = false;
-        growingArray_foreach_START(&parent->children, size_t *, child_idx_ptr) {
-                if (*child_idx_ptr == child->idx) {
-                        n = growingArray_foreach_idx;
-                        found = true;
-                        break;
-                }
-        } growingArray_foreach_END;
-        assert(found);
-        
-        growingArray_remove(&parent->children, n);
+struct game *object_getGame(const struct object *const object) {
+        return object_getScene(object)->game;
+}
+
+const char *object_getName(const struct object *const object) {
+        const struct objectInfo *const info = growingArray_get(
+                &object_getScene(object)->objectInfo, object->idx);
+        return info->name;
+}
+
+// Let the scene know if the object now has something to update, or no longer
+// does
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static void refreshActive(const struct object *const object) {
+        activeSet_refresh(&object_getScene(object)->active, object);
 }
 
 void object_setComponent(struct object *object, struct component *comp) {
+        if (comp->type == COMPONENT_ANIMATIONCOLLECTION &&
+            object->components.animationCollection != comp->idx + 1) {
+                scene_handOffAnimation(object_getScene(object), object);
+        }
         componentCollection_set(object->componentsMemory, &object->components, object->idx, comp->type, comp->idx);
+        if (comp->type == COMPONENT_ANIMATIONCOLLECTION) {
+                refreshActive(object);
+        } else if (comp->type == COMPONENT_GEOMETRY) {
+                bvh_refresh(&object_getScene(object)->bvh, object);
+                renderQueue_refresh(&object_getScene(object)->renderQueue,
+                                    object->idx);
+        } else if (comp->type == COMPONENT_MATERIAL ||
+                   comp->type == COMPONENT_MATERIAL_SKYBOX) {
+                renderQueue_refresh(&object_getScene(object)->renderQueue,
+                                    object->idx);
+        }
+        // The references to components it gathered are out of date
+        compaction_restart(&object_getScene(object)->compaction);
+}
+
+void object_setOnUpdate(struct object *const object,
+                        const eventBrokerCallback onUpdate) {
+        object->onUpdate = onUpdate;
+        refreshActive(object);
 }
 
 void *object_getComponent(const struct object *object,
@@ -99,25 +125,24 @@ void object_update(struct object *const object, const float timeDelta) {
                 };
                 object->onUpdate(object, &args);
         }
-        componentCollection_update(object->componentsMemory, &object->components, timeDelta);
+        componentCollection_update(object->componentsMemory, &object->components,
+                                   object->idx, timeDelta);
 }
 
-bool object_draw(const struct object *const object, mat4s model,
-                 mat4s view, const mat4s projection,
-                 enum renderStage *const lastRenderStage,
-                 const struct material **const lastMaterial,
-                 enum shaders *const lastShader) {
-        const struct geometry *const geometry = object_getComponent(
-                object, COMPONENT_GEOMETRY);
-
-        if (geometry == NULL) {
-                // All objects without geometry are lumped at the end. If we
-                // find one, we're done.
-                return false;
-        }
-
-        const struct material *const material = object_getComponent(
-                object, COMPONENT_MATERIAL);
+// Switch to the object's render stage, shader and material, if they aren't
+// the last ones used, and return the material
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((access (read_write, 3)))
+__attribute__((access (read_write, 4)))
+__attribute__((nonnull))
+__attribute__((returns_nonnull))
+static const struct material *prepareDraw(
+        const struct object *const object,
+        enum renderStage *const lastRenderStage,
+        const struct material **const lastMaterial,
+        enum shaders *const lastShader) {
+        const struct material *const material = object_getMaterial(object);
         assert(material != NULL);
 
         // Sanity checks, if objects are well sorted this should always pass
@@ -129,25 +154,12 @@ bool object_draw(const struct object *const object, mat4s model,
         if (material->base.type == COMPONENT_MATERIAL_SKYBOX) {
                 *lastRenderStage = RENDER_SKYBOX;
                 glDepthFunc(GL_LEQUAL);
-
-                model.col[3] = (vec4s){{0, 0, 0, 1}};
-                model.m03 = 0;
-                model.m13 = 0;
-                model.m23 = 0;
-                model.m33 = 1;
-                
-                view.col[3] = (vec4s){{0, 0, 0, 1}};
-                view.m03 = 0;
-                view.m13 = 0;
-                view.m23 = 0;
-                view.m33 = 1;
         }
 
         const enum shaders shader = material->shader;
         if (shader != *lastShader) {
                 shader_use(shader);
                 *lastShader = shader;
-                shader_setMat4(shader, "invView", glms_mat4_inv(view));
         }
         if (material != *lastMaterial) {
                 material_updateShader(material);
@@ -155,32 +167,82 @@ bool object_draw(const struct object *const object, mat4s model,
                 *lastMaterial = material;
         }
 
-        struct animationCollection *anims = object_getComponent(
-                object, COMPONENT_ANIMATIONCOLLECTION);
-        if (anims != NULL) {
-                animationCollection_bindBones(anims, shader);
-        }
-
         if (*lastRenderStage == RENDER_OPAQUE_OBJECTS &&
             material_isTransparent(material)) {
                 *lastRenderStage = RENDER_TRANSPARENT_OBJECTS;
                 glEnable(GL_BLEND);
                 glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         }
-        
-        const mat4s modelView = glms_mat4_mul(view, model);
-        const mat4s modelViewProjection =
-                glms_mat4_mul(projection, modelView);
-        
-        shader_setMat4(shader, "modelView", modelView);
-        shader_setMat4(shader, "modelViewProjection", modelViewProjection);
+
+        return material;
+}
+
+bool object_draw(const struct object *const object, mat4s model,
+                 const struct bonePalette *const bones,
+                 enum renderStage *const lastRenderStage,
+                 const struct material **const lastMaterial,
+                 enum shaders *const lastShader) {
+        const struct geometry *const geometry = object_getGeometry(object);
+
+        if (geometry == NULL) {
+                // All objects without geometry are lumped at the end. If we
+                // find one, we're done.
+                return false;
+        }
+
+        const struct material *const material = prepareDraw(
+                object, lastRenderStage, lastMaterial, lastShader);
+        const enum shaders shader = material->shader;
+
+        if (material->base.type == COMPONENT_MATERIAL_SKYBOX) {
+                model.col[3] = (vec4s){{0, 0, 0, 1}};
+                model.m03 = 0;
+                model.m13 = 0;
+                model.m23 = 0;
+                model.m33 = 1;
+        }
+
+        const struct animationCollection *const anims =
+                object_getAnimationCollection(object);
+        if (anims != NULL) {
+                shader_setUniformInt(shader, SHADER_UNIFORM_BONEOFFSET,
+                                     (int)bonePalette_offset(bones, anims));
+        }
+
+        // Only uploaded if the shader's last draw was instanced
+        shader_setUniformBool(shader, SHADER_UNIFORM_INSTANCED, false);
+        shader_setUniformMat4(shader, SHADER_UNIFORM_MODEL, model);
 
         geometry_draw(geometry);
 
         return true;
 }
 
-void object_free(struct object *object) {
-        free(object->name);
-        growingArray_destroy(&object->children);
+bool object_isInstanceable(const struct object *const object) {
+        const struct geometry *const geometry = object_getGeometry(object);
+        if (geometry == NULL || !geometry->loaded) {
+                return false;
+        }
+        const struct material *const material = object_getMaterial(object);
+        assert(material != NULL);
+        return material->base.type != COMPONENT_MATERIAL_SKYBOX &&
+                object_getAnimationCollection(object) == NULL;
+}
+
+void object_drawInstanced(const struct object *const object,
+                          const struct instanceBuffer *const instances,
+                          const size_t first, const size_t count,
+                          enum renderStage *const lastRenderStage,
+                          const struct material **const lastMaterial,
+                          enum shaders *const lastShader) {
+        assert(object_isInstanceable(object));
+
+        const struct material *const material = prepareDraw(
+                object, lastRenderStage, lastMaterial, lastShader);
+
+        shader_setUniformBool(material->shader, SHADER_UNIFORM_INSTANCED,
+                              true);
+
+        geometry_drawInstanced(object_getGeometry(object), instances,
+                               first, count);
 }
@@ -0,0 +1,59 @@
+#include <thirty/prefab.h>
+#include <thirty/scene.h>
+#include <thirty/util.h>
+
+#define PREFAB_INITIAL_CAPACITY 8
+
+// Add a node for the object and, after it, nodes for all of its descendants
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((access (read_only, 3)))
+__attribute__((nonnull))
+static void addNode(struct prefab *const prefab, struct scene *const scene,
+                    const struct object *const object, const size_t parent,
+                    const unsigned depth) {
+        if (depth >= OBJECT_TREE_MAXIMUM_DEPTH) {
+                die("Prefab too deep\n");
+        }
+
+        const size_t n = prefab->nodes.length;
+        struct prefabNode *const node = growingArray_append(&prefab->nodes);
+        node->name = sstrdup(object_getName(object));
+        node->parent = parent;
+        node->components = object->components;
+        node->components.transform = 0;
+        node->onUpdate = object->onUpdate;
+        node->threadSafe = object->threadSafe;
+
+        const struct transform *const trans = object_getTransform(object);
+        if (trans != NULL) {
+                node->transform = *trans;
+                // Only its instances belong to the scene
+                node->transform.scene = NULL;
+        } else {
+                node->transform.base.type = COMPONENT_TRANSFORM;
+                node->transform.scene = NULL;
+                transform_reset(&node->transform);
+        }
+
+        for (size_t child=object->firstChild; child!=0;
+             child=scene_getObjectFromIdxConst(scene, child)->nextSibling) {
+                addNode(prefab, scene, scene_getObjectFromIdxConst(
+                                scene, child), n, depth + 1);
+        }
+}
+
+void prefab_init(struct prefab *const prefab, struct scene *const scene,
+                 const size_t idx) {
+        assert(idx != 0);
+        growingArray_init(&prefab->nodes, sizeof(struct prefabNode),
+                          PREFAB_INITIAL_CAPACITY);
+        addNode(prefab, scene, scene_getObjectFromIdxConst(scene, idx), 0, 0);
+}
+
+void prefab_free(struct prefab *const prefab) {
+        growingArray_foreach_START(&prefab->nodes, struct prefabNode *, node)
+                free(node->name);
+        growingArray_foreach_END;
+        growingArray_destroy(&prefab->nodes);
+}
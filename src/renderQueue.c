@@ -0,0 +1,361 @@
+#include <thirty/renderQueue.h>
+#include <thirty/scene.h>
+#include <thirty/util.h>
+
+#define RENDERQUEUE_INITIAL_ITEMS 64
+
+#define DEPTH_BITS 18
+#define GEOMETRY_BITS 18
+#define MATERIAL_BITS 20
+#define SHADER_BITS 6
+
+#define GEOMETRY_SHIFT DEPTH_BITS
+#define MATERIAL_SHIFT (GEOMETRY_SHIFT + GEOMETRY_BITS)
+#define SHADER_SHIFT (MATERIAL_SHIFT + MATERIAL_BITS)
+#define STAGE_SHIFT (SHADER_SHIFT + SHADER_BITS)
+
+#define MASK(bits) ((UINT64_C(1) << (bits)) - 1)
+
+// Radix sort digits
+#define DIGIT_BITS 8
+#define DIGITS (64 / DIGIT_BITS)
+#define BUCKETS (1 << DIGIT_BITS)
+
+void renderQueue_init(struct renderQueue *const queue) {
+        growingArray_init(&queue->items, sizeof(struct renderItem),
+                          RENDERQUEUE_INITIAL_ITEMS);
+        growingArray_init(&queue->slots, sizeof(size_t),
+                          RENDERQUEUE_INITIAL_ITEMS);
+        growingArray_init(&queue->scratch, sizeof(struct renderItem),
+                          RENDERQUEUE_INITIAL_ITEMS);
+        growingArray_init(&queue->stale, sizeof(size_t),
+                          RENDERQUEUE_INITIAL_ITEMS);
+        queue->eye = GLMS_VEC4_ZERO;
+        queue->materialChanges = 0;
+        queue->holes = 0;
+        queue->sorted = true;
+        queue->valid = false;
+        queue->sorts = 0;
+}
+
+void renderQueue_invalidate(struct renderQueue *const queue) {
+        growingArray_clear(&queue->items);
+        growingArray_clear(&queue->slots);
+        growingArray_clear(&queue->stale);
+        queue->holes = 0;
+        queue->sorted = true;
+        queue->valid = false;
+}
+
+// The top bits of a float that isn't negative, which keep its order
+static uint64_t quantizeDepth(const float depth) {
+        if (!(depth > 0)) {
+                return 0;
+        }
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits >> (31 - DEPTH_BITS);
+}
+
+uint64_t renderQueue_pack(const unsigned stage, const unsigned shader,
+                          const size_t material, const size_t geometry,
+                          const float depth) {
+        assert(stage <= RENDER_SKYBOX);
+        assert(shader <= MASK(SHADER_BITS));
+
+        uint64_t key = (uint64_t)stage << STAGE_SHIFT |
+                (uint64_t)shader << SHADER_SHIFT |
+                (material & MASK(MATERIAL_BITS)) << MATERIAL_SHIFT |
+                quantizeDepth(depth);
+        // Transparent objects have to stay in order
+        if (stage == RENDER_OPAQUE_OBJECTS) {
+                key |= (geometry & MASK(GEOMETRY_BITS)) << GEOMETRY_SHIFT;
+        }
+        return key;
+}
+
+uint64_t renderQueue_key(const struct object *const object,
+                         const float depth) {
+        const struct geometry *const geometry = object_getGeometry(object);
+        const struct material *const material = object_getMaterial(object);
+        assert(geometry != NULL);
+        assert(material != NULL);
+
+        enum renderStage stage = RENDER_OPAQUE_OBJECTS;
+        if (material->base.type == COMPONENT_MATERIAL_SKYBOX) {
+                stage = RENDER_SKYBOX;
+        } else if (material_isTransparent(material)) {
+                stage = RENDER_TRANSPARENT_OBJECTS;
+        }
+
+        return renderQueue_pack(stage, material->shader, material->base.idx,
+                                geometry->base.idx, depth);
+}
+
+// Items never have holes in the array, only items that are holes, so it can
+// be indexed directly
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+__attribute__((returns_nonnull))
+static inline struct renderItem *item(const struct renderQueue *const queue,
+                                      const size_t n) {
+        assert(n < queue->items.length);
+        return (struct renderItem*)queue->items.data + n;
+}
+
+// Return the slot entry of the given object, making room for it if it's a
+// new one
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+__attribute__((returns_nonnull))
+static size_t *slotOf(struct renderQueue *const queue, const size_t idx) {
+        while (queue->slots.length <= idx) {
+                size_t *const slot = growingArray_append(&queue->slots);
+                *slot = RENDERQUEUE_NONE;
+        }
+        return growingArray_get(&queue->slots, idx);
+}
+
+// Whether the item at the given position has a key between its neighbors'
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static bool inOrder(const struct renderQueue *const queue, const size_t n) {
+        const uint64_t key = item(queue, n)->key;
+        const size_t last = queue->items.length - 1;
+        return (n == 0 || item(queue, n - 1)->key <= key) &&
+                (n == last || item(queue, n + 1)->key >= key);
+}
+
+// Key of an object from the scene's camera
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static uint64_t keyOf(const struct renderQueue *const queue,
+                      const struct object *const object) {
+        const struct transform *const trans = object_getTransform(object);
+        assert(trans != NULL);
+        return renderQueue_key(object, glms_vec4_distance(
+                                       queue->eye, trans->world.col[3]));
+}
+
+// Add, set the key of or remove the item of an object, depending on whether
+// it's drawn. Objects removed since they were queued are left alone.
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void refreshObject(struct scene *const scene, const size_t idx) {
+        struct renderQueue *const queue = &scene->renderQueue;
+        const struct hierarchy *const hierarchy = &scene->hierarchy;
+        if (idx >= hierarchy->positions.length ||
+            ((const size_t*)hierarchy->positions.data)[idx] ==
+            HIERARCHY_NONE) {
+                return;
+        }
+
+        const struct object *const object = scene_getObjectFromIdxConst(
+                scene, idx);
+        if (object_getGeometry(object) != NULL &&
+            object_getMaterial(object) != NULL) {
+                renderQueue_set(queue, idx, keyOf(queue, object));
+        } else {
+                renderQueue_remove(queue, idx);
+        }
+}
+
+void renderQueue_update(struct scene *const scene, const vec4s eye) {
+        struct renderQueue *const queue = &scene->renderQueue;
+        hierarchy_update(scene);
+        const size_t materialChanges = material_stageChanges();
+        const bool everyKey = !glms_vec4_eqv(eye, queue->eye) ||
+                materialChanges != queue->materialChanges;
+        queue->eye = eye;
+        queue->materialChanges = materialChanges;
+
+        if (!queue->valid) {
+                const size_t *const idxs = scene->hierarchy.idxs.data;
+                for (size_t i=0; i<scene->hierarchy.idxs.length; i++) {
+                        refreshObject(scene, idxs[i]);
+                }
+                growingArray_clear(&queue->stale);
+                queue->valid = true;
+                renderQueue_order(queue);
+                return;
+        }
+
+        // New and removed items first, then the keys of the others
+        const size_t *const stale = queue->stale.data;
+        for (size_t i=0; i<queue->stale.length; i++) {
+                refreshObject(scene, stale[i]);
+        }
+        growingArray_clear(&queue->stale);
+
+        if (everyKey) {
+                // Holes take the key before them to stay in order
+                uint64_t last = 0;
+                for (size_t n=0; n<queue->items.length; n++) {
+                        struct renderItem *const it = item(queue, n);
+                        if (it->object != RENDERQUEUE_NONE) {
+                                it->key = keyOf(queue,
+                                                scene_getObjectFromIdxConst(
+                                                        scene, it->object));
+                                if (it->key < last) {
+                                        queue->sorted = false;
+                                }
+                        } else {
+                                it->key = last;
+                        }
+                        last = it->key;
+                }
+        }
+        renderQueue_order(queue);
+}
+
+void renderQueue_refresh(struct renderQueue *const queue, const size_t idx) {
+        if (!queue->valid) {
+                return;
+        }
+        size_t *const stale = growingArray_append(&queue->stale);
+        *stale = idx;
+}
+
+void renderQueue_set(struct renderQueue *const queue, const size_t idx,
+                     const uint64_t key) {
+        size_t *const slot = slotOf(queue, idx);
+        if (*slot == RENDERQUEUE_NONE) {
+                *slot = queue->items.length;
+                struct renderItem *const new = growingArray_append(
+                        &queue->items);
+                new->key = key;
+                new->object = idx;
+        } else if (item(queue, *slot)->key != key) {
+                item(queue, *slot)->key = key;
+        } else {
+                return;
+        }
+        if (!inOrder(queue, *slot)) {
+                queue->sorted = false;
+        }
+}
+
+void renderQueue_remove(struct renderQueue *const queue, const size_t idx) {
+        if (idx >= queue->slots.length) {
+                return;
+        }
+        size_t *const slot = growingArray_get(&queue->slots, idx);
+        if (*slot == RENDERQUEUE_NONE) {
+                return;
+        }
+
+        // The hole takes the key before it to stay in order
+        struct renderItem *const hole = item(queue, *slot);
+        hole->object = RENDERQUEUE_NONE;
+        hole->key = *slot == 0 ? 0 : item(queue, *slot - 1)->key;
+        *slot = RENDERQUEUE_NONE;
+        queue->holes++;
+}
+
+void renderQueue_move(struct renderQueue *const queue, const size_t from,
+                      const size_t to) {
+        if (from >= queue->slots.length) {
+                return;
+        }
+        size_t *const fromSlot = growingArray_get(&queue->slots, from);
+        const size_t slot = *fromSlot;
+        if (slot == RENDERQUEUE_NONE) {
+                return;
+        }
+        *fromSlot = RENDERQUEUE_NONE;
+        size_t *const toSlot = slotOf(queue, to);
+        assert(*toSlot == RENDERQUEUE_NONE);
+        *toSlot = slot;
+        item(queue, slot)->object = to;
+        // In case it was queued under the idx it had
+        renderQueue_refresh(queue, to);
+}
+
+void renderQueue_order(struct renderQueue *const queue) {
+        if (queue->sorted && queue->holes * 2 <= queue->items.length) {
+                return;
+        }
+
+        // Without the holes, in the same order
+        size_t n = 0;
+        for (size_t i=0; i<queue->items.length; i++) {
+                if (item(queue, i)->object != RENDERQUEUE_NONE) {
+                        *item(queue, n++) = *item(queue, i);
+                }
+        }
+        while (queue->items.length > n) {
+                growingArray_pop(&queue->items);
+        }
+        queue->holes = 0;
+
+        if (!queue->sorted) {
+                growingArray_reserve(&queue->scratch, n);
+                while (queue->scratch.length < n) {
+                        growingArray_append(&queue->scratch);
+                }
+                renderQueue_sort(queue->items.data, queue->scratch.data, n);
+                queue->sorted = true;
+                queue->sorts++;
+        }
+
+        for (size_t i=0; i<n; i++) {
+                *slotOf(queue, item(queue, i)->object) = i;
+        }
+}
+
+void renderQueue_sort(struct renderItem *const items,
+                      struct renderItem *const scratch, const size_t n) {
+        if (n < 2) {
+                return;
+        }
+
+        // Count every digit in a single pass
+        size_t counts[DIGITS][BUCKETS] = {{0}};
+        for (size_t i=0; i<n; i++) {
+                const uint64_t key = items[i].key;
+                for (size_t d=0; d<DIGITS; d++) {
+                        counts[d][(key >> (d * DIGIT_BITS)) & (BUCKETS - 1)]++;
+                }
+        }
+
+        // Least significant digit first, skipping the ones all keys share,
+        // like the unused bits of the depth and the stage
+        struct renderItem *from = items;
+        struct renderItem *to = scratch;
+        for (size_t d=0; d<DIGITS; d++) {
+                const unsigned shift = (unsigned)(d * DIGIT_BITS);
+                size_t *const count = counts[d];
+                if (count[(from[0].key >> shift) & (BUCKETS - 1)] == n) {
+                        continue;
+                }
+
+                size_t offset = 0;
+                for (size_t b=0; b<BUCKETS; b++) {
+                        const size_t c = count[b];
+                        count[b] = offset;
+                        offset += c;
+                }
+                for (size_t i=0; i<n; i++) {
+                        const size_t b = (from[i].key >> shift) &
+                                (BUCKETS - 1);
+                        to[count[b]++] = from[i];
+                }
+
+                struct renderItem *const tmp = from;
+                from = to;
+                to = tmp;
+        }
+
+        if (from != items) {
+                memcpy(items, from, n * sizeof(*items));
+        }
+}
+
+void renderQueue_free(struct renderQueue *const queue) {
+        growingArray_destroy(&queue->items);
+        growingArray_destroy(&queue->slots);
+        growingArray_destroy(&queue->scratch);
+        growingArray_destroy(&queue->stale);
+        queue->valid = false;
+}
@@ -1,61 +1,100 @@
 #include <thirty/scene.h>
+#include <thirty/sceneImage.h>
 #include <thirty/util.h>
 #include <thirty/asyncLoader.h>
+#include <thirty/vectorMath.h>
+#include <thirty/threadPool.h>
+#include <thirty/cameraBuffer.h>
+#include <thirty/lightBuffer.h>
+#include <thirty/bonePalette.h>
+#include <thirty/instanceBuffer.h>
+#include <thirty/renderQueue.h>
 
 #define BOGLE_MAGIC_SIZE 5
+#define BOGLE_VERSION 1
 #define OBJECT_TREE_NUMBER_BASE 10
+#define STREAMING_BUDGET 2000  // microseconds per frame spent streaming cells
+#define PARALLEL_UPDATE_CHUNK 256  // objects per job when updating in parallel
 
+// Changing an object's parent changes its world matrix. It's queued even if
+// it's dirty already, as it may not have been part of the hierarchy before.
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void markTransformDirty(struct scene *const scene,
+                               const struct object *const object) {
+        struct transform *const trans = object_getTransform(object);
+        if (trans != NULL) {
+                trans->dirty = true;
+                scene_queueTransform(scene, object->idx);
+        }
+}
+
+// Make the object the first child of the given parent. It must not have a
+// parent already.
 __attribute__((access (read_write, 1)))
 __attribute__((access (read_write, 2)))
+__attribute__((access (read_write, 3)))
 __attribute__((nonnull))
-static void parse_object_tree(struct scene *const scene, FILE *const f) {
-        struct stack stack;
-        stack_init(&stack, OBJECT_TREE_MAXIMUM_DEPTH, sizeof(size_t));
-        
-        size_t currentObjectIdx = 0;
-        size_t lastParsedObjectIdx = 0;
-        for(;;) {
-                int c = fgetc(f);
-                if (c == EOF) {
-                        bail("Unexpected end of file or error.\n");
-                } else if (isdigit(c)) {
-                        size_t newObjectIdx = 0;
-                        while (isdigit(c)) {
-                                newObjectIdx *= OBJECT_TREE_NUMBER_BASE;
-                                newObjectIdx += (unsigned int)c - '0';
-                                c = fgetc(f);
-                        }
-                        ungetc(c, f);
-                        newObjectIdx++;
+static void linkChild(struct scene *const scene, struct object *const parent,
+                      struct object *const child) {
+        assert(child->idx != 0);
+        if (parent->firstChild != 0) {
+                scene_getObjectFromIdx(scene, parent->firstChild)->prevSibling =
+                        child->idx;
+        }
+        child->nextSibling = parent->firstChild;
+        child->prevSibling = 0;
+        child->parent = parent->idx;
+        parent->firstChild = child->idx;
+        markTransformDirty(scene, child);
+}
 
-                        struct object *parent = scene_getObjectFromIdx(
-                                scene, currentObjectIdx);
-                        struct object *child = scene_getObjectFromIdx(
-                                scene, newObjectIdx);
-                        object_addChild(parent, child);
-                        
-                        lastParsedObjectIdx = newObjectIdx;
-                } else if (isspace(c)) {
-                } else if (c == '{') {
-                        size_t *idx = stack_push(&stack);
-                        *idx = currentObjectIdx;
-                        currentObjectIdx = lastParsedObjectIdx;
-                } else if (c == '}') {
-                        size_t *idx = stack_pop(&stack);
-                        currentObjectIdx = *idx;
-                } else if (c == '\0') {
-                        break;
-                } else {
-                        bail("Unexpected character in file.\n");
-                }
+// Take the object out of its parent's children, leaving it without parent
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((nonnull))
+static void unlinkChild(struct scene *const scene, struct object *const child) {
+        assert(child->idx != 0);
+        if (child->prevSibling != 0) {
+                scene_getObjectFromIdx(scene, child->prevSibling)->nextSibling =
+                        child->nextSibling;
+        } else {
+                scene_getObjectFromIdx(scene, child->parent)->firstChild =
+                        child->nextSibling;
+        }
+        if (child->nextSibling != 0) {
+                scene_getObjectFromIdx(scene, child->nextSibling)->prevSibling =
+                        child->prevSibling;
+        }
+        child->nextSibling = 0;
+        child->prevSibling = 0;
+        child->parent = 0;
+        markTransformDirty(scene, child);
+}
+
+// Keep the name of the object with the given idx
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull (1)))
+static void setObjectInfo(struct scene *const scene, const size_t idx,
+                          char *const name, const bool borrowed) {
+        while (scene->objectInfo.length <= idx) {
+                struct objectInfo *const info = growingArray_append(
+                        &scene->objectInfo);
+                info->name = NULL;
+                info->borrowed = false;
         }
-        stack_destroy(&stack);
+        struct objectInfo *const info = growingArray_get(&scene->objectInfo,
+                                                         idx);
+        info->name = name;
+        info->borrowed = borrowed;
 }
 
 static bool loadRootObj(struct scene *const scene, void *args) {
         (void)args;
-        object_initEmpty(&scene->root, scene->game, scene->idx, "root", &scene->components);
         scene->root.idx = 0;
+        object_initEmpty(&scene->root, scene->game, &scene->components);
+        setObjectInfo(scene, 0, sstrdup("root"), false);
         return true;
 }
 
@@ -65,12 +104,66 @@ static bool createComponentCollection(struct scene *const scene, void *args) {
         return true;
 }
 
-static void scene_initBasic(struct scene *const scene, struct game *const game) {
+// Initial count for the list of transforms used while updating them
+#define STARTING_TRANSFORM_COUNT 16
+
+// A transform and whether its world matrix was recomputed, so that its
+// children know they must recompute theirs
+struct transformUpdate {
+        struct transform *trans;
+        size_t idx;  // of its object
+        bool changed;
+};
+
+__attribute__((access (write_only, 1)))
+__attribute__((nonnull))
+static void initTransformLists(struct transformLists *const lists) {
+        growingArray_init(&lists->roots, sizeof(size_t),
+                          STARTING_TRANSFORM_COUNT);
+        growingArray_init(&lists->updates, sizeof(struct transformUpdate),
+                          STARTING_TRANSFORM_COUNT);
+        growingArray_init(&lists->moved, sizeof(struct transform*),
+                          STARTING_TRANSFORM_COUNT);
+        growingArray_init(&lists->models, sizeof(mat4s),
+                          STARTING_TRANSFORM_COUNT);
+        trsArrays_init(&lists->trs, STARTING_TRANSFORM_COUNT);
+        growingArray_init(&lists->parentWorlds, sizeof(const mat4s*),
+                          STARTING_TRANSFORM_COUNT);
+        growingArray_init(&lists->localModels, sizeof(const mat4s*),
+                          STARTING_TRANSFORM_COUNT);
+        growingArray_init(&lists->worlds, sizeof(mat4s*),
+                          STARTING_TRANSFORM_COUNT);
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void freeTransformLists(struct transformLists *const lists) {
+        growingArray_destroy(&lists->roots);
+        growingArray_destroy(&lists->updates);
+        growingArray_destroy(&lists->moved);
+        growingArray_destroy(&lists->models);
+        trsArrays_free(&lists->trs);
+        growingArray_destroy(&lists->parentWorlds);
+        growingArray_destroy(&lists->localModels);
+        growingArray_destroy(&lists->worlds);
+}
+
+static void scene_initCommon(struct scene *const scene, struct game *const game) {
         scene->loading = false;
         scene->loaded = false;
         scene->game = game;
+        scene->image = NULL;
+        scene->imageSize = 0;
+        scene->loadDeadline = 0;
+        scene->parallelUpdate = false;
+        scene->updatingInParallel = false;
         growingArray_init(&scene->loadSteps, sizeof(struct scene_loadStep), 4);
         growingArray_init(&scene->freePtrs, sizeof(void*), 4);
+        initTransformLists(&scene->transformLists);
+}
+
+static void scene_initBasic(struct scene *const scene, struct game *const game) {
+        scene_initCommon(scene, game);
         scene_addLoadingStep(scene, createComponentCollection, NULL);
         scene_addLoadingStep(scene, loadRootObj, NULL);
 }
@@ -85,42 +178,240 @@ struct bogleFileLoadArgs {
                 uint32_t nlights;
                 uint32_t nanims;
                 uint32_t nobjs;
+                uint32_t ncells;  // since version 1
         } header;
         FILE *f;
         size_t idxOffset;
+
+        // Progress, so that loading can be resumed after yielding
+        unsigned section;  // component section being parsed
+        unsigned next;  // next component or object to parse in the section
+        struct stack tree;  // parents while parsing the object tree
+        size_t currentObjectIdx;
+        size_t lastParsedObjectIdx;
+};
+
+// Component sections of a BOGLE file, in file order
+enum bogleSection {
+        BOGLE_SECTION_CAMERAS,
+        BOGLE_SECTION_GEOMETRIES,
+        BOGLE_SECTION_MATERIALS,
+        BOGLE_SECTION_LIGHTS,
+        BOGLE_SECTION_ANIMATIONS,
+        BOGLE_SECTION_TOTAL
 };
 
-static void parse_objects(struct bogleFileLoadArgs *args, struct growingArray *objects,
-                          struct varSizeGrowingArray *components, struct game *game,
-                          size_t scene) {
-        for (unsigned i=0; i<args->header.nobjs; i++) {
-                struct object *obj = growingArray_append(objects);
-                obj->idx = objects->length;  // idx 0 is root
-                object_initFromFile(obj, game, components, scene, args->idxOffset,
-                                    args->header.ncams, args->header.ngeos,
-                                    args->header.nmats, args->header.nlights,
-                                    args->header.nanims, args->f);
+// Yield from a loading step: push it again so that it's resumed on the next
+// call to scene_load.
+#define YIELD_STEP(scene, cb, args)                                     \
+        do {                                                            \
+                scene_addLoadingStep((scene), (cb), (args));            \
+                return false;                                           \
+        } while (0)
+
+static bool loadBogleFileEnd(struct scene *const scene, void *const vargs) {
+        (void)scene;
+        struct bogleFileLoadArgs *args = vargs;
+
+        const int c = fgetc(args->f);
+        if (c != EOF) {
+                bail("Malformated file, trash at the end, I'm being very strict so I won't just ignore it.\n");
+        }
+
+        fclose(args->f);
+        stack_destroy(&args->tree);
+        free(args);
+
+        return true;
+}
+
+// Start reading the file's geometries, except for the ones streamed along
+// with their cells
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void loadBogleFileGeometries(struct scene *const scene,
+                                    const struct bogleFileLoadArgs *const args) {
+        const size_t first = args->idxOffset + args->header.ncams;
+        for (size_t i=first; i<first+args->header.ngeos; i++) {
+                if (!streaming_isStreamed(&scene->streaming, i)) {
+                        geometry_loadFile(componentCollection_compByIdx(
+                                                  &scene->components, i),
+                                          &scene->components);
+                }
+        }
+}
+
+static bool loadBogleFileCells(struct scene *const scene, void *const vargs) {
+        struct bogleFileLoadArgs *args = vargs;
+
+        while (args->next < args->header.ncells) {
+                struct {
+                        vec3s min;
+                        vec3s max;
+                        uint32_t firstObject;
+                        uint32_t nobjects;
+                } cell;
+                sfread(cell.min.raw, sizeof(float), 3, args->f);
+                sfread(cell.max.raw, sizeof(float), 3, args->f);
+                sfread(&cell.firstObject, sizeof(cell.firstObject), 1, args->f);
+                sfread(&cell.nobjects, sizeof(cell.nobjects), 1, args->f);
+
+                if ((size_t)cell.firstObject + cell.nobjects > args->header.nobjs) {
+                        bail("Malformatted scene file, cell objects out of range\n");
+                }
+
+                // Objects are numbered from 1, 0 is root
+                streaming_addCell(&scene->streaming, cell.min, cell.max,
+                                  (size_t)cell.firstObject + 1, cell.nobjects);
+                args->next++;
+
+                if (scene_loadBudgetExceeded(scene)) {
+                        YIELD_STEP(scene, loadBogleFileCells, args);
+                }
         }
+
+        // Now that it's known which geometries belong to cells, load the
+        // rest and the cells around the starting position.
+        streaming_prepare(scene);
+        loadBogleFileGeometries(scene, args);
+        streaming_request(scene);
+
+        scene_addLoadingStep(scene, loadBogleFileEnd, args);
+        return true;
+}
+
+static bool loadBogleFileTree(struct scene *const scene, void *const vargs) {
+        struct bogleFileLoadArgs *args = vargs;
+        FILE *const f = args->f;
+
+        for(;;) {
+                int c = fgetc(f);
+                if (c == EOF) {
+                        bail("Unexpected end of file or error.\n");
+                } else if (isdigit(c)) {
+                        size_t newObjectIdx = 0;
+                        while (isdigit(c)) {
+                                newObjectIdx *= OBJECT_TREE_NUMBER_BASE;
+                                newObjectIdx += (unsigned int)c - '0';
+                                c = fgetc(f);
+                        }
+                        ungetc(c, f);
+                        newObjectIdx++;
+
+                        struct object *parent = scene_getObjectFromIdx(
+                                scene, args->currentObjectIdx);
+                        struct object *child = scene_getObjectFromIdx(
+                                scene, newObjectIdx);
+                        linkChild(scene, parent, child);
+                        
+                        args->lastParsedObjectIdx = newObjectIdx;
+
+                        if (scene_loadBudgetExceeded(scene)) {
+                                YIELD_STEP(scene, loadBogleFileTree, args);
+                        }
+                } else if (isspace(c)) {
+                } else if (c == '{') {
+                        size_t *idx = stack_push(&args->tree);
+                        *idx = args->currentObjectIdx;
+                        args->currentObjectIdx = args->lastParsedObjectIdx;
+                } else if (c == '}') {
+                        size_t *idx = stack_pop(&args->tree);
+                        args->currentObjectIdx = *idx;
+                } else if (c == '\0') {
+                        break;
+                } else {
+                        bail("Unexpected character in file.\n");
+                }
+        }
+
+        if (args->header.ncells > 0) {
+                args->next = 0;
+                scene_addLoadingStep(scene, loadBogleFileCells, args);
+        } else {
+                scene_addLoadingStep(scene, loadBogleFileEnd, args);
+        }
+        return true;
 }
 
 static bool loadBogleFileObjects(struct scene *const scene, void *const vargs) {
         struct bogleFileLoadArgs *args = vargs;
 
-        growingArray_init(&scene->objects, sizeof(struct object), args->header.nobjs);
+        if (args->next == 0) {
+                growingArray_init(&scene->objects, sizeof(struct object),
+                                  args->header.nobjs);
+        }
 
         // TODO: Read the chunk of the file needed all at once (async) and parse it into the objects later
-        parse_objects(args, &scene->objects, &scene->components, scene->game, scene->idx);
-        // TODO: Read the chunk of the file needed all at once (async) and parse it into the object tree later
-        parse_object_tree(scene, args->f);
+        while (args->next < args->header.nobjs) {
+                struct object *obj = growingArray_append(&scene->objects);
+                obj->idx = scene->objects.length;  // idx 0 is root
+                char *const name = object_initFromFile(
+                        obj, scene->game, &scene->components,
+                        args->idxOffset,
+                        args->header.ncams, args->header.ngeos,
+                        args->header.nmats, args->header.nlights,
+                        args->header.nanims, args->f);
+                setObjectInfo(scene, obj->idx, name, false);
+                args->next++;
+
+                if (scene_loadBudgetExceeded(scene)) {
+                        YIELD_STEP(scene, loadBogleFileObjects, args);
+                }
+        }
 
-        const int c = fgetc(args->f);
-        if (c != EOF) {
-                bail("Malformated file, trash at the end, I'm being very strict so I won't just ignore it.\n");
+        stack_init(&args->tree, OBJECT_TREE_MAXIMUM_DEPTH, sizeof(size_t));
+        args->currentObjectIdx = 0;
+        args->lastParsedObjectIdx = 0;
+        scene_addLoadingStep(scene, loadBogleFileTree, args);
+        return true;
+}
+
+static bool loadBogleFileComponents(struct scene *const scene,
+                                    void *const vargs) {
+        struct bogleFileLoadArgs *args = vargs;
+
+#define LOAD_DATA(n, which, baseType)                                   \
+        while (args->next < (n)) {                                      \
+                uint8_t type;                                           \
+                sfread(&type, sizeof(type), 1, args->f);                \
+                struct which *comp = componentCollection_create(&scene->components, scene->game, (baseType) + type); \
+                which##_initFromFile(comp, args->f, (baseType) + type, &scene->components); \
+                args->next++;                                           \
+                if (scene_loadBudgetExceeded(scene)) {                  \
+                        YIELD_STEP(scene, loadBogleFileComponents, args); \
+                }                                                       \
+        }                                                               \
+        break
+
+        while (args->section < BOGLE_SECTION_TOTAL) {
+                switch ((enum bogleSection)args->section) {
+                case BOGLE_SECTION_CAMERAS:
+                        LOAD_DATA(args->header.ncams, camera, COMPONENT_CAMERA);
+                case BOGLE_SECTION_GEOMETRIES:
+                        LOAD_DATA(args->header.ngeos, geometry, COMPONENT_GEOMETRY);
+                case BOGLE_SECTION_MATERIALS:
+                        LOAD_DATA(args->header.nmats, material, COMPONENT_MATERIAL);
+                case BOGLE_SECTION_LIGHTS:
+                        LOAD_DATA(args->header.nlights, light, COMPONENT_LIGHT);
+                case BOGLE_SECTION_ANIMATIONS:
+                        LOAD_DATA(args->header.nanims, animationCollection, COMPONENT_ANIMATIONCOLLECTION);
+                case BOGLE_SECTION_TOTAL:
+                default:
+                        assert_fail();
+                }
+                args->section++;
+                args->next = 0;
         }
+#undef LOAD_DATA
 
-        fclose(args->f);
-        free(args);
+        // Without cells every geometry is loaded, no need to wait until the
+        // objects are parsed to start reading them.
+        if (args->header.ncells == 0) {
+                loadBogleFileGeometries(scene, args);
+        }
 
+        scene_addLoadingStep(scene, loadBogleFileObjects, args);
         return true;
 }
 
@@ -131,6 +422,8 @@ static bool loadBogleFile(struct scene *const scene, void *const vargs) {
         
         args->idxOffset = componentCollection_currentOffset(&scene->components);
         args->f = sfopen(filename, "r");
+        args->section = BOGLE_SECTION_CAMERAS;
+        args->next = 0;
 
         sfread(&args->header.magic, sizeof(uint8_t), BOGLE_MAGIC_SIZE, args->f);
         if (strncmp((char*)(args->header.magic), "BOGLE", BOGLE_MAGIC_SIZE) != 0) {
@@ -138,9 +431,10 @@ static bool loadBogleFile(struct scene *const scene, void *const vargs) {
         }
 
         sfread(&args->header.version, sizeof(args->header.version), 1, args->f);
-        if (args->header.version != 0) {
+        if (args->header.version > BOGLE_VERSION) {
                 bail("Unsupported scene file version: %d "
-                     "(support only 0)\n", args->header.version);
+                     "(support up to %d)\n", args->header.version,
+                     BOGLE_VERSION);
         }
 
         sfread(&args->header.ncams, sizeof(args->header.ncams), 1, args->f);
@@ -149,28 +443,17 @@ static bool loadBogleFile(struct scene *const scene, void *const vargs) {
         sfread(&args->header.nlights, sizeof(args->header.nlights), 1, args->f);
         sfread(&args->header.nanims, sizeof(args->header.nanims), 1, args->f);
         sfread(&args->header.nobjs, sizeof(args->header.nobjs), 1, args->f);
+        args->header.ncells = 0;
+        if (args->header.version >= 1) {
+                sfread(&args->header.ncells, sizeof(args->header.ncells), 1, args->f);
+        }
 
         sfread(scene->globalAmbientLight.raw,
                sizeof(*scene->globalAmbientLight.raw),
                sizeof(scene->globalAmbientLight) /
                sizeof(*scene->globalAmbientLight.raw), args->f);
-        
-#define LOAD_DATA(n, which, baseType)                                   \
-        for (unsigned i=0; i<(n); i++) {                                \
-                uint8_t type;                                           \
-                sfread(&type, sizeof(type), 1, args->f);                \
-                struct which *comp = componentCollection_create(&scene->components, scene->game, (baseType) + type); \
-                which##_initFromFile(comp, args->f, (baseType) + type, &scene->components); \
-        }
 
-        LOAD_DATA(args->header.ncams, camera, COMPONENT_CAMERA);
-        LOAD_DATA(args->header.ngeos, geometry, COMPONENT_GEOMETRY);
-        LOAD_DATA(args->header.nmats, material, COMPONENT_MATERIAL);
-        LOAD_DATA(args->header.nlights, light, COMPONENT_LIGHT);
-        LOAD_DATA(args->header.nanims, animationCollection, COMPONENT_ANIMATIONCOLLECTION);
-#undef LOAD_DATA
-
-        scene_addLoadingStep(scene, loadBogleFileObjects, args);
+        scene_addLoadingStep(scene, loadBogleFileComponents, args);
         
         return true;
 }
@@ -209,6 +492,33 @@ void scene_initFromFile(struct scene *const scene,
         scene_addLoadingStep(scene, loadBogleFile, sstrdup(filename));
 }
 
+static bool loadImageResources(struct scene *const scene, void *const vargs) {
+        size_t *const next = vargs;
+        if (!sceneImage_upload(scene, next)) {
+                YIELD_STEP(scene, loadImageResources, next);
+        }
+        free(next);
+        return true;
+}
+
+static bool loadImageFile(struct scene *const scene, void *const vargs) {
+        const char *const filename = vargs;
+        sceneImage_load(scene, filename);
+
+        size_t *const next = smalloc(sizeof(*next));
+        *next = 0;
+        scene_addLoadingStep(scene, loadImageResources, next);
+        return true;
+}
+
+void scene_initFromImage(struct scene *const scene,
+                         struct game *const game,
+                         const char *const filename) {
+        // The image brings its own components and root object
+        scene_initCommon(scene, game);
+        scene_addLoadingStep(scene, loadImageFile, sstrdup(filename));
+}
+
 static void prepareLoadingProcess(struct scene *const scene) {
         growingArray_init(&scene->loadingStack, sizeof(struct scene_loadStep), scene->loadSteps.length);
         asyncLoader_init();
@@ -225,6 +535,16 @@ static void prepareLoadingProcess(struct scene *const scene) {
         }
         free(steps);
         
+        streaming_init(&scene->streaming);
+        hierarchy_init(&scene->hierarchy);
+        growingArray_init(&scene->dirtyTransforms, sizeof(size_t), 16);
+        activeSet_init(&scene->active);
+        bvh_init(&scene->bvh);
+        renderQueue_init(&scene->renderQueue);
+        compaction_init(&scene->compaction);
+        growingArray_init(&scene->prefabs, sizeof(struct prefab), 1);
+        growingArray_init(&scene->objectInfo, sizeof(struct objectInfo), 16);
+
         scene->loading = true;
         scene->loaded = false;
         scene->totalSizeFinishedAsyncLoad = 0;
@@ -254,18 +574,65 @@ bool scene_load(struct scene *const scene) {
         return true;
 }
 
+bool scene_loadBudget(struct scene *const scene, const unsigned long micros) {
+        if (scene->loaded) {
+                return true;
+        }
+
+        scene->loadDeadline = time_micros() + micros;
+
+        bool done = false;
+        if (scene_load(scene)) {
+                // Reap as many finished async loads as fit in the budget,
+                // each one usually means a GL upload. Stop early when the
+                // next one is still being read.
+                for (;;) {
+                        const size_t before = scene->totalSizeFinishedAsyncLoad;
+                        done = scene_awaitAsyncLoaders(scene);
+                        if (done || scene_loadBudgetExceeded(scene) ||
+                            before == scene->totalSizeFinishedAsyncLoad) {
+                                break;
+                        }
+                }
+        }
+
+        scene->loadDeadline = 0;
+        return done;
+}
+
+bool scene_loadBudgetExceeded(const struct scene *const scene) {
+        return scene->loadDeadline != 0 &&
+                time_micros() >= scene->loadDeadline;
+}
+
 static void addMustFreePtr(struct scene *scene, void *ptr) {
         void **pptr = growingArray_append(&scene->freePtrs);
         *pptr = ptr;
 }
 
 void scene_unload(struct scene *const scene) {
-        object_free(&scene->root);
-        growingArray_foreach_START(&scene->objects, struct object *, object)
-                object_free(object);
+        growingArray_foreach_START(&scene->objectInfo, struct objectInfo *,
+                                   info)
+                if (!info->borrowed) {
+                        free(info->name);
+                }
         growingArray_foreach_END;
+        growingArray_destroy(&scene->objectInfo);
+        // Objects may have been using the prefabs' names
+        growingArray_foreach_START(&scene->prefabs, struct prefab *, prefab)
+                prefab_free(prefab);
+        growingArray_foreach_END;
+        growingArray_destroy(&scene->prefabs);
+        streaming_free(&scene->streaming);
+        hierarchy_free(&scene->hierarchy);
+        growingArray_destroy(&scene->dirtyTransforms);
+        activeSet_free(&scene->active);
+        bvh_free(&scene->bvh);
+        renderQueue_free(&scene->renderQueue);
+        compaction_free(&scene->compaction);
         growingArray_destroy(&scene->objects);
         componentCollection_freeCollection(&scene->components);
+        sceneImage_release(scene);
         scene->loading = false;
         scene->loaded = false;
 }
@@ -285,6 +652,7 @@ bool scene_awaitAsyncLoaders(struct scene *const scene) {
 
         if (done) {
                 asyncLoader_destroy();
+                scene_updateTransforms(scene);
                 scene->loading = false;
                 scene->loaded = true;
                 return true;
@@ -314,58 +682,377 @@ struct object *scene_createObject(struct scene *scene,
                                   const char *const name,
                                   const size_t parent_idx) {
         struct object *const child = growingArray_append(&scene->objects);
-        size_t child_idx = scene->objects.length;  // idx 0 is root
-        object_initEmpty(child, scene->game, scene->idx, name, &scene->components);
+        // It may take the place of a removed one, idx 0 is root
+        const size_t child_idx = (size_t)(
+                child - (struct object*)scene->objects.data) + 1;
         child->idx = child_idx;
+        object_initEmpty(child, scene->game, &scene->components);
+        setObjectInfo(scene, child_idx, sstrdup(name), false);
         struct object *const parent = scene_getObjectFromIdx(
                 scene, parent_idx);
-        object_addChild(parent, child);
+        linkChild(scene, parent, child);
+        hierarchy_add(&scene->hierarchy, child_idx, parent_idx);
+        compaction_restart(&scene->compaction);
         return child;
 }
 
 void scene_removeObject(struct scene *const scene,
                         struct object *const object) {
         assert(object->idx > 0);
-        assert(object->scene == scene->idx);
+        assert(object_getScene(object) == scene);
+        scene_handOffAnimation(scene, object);
         struct object *const parent = scene_getObjectFromIdx(scene, object->parent);
-        object_removeChild(parent, object);
-        growingArray_foreach_START(&object->children, struct object *, child) {
-                object_addChild(parent, child);
-        } growingArray_foreach_END;
-
-        object_free(object);
+        unlinkChild(scene, object);
+        size_t next = object->firstChild;
+        while (next != 0) {
+                struct object *const child = scene_getObjectFromIdx(
+                        scene, next);
+                next = child->nextSibling;
+                linkChild(scene, parent, child);
+        }
+        object->firstChild = 0;
+        hierarchy_remove(&scene->hierarchy, object->idx);
+        activeSet_remove(&scene->active, object->idx);
+        bvh_remove(&scene->bvh, object->idx);
+        renderQueue_remove(&scene->renderQueue, object->idx);
+        compaction_restart(&scene->compaction);
+
+        struct objectInfo *const info = growingArray_get(&scene->objectInfo,
+                                                         object->idx);
+        if (!info->borrowed) {
+                free(info->name);
+        }
+        info->name = NULL;
         growingArray_remove(&scene->objects, object->idx-1);
 }
 
+void scene_setParent(struct scene *const scene, struct object *const object,
+                     const size_t parent_idx) {
+        assert(object->idx > 0);
+        assert(object_getScene(object) == scene);
+        unlinkChild(scene, object);
+        linkChild(scene, scene_getObjectFromIdx(scene, parent_idx), object);
+        hierarchy_reparent(&scene->hierarchy, object->idx, parent_idx);
+        activeSet_invalidateOrder(&scene->active);
+}
+
+void scene_handOffAnimation(struct scene *const scene,
+                            const struct object *const object) {
+        struct animationCollection *const anim = componentCollection_get(
+                &scene->components, &object->components,
+                COMPONENT_ANIMATIONCOLLECTION);
+        if (anim == NULL || anim->base.object != object->idx) {
+                return;
+        }
+
+        // Any other one, they're all in the active set already
+        bool found = false;
+        growingArray_foreach_START(&scene->objects, struct object *, other)
+                if (!found && other->idx != object->idx &&
+                    other->components.animationCollection ==
+                    object->components.animationCollection) {
+                        anim->base.object = other->idx;
+                        found = true;
+                }
+        growingArray_foreach_END;
+}
+
+size_t scene_createPrefab(struct scene *const scene, const size_t object_idx) {
+        struct prefab *const prefab = growingArray_append(&scene->prefabs);
+        prefab_init(prefab, scene, object_idx);
+        // It refers to components too
+        compaction_restart(&scene->compaction);
+        return scene->prefabs.length - 1;
+}
+
+void scene_instantiatePrefab(struct scene *const scene, const size_t prefab_idx,
+                             const size_t parent_idx, const size_t count,
+                             const mat4s *const models, size_t *const idxs) {
+        // Transforms without a name of their own
+        static char transformName[] = "transform";
+        const struct prefab *const prefab = growingArray_get(&scene->prefabs,
+                                                             prefab_idx);
+        const struct prefabNode *const nodes = prefab->nodes.data;
+        const size_t nnodes = prefab->nodes.length;
+
+        // All at once, so that pointers stay valid meanwhile too
+        growingArray_reserve(&scene->objects, count * nnodes);
+        varSizeGrowingArray_reserve(&scene->components, count * nnodes,
+                                    sizeof(struct transform));
+        size_t *const nodeIdxs = smallocarray(nnodes, sizeof(size_t));
+
+        for (size_t i=0; i<count; i++) {
+                for (size_t n=0; n<nnodes; n++) {
+                        const struct prefabNode *const node = &nodes[n];
+                        struct object *const object = growingArray_append(
+                                &scene->objects);
+                        // It may take the place of a removed one
+                        const size_t idx = (size_t)(
+                                object - (struct object*)scene->objects.data)
+                                + 1;
+                        nodeIdxs[n] = idx;
+
+                        object->idx = idx;
+                        setObjectInfo(scene, idx, node->name, true);
+                        object->parent = 0;
+                        object->firstChild = 0;
+                        object->nextSibling = 0;
+                        object->prevSibling = 0;
+                        object->components = node->components;
+                        object->componentsMemory = &scene->components;
+                        object->onUpdate = node->onUpdate;
+                        object->threadSafe = node->threadSafe;
+
+                        struct transform *const trans =
+                                componentCollection_create(
+                                        &scene->components, scene->game,
+                                        COMPONENT_TRANSFORM);
+                        const size_t transIdx = trans->base.idx;
+                        *trans = node->transform;
+                        trans->base.idx = transIdx;
+                        trans->base.game = scene->game;
+                        trans->base.name = transformName;
+                        trans->base.borrowed = true;
+                        trans->dirty = true;
+                        trans->scene = scene;
+                        componentCollection_set(&scene->components,
+                                                &object->components, idx,
+                                                COMPONENT_TRANSFORM, transIdx);
+                        if (n == 0 && models != NULL) {
+                                transform_setMatrix(trans, models[i]);
+                        }
+                }
+
+                // Children are linked in front of their siblings, so they go
+                // backwards to keep their order
+                for (size_t n=nnodes-1; n>0; n--) {
+                        linkChild(scene,
+                                  scene_getObjectFromIdx(
+                                          scene, nodeIdxs[nodes[n].parent]),
+                                  scene_getObjectFromIdx(scene, nodeIdxs[n]));
+                }
+                linkChild(scene, scene_getObjectFromIdx(scene, parent_idx),
+                          scene_getObjectFromIdx(scene, nodeIdxs[0]));
+
+                for (size_t n=0; n<nnodes; n++) {
+                        hierarchy_add(&scene->hierarchy, nodeIdxs[n],
+                                      n == 0 ? parent_idx :
+                                      nodeIdxs[nodes[n].parent]);
+                        activeSet_refresh(&scene->active,
+                                          scene_getObjectFromIdx(
+                                                  scene, nodeIdxs[n]));
+                        renderQueue_refresh(&scene->renderQueue,
+                                            nodeIdxs[n]);
+                }
+                if (idxs != NULL) {
+                        idxs[i] = nodeIdxs[0];
+                }
+        }
+
+        free(nodeIdxs);
+        compaction_restart(&scene->compaction);
+}
+
+void scene_queueTransform(struct scene *const scene, const size_t object_idx) {
+        // The workers can't share the list, their objects are looked through
+        // once they're done
+        if (scene->updatingInParallel) {
+                return;
+        }
+        size_t *const idx = growingArray_append(&scene->dirtyTransforms);
+        *idx = object_idx;
+}
+
+static int comparePositions(const void *const a, const void *const b) {
+        const size_t positionA = *(const size_t*)a;
+        const size_t positionB = *(const size_t*)b;
+        return (positionA > positionB) - (positionA < positionB);
+}
+
+void scene_updateTransforms(struct scene *const scene) {
+        struct transformLists *const lists = &scene->transformLists;
+        static const mat4s identity = GLMS_MAT4_IDENTITY_INIT;
+
+        // Drawing needs it even when nothing moved
+        hierarchy_update(scene);
+        if (scene->dirtyTransforms.length == 0) {
+                return;
+        }
+        const size_t length = scene->hierarchy.idxs.length;
+        const size_t *const idxs = scene->hierarchy.idxs.data;
+        const size_t *const parents = scene->hierarchy.parents.data;
+        const size_t *const ends = scene->hierarchy.ends.data;
+        const size_t *const positions = scene->hierarchy.positions.data;
+
+        // Where the subtrees of the queued objects start, parents first.
+        // Removed objects and the idxs compaction moved them from have none.
+        growingArray_clear(&lists->roots);
+        const size_t *const dirty = scene->dirtyTransforms.data;
+        for (size_t i=0; i<scene->dirtyTransforms.length; i++) {
+                if (dirty[i] < scene->hierarchy.positions.length &&
+                    positions[dirty[i]] != HIERARCHY_NONE) {
+                        size_t *const root = growingArray_append(&lists->roots);
+                        *root = positions[dirty[i]];
+                }
+        }
+        growingArray_clear(&scene->dirtyTransforms);
+        qsort(lists->roots.data, lists->roots.length, sizeof(size_t),
+              comparePositions);
+
+        // Gather the transforms of each subtree, leaving out the ones inside
+        // one already gathered, and the ones that changed themselves
+        size_t *const root = lists->roots.data;
+        size_t nroots = 0;
+        size_t end = 0;
+        growingArray_clear(&lists->updates);
+        growingArray_clear(&lists->moved);
+        trsArrays_reserve(&lists->trs, length);
+        for (size_t r=0; r<lists->roots.length; r++) {
+                if (root[r] < end) {
+                        continue;
+                }
+                root[nroots++] = root[r];
+                end = ends[root[r]];
+                for (size_t i=root[r]; i<end; i++) {
+                        const struct object *const object =
+                                scene_getObjectFromIdxConst(scene, idxs[i]);
+                        struct transformUpdate *const update =
+                                growingArray_append(&lists->updates);
+                        update->trans = object_getTransform(object);
+                        update->idx = idxs[i];
+                        update->changed = false;
+
+                        if (update->trans->dirty) {
+                                trsArrays_set(&lists->trs, lists->moved.length,
+                                              update->trans->position,
+                                              update->trans->rotation,
+                                              update->trans->scale);
+                                struct transform **const movedTrans =
+                                        growingArray_append(&lists->moved);
+                                *movedTrans = update->trans;
+                        }
+                }
+        }
+
+        // Compose their model matrices all at once
+        if (lists->moved.length > 0) {
+                growingArray_clear(&lists->models);
+                for (size_t i=0; i<lists->moved.length; i++) {
+                        growingArray_append(&lists->models);
+                }
+                vectorMath_composeTRS(&lists->trs, lists->models.data,
+                                      lists->moved.length);
+
+                const mat4s *const model = lists->models.data;
+                struct transform *const *const movedTrans = lists->moved.data;
+                for (size_t i=0; i<lists->moved.length; i++) {
+                        movedTrans[i]->model = model[i];
+                }
+        }
+
+        // Find the world matrices to recompute and what goes into each.
+        // Parents come first, and the products are done in that same order,
+        // so by the time one is done its parent's world matrix is up to date.
+        // The parent of a subtree's root is outside of it and clean, as it
+        // would have been queued before it otherwise.
+        growingArray_clear(&lists->parentWorlds);
+        growingArray_clear(&lists->localModels);
+        growingArray_clear(&lists->worlds);
+        struct transformUpdate *const update = lists->updates.data;
+        size_t u = 0;
+        for (size_t r=0; r<nroots; r++) {
+                // Updates of the subtree are in the order of its positions
+                const size_t start = u;
+                for (size_t i=root[r]; i<ends[root[r]]; i++, u++) {
+                        const struct transformUpdate *const parent =
+                                i == root[r] ? NULL :
+                                &update[start + parents[i] - root[r]];
+                        update[u].changed = update[u].trans->dirty ||
+                                (parent != NULL && parent->changed);
+                        if (!update[u].changed) {
+                                continue;
+                        }
+
+                        const mat4s **const parentWorld =
+                                growingArray_append(&lists->parentWorlds);
+                        if (i == 0) {
+                                *parentWorld = &identity;
+                        } else if (parent == NULL) {
+                                *parentWorld = &object_getTransform(
+                                        scene_getObjectFromIdxConst(
+                                                scene, idxs[parents[i]]))
+                                        ->world;
+                        } else {
+                                *parentWorld = &parent->trans->world;
+                        }
+                        const mat4s **const localModel =
+                                growingArray_append(&lists->localModels);
+                        *localModel = &update[u].trans->model;
+                        mat4s **const world = growingArray_append(
+                                &lists->worlds);
+                        *world = &update[u].trans->world;
+                        update[u].trans->dirty = false;
+                }
+        }
+        vectorMath_mulIndirect(lists->parentWorlds.data,
+                               lists->localModels.data, lists->worlds.data,
+                               lists->worlds.length);
+
+        // Objects that moved take their bounds along, and their distance to
+        // the camera
+        for (size_t i=0; i<lists->updates.length; i++) {
+                if (!update[i].changed) {
+                        continue;
+                }
+                bvh_refresh(&scene->bvh, scene_getObjectFromIdxConst(
+                                    scene, update[i].idx));
+                renderQueue_refresh(&scene->renderQueue, update[i].idx);
+        }
+}
+
+const struct bvh *scene_getBVH(struct scene *const scene) {
+        scene_updateTransforms(scene);
+        bvh_update(scene);
+        return &scene->bvh;
+}
+
 mat4s scene_getObjectAbsoluteTransform(struct scene *scene,
                                        const struct object *object) {
-        struct transform *trans = object_getComponent(object, COMPONENT_TRANSFORM);
+        const struct transform *trans = object_getTransform(object);
         if (trans == NULL) {
                 return GLMS_MAT4_IDENTITY;
         }
 
-        mat4s model = trans->model;
-        while (object->idx != 0) {
-                const struct object *parent = scene_getObjectFromIdx(scene, object->parent);
-                struct transform *parentTrans = object_getComponent(parent, COMPONENT_TRANSFORM);
-                if (parentTrans == NULL) {
+        // The cached matrix is good unless the object or any of its
+        // ancestors moved since the last update
+        for (const struct object *obj = object; ;
+             obj = scene_getObjectFromIdxConst(scene, obj->parent)) {
+                const struct transform *const objTrans =
+                        object_getTransform(obj);
+                if (objTrans == NULL) {
                         return GLMS_MAT4_IDENTITY;
                 }
-                
-                mat4s parentModel = parentTrans->model;
-                model = glms_mat4_mul(parentModel, model);
-                object = parent;
+                if (objTrans->dirty) {
+                        scene_updateTransforms(scene);
+                        break;
+                }
+                if (obj->idx == 0) {
+                        break;
+                }
         }
-        
-        return model;
+
+        return trans->world;
 }
 
 size_t scene_idxByName(const struct scene *scene, const char *name) {
-        growingArray_foreach_START(&scene->objects, struct object*, obj)
-                if (strcmp(name, obj->name) == 0) {
-                        return growingArray_foreach_idx+1;
+        // Only the names, without going through the objects themselves
+        const struct objectInfo *const infos = scene->objectInfo.data;
+        for (size_t idx=1; idx<scene->objectInfo.length; idx++) {
+                if (infos[idx].name != NULL &&
+                    strcmp(name, infos[idx].name) == 0) {
+                        return idx;
                 }
-        growingArray_foreach_END;
+        }
         return 0;
 }
 
@@ -410,6 +1097,7 @@ void scene_free(struct scene *const scene) {
         growingArray_foreach_END;
         growingArray_destroy(&scene->loadSteps);
         growingArray_destroy(&scene->freePtrs);
+        freeTransformLists(&scene->transformLists);
 }
 
 
@@ -418,288 +1106,402 @@ void scene_free(struct scene *const scene) {
 // Initial counts for some lists
 #define STARTING_OBJECT_COUNT 16
 #define STARTING_LIGHT_COUNT 8
-#define STARTING_SHADER_COUNT 1
-
-// This struct is used to hold a reference to an object along with its global
-// model matrix after taking into account its parents, and its distance to the
-// camera. The model matrix is passed to the shader for rendering, while the
-// distance to the camera is used for sorting the objects by distance to camera
-// before rendering.
-struct objectModelAndDistance {
-        const struct object *object;
-        mat4s model;
-        float distanceToCamera;
-};
 
-// Used to determine shader order and for checking equality between shaders.
+// Find the main camera, the skybox and the lights. The cached world matrices
+// of the objects are the ones passed to the shaders, see
+// scene_updateTransforms.
 __attribute__((access (read_only, 1)))
-__attribute__((access (read_only, 2)))
-__attribute__((nonnull (1, 2)))
-static int cmpshdr(const void *const item1,
-                   const void *const item2,
-                   void *const args) {
-        const enum shaders *const shader1 = item1;
-        const enum shaders *const shader2 = item2;
-        (void)args;
+__attribute__((access (write_only, 2)))
+__attribute__((access (write_only, 3)))
+__attribute__((access (read_write, 4)))
+__attribute__((nonnull))
+static void gatherObjects(const struct scene *const scene,
+                          const struct object **const camera,
+                          const struct object **const skybox,
+                          struct growingArray *const lights) {
+        assert(scene->hierarchy.valid);
+        const size_t length = scene->hierarchy.idxs.length;
+        const size_t *const idxs = scene->hierarchy.idxs.data;
+
+        *camera = &scene->root;
+        *skybox = &scene->root;
+        for (size_t i=0; i<length; i++) {
+                const struct object *const object = scene_getObjectFromIdxConst(
+                        scene, idxs[i]);
+
+                assert(!object_getTransform(object)->dirty);
+
+                // Detect camera
+                const struct camera *cameraComp = object_getCamera(object);
+                if (cameraComp != NULL && cameraComp->main) {
+                        *camera = object;
+                }
+
+                // Detect skybox
+                const struct material *const material =
+                        object_getMaterial(object);
+                if (material != NULL &&
+                    material->base.type == COMPONENT_MATERIAL_SKYBOX) {
+                        *skybox = object;
+                }
 
-        return (int)*shader1 - (int)*shader2;
+                // Detect light
+                if (componentCollection_hasComponent(
+                            &object->components, COMPONENT_LIGHT)) {
+                        const struct object **const light =
+                                growingArray_append(lights);
+                        *light = object;
+                }
+        }
 }
 
+// Whether an object can be left out when its bounds aren't in view. The
+// skybox is always around the camera, and skinned meshes move their vertices
+// away from the bind pose the bounds are computed from.
 __attribute__((access (read_only, 1)))
-__attribute__((access (read_write, 2)))
-__attribute__((access (read_only, 3)))
-__attribute__((access (write_only, 5)))
-__attribute__((access (write_only, 6)))
-__attribute__((access (read_write, 7)))
-__attribute__((access (read_write, 8)))
 __attribute__((nonnull))
-static void gatherObjectTree(const struct scene *const scene,
-                             struct growingArray *const objects,
-                             const struct object *const object,
-                             const mat4s parentModel,
-                             size_t *const cameraIdx,
-                             size_t *const skyboxIdx,
-                             struct growingArray *const lightIdxs,
-                             struct growingArray *const shaders) {
-
-        // Apply model matrix
-        const struct transform *const trans = object_getComponent(
-                object, COMPONENT_TRANSFORM);
-        const mat4s model = glms_mat4_mul(parentModel, trans->model);
-
-        // Add to objects array
-        struct objectModelAndDistance *const objmod =
-                growingArray_append(objects);
-        objmod->object = object;
-        objmod->model = model;
-        
-        // Detect camera
-        const struct camera *cameraComp = object_getComponent(
-                object, COMPONENT_CAMERA);
-        if (cameraComp != NULL && cameraComp->main) {
-                *cameraIdx = objects->length - 1;
+static bool isCullable(const struct object *const object) {
+        const struct geometry *const geometry = object_getGeometry(object);
+        if (geometry == NULL || !geometry->loaded) {
+                return false;
         }
-
-        // Detect skybox
-        const struct component *materialComp = object_getComponent(
-                object, COMPONENT_MATERIAL);
-        if (materialComp != NULL &&
-            materialComp->type == COMPONENT_MATERIAL_SKYBOX) {
-                *skyboxIdx = objects->length - 1;
+        const struct material *const material = object_getMaterial(object);
+        if (material != NULL &&
+            material->base.type == COMPONENT_MATERIAL_SKYBOX) {
+                return false;
         }
+        return object_getAnimationCollection(object) == NULL;
+}
 
-        // Detect light
-        if (componentCollection_hasComponent(
-                    &object->components, COMPONENT_LIGHT)) {
-                size_t *const lightIdx = growingArray_append(lightIdxs);
-                *lightIdx = objects->length - 1;
+// Find which of the queue's items are drawn, leaving out the holes and the
+// objects outside of the frustum. Only the scene's bounding volume hierarchy
+// is walked to find the ones inside, so objects far from the view cost
+// nothing more than their item.
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((access (read_write, 3)))
+__attribute__((access (read_write, 4)))
+__attribute__((access (read_write, 5)))
+__attribute__((access (read_write, 6)))
+__attribute__((nonnull))
+static void cullItems(struct scene *const scene,
+                      const vec4s planes[6],
+                      struct growingArray *const inside,
+                      struct growingArray *const inFrustum,
+                      struct growingArray *const visible,
+                      struct sceneDrawStats *const stats) {
+        const struct renderItem *const items = scene->renderQueue.items.data;
+        const size_t n = scene->renderQueue.items.length;
+        growingArray_clear(inside);
+        bvh_queryFrustum(scene_getBVH(scene), planes, inside);
+
+        // Flag them by idx, the flags are all cleared again at the end
+        const size_t *const insideIdxs = inside->data;
+        for (size_t i=0; i<inside->length; i++) {
+                while (inFrustum->length <= insideIdxs[i]) {
+                        bool *const flag = growingArray_append(inFrustum);
+                        *flag = false;
+                }
+        }
+        bool *const flags = inFrustum->data;
+        for (size_t i=0; i<inside->length; i++) {
+                flags[insideIdxs[i]] = true;
         }
 
-        // Detect shader
-        if (materialComp != NULL) {
-                const enum shaders shader = ((const struct material*)
-                                             materialComp)->shader;
-                if (!growingArray_contains(shaders, cmpshdr, &shader)) {
-                        enum shaders *shdrptr = growingArray_append(shaders);
-                        *shdrptr = shader;
+        growingArray_clear(visible);
+        stats->visible = 0;
+        stats->culled = 0;
+        for (size_t i=0; i<n; i++) {
+                bool *const drawn = growingArray_append(visible);
+                *drawn = false;
+                if (items[i].object == RENDERQUEUE_NONE) {
+                        continue;
+                }
+                *drawn = !isCullable(scene_getObjectFromIdxConst(
+                                             scene, items[i].object)) ||
+                        (items[i].object < inFrustum->length &&
+                         flags[items[i].object]);
+                if (*drawn) {
+                        stats->visible++;
+                } else {
+                        stats->culled++;
                 }
         }
 
-        // Recurse
-        growingArray_foreach_START(&object->children, size_t*, child_idx)
-                const struct object *child = scene_getObjectFromIdxConst(
-                        scene, *child_idx);
-                gatherObjectTree(scene, objects, child, model,
-                                 cameraIdx, skyboxIdx, lightIdxs, shaders);
-        growingArray_foreach_END;
+        for (size_t i=0; i<inside->length; i++) {
+                flags[insideIdxs[i]] = false;
+        }
 }
 
-// Compare function used to sort objects for rendering. We want objects with
-// the same material to be grouped together, order objects by distance to the
-// camera, etc.
-static int cmpobj(const void *const item1,
-                  const void *const item2,
-                  void *const args) {
-        (void)args;
-        
-        const struct objectModelAndDistance *const obj1 = item1;
-        const struct objectModelAndDistance *const obj2 = item2;
-
-        const struct geometry *geo1 = object_getComponent(
-                obj1->object, COMPONENT_GEOMETRY);
-        const struct geometry *geo2 = object_getComponent(
-                obj2->object, COMPONENT_GEOMETRY);
-        
-        const bool hasgeo1 = geo1 != NULL;
-        const bool hasgeo2 = geo2 != NULL;
-        
-        // No need to do anything for objects without geometry which won't be
-        // rendered. Just put them all at the end so we can finish early when
-        // we find the first one.
-        if (!hasgeo1 && !hasgeo2) {
-                return 0;
-        }
-        if (!hasgeo1 && hasgeo2) {
-                return 1;
-        }
-        if (hasgeo1 && !hasgeo2) {
-                return -1;
-        }
+// A run of queued objects drawn with a single call. Runs of more than one
+// object share their geometry and material, and their model matrices are in
+// the instance buffer from instance on.
+struct drawRun {
+        size_t first;  // in the queue's items
+        size_t count;
+        size_t instance;
+};
 
-        const struct material *mat1 = object_getComponent(
-                obj1->object, COMPONENT_MATERIAL);
-        const struct material *mat2 = object_getComponent(
-                obj2->object, COMPONENT_MATERIAL);
+// Whether an object can be drawn in the same run as another, instanceable,
+// one with the given geometry and material
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((access (read_only, 3)))
+__attribute__((nonnull))
+static bool sameRun(const struct object *const object,
+                    const struct geometry *const geometry,
+                    const struct material *const material) {
+        return object_getGeometry(object) == geometry &&
+                object_getMaterial(object) == material &&
+                object_isInstanceable(object);
+}
 
-        const bool isSkybox1 = mat1->base.type == COMPONENT_MATERIAL_SKYBOX;
-        const bool isSkybox2 = mat2->base.type == COMPONENT_MATERIAL_SKYBOX;
+// Split the items drawn into runs, and put the model matrices of the objects
+// drawn with instancing in the instance buffer. Items that aren't drawn don't
+// break a run.
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((access (read_write, 3)))
+__attribute__((access (read_write, 4)))
+__attribute__((nonnull))
+static void batchObjects(const struct scene *const scene,
+                         const bool *const visible,
+                         struct growingArray *const runs,
+                         struct instanceBuffer *const instances) {
+        growingArray_clear(runs);
+        instanceBuffer_begin(instances);
+
+        const struct renderItem *const items = scene->renderQueue.items.data;
+        const size_t n = scene->renderQueue.items.length;
+        size_t i = 0;
+        while (i < n) {
+                if (!visible[i]) {
+                        i++;
+                        continue;
+                }
+                const struct object *const object =
+                        scene_getObjectFromIdxConst(scene, items[i].object);
+
+                size_t count = 1;
+                size_t next = i + 1;
+                if (object_isInstanceable(object)) {
+                        const struct geometry *const geometry =
+                                object_getGeometry(object);
+                        const struct material *const material =
+                                object_getMaterial(object);
+                        for (; next < n; next++) {
+                                if (!visible[next]) {
+                                        continue;
+                                }
+                                if (!sameRun(scene_getObjectFromIdxConst(
+                                                     scene,
+                                                     items[next].object),
+                                             geometry, material)) {
+                                        break;
+                                }
+                                count++;
+                        }
+                }
 
-        // The skybox object needs to be rendered last.
-        if (isSkybox1 && !isSkybox2) {
-                return 1;
-        }
-        if (!isSkybox1 && isSkybox2) {
-                return -1;
+                struct drawRun *const run = growingArray_append(runs);
+                run->first = i;
+                run->count = count;
+                run->instance = instances->models.length;
+                if (count > 1) {
+                        for (size_t j=i; j<next; j++) {
+                                if (!visible[j]) {
+                                        continue;
+                                }
+                                instanceBuffer_add(
+                                        instances,
+                                        object_getTransform(
+                                                scene_getObjectFromIdxConst(
+                                                        scene,
+                                                        items[j].object))
+                                        ->world);
+                        }
+                }
+                i = next;
         }
 
-        const bool trans1 = material_isTransparent(mat1);
-        const bool trans2 = material_isTransparent(mat2);
-
-        // Non transparent objects first
-        if (!trans1 && trans2) {
-                return -1;
-        }
-        if (trans1 && !trans2) {
-                return 1;
-        }
+        instanceBuffer_end(instances);
+}
 
-        const enum shaders shader1 = mat1->shader;
-        const enum shaders shader2 = mat2->shader;
+struct parallelUpdateArgs {
+        struct scene *scene;
+        float timeDelta;
+};
 
-        // Group by shader
-        const int c = cmpshdr(&shader1, &shader2, NULL);
-        if (c != 0) {
-                return c;
+// Update the thread safe objects in a range of the active set
+static void updateThreadSafe(void *const argsPtr,
+                             const size_t first, const size_t last) {
+        const struct parallelUpdateArgs *const args = argsPtr;
+        const size_t *const idxs = args->scene->active.idxs.data;
+        for (size_t i=first; i<last; i++) {
+                struct object *const object = scene_getObjectFromIdx(
+                        args->scene, idxs[i]);
+                if (object->threadSafe) {
+                        object_update(object, args->timeDelta);
+                }
         }
+}
 
-        // Group by material
-        if (mat1 < mat2) {
-                return -1;
-        }
-        if (mat1 > mat2) {
-                return 1;
+void scene_update(struct scene *const scene, const float timeDelta) {
+        // Only objects with something to update, parents first
+        activeSet_update(scene);
+
+        // Thread safe objects can't create or remove others, so this many
+        // are done already
+        size_t parallelDone = 0;
+        if (scene->parallelUpdate) {
+                struct parallelUpdateArgs args = {
+                        .scene = scene,
+                        .timeDelta = timeDelta,
+                };
+                parallelDone = scene->active.idxs.length;
+                scene->updatingInParallel = true;
+                threadPool_parallelFor(updateThreadSafe, &args, parallelDone,
+                                       PARALLEL_UPDATE_CHUNK);
+                scene->updatingInParallel = false;
+
+                // Queue the transforms they moved
+                const size_t *const idxs = scene->active.idxs.data;
+                for (size_t i=0; i<parallelDone; i++) {
+                        if (idxs[i] == ACTIVESET_NONE) {
+                                continue;
+                        }
+                        const struct object *const object =
+                                scene_getObjectFromIdxConst(scene, idxs[i]);
+                        const struct transform *const trans =
+                                object_getTransform(object);
+                        if (object->threadSafe && trans != NULL &&
+                            trans->dirty) {
+                                scene_queueTransform(scene, idxs[i]);
+                        }
+                }
         }
 
-        const float dist1 = obj1->distanceToCamera;
-        const float dist2 = obj2->distanceToCamera;
-
-        // Objects closer to the camera first
-        if (dist1 < dist2) {
-                return -1;
+        // Objects that become active while updating are appended and updated
+        // too, so the length can't be cached. Removed ones leave a hole.
+        for (size_t i=0; i<scene->active.idxs.length; i++) {
+                const size_t *const idx = growingArray_get(
+                        &scene->active.idxs, i);
+                if (*idx == ACTIVESET_NONE) {
+                        continue;
+                }
+                struct object *const object = scene_getObjectFromIdx(
+                        scene, *idx);
+                if (i >= parallelDone || !object->threadSafe) {
+                        object_update(object, timeDelta);
+                }
         }
-        if (dist1 > dist2) {
-                return 1;
+
+        scene_updateTransforms(scene);
+        if (!compaction_movingComponents(&scene->compaction)) {
+                streaming_update(scene, STREAMING_BUDGET);
         }
+}
 
-        return 0;
+void scene_setParallelUpdate(struct scene *const scene, const bool parallel) {
+        if (parallel) {
+                threadPool_init(0);
+        }
+        scene->parallelUpdate = parallel;
 }
 
-void scene_update(struct scene *const scene, const float timeDelta) {
-        struct stack stack;
-        stack_init(&stack, scene->objects.length+1, sizeof(size_t));
-        size_t *ptr = stack_push(&stack);
-        *ptr = 0;
+bool scene_compact(struct scene *const scene, const unsigned long micros,
+                   size_t *const reclaimed) {
+        assert(scene->loaded);
+        size_t stepReclaimed;
+        const bool done = compaction_step(scene, micros, &stepReclaimed);
+        if (reclaimed != NULL) {
+                *reclaimed = stepReclaimed;
+        }
+        return done;
+}
 
-        while (!stack_empty(&stack)) {
-                size_t *objIdx = stack_pop(&stack);
-                struct object *obj = scene_getObjectFromIdx(scene, *objIdx);
-                object_update(obj, timeDelta);
+void scene_snapshot(const struct scene *const scene,
+                    struct snapshot *const snapshot,
+                    const struct snapshot *const since) {
+        snapshot_take(scene, snapshot, since);
+}
 
-                growingArray_foreach_START(&obj->children, size_t *, chldIdx)
-                        ptr = stack_push(&stack);
-                        *ptr = *chldIdx;
-                growingArray_foreach_END;
-        }
-        stack_destroy(&stack);
+void scene_restore(struct scene *const scene,
+                   const struct snapshot *const snapshot,
+                   const struct snapshot *const delta) {
+        snapshot_restore(scene, snapshot, delta);
 }
 
-void scene_draw(const struct scene *const scene) {
-        // Prepare data structures to hold a list of objects, of lights and of
-        // shaders. We will need them later. Keep them prepared so that on each
-        // draw we use the same list and we don't have to reinitialize it
-        // again.
+void scene_draw(struct scene *const scene, struct sceneDrawStats *stats) {
+        // Prepare data structures to hold a list of lights, and the
+        // camera's, lights' and bones' buffers. We will need them later. Keep
+        // them prepared so that on each draw we use the same list and we
+        // don't have to reinitialize it again.
         static bool first = true;
-        static struct growingArray objects;
-        static struct growingArray lightIdxs;
-        static struct growingArray shaders;
+        static struct growingArray lightObjects;
+        static struct cameraBuffer cameraConstants;
+        static struct lightBuffer lights;
+        static struct bonePalette bones;
+        static struct instanceBuffer instances;
+        static struct growingArray runs;
+        static struct growingArray inside;
+        static struct growingArray inFrustum;
+        static struct growingArray visible;
         if (first) {
-                growingArray_init(&objects,
-                                  sizeof(struct objectModelAndDistance),
-                                  STARTING_OBJECT_COUNT);
-                growingArray_init(&lightIdxs,
-                                  sizeof(size_t),
+                growingArray_init(&lightObjects,
+                                  sizeof(const struct object*),
                                   STARTING_LIGHT_COUNT);
-                growingArray_init(&shaders,
-                                  sizeof(enum shaders),
-                                  STARTING_SHADER_COUNT);
+                cameraBuffer_init(&cameraConstants);
+                lightBuffer_init(&lights);
+                bonePalette_init(&bones);
+                instanceBuffer_init(&instances);
+                growingArray_init(&runs, sizeof(struct drawRun),
+                                  STARTING_OBJECT_COUNT);
+                growingArray_init(&inside, sizeof(size_t),
+                                  STARTING_OBJECT_COUNT);
+                growingArray_init(&inFrustum, sizeof(bool),
+                                  STARTING_OBJECT_COUNT);
+                growingArray_init(&visible, sizeof(bool),
+                                  STARTING_OBJECT_COUNT);
                 first = false;
         }
+        struct sceneDrawStats frameStats;
+        if (stats == NULL) {
+                stats = &frameStats;
+        }
 
-        // We also need to identify the camera and the skybox.
-        size_t cameraIdx = 0;
-        size_t skyboxIdx = 0;
-
-        // Populate 'objects' array, calculate model matrices, gather shaders,
-        // lights, main camera and skybox.
-        gatherObjectTree(scene, &objects, &scene->root, GLMS_MAT4_IDENTITY,
-                         &cameraIdx, &skyboxIdx, &lightIdxs, &shaders);
-
-        struct objectModelAndDistance *camera = growingArray_get(
-                &objects, cameraIdx);
-        struct objectModelAndDistance *skybox = growingArray_get(
-                &objects, skyboxIdx);
-
-        // Calculate the distance to the main camera for each object
-        const vec4s cameraPosition = camera->model.col[3];
-        growingArray_foreach_START(&objects, struct objectModelAndDistance*,
-                                   objMod)
-                const vec4s objectPosition = objMod->model.col[3];
-                objMod->distanceToCamera = glms_vec4_distance(
-                        cameraPosition, objectPosition);
-        growingArray_foreach_END;
+        // Gather lights, main camera and skybox.
+        const struct object *camera;
+        const struct object *skybox;
+        growingArray_clear(&lightObjects);
+        gatherObjects(scene, &camera, &skybox, &lightObjects);
+        const mat4s cameraModel = object_getTransform(camera)->world;
 
-        // Get view and projection matrices from main camera
-        const struct camera *const cameraComp =
-                object_getComponent(camera->object, COMPONENT_CAMERA);
+        // Get view and projection matrices from main camera, once for the
+        // whole frame
+        const struct camera *const cameraComp = object_getCamera(camera);
         assert(cameraComp != NULL);
         assert(cameraComp->main);
-        const mat4s view = camera_viewMatrix(cameraComp, camera->model);
-        const mat4s projection = camera_projectionMatrix(cameraComp);
-
-        // Update lighting for all shaders
-        growingArray_foreach_START(&shaders, enum shaders*, shader)
-                shader_use(*shader);
-                for (size_t i=0; i<lightIdxs.length; i++) {
-                        const size_t *const objModIdx = growingArray_get(
-                                &lightIdxs, i);
-                        const struct objectModelAndDistance *const objMod =
-                                growingArray_get(&objects, *objModIdx);
-                        const struct light *const light =
-                                object_getComponent(
-                                        objMod->object, COMPONENT_LIGHT);
-                        assert(light != NULL);
-                        light_updateShader(light, i, view,
-                                           objMod->model, *shader);
-                }
-                light_updateShaderDisabled(lightIdxs.length, *shader);
-                light_updateGlobalAmbient(*shader, scene->globalAmbientLight);
-        growingArray_foreach_END;
+        cameraBuffer_update(&cameraConstants, cameraModel,
+                            camera_projectionMatrix(cameraComp));
+        const mat4s view = cameraConstants.data.view;
+
+        // Update lighting once, for all shaders
+        lightBuffer_begin(&lights, view, scene->globalAmbientLight);
+        const struct object *const *const lightObject = lightObjects.data;
+        for (size_t i=0; i<lightObjects.length; i++) {
+                const struct light *const light =
+                        object_getLight(lightObject[i]);
+                assert(light != NULL);
+                lightBuffer_set(&lights, i, light,
+                                object_getTransform(lightObject[i])->world);
+        }
+        lightBuffer_end(&lights, lightObjects.length);
 
         // No environment mapping yet, just the skybox, so make sure the
         // texture for the environment slot is loaded since some objects might
         // use it.
-        const struct material *skyboxMaterial = object_getComponent(
-                skybox->object, COMPONENT_MATERIAL);
+        const struct material *skyboxMaterial = object_getMaterial(skybox);
         if (skyboxMaterial != NULL) {
                 // Will be NULL when there's no skybox object. In that case, no
                 // skybox material, no environment texture, hope there's no
@@ -707,8 +1509,38 @@ void scene_draw(const struct scene *const scene) {
                 material_bindTextures(skyboxMaterial);
         }
 
-        // Sort objects by render order
-        growingArray_sort(&objects, cmpobj, NULL);
+        // Put the objects in render order with their distance to the main
+        // camera. Only those that changed since the last frame are looked at,
+        // unless the camera moved.
+        renderQueue_update(scene, cameraModel.col[3]);
+
+        // Leave out everything the camera can't see before doing any more
+        // work for it
+        vec4s planes[6];
+        glms_frustum_planes(cameraConstants.data.viewProjection, planes);
+        cullItems(scene, planes, &inside, &inFrustum, &visible, stats);
+        const bool *const drawn = visible.data;
+        const struct renderItem *const items = scene->renderQueue.items.data;
+
+        // Skinning matrices of every animated object, once for each animation
+        // collection, in a single upload
+        bonePalette_begin(&bones);
+        for (size_t i=0; i<scene->renderQueue.items.length; i++) {
+                if (!drawn[i]) {
+                        continue;
+                }
+                const struct animationCollection *const anims =
+                        object_getAnimationCollection(
+                                scene_getObjectFromIdxConst(
+                                        scene, items[i].object));
+                if (anims != NULL) {
+                        bonePalette_add(&bones, anims);
+                }
+        }
+        bonePalette_end(&bones);
+
+        // Find the runs of objects that can be drawn with a single call
+        batchObjects(scene, drawn, &runs, &instances);
 
         // Render everything. We keep a state of the rendering process with
         // renderStage, material and shader. They are changed automatically by
@@ -718,19 +1550,25 @@ void scene_draw(const struct scene *const scene) {
         enum renderStage renderStage = RENDER_OPAQUE_OBJECTS;
         const struct material *material = NULL;  // last material used
         enum shaders shader = SHADER_TOTAL;  // last shader used
-        growingArray_foreach_START(&objects, struct objectModelAndDistance*,
-                                   objMod)
-                if (!object_draw(objMod->object, objMod->model,
-                                 view, projection,
-                                 &renderStage, &material, &shader)) {
-                        break;
+        stats->draws = runs.length;
+        growingArray_foreach_START(&runs, struct drawRun*, run)
+                const struct object *const object =
+                        scene_getObjectFromIdxConst(
+                                scene, items[run->first].object);
+                if (run->count > 1) {
+                        object_drawInstanced(object, &instances,
+                                             run->instance, run->count,
+                                             &renderStage, &material,
+                                             &shader);
+                } else {
+                        object_draw(object,
+                                    object_getTransform(object)->world,
+                                    &bones, &renderStage, &material,
+                                    &shader);
                 }
         growingArray_foreach_END;
 
         // Cleanup
         glDisable(GL_BLEND);
         glDepthFunc(GL_LESS);
-        growingArray_clear(&objects);
-        growingArray_clear(&lightIdxs);
-        growingArray_clear(&shaders);
 }
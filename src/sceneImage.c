@@ -0,0 +1,868 @@
+#define _DEFAULT_SOURCE  // mmap, fstat
+
+#include <thirty/sceneImage.h>
+#include <thirty/util.h>
+#include <sys/mman.h> //TODO: Only for linux
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <limits.h>
+
+#define SCENE_IMAGE_MAGIC "30IMAGE"
+#define SCENE_IMAGE_MAGIC_SIZE 8
+#define SCENE_IMAGE_VERSION 8
+#define SCENE_IMAGE_ALIGNMENT 16
+#define SCENE_IMAGE_INITIAL_CAPACITY (1024 * 1024)
+
+/*
+ * Layout of an image: a header followed by sections, each one aligned to
+ * SCENE_IMAGE_ALIGNMENT. Offsets are always from the start of the image, so
+ * offset 0 (the header) doubles as the NULL pointer.
+ *
+ *  - components: the raw memory of the scene's varSizeGrowingArray.
+ *  - componentOffsets: the end offset of each component in that memory.
+ *  - objects: the root object followed by every other object, in idx order.
+ *  - objectInfo: the objects' struct objectInfo, in the same order.
+ *  - geometries: a sceneImageGeometry per loaded geometry component.
+ *  - textures: a sceneImageTexture per loaded material texture.
+ *
+ * Everything the above points to (names, skeletons, animations, vertices,
+ * pixels...) is stored in between.
+ */
+
+struct sceneImageSection {
+        uint64_t offset;
+        uint64_t count;
+        uint64_t size;
+};
+
+struct sceneImageHeader {
+        char magic[SCENE_IMAGE_MAGIC_SIZE];
+        uint32_t version;
+        uint32_t pointerSize;
+        uint64_t objectSize;
+        uint64_t componentPadding;
+        vec4s globalAmbientLight;
+        struct sceneImageSection components;
+        struct sceneImageSection componentOffsets;
+        struct sceneImageSection objects;
+        struct sceneImageSection objectInfo;
+        struct sceneImageSection geometries;
+        struct sceneImageSection textures;
+};
+
+struct sceneImageGeometry {
+        uint64_t component;
+        struct sceneImageSection vertices;
+        struct sceneImageSection indices;
+};
+
+struct sceneImageTexture {
+        uint64_t component;
+        uint32_t slot;  // enum material_textureType
+        int32_t width;
+        int32_t height;
+        struct sceneImageSection pixels;
+};
+
+// Store an image offset where a pointer is expected
+#define IMAGE_OFFSET(offset) ((void*)(uintptr_t)(offset))
+
+
+/// Baking ///
+
+struct imageWriter {
+        char *data;
+        size_t size;
+        size_t capacity;
+};
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static size_t writer_reserve(struct imageWriter *const w, const size_t size) {
+        const size_t offset = (w->size + SCENE_IMAGE_ALIGNMENT - 1) &
+                ~(size_t)(SCENE_IMAGE_ALIGNMENT - 1);
+        bool change = false;
+        while (offset + size > w->capacity) {
+                w->capacity *= 2;
+                change = true;
+        }
+        if (change) {
+                w->data = srealloc(w->data, w->capacity);
+        }
+        memset(w->data + w->size, 0, offset + size - w->size);
+        w->size = offset + size;
+        return offset;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2, 3)))
+__attribute__((nonnull (1)))
+static size_t writer_write(struct imageWriter *const w,
+                           const void *const src, const size_t size) {
+        const size_t offset = writer_reserve(w, size);
+        if (size > 0) {
+                memcpy(w->data + offset, src, size);
+        }
+        return offset;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static size_t writer_writeString(struct imageWriter *const w,
+                                 const char *const s) {
+        return writer_write(w, s, strlen(s) + 1);
+}
+
+// Pointers into the image are invalidated by every write, so always go
+// through this with an offset.
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static inline void *writer_at(const struct imageWriter *const w,
+                              const size_t offset) {
+        return w->data + offset;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void bakeAnimationCollection(struct imageWriter *const w,
+                                    const struct animationCollection *const col,
+                                    const size_t colOffset) {
+        const size_t nbones = col->skeleton.nbones;
+        const size_t bones = writer_write(w, col->skeleton.bones,
+                                          nbones * sizeof(struct bone));
+        const size_t boneOrder = writer_write(w, col->skeleton.boneOrder,
+                                              nbones * sizeof(size_t));
+        const size_t animations = writer_write(
+                w, col->animations,
+                col->nanimations * sizeof(struct animation));
+
+        for (size_t i=0; i<col->nanimations; i++) {
+                const struct animation *const anim = &col->animations[i];
+                const size_t name = writer_writeString(w, anim->name);
+                const size_t keyframes = writer_write(
+                        w, anim->keyframes,
+                        anim->nkeyframes * sizeof(struct keyframe));
+
+                for (size_t j=0; j<anim->nkeyframes; j++) {
+                        const struct keyframe *const kf = &anim->keyframes[j];
+                        const size_t rotations = writer_write(
+                                w, kf->relativeBoneRotations,
+                                kf->nbones * sizeof(versors));
+                        struct keyframe *const imgKf =
+                                (struct keyframe*)writer_at(w, keyframes) + j;
+                        imgKf->relativeBoneRotations = IMAGE_OFFSET(rotations);
+                }
+
+                struct animation *const imgAnim =
+                        (struct animation*)writer_at(w, animations) + i;
+                imgAnim->name = IMAGE_OFFSET(name);
+                imgAnim->keyframes = IMAGE_OFFSET(keyframes);
+        }
+
+        struct animationCollection *const imgCol = writer_at(w, colOffset);
+        imgCol->skeleton.bones = IMAGE_OFFSET(bones);
+        imgCol->skeleton.boneOrder = IMAGE_OFFSET(boneOrder);
+        imgCol->animations = IMAGE_OFFSET(animations);
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((access (read_write, 5)))
+__attribute__((nonnull))
+static void bakeGeometry(struct imageWriter *const w,
+                         const struct geometry *const geometry,
+                         const size_t n, const size_t geoOffset,
+                         struct growingArray *const geometries) {
+        if (!geometry->loaded) {
+                bail("Can't bake a scene with geometries that aren't loaded\n");
+        }
+
+        struct vertex *vertices;
+        size_t nvertices;
+        unsigned *indices;
+        size_t nindices;
+        geometry_readback(geometry, &vertices, &nvertices, &indices, &nindices);
+
+        const size_t verticesSize = nvertices * sizeof(*vertices);
+        const size_t indicesSize = nindices * sizeof(*indices);
+        struct sceneImageGeometry *const rec = growingArray_append(geometries);
+        rec->component = n;
+        rec->vertices.offset = writer_write(w, vertices, verticesSize);
+        rec->vertices.count = nvertices;
+        rec->vertices.size = verticesSize;
+        rec->indices.offset = writer_write(w, indices, indicesSize);
+        rec->indices.count = nindices;
+        rec->indices.size = indicesSize;
+
+        free(vertices);
+        free(indices);
+
+        struct geometry *const imgGeo = writer_at(w, geoOffset);
+        imgGeo->vao = 0;
+        imgGeo->vbo = 0;
+        imgGeo->ibo = 0;
+        imgGeo->loaded = false;
+        imgGeo->path = NULL;  // the data is in the image
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((access (read_write, 5)))
+__attribute__((nonnull))
+static void bakeMaterial(struct imageWriter *const w,
+                         struct material *const material,
+                         const size_t n, const size_t matOffset,
+                         struct growingArray *const textures) {
+        for (enum material_textureType tex = MATERIAL_TEXTURE_AMBIENT;
+             tex < MATERIAL_TEXTURE_TOTAL; tex++) {
+                const struct texture *const texture =
+                        material_getTexture(material, tex);
+                if (texture == NULL || !texture->loaded) {
+                        continue;
+                }
+
+                int width;
+                int height;
+                size_t size;
+                void *const pixels = texture_readPixels(texture, &width,
+                                                        &height, &size);
+
+                struct sceneImageTexture *const rec =
+                        growingArray_append(textures);
+                rec->component = n;
+                rec->slot = (uint32_t)tex;
+                rec->width = width;
+                rec->height = height;
+                rec->pixels.offset = writer_write(w, pixels, size);
+                rec->pixels.count = 1;
+                rec->pixels.size = size;
+                free(pixels);
+
+                struct texture *const imgTex = material_getTexture(
+                        writer_at(w, matOffset), tex);
+                imgTex->loaded = false;
+                imgTex->idx = 0;
+        }
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((access (read_write, 5)))
+__attribute__((access (read_write, 6)))
+__attribute__((nonnull))
+static void bakeComponent(struct imageWriter *const w,
+                          const struct scene *const scene,
+                          const size_t n, const size_t componentsOffset,
+                          struct growingArray *const geometries,
+                          struct growingArray *const textures) {
+        const struct varSizeGrowingArray *const components = &scene->components;
+        size_t start = 0;
+        if (n > 0) {
+                const size_t *const off = growingArray_get(
+                        &components->offsets, n-1);
+                start = *off;
+        }
+        const size_t offset = componentsOffset + start + sizeof(size_t) +
+                components->padding;
+        struct component *const comp = varSizeGrowingArray_get(
+                components, n, NULL);
+
+        const size_t name = writer_writeString(w, comp->name);
+        struct component *const imgComp = writer_at(w, offset);
+        imgComp->name = IMAGE_OFFSET(name);
+        imgComp->game = NULL;
+        imgComp->borrowed = true;
+
+        switch (comp->type) {
+        case COMPONENT_GEOMETRY:
+                bakeGeometry(w, (struct geometry*)comp, n, offset, geometries);
+                break;
+
+        case COMPONENT_MATERIAL_UBER:
+        case COMPONENT_MATERIAL_SKYBOX:
+                bakeMaterial(w, (struct material*)comp, n, offset, textures);
+                break;
+
+        case COMPONENT_ANIMATIONCOLLECTION:
+                bakeAnimationCollection(
+                        w, (struct animationCollection*)comp, offset);
+                break;
+
+        case COMPONENT_TRANSFORM:
+        case COMPONENT_CAMERA:
+        case COMPONENT_LIGHT_SPOT:
+        case COMPONENT_LIGHT_DIRECTION:
+        case COMPONENT_LIGHT_POINT:
+                // Plain data, nothing else to do
+                break;
+
+        case COMPONENT_TOTAL:
+        default:
+                assert_fail();
+        }
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void bakeObject(struct imageWriter *const w,
+                       const struct objectInfo *const info,
+                       const size_t objOffset, const size_t infoOffset) {
+        // Tree links are idxs, they stay as they are
+        struct object *const imgObj = writer_at(w, objOffset);
+        imgObj->componentsMemory = NULL;
+        imgObj->onUpdate = NULL;
+        imgObj->threadSafe = false;
+
+        const size_t name = writer_writeString(w, info->name);
+        struct objectInfo *const imgInfo = writer_at(w, infoOffset);
+        imgInfo->name = IMAGE_OFFSET(name);
+        imgInfo->borrowed = true;
+}
+
+void sceneImage_bake(const struct scene *const scene,
+                     const char *const filename) {
+        if (!scene->loaded) {
+                bail("Only fully loaded scenes can be baked\n");
+        }
+        if (scene->objects.deletedNodes != NULL) {
+                bail("Can't bake a scene with removed objects\n");
+        }
+        if (scene->streaming.cells.length > 0) {
+                bail("Can't bake a scene streamed in cells\n");
+        }
+
+        struct imageWriter w = {
+                .data = smalloc(SCENE_IMAGE_INITIAL_CAPACITY),
+                .size = 0,
+                .capacity = SCENE_IMAGE_INITIAL_CAPACITY,
+        };
+        struct sceneImageHeader header;
+        memset(&header, 0, sizeof(header));
+        writer_reserve(&w, sizeof(header));
+
+        memcpy(header.magic, SCENE_IMAGE_MAGIC, SCENE_IMAGE_MAGIC_SIZE);
+        header.version = SCENE_IMAGE_VERSION;
+        header.pointerSize = sizeof(void*);
+        header.objectSize = sizeof(struct object);
+        header.componentPadding = scene->components.padding;
+        header.globalAmbientLight = scene->globalAmbientLight;
+
+        // Components, copied verbatim and then fixed up one by one
+        const struct varSizeGrowingArray *const components = &scene->components;
+        const size_t ncomponents = components->offsets.length;
+        size_t componentsSize = 0;
+        if (ncomponents > 0) {
+                const size_t *const off = growingArray_get(
+                        &components->offsets, ncomponents-1);
+                componentsSize = *off;
+        }
+        header.components.offset = writer_write(&w, components->data,
+                                                componentsSize);
+        header.components.count = ncomponents;
+        header.components.size = componentsSize;
+        header.componentOffsets.offset = writer_write(
+                &w, components->offsets.data, ncomponents * sizeof(size_t));
+        header.componentOffsets.count = ncomponents;
+        header.componentOffsets.size = ncomponents * sizeof(size_t);
+
+        struct growingArray geometries;
+        struct growingArray textures;
+        growingArray_init(&geometries, sizeof(struct sceneImageGeometry), 8);
+        growingArray_init(&textures, sizeof(struct sceneImageTexture), 8);
+        for (size_t n=0; n<ncomponents; n++) {
+                bakeComponent(&w, scene, n, header.components.offset,
+                              &geometries, &textures);
+        }
+
+        // Objects, root first so that the image's index matches the idx
+        const size_t nobjects = scene->objects.length + 1;
+        header.objects.offset = writer_reserve(
+                &w, nobjects * sizeof(struct object));
+        header.objects.count = nobjects;
+        header.objects.size = nobjects * sizeof(struct object);
+        memcpy(writer_at(&w, header.objects.offset), &scene->root,
+               sizeof(struct object));
+        if (nobjects > 1) {
+                memcpy(writer_at(&w, header.objects.offset +
+                                 sizeof(struct object)),
+                       scene->objects.data,
+                       (nobjects - 1) * sizeof(struct object));
+        }
+        assert(scene->objectInfo.length == nobjects);
+        header.objectInfo.offset = writer_write(
+                &w, scene->objectInfo.data,
+                nobjects * sizeof(struct objectInfo));
+        header.objectInfo.count = nobjects;
+        header.objectInfo.size = nobjects * sizeof(struct objectInfo);
+        for (size_t i=0; i<nobjects; i++) {
+                bakeObject(&w, growingArray_get(&scene->objectInfo, i),
+                           header.objects.offset + i * sizeof(struct object),
+                           header.objectInfo.offset +
+                           i * sizeof(struct objectInfo));
+        }
+
+        header.geometries.offset = writer_write(
+                &w, geometries.data,
+                geometries.length * sizeof(struct sceneImageGeometry));
+        header.geometries.count = geometries.length;
+        header.geometries.size =
+                geometries.length * sizeof(struct sceneImageGeometry);
+        header.textures.offset = writer_write(
+                &w, textures.data,
+                textures.length * sizeof(struct sceneImageTexture));
+        header.textures.count = textures.length;
+        header.textures.size =
+                textures.length * sizeof(struct sceneImageTexture);
+        growingArray_destroy(&geometries);
+        growingArray_destroy(&textures);
+
+        memcpy(writer_at(&w, 0), &header, sizeof(header));
+
+        FILE *const f = sfopen(filename, "wb");
+        if (fwrite(w.data, 1, w.size, f) != w.size) {
+                bail("Error writing scene image %s\n", filename);
+        }
+        sfclose(f);
+        free(w.data);
+}
+
+
+/// Loading ///
+
+// Nothing read from an image is trusted, a truncated or corrupted file must
+// be rejected before it makes us read past the mapping. Every offset is
+// checked against the image's size and every idx against what it indexes.
+struct imageReader {
+        char *base;
+        size_t size;
+};
+
+// Bitmask of component types accepted by tableComponent
+#define COMPONENT_BIT(type) (1u << (type))
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static void checkSection(const struct sceneImageSection *const section,
+                         const size_t elementSize, const size_t imageSize) {
+        if (section->offset % SCENE_IMAGE_ALIGNMENT != 0 ||
+            section->offset > imageSize ||
+            section->size > imageSize - section->offset ||
+            !is_safe_multiply(section->count, elementSize) ||
+            section->count * elementSize != section->size) {
+                bail("Malformatted scene image\n");
+        }
+}
+
+// Turn an offset into a pointer to count elements of the given size
+__attribute__((access (read_only, 1)))
+__attribute__((access (none, 2)))
+__attribute__((nonnull (1)))
+static void *relocate(const struct imageReader *const r,
+                      const void *const offset, const size_t count,
+                      const size_t elementSize) {
+        const uintptr_t start = (uintptr_t)offset;
+        if (start == 0) {
+                if (count > 0) {
+                        bail("Malformatted scene image\n");
+                }
+                return NULL;
+        }
+        if (start % SCENE_IMAGE_ALIGNMENT != 0 || start > r->size ||
+            !is_safe_multiply(count, elementSize) ||
+            count * elementSize > r->size - start) {
+                bail("Malformatted scene image\n");
+        }
+        return r->base + start;
+}
+
+// Same for a string, which must be terminated inside the image
+__attribute__((access (read_only, 1)))
+__attribute__((access (none, 2)))
+__attribute__((nonnull (1)))
+static char *relocateString(const struct imageReader *const r,
+                            const void *const offset) {
+        const uintptr_t start = (uintptr_t)offset;
+        if (start == 0 || start >= r->size ||
+            memchr(r->base + start, '\0', r->size - start) == NULL) {
+                bail("Malformatted scene image\n");
+        }
+        return r->base + start;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void relocateAnimationCollection(struct animationCollection *const col,
+                                        const struct imageReader *const r) {
+        struct skeleton *const skel = &col->skeleton;
+        const size_t nbones = skel->nbones;
+        skel->bones = relocate(r, skel->bones, nbones, sizeof(struct bone));
+        skel->boneOrder = relocate(r, skel->boneOrder, nbones, sizeof(size_t));
+        for (size_t i=0; i<nbones; i++) {
+                // Parents are stored as idx+1, 0 for the root
+                if (skel->bones[i].parent > nbones ||
+                    skel->boneOrder[i] >= nbones) {
+                        bail("Malformatted scene image\n");
+                }
+        }
+
+        col->animations = relocate(r, col->animations, col->nanimations,
+                                   sizeof(struct animation));
+        if (col->current > col->nanimations) {
+                bail("Malformatted scene image\n");
+        }
+        for (size_t i=0; i<col->nanimations; i++) {
+                struct animation *const anim = &col->animations[i];
+                anim->name = relocateString(r, anim->name);
+                anim->keyframes = relocate(r, anim->keyframes, anim->nkeyframes,
+                                           sizeof(struct keyframe));
+                for (size_t j=0; j<anim->nkeyframes; j++) {
+                        struct keyframe *const kf = &anim->keyframes[j];
+                        if (kf->nbones != nbones) {
+                                bail("Malformatted scene image\n");
+                        }
+                        kf->relativeBoneRotations = relocate(
+                                r, kf->relativeBoneRotations, nbones,
+                                sizeof(versors));
+                }
+        }
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void relocateMaterial(struct material *const material) {
+        if ((unsigned)material->shader >= SHADER_TOTAL) {
+                bail("Malformatted scene image\n");
+        }
+        // Only the textures with a record in the image get loaded
+        for (enum material_textureType tex = MATERIAL_TEXTURE_AMBIENT;
+             tex < MATERIAL_TEXTURE_TOTAL; tex++) {
+                struct texture *const texture =
+                        material_getTexture(material, tex);
+                if (texture != NULL) {
+                        texture->loaded = false;
+                        texture->idx = 0;
+                }
+        }
+        if (material->base.type == COMPONENT_MATERIAL_UBER) {
+                // The slot it had when baked belongs to someone else
+                material_uber_initBlock((struct material_uber*)material);
+        }
+}
+
+// Fix up the n-th component, which has size bytes of room in the image
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 4)))
+__attribute__((access (read_write, 5)))
+__attribute__((nonnull))
+static void relocateComponent(struct component *const comp, const size_t size,
+                              const size_t n,
+                              const struct imageReader *const r,
+                              struct scene *const scene,
+                              const size_t nobjects) {
+        if ((unsigned)comp->type >= COMPONENT_TOTAL ||
+            size < componentCollection_sizeOf(comp->type) ||
+            comp->idx != n || comp->object >= nobjects) {
+                bail("Malformatted scene image\n");
+        }
+        comp->name = relocateString(r, comp->name);
+        comp->game = scene->game;
+        comp->borrowed = true;
+
+        switch (comp->type) {
+        case COMPONENT_ANIMATIONCOLLECTION:
+                relocateAnimationCollection(
+                        (struct animationCollection*)comp, r);
+                break;
+
+        case COMPONENT_MATERIAL_UBER:
+        case COMPONENT_MATERIAL_SKYBOX:
+                relocateMaterial((struct material*)comp);
+                break;
+
+        case COMPONENT_GEOMETRY:
+                // Only the geometries with a record in the image get loaded
+                ((struct geometry*)comp)->loaded = false;
+                ((struct geometry*)comp)->path = NULL;
+                break;
+
+        case COMPONENT_TRANSFORM:
+                ((struct transform*)comp)->scene = scene;
+                break;
+
+        case COMPONENT_CAMERA:
+        case COMPONENT_LIGHT_SPOT:
+        case COMPONENT_LIGHT_DIRECTION:
+        case COMPONENT_LIGHT_POINT:
+                // Plain data
+                break;
+
+        case COMPONENT_TOTAL:
+        default:
+                bail("Malformatted scene image\n");
+        }
+}
+
+// Get a component from its idx, making sure it's of one of the given types
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static void *tableComponent(const struct scene *const scene,
+                            const uint64_t component, const unsigned types) {
+        if (component >= scene->components.offsets.length) {
+                bail("Malformatted scene image\n");
+        }
+        struct component *const comp = varSizeGrowingArray_get(
+                &scene->components, component, NULL);
+        if ((COMPONENT_BIT(comp->type) & types) == 0) {
+                bail("Malformatted scene image\n");
+        }
+        return comp;
+}
+
+// A slot of a component collection holds idx+1, or 0 if it's empty
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static void checkSlot(const struct scene *const scene, const size_t slot,
+                      const unsigned types) {
+        if (slot != 0) {
+                tableComponent(scene, slot - 1, types);
+        }
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_write, 4)))
+__attribute__((nonnull))
+static void relocateObject(struct object *const object, const size_t idx,
+                           const size_t nobjects, struct scene *const scene) {
+        // Root can't be anyone's child or sibling, 0 means there's none
+        if (object->idx != idx || object->parent >= nobjects ||
+            object->firstChild >= nobjects ||
+            object->nextSibling >= nobjects ||
+            object->prevSibling >= nobjects) {
+                bail("Malformatted scene image\n");
+        }
+
+        // The object_get* accessors trust the slots' types
+        const struct componentCollection *const c = &object->components;
+        checkSlot(scene, c->transform, COMPONENT_BIT(COMPONENT_TRANSFORM));
+        checkSlot(scene, c->camera, COMPONENT_BIT(COMPONENT_CAMERA));
+        checkSlot(scene, c->geometry, COMPONENT_BIT(COMPONENT_GEOMETRY));
+        checkSlot(scene, c->material,
+                  COMPONENT_BIT(COMPONENT_MATERIAL_UBER) |
+                  COMPONENT_BIT(COMPONENT_MATERIAL_SKYBOX));
+        checkSlot(scene, c->light,
+                  COMPONENT_BIT(COMPONENT_LIGHT_SPOT) |
+                  COMPONENT_BIT(COMPONENT_LIGHT_DIRECTION) |
+                  COMPONENT_BIT(COMPONENT_LIGHT_POINT));
+        checkSlot(scene, c->animationCollection,
+                  COMPONENT_BIT(COMPONENT_ANIMATIONCOLLECTION));
+
+        object->componentsMemory = &scene->components;
+        object->onUpdate = NULL;
+        object->threadSafe = false;
+}
+
+// Check that the component offsets describe consecutive elements that fill
+// the components section, each with room for at least a struct component
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void checkComponentOffsets(const struct sceneImageHeader *const header,
+                                  const char *const base) {
+        if (header->componentPadding >= COMPONENT_STRUCT_ALIGNMENT) {
+                bail("Malformatted scene image\n");
+        }
+        const size_t elementHeader = sizeof(size_t) + header->componentPadding;
+        const size_t *const offsets =
+                (const void*)(base + header->componentOffsets.offset);
+        size_t start = 0;
+        for (size_t n=0; n<header->componentOffsets.count; n++) {
+                const size_t end = offsets[n];
+                if (end % COMPONENT_STRUCT_ALIGNMENT != 0 ||
+                    end > header->components.size || end < start ||
+                    end - start < elementHeader + sizeof(struct component)) {
+                        bail("Malformatted scene image\n");
+                }
+                start = end;
+        }
+        if (start != header->components.size) {
+                bail("Malformatted scene image\n");
+        }
+}
+
+void sceneImage_load(struct scene *const scene, const char *const filename) {
+        const int fd = sopen(filename, O_RDONLY);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+                bail("Can't stat scene image %s\n", filename);
+        }
+        const size_t size = (size_t)st.st_size;
+        if (size < sizeof(struct sceneImageHeader)) {
+                bail("Malformatted scene image\n");
+        }
+
+        // Private mapping: fixing up pointers must not write to the file
+        char *const base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+                bail("Can't map scene image %s\n", filename);
+        }
+        close(fd);
+
+        const struct sceneImageHeader *const header = (void*)base;
+        if (memcmp(header->magic, SCENE_IMAGE_MAGIC,
+                   SCENE_IMAGE_MAGIC_SIZE) != 0) {
+                bail("Malformatted scene image\n");
+        }
+        if (header->version != SCENE_IMAGE_VERSION ||
+            header->pointerSize != sizeof(void*) ||
+            header->objectSize != sizeof(struct object)) {
+                bail("Scene image %s was baked by an incompatible build, "
+                     "bake it again\n", filename);
+        }
+        checkSection(&header->components, 1, size);
+        checkSection(&header->componentOffsets, sizeof(size_t), size);
+        checkSection(&header->objects, sizeof(struct object), size);
+        checkSection(&header->objectInfo, sizeof(struct objectInfo), size);
+        checkSection(&header->geometries,
+                     sizeof(struct sceneImageGeometry), size);
+        checkSection(&header->textures, sizeof(struct sceneImageTexture), size);
+        if (header->components.count != header->componentOffsets.count ||
+            header->objects.count == 0 ||
+            header->objectInfo.count != header->objects.count) {
+                bail("Malformatted scene image\n");
+        }
+        checkComponentOffsets(header, base);
+        const struct imageReader r = {.base = base, .size = size};
+        const size_t nobjects = header->objects.count;
+
+        scene->image = base;
+        scene->imageSize = size;
+        scene->globalAmbientLight = header->globalAmbientLight;
+
+        // Components
+        varSizeGrowingArray_initFromBuffer(
+                &scene->components, COMPONENT_STRUCT_ALIGNMENT,
+                base + header->components.offset, header->components.size,
+                (const void*)(base + header->componentOffsets.offset),
+                header->componentOffsets.count);
+        if (scene->components.padding != header->componentPadding) {
+                bail("Scene image %s was baked by an incompatible build, "
+                     "bake it again\n", filename);
+        }
+        const size_t elementHeader = sizeof(size_t) + scene->components.padding;
+        const size_t *const offsets = scene->components.offsets.data;
+        for (size_t n=0; n<header->components.count; n++) {
+                const size_t start = n == 0 ? 0 : offsets[n-1];
+                relocateComponent(varSizeGrowingArray_get(
+                                          &scene->components, n, NULL),
+                                  offsets[n] - start - elementHeader, n, &r,
+                                  scene, nobjects);
+        }
+
+        // Objects
+        const struct object *const objects =
+                (const void*)(base + header->objects.offset);
+        scene->root = objects[0];
+        relocateObject(&scene->root, 0, nobjects, scene);
+        growingArray_initFromBuffer(&scene->objects, sizeof(struct object),
+                                    objects + 1, nobjects - 1);
+        for (size_t i=1; i<nobjects; i++) {
+                relocateObject(growingArray_get(&scene->objects, i-1), i,
+                               nobjects, scene);
+        }
+        // Whatever was left dirty when it was baked
+        scene_queueTransform(scene, 0);
+
+        // Names stay in the image
+        const struct objectInfo *const infos =
+                (const void*)(base + header->objectInfo.offset);
+        for (size_t i=0; i<header->objectInfo.count; i++) {
+                struct objectInfo *const info = growingArray_append(
+                        &scene->objectInfo);
+                info->name = relocateString(&r, infos[i].name);
+                info->borrowed = true;
+        }
+}
+
+bool sceneImage_upload(struct scene *const scene, size_t *const next) {
+        char *const base = scene->image;
+        const size_t size = scene->imageSize;
+        assert(base != NULL);
+        const struct sceneImageHeader *const header = (void*)base;
+
+        const struct sceneImageGeometry *const geometries =
+                (const void*)(base + header->geometries.offset);
+        const struct sceneImageTexture *const textures =
+                (const void*)(base + header->textures.offset);
+        const size_t total = header->geometries.count + header->textures.count;
+
+        // Geometries first, then textures, straight from the mapping
+        while (*next < total) {
+                if (*next < header->geometries.count) {
+                        const struct sceneImageGeometry *const rec =
+                                &geometries[*next];
+                        checkSection(&rec->vertices, sizeof(struct vertex),
+                                     size);
+                        checkSection(&rec->indices, sizeof(unsigned), size);
+                        if (rec->indices.count > INT_MAX) {
+                                bail("Malformatted scene image\n");
+                        }
+                        struct geometry *const geometry = tableComponent(
+                                scene, rec->component,
+                                COMPONENT_BIT(COMPONENT_GEOMETRY));
+                        geometry_upload(
+                                geometry,
+                                (const void*)(base + rec->vertices.offset),
+                                rec->vertices.count,
+                                (const void*)(base + rec->indices.offset),
+                                rec->indices.count);
+                } else {
+                        const struct sceneImageTexture *const rec =
+                                &textures[*next - header->geometries.count];
+                        checkSection(&rec->pixels, rec->pixels.size, size);
+                        struct material *const material = tableComponent(
+                                scene, rec->component,
+                                COMPONENT_BIT(COMPONENT_MATERIAL_UBER) |
+                                COMPONENT_BIT(COMPONENT_MATERIAL_SKYBOX));
+                        if (rec->slot >= MATERIAL_TEXTURE_TOTAL) {
+                                bail("Malformatted scene image\n");
+                        }
+                        struct texture *const texture = material_getTexture(
+                                material, (enum material_textureType)rec->slot);
+                        if (texture == NULL) {
+                                bail("Malformatted scene image\n");
+                        }
+                        // The pixels are read straight from the mapping, so
+                        // there must be exactly as many as the size says
+                        size_t pixelsSize;
+                        if (!texture_pixelsSize(texture, rec->width,
+                                                rec->height, &pixelsSize) ||
+                            pixelsSize != rec->pixels.size) {
+                                bail("Malformatted scene image\n");
+                        }
+                        texture_loadPixels(texture, rec->width, rec->height,
+                                           base + rec->pixels.offset);
+                }
+                (*next)++;
+
+                if (scene_loadBudgetExceeded(scene)) {
+                        return *next >= total;
+                }
+        }
+
+        return true;
+}
+
+void sceneImage_release(struct scene *const scene) {
+        if (scene->image != NULL) {
+                munmap(scene->image, scene->imageSize);
+                scene->image = NULL;
+                scene->imageSize = 0;
+        }
+}
@@ -1,4 +1,5 @@
 #include <thirty/shader.h>
+#include <thirty/bonePalette.h>
 #include <thirty/util.h>
 
 static const int ambientTextureSampler = 0;
@@ -10,6 +11,7 @@ static const int normalTextureSampler = 5;
 static const int bumpTextureSampler = 6;
 static const int opacityTextureSampler = 7;
 static const int environmentTextureSampler = 8;
+static const int bonesTextureSampler = BONEPALETTE_TEXTURE_UNIT;
 
 static const int uiQuadTextureSampler = 0;
 static const int uiFontTextureSampler = 1;
@@ -17,6 +19,26 @@ static const int uiFontTextureSampler = 1;
 // Holds currently created shaders, or 0 if the shader hasn't been created yet.
 static unsigned shaders[SHADER_TOTAL];
 
+// Uniform locations of each created shader, -1 for the ones it doesn't have
+static int locations[SHADER_TOTAL][SHADER_UNIFORM_TOTAL];
+
+// Last value each created shader's int, unsigned and bool uniforms were set
+// to, if they were, so that setting one to the same value again is skipped
+static unsigned scalars[SHADER_TOTAL][SHADER_UNIFORM_TOTAL];
+static bool scalarsSet[SHADER_TOTAL][SHADER_UNIFORM_TOTAL];
+
+static const char *const uniformNames[SHADER_UNIFORM_TOTAL] = {
+        [SHADER_UNIFORM_MODEL] = "model",
+        [SHADER_UNIFORM_BONEOFFSET] = "boneOffset",
+        [SHADER_UNIFORM_INSTANCED] = "instanced",
+};
+
+static const char *const blockNames[SHADER_BLOCK_TOTAL] = {
+        [SHADER_BLOCK_LIGHTS] = "Lights",
+        [SHADER_BLOCK_CAMERA] = "Camera",
+        [SHADER_BLOCK_MATERIAL] = "Material",
+};
+
 __attribute__((access (read_only, 1)))
 __attribute__((nonnull))
 __attribute__((returns_nonnull))
@@ -173,6 +195,7 @@ static void init_shader(const enum shaders shader) {
                 shader_setInt(shader, "bumpTexture", bumpTextureSampler);
                 shader_setInt(shader, "opacityTexture", opacityTextureSampler);
                 shader_setInt(shader, "environment", environmentTextureSampler);
+                shader_setInt(shader, "bones", bonesTextureSampler);
                 break;
         case SHADER_SKYBOX:
                 shader_setInt(shader, "skybox", environmentTextureSampler);
@@ -187,6 +210,22 @@ static void init_shader(const enum shaders shader) {
         }
 }
 
+static void find_locations(const enum shaders shader, const unsigned id) {
+        int *const locs = locations[shader];
+        for (size_t i=0; i<SHADER_UNIFORM_TOTAL; i++) {
+                locs[i] = glGetUniformLocation(id, uniformNames[i]);
+                scalarsSet[shader][i] = false;
+        }
+
+        for (unsigned block=0; block<SHADER_BLOCK_TOTAL; block++) {
+                const unsigned idx = glGetUniformBlockIndex(
+                        id, blockNames[block]);
+                if (idx != GL_INVALID_INDEX) {
+                        glUniformBlockBinding(id, idx, block);
+                }
+        }
+}
+
 static unsigned get_shader_id(const enum shaders shader) {
         if (shaders[shader] != 0) {
                 return shaders[shader];
@@ -236,6 +275,7 @@ static unsigned get_shader_id(const enum shaders shader) {
         unsigned id = shader_new(nvertfiles, nfragfiles, vertfiles, fragfiles);
         shaders[shader] = id;
 
+        find_locations(shader, id);
         init_shader(shader);
         return id;
 }
@@ -287,3 +327,61 @@ void shader_setMat4(const enum shaders shader, const char *const name,
                     const mat4s value) {
         glUniformMatrix4fv(getloc(shader, name), 1, GL_FALSE, value.raw[0]);
 }
+
+inline static int uniformloc(const enum shaders shader,
+                             const enum shaderUniform uniform) {
+        assert(uniform < SHADER_UNIFORM_TOTAL);
+        get_shader_id(shader);
+        return locations[shader][uniform];
+}
+
+// Whether the uniform of a created shader was already set to the value,
+// remembering it if it wasn't
+static bool sameScalar(const enum shaders shader,
+                       const enum shaderUniform uniform,
+                       const unsigned value) {
+        if (scalarsSet[shader][uniform] && scalars[shader][uniform] == value) {
+                return true;
+        }
+        scalars[shader][uniform] = value;
+        scalarsSet[shader][uniform] = true;
+        return false;
+}
+
+void shader_setUniformBool(const enum shaders shader,
+                           const enum shaderUniform uniform,
+                           const bool value) {
+        shader_setUniformUInt(shader, uniform, value);
+}
+void shader_setUniformInt(const enum shaders shader,
+                          const enum shaderUniform uniform,
+                          const int value) {
+        const int location = uniformloc(shader, uniform);
+        if (!sameScalar(shader, uniform, (unsigned)value)) {
+                glUniform1i(location, value);
+        }
+}
+void shader_setUniformUInt(const enum shaders shader,
+                           const enum shaderUniform uniform,
+                           const unsigned value) {
+        const int location = uniformloc(shader, uniform);
+        if (!sameScalar(shader, uniform, value)) {
+                glUniform1ui(location, value);
+        }
+}
+void shader_setUniformFloat(const enum shaders shader,
+                            const enum shaderUniform uniform,
+                            const float value) {
+        glUniform1f(uniformloc(shader, uniform), value);
+}
+void shader_setUniformVec4(const enum shaders shader,
+                           const enum shaderUniform uniform,
+                           const vec4s value) {
+        glUniform4fv(uniformloc(shader, uniform), 1, value.raw);
+}
+void shader_setUniformMat4(const enum shaders shader,
+                           const enum shaderUniform uniform,
+                           const mat4s value) {
+        glUniformMatrix4fv(uniformloc(shader, uniform), 1, GL_FALSE,
+                           value.raw[0]);
+}
@@ -1,8 +1,7 @@
 #include <thirty/skeleton.h>
+#include <thirty/vectorMath.h>
 #include <thirty/util.h>
 
-#define BUFFSIZE 256
-
 __attribute__((access (read_only, 1, 2)))
 __attribute__((nonnull))
 static bool arrayContains(const size_t *const array, const size_t arrayLen,
@@ -39,47 +38,59 @@ static void calcBoneOrder(struct skeleton *const skel) {
         }
 }
 
+// Each bone's absolute transform is its parent's, rotated by the bone's
+// rotation and then moved by its position: parent * R * T(p). The bone's part
+// of that is T(R p) * R, which is composed for all bones at once, and then the
+// products go in boneOrder so that parents are always done first.
 static void calcAbsoluteTransforms(struct skeleton *const skel) {
-        for (size_t ii=0; ii<skel->nbones; ii++) {
-                size_t i = skel->boneOrder[ii];
-                struct bone *bone = &skel->bones[i];
-
-                // Start with the parent's absolute transform
-                if (bone->parent == 0) {
-                        // For the root, the skeleton's transform, which is
-                        // relative to the actual object we're animating.
-                        bone->absoluteTransform = skel->model;
-                } else {
-                        bone->absoluteTransform =
-                                skel->bones[bone->parent-1].absoluteTransform;
-                }
-
-                // Record current location, move to origin
-                vec3s trans = glms_vec3(bone->absoluteTransform.col[3]);
-                bone->absoluteTransform.col[3].x = 0;
-                bone->absoluteTransform.col[3].y = 0;
-                bone->absoluteTransform.col[3].z = 0;
-
-                // Apply rotation relative to the parent's
-                bone->absoluteTransform = glms_quat_rotate(
-                        bone->absoluteTransform, bone->rotationRelative);
-
-                // Set position back to what it was
-                bone->absoluteTransform.col[3].x = trans.x;
-                bone->absoluteTransform.col[3].y = trans.y;
-                bone->absoluteTransform.col[3].z = trans.z;
-
-                // Advance to the bone position relative to the parent
-                bone->absoluteTransform = glms_translate(
-                        bone->absoluteTransform, bone->positionRelative);
+        const size_t n = skel->nbones;
+        struct trsArrays trs;
+        trsArrays_init(&trs, n);
+        for (size_t i=0; i<n; i++) {
+                const struct bone *const bone = &skel->bones[i];
+                const versors rotation = glms_quat_normalize(
+                        bone->rotationRelative);
+                trsArrays_set(&trs, i,
+                              glms_quat_rotatev(rotation,
+                                                bone->positionRelative),
+                              rotation, GLMS_VEC3_ONE);
+        }
+        mat4s *const locals = smallocarray(n, sizeof(*locals));
+        vectorMath_composeTRS(&trs, locals, n);
+
+        const mat4s **const parents = smallocarray(n, sizeof(*parents));
+        const mat4s **const localPtrs = smallocarray(n, sizeof(*localPtrs));
+        mat4s **const absolutes = smallocarray(n, sizeof(*absolutes));
+        for (size_t ii=0; ii<n; ii++) {
+                const size_t i = skel->boneOrder[ii];
+                struct bone *const bone = &skel->bones[i];
+                // The root starts from the skeleton's transform, which is
+                // relative to the actual object we're animating
+                parents[ii] = bone->parent == 0 ? &skel->model :
+                        &skel->bones[bone->parent-1].absoluteTransform;
+                localPtrs[ii] = &locals[i];
+                absolutes[ii] = &bone->absoluteTransform;
         }
+        vectorMath_mulIndirect(parents, localPtrs, absolutes, n);
+
+        free(absolutes);
+        free(localPtrs);
+        free(parents);
+        free(locals);
+        trsArrays_free(&trs);
 }
 
+// Bones' transforms are affine, so the cheaper inverse does
 static void calcBindPose(struct skeleton *const skel) {
+        mat4s *const inverses = smallocarray(skel->nbones, sizeof(*inverses));
+        for (size_t i=0; i<skel->nbones; i++) {
+                inverses[i] = skel->bones[i].absoluteTransform;
+        }
+        vectorMath_invAffine(inverses, inverses, skel->nbones);
         for (size_t i=0; i<skel->nbones; i++) {
-                struct bone *bone = &skel->bones[i];
-                bone->bindPoseInv = glms_mat4_inv(bone->absoluteTransform);
+                skel->bones[i].bindPoseInv = inverses[i];
         }
+        free(inverses);
 }
 
 void skeleton_initFromFile(struct skeleton *const skel, FILE *const f) {
@@ -128,15 +139,12 @@ void skeleton_initFromKeyframe(struct skeleton *const skel,
         calcAbsoluteTransforms(skel);
 }
 
-void skeleton_bindBones(const struct skeleton *const skel,
-                        const enum shaders shader) {
+void skeleton_skinningMatrices(const struct skeleton *const skel,
+                               mat4s *const out) {
         for (size_t i=0; i<skel->nbones; i++) {
-                struct bone *bone = skel->bones + i;
-                mat4s skinningMatrix = glms_mat4_mul(bone->absoluteTransform,
-                                                     bone->bindPoseInv);
-                static char buff[BUFFSIZE];
-                snprintf(buff, BUFFSIZE, "bones[%lu]", i);
-                shader_setMat4(shader, buff, skinningMatrix);
+                const struct bone *const bone = skel->bones + i;
+                out[i] = glms_mat4_mul(bone->absoluteTransform,
+                                       bone->bindPoseInv);
         }
 }
 
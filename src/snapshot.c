@@ -0,0 +1,798 @@
+#include <thirty/snapshot.h>
+#include <thirty/scene.h>
+#include <thirty/util.h>
+
+#define SNAPSHOT_MAGIC "30SNAP"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_ALIGNMENT 8
+#define SNAPSHOT_INITIAL_CAPACITY 4096
+
+/*
+ * Layout of a snapshot: a header followed by its sections one after the
+ * other, each one a section header and its records, aligned to
+ * SNAPSHOT_ALIGNMENT. Readers skip the sections they don't know, and reject
+ * the ones they do know with another version.
+ *
+ *  - objects: a snapshotObject per object slot, by idx, root first.
+ *  - names: a snapshotName per object, each followed by the name itself.
+ *  - transforms: a snapshotTransform per transform component, by idx.
+ *  - animations: a snapshotAnimation per animation collection, by idx.
+ *
+ * Deltas only have the records that differ from the full snapshot they were
+ * taken against, and the object slots past their count are gone.
+ */
+
+enum snapshotSectionType {
+        SNAPSHOT_OBJECTS,
+        SNAPSHOT_NAMES,
+        SNAPSHOT_TRANSFORMS,
+        SNAPSHOT_ANIMATIONS,
+};
+
+// Bumped whenever the records of the section change
+#define SNAPSHOT_OBJECTS_VERSION 1
+#define SNAPSHOT_NAMES_VERSION 1
+#define SNAPSHOT_TRANSFORMS_VERSION 1
+#define SNAPSHOT_ANIMATIONS_VERSION 1
+
+struct snapshotHeader {
+        char magic[SNAPSHOT_MAGIC_SIZE];
+        uint32_t version;
+        uint32_t delta;  // 1 if it only has the changes since 'base'
+        uint64_t id;
+        uint64_t base;
+        uint64_t nobjects;  // slots, root included
+        uint64_t ncomponents;
+        uint64_t generation;  // of the scene's compaction
+        uint64_t nsections;
+};
+
+struct snapshotSection {
+        uint32_t type;  // enum snapshotSectionType
+        uint32_t version;
+        uint64_t count;
+        uint64_t size;  // of the records that follow, padding included
+};
+
+#define SNAPSHOT_PRESENT 1
+#define SNAPSHOT_THREADSAFE 2
+
+struct snapshotObject {
+        size_t idx;
+        size_t flags;  // all 0 for removed objects
+        size_t parent;
+        size_t firstChild;
+        size_t nextSibling;
+        size_t prevSibling;
+        struct componentCollection components;
+        eventBrokerCallback onUpdate;
+};
+
+struct snapshotName {
+        size_t idx;
+        size_t length;  // followed by the name, its terminator and padding
+};
+
+struct snapshotTransform {
+        size_t component;
+        float position[3];
+        float rotation[4];
+        float scale[3];
+};
+
+struct snapshotAnimation {
+        size_t component;
+        size_t current;
+        float time;
+        uint32_t running;
+};
+
+void snapshot_init(struct snapshot *const snapshot) {
+        snapshot->data = NULL;
+        snapshot->size = 0;
+        snapshot->capacity = 0;
+}
+
+void snapshot_initFromBuffer(struct snapshot *const snapshot,
+                             const void *const data, const size_t size) {
+        snapshot->data = smalloc(size > 0 ? size : 1);
+        memcpy(snapshot->data, data, size);
+        snapshot->size = size;
+        snapshot->capacity = size;
+}
+
+void snapshot_free(struct snapshot *const snapshot) {
+        free(snapshot->data);
+        snapshot_init(snapshot);
+}
+
+
+/// Taking ///
+
+// Make room for size bytes at the end, aligned, and return their offset
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static size_t reserve(struct snapshot *const snapshot, const size_t size) {
+        const size_t offset = (snapshot->size + SNAPSHOT_ALIGNMENT - 1) &
+                ~(size_t)(SNAPSHOT_ALIGNMENT - 1);
+        if (offset + size > snapshot->capacity) {
+                size_t capacity = snapshot->capacity > 0 ?
+                        snapshot->capacity : SNAPSHOT_INITIAL_CAPACITY;
+                while (capacity < offset + size) {
+                        capacity *= 2;
+                }
+                snapshot->data = srealloc(snapshot->data, capacity);
+                snapshot->capacity = capacity;
+        }
+        memset(snapshot->data + snapshot->size, 0,
+               offset + size - snapshot->size);
+        snapshot->size = offset + size;
+        return offset;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2, 3)))
+__attribute__((nonnull))
+static void writeRecord(struct snapshot *const snapshot,
+                        const void *const record, const size_t size) {
+        memcpy(snapshot->data + reserve(snapshot, size), record, size);
+}
+
+// Pointers into the snapshot are invalidated by every write, so always go
+// through these with an offset
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static size_t beginSection(struct snapshot *const snapshot,
+                           const enum snapshotSectionType type,
+                           const uint32_t version) {
+        const size_t offset = reserve(snapshot,
+                                      sizeof(struct snapshotSection));
+        struct snapshotSection *const section =
+                (void*)(snapshot->data + offset);
+        section->type = type;
+        section->version = version;
+        return offset;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void endSection(struct snapshot *const snapshot, const size_t offset,
+                       const size_t count) {
+        reserve(snapshot, 0);
+        struct snapshotSection *const section =
+                (void*)(snapshot->data + offset);
+        section->count = count;
+        section->size = snapshot->size - offset - sizeof(*section);
+        struct snapshotHeader *const header = (void*)snapshot->data;
+        header->nsections++;
+}
+
+// Make sure the snapshot is one that can be restored into the scene, and
+// return its header
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static const struct snapshotHeader *checkHeader(
+        const struct snapshot *const snapshot,
+        const struct scene *const scene) {
+        if (snapshot->size < sizeof(struct snapshotHeader)) {
+                bail("Malformatted snapshot\n");
+        }
+        const struct snapshotHeader *const header =
+                (const void*)snapshot->data;
+        if (memcmp(header->magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) != 0) {
+                bail("Malformatted snapshot\n");
+        }
+        if (header->version != SNAPSHOT_VERSION) {
+                bail("Snapshot taken by an incompatible build\n");
+        }
+        if (header->generation != scene->compaction.generation ||
+            header->ncomponents > scene->components.offsets.length) {
+                bail("Snapshot taken before the scene's components were "
+                     "compacted\n");
+        }
+        return header;
+}
+
+// Return the section of the given type, or NULL if there's none. Records of
+// fixed size are checked to fill the section exactly.
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static const struct snapshotSection *findSection(
+        const struct snapshot *const snapshot,
+        const enum snapshotSectionType type, const uint32_t version,
+        const size_t recordSize) {
+        const struct snapshotHeader *const header =
+                (const void*)snapshot->data;
+        size_t offset = sizeof(*header);
+        for (uint64_t i=0; i<header->nsections; i++) {
+                if (offset > snapshot->size ||
+                    snapshot->size - offset < sizeof(struct snapshotSection)) {
+                        bail("Malformatted snapshot\n");
+                }
+                const struct snapshotSection *const section =
+                        (const void*)(snapshot->data + offset);
+                offset += sizeof(*section);
+                if (section->size > snapshot->size - offset) {
+                        bail("Malformatted snapshot\n");
+                }
+
+                if (section->type == (uint32_t)type) {
+                        if (section->version != version) {
+                                bail("Snapshot section %u has version %u, "
+                                     "expected %u\n", type, section->version,
+                                     version);
+                        }
+                        if (recordSize != 0 &&
+                            (!is_safe_multiply(section->count, recordSize) ||
+                             section->count * recordSize != section->size)) {
+                                bail("Malformatted snapshot\n");
+                        }
+                        return section;
+                }
+                offset += section->size;
+        }
+        return NULL;
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static inline const void *sectionRecords(
+        const struct snapshotSection *const section) {
+        return section + 1;
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((access (write_only, 3)))
+__attribute__((nonnull))
+static void objectRecord(const struct scene *const scene, const size_t idx,
+                         struct snapshotObject *const record) {
+        memset(record, 0, sizeof(*record));
+        record->idx = idx;
+
+        // Removed objects are the ones without a name
+        const struct objectInfo *const info = scene->objectInfo.data;
+        if (idx >= scene->objectInfo.length || info[idx].name == NULL) {
+                return;
+        }
+        const struct object *const object = scene_getObjectFromIdxConst(
+                scene, idx);
+        record->flags = SNAPSHOT_PRESENT;
+        if (object->threadSafe) {
+                record->flags |= SNAPSHOT_THREADSAFE;
+        }
+        record->parent = object->parent;
+        record->firstChild = object->firstChild;
+        record->nextSibling = object->nextSibling;
+        record->prevSibling = object->prevSibling;
+        record->components = object->components;
+        record->onUpdate = object->onUpdate;
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((access (read_only, 3)))
+__attribute__((nonnull (1, 2)))
+static void takeObjects(const struct scene *const scene,
+                        struct snapshot *const snapshot,
+                        const struct snapshot *const since) {
+        // Full snapshots have every slot, in order
+        const struct snapshotObject *base = NULL;
+        size_t nbase = 0;
+        if (since != NULL) {
+                const struct snapshotSection *const section = findSection(
+                        since, SNAPSHOT_OBJECTS, SNAPSHOT_OBJECTS_VERSION,
+                        sizeof(struct snapshotObject));
+                if (section != NULL) {
+                        base = sectionRecords(section);
+                        nbase = section->count;
+                }
+        }
+
+        const size_t nobjects = scene->objects.fragLength + 1;
+        const size_t offset = beginSection(snapshot, SNAPSHOT_OBJECTS,
+                                           SNAPSHOT_OBJECTS_VERSION);
+        size_t count = 0;
+        for (size_t idx=0; idx<nobjects; idx++) {
+                struct snapshotObject record;
+                objectRecord(scene, idx, &record);
+                if (idx < nbase &&
+                    memcmp(&record, &base[idx], sizeof(record)) == 0) {
+                        continue;
+                }
+                writeRecord(snapshot, &record, sizeof(record));
+                count++;
+        }
+        endSection(snapshot, offset, count);
+}
+
+// Go through the records of a names section, return the next one's offset
+__attribute__((access (read_only, 1)))
+__attribute__((access (write_only, 3)))
+__attribute__((nonnull))
+static size_t nextName(const struct snapshotSection *const section,
+                       const size_t offset, const char **const name) {
+        const char *const data = sectionRecords(section);
+        if (section->size - offset < sizeof(struct snapshotName)) {
+                bail("Malformatted snapshot\n");
+        }
+        const struct snapshotName *const record = (const void*)(data + offset);
+        const size_t start = offset + sizeof(*record);
+        if (record->length >= section->size - start ||
+            data[start + record->length] != '\0') {
+                bail("Malformatted snapshot\n");
+        }
+        *name = data + start;
+        return (start + record->length + 1 + SNAPSHOT_ALIGNMENT - 1) &
+                ~(size_t)(SNAPSHOT_ALIGNMENT - 1);
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((access (read_only, 3)))
+__attribute__((nonnull (1, 2)))
+static void takeNames(const struct scene *const scene,
+                      struct snapshot *const snapshot,
+                      const struct snapshot *const since) {
+        const struct snapshotSection *base = NULL;
+        if (since != NULL) {
+                base = findSection(since, SNAPSHOT_NAMES,
+                                   SNAPSHOT_NAMES_VERSION, 0);
+        }
+        size_t baseNext = 0;  // both go by idx
+        size_t baseOffset = 0;
+        size_t baseIdx = SIZE_MAX;
+        const char *baseName = NULL;
+
+        const struct objectInfo *const infos = scene->objectInfo.data;
+        const size_t offset = beginSection(snapshot, SNAPSHOT_NAMES,
+                                           SNAPSHOT_NAMES_VERSION);
+        size_t count = 0;
+        for (size_t idx=0; idx<scene->objectInfo.length; idx++) {
+                if (infos[idx].name == NULL) {
+                        continue;
+                }
+                while (base != NULL && baseNext < base->count &&
+                       (baseIdx == SIZE_MAX || baseIdx < idx)) {
+                        const struct snapshotName *const record =
+                                (const void*)((const char*)sectionRecords(
+                                                      base) + baseOffset);
+                        baseOffset = nextName(base, baseOffset, &baseName);
+                        baseIdx = record->idx;
+                        baseNext++;
+                }
+                if (baseIdx == idx && strcmp(baseName, infos[idx].name) == 0) {
+                        continue;
+                }
+
+                const struct snapshotName record = {
+                        .idx = idx,
+                        .length = strlen(infos[idx].name),
+                };
+                writeRecord(snapshot, &record, sizeof(record));
+                writeRecord(snapshot, infos[idx].name, record.length + 1);
+                count++;
+        }
+        endSection(snapshot, offset, count);
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((access (read_only, 3)))
+__attribute__((nonnull (1, 2)))
+static void takeTransforms(const struct scene *const scene,
+                           struct snapshot *const snapshot,
+                           const struct snapshot *const since) {
+        const struct snapshotTransform *base = NULL;
+        size_t nbase = 0;
+        if (since != NULL) {
+                const struct snapshotSection *const section = findSection(
+                        since, SNAPSHOT_TRANSFORMS,
+                        SNAPSHOT_TRANSFORMS_VERSION,
+                        sizeof(struct snapshotTransform));
+                if (section != NULL) {
+                        base = sectionRecords(section);
+                        nbase = section->count;
+                }
+        }
+        size_t next = 0;  // both go by component idx
+
+        const size_t offset = beginSection(snapshot, SNAPSHOT_TRANSFORMS,
+                                           SNAPSHOT_TRANSFORMS_VERSION);
+        size_t count = 0;
+        for (size_t i=0; i<scene->components.offsets.length; i++) {
+                const struct transform *const trans = varSizeGrowingArray_at(
+                        &scene->components, i);
+                if (trans->base.type != COMPONENT_TRANSFORM) {
+                        continue;
+                }
+
+                struct snapshotTransform record;
+                record.component = i;
+                memcpy(record.position, trans->position.raw,
+                       sizeof(record.position));
+                memcpy(record.rotation, trans->rotation.raw,
+                       sizeof(record.rotation));
+                memcpy(record.scale, trans->scale.raw, sizeof(record.scale));
+
+                while (next < nbase && base[next].component < i) {
+                        next++;
+                }
+                if (next < nbase &&
+                    memcmp(&record, &base[next], sizeof(record)) == 0) {
+                        continue;
+                }
+                writeRecord(snapshot, &record, sizeof(record));
+                count++;
+        }
+        endSection(snapshot, offset, count);
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((access (read_only, 3)))
+__attribute__((nonnull (1, 2)))
+static void takeAnimations(const struct scene *const scene,
+                           struct snapshot *const snapshot,
+                           const struct snapshot *const since) {
+        const struct snapshotAnimation *base = NULL;
+        size_t nbase = 0;
+        if (since != NULL) {
+                const struct snapshotSection *const section = findSection(
+                        since, SNAPSHOT_ANIMATIONS,
+                        SNAPSHOT_ANIMATIONS_VERSION,
+                        sizeof(struct snapshotAnimation));
+                if (section != NULL) {
+                        base = sectionRecords(section);
+                        nbase = section->count;
+                }
+        }
+        size_t next = 0;  // both go by component idx
+
+        const size_t offset = beginSection(snapshot, SNAPSHOT_ANIMATIONS,
+                                           SNAPSHOT_ANIMATIONS_VERSION);
+        size_t count = 0;
+        for (size_t i=0; i<scene->components.offsets.length; i++) {
+                const struct animationCollection *const col =
+                        varSizeGrowingArray_at(&scene->components, i);
+                if (col->base.type != COMPONENT_ANIMATIONCOLLECTION) {
+                        continue;
+                }
+
+                const struct snapshotAnimation record = {
+                        .component = i,
+                        .current = col->current,
+                        .time = col->time,
+                        .running = col->running,
+                };
+                while (next < nbase && base[next].component < i) {
+                        next++;
+                }
+                if (next < nbase &&
+                    memcmp(&record, &base[next], sizeof(record)) == 0) {
+                        continue;
+                }
+                writeRecord(snapshot, &record, sizeof(record));
+                count++;
+        }
+        endSection(snapshot, offset, count);
+}
+
+// Unique enough to tell snapshots apart
+static uint64_t newId(void) {
+        static uint64_t last = 0;
+        uint64_t id = time_micros();
+        if (id <= last) {
+                id = last + 1;
+        }
+        last = id;
+        return id;
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static void checkScene(const struct scene *const scene) {
+        if (!scene->loaded) {
+                bail("Only fully loaded scenes have snapshots\n");
+        }
+        if (scene->streaming.cells.length > 0) {
+                bail("Scenes streamed in cells don't have snapshots\n");
+        }
+        if (compaction_movingComponents(&scene->compaction)) {
+                bail("Scenes don't have snapshots while their components "
+                     "are being compacted\n");
+        }
+}
+
+void snapshot_take(const struct scene *const scene,
+                   struct snapshot *const snapshot,
+                   const struct snapshot *const since) {
+        checkScene(scene);
+        const struct snapshotHeader *base = NULL;
+        if (since != NULL) {
+                base = checkHeader(since, scene);
+                if (base->delta) {
+                        bail("Deltas can only be taken against full "
+                             "snapshots\n");
+                }
+        }
+
+        struct snapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version = SNAPSHOT_VERSION;
+        header.delta = base != NULL;
+        header.id = newId();
+        header.base = base != NULL ? base->id : 0;
+        header.nobjects = scene->objects.fragLength + 1;
+        header.ncomponents = scene->components.offsets.length;
+        header.generation = scene->compaction.generation;
+        header.nsections = 0;
+
+        snapshot->size = 0;
+        writeRecord(snapshot, &header, sizeof(header));
+        takeObjects(scene, snapshot, since);
+        takeNames(scene, snapshot, since);
+        takeTransforms(scene, snapshot, since);
+        takeAnimations(scene, snapshot, since);
+}
+
+
+/// Restoring ///
+
+// Gather the objects and names of a snapshot, by idx, later ones replace
+// earlier ones
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_write, 2, 4)))
+__attribute__((access (read_write, 3, 4)))
+__attribute__((nonnull))
+static void readObjects(const struct snapshot *const snapshot,
+                        struct snapshotObject *const objects,
+                        const char **const names, const size_t nobjects) {
+        const struct snapshotSection *section = findSection(
+                snapshot, SNAPSHOT_OBJECTS, SNAPSHOT_OBJECTS_VERSION,
+                sizeof(struct snapshotObject));
+        if (section != NULL) {
+                const struct snapshotObject *const records =
+                        sectionRecords(section);
+                for (size_t i=0; i<section->count; i++) {
+                        if (records[i].idx < nobjects) {
+                                objects[records[i].idx] = records[i];
+                        }
+                }
+        }
+
+        section = findSection(snapshot, SNAPSHOT_NAMES,
+                              SNAPSHOT_NAMES_VERSION, 0);
+        if (section != NULL) {
+                size_t offset = 0;
+                for (size_t i=0; i<section->count; i++) {
+                        const struct snapshotName *const record =
+                                (const void*)((const char*)sectionRecords(
+                                                      section) + offset);
+                        const char *name;
+                        offset = nextName(section, offset, &name);
+                        if (record->idx < nobjects) {
+                                names[record->idx] = name;
+                        }
+                }
+        }
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void readComponents(struct scene *const scene,
+                           const struct snapshot *const snapshot) {
+        const struct snapshotSection *section = findSection(
+                snapshot, SNAPSHOT_TRANSFORMS, SNAPSHOT_TRANSFORMS_VERSION,
+                sizeof(struct snapshotTransform));
+        if (section != NULL) {
+                const struct snapshotTransform *const records =
+                        sectionRecords(section);
+                for (size_t i=0; i<section->count; i++) {
+                        if (records[i].component >=
+                            scene->components.offsets.length) {
+                                bail("Malformatted snapshot\n");
+                        }
+                        struct transform *const trans =
+                                varSizeGrowingArray_at(&scene->components,
+                                                       records[i].component);
+                        if (trans->base.type != COMPONENT_TRANSFORM) {
+                                bail("Malformatted snapshot\n");
+                        }
+                        memcpy(trans->position.raw, records[i].position,
+                               sizeof(records[i].position));
+                        memcpy(trans->rotation.raw, records[i].rotation,
+                               sizeof(records[i].rotation));
+                        memcpy(trans->scale.raw, records[i].scale,
+                               sizeof(records[i].scale));
+                        trans->dirty = true;
+                }
+                scene_queueTransform(scene, 0);
+        }
+
+        section = findSection(snapshot, SNAPSHOT_ANIMATIONS,
+                              SNAPSHOT_ANIMATIONS_VERSION,
+                              sizeof(struct snapshotAnimation));
+        if (section != NULL) {
+                const struct snapshotAnimation *const records =
+                        sectionRecords(section);
+                for (size_t i=0; i<section->count; i++) {
+                        if (records[i].component >=
+                            scene->components.offsets.length) {
+                                bail("Malformatted snapshot\n");
+                        }
+                        struct animationCollection *const col =
+                                varSizeGrowingArray_at(&scene->components,
+                                                       records[i].component);
+                        if (col->base.type != COMPONENT_ANIMATIONCOLLECTION ||
+                            (records[i].current >= col->nanimations &&
+                             col->nanimations > 0)) {
+                                bail("Malformatted snapshot\n");
+                        }
+                        col->current = records[i].current;
+                        col->time = records[i].time;
+                        col->running = records[i].running != 0;
+                }
+        }
+}
+
+// Give the object the name it had, keeping the current one if it's the same
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull (1)))
+static void restoreName(struct scene *const scene, const size_t idx,
+                        const char *const name) {
+        while (scene->objectInfo.length <= idx) {
+                struct objectInfo *const info = growingArray_append(
+                        &scene->objectInfo);
+                info->name = NULL;
+                info->borrowed = false;
+        }
+        struct objectInfo *const info = growingArray_get(&scene->objectInfo,
+                                                         idx);
+        if (info->name != NULL && name != NULL &&
+            strcmp(info->name, name) == 0) {
+                return;
+        }
+        if (!info->borrowed) {
+                free(info->name);
+        }
+        info->name = name != NULL ? sstrdup(name) : NULL;
+        info->borrowed = false;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (write_only, 2)))
+__attribute__((access (read_only, 3)))
+__attribute__((nonnull))
+static void restoreObject(struct scene *const scene,
+                          struct object *const object,
+                          const struct snapshotObject *const record) {
+        object->idx = record->idx;
+        object->parent = record->parent;
+        object->firstChild = record->firstChild;
+        object->nextSibling = record->nextSibling;
+        object->prevSibling = record->prevSibling;
+        object->components = record->components;
+        object->componentsMemory = &scene->components;
+        object->onUpdate = record->onUpdate;
+        object->threadSafe = (record->flags & SNAPSHOT_THREADSAFE) != 0;
+        if ((record->flags & SNAPSHOT_PRESENT) == 0) {
+                return;
+        }
+
+        // Shared components end up with the last object using them
+        const size_t slots[] = {
+                object->components.transform,
+                object->components.camera,
+                object->components.geometry,
+                object->components.material,
+                object->components.light,
+                object->components.animationCollection,
+        };
+        for (size_t i=0; i<sizeof(slots)/sizeof(*slots); i++) {
+                if (slots[i] == 0) {
+                        continue;
+                }
+                if (slots[i] > scene->components.offsets.length) {
+                        bail("Malformatted snapshot\n");
+                }
+                struct component *const component = varSizeGrowingArray_at(
+                        &scene->components, slots[i] - 1);
+                component->object = object->idx;
+        }
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2, 4)))
+__attribute__((access (read_only, 3, 4)))
+__attribute__((nonnull))
+static void rebuildObjects(struct scene *const scene,
+                           const struct snapshotObject *const objects,
+                           const char *const *const names,
+                           const size_t nobjects) {
+        if ((objects[0].flags & SNAPSHOT_PRESENT) == 0) {
+                bail("Malformatted snapshot\n");
+        }
+
+        for (size_t idx=0; idx<nobjects; idx++) {
+                const bool present = (objects[idx].flags &
+                                      SNAPSHOT_PRESENT) != 0;
+                if (present && names[idx] == NULL) {
+                        bail("Malformatted snapshot\n");
+                }
+                restoreName(scene, idx, present ? names[idx] : NULL);
+        }
+        while (scene->objectInfo.length > nobjects) {
+                struct objectInfo *const info = growingArray_get(
+                        &scene->objectInfo, scene->objectInfo.length - 1);
+                if (!info->borrowed) {
+                        free(info->name);
+                }
+                growingArray_pop(&scene->objectInfo);
+        }
+
+        restoreObject(scene, &scene->root, &objects[0]);
+        growingArray_clear(&scene->objects);
+        growingArray_reserve(&scene->objects, nobjects - 1);
+        for (size_t idx=1; idx<nobjects; idx++) {
+                restoreObject(scene, growingArray_append(&scene->objects),
+                              &objects[idx]);
+        }
+        // Removed ones leave their holes, trailing ones are just dropped
+        for (size_t idx=nobjects-1; idx>0; idx--) {
+                if ((objects[idx].flags & SNAPSHOT_PRESENT) == 0) {
+                        growingArray_remove(&scene->objects, idx-1);
+                }
+        }
+
+        hierarchy_invalidate(&scene->hierarchy);
+        activeSet_invalidate(&scene->active);
+        bvh_invalidate(&scene->bvh);
+        renderQueue_invalidate(&scene->renderQueue);
+        compaction_restart(&scene->compaction);
+}
+
+void snapshot_restore(struct scene *const scene,
+                      const struct snapshot *const snapshot,
+                      const struct snapshot *const delta) {
+        checkScene(scene);
+        const struct snapshotHeader *const header = checkHeader(snapshot,
+                                                                scene);
+        if (header->delta) {
+                bail("Deltas are restored along with the full snapshot they "
+                     "were taken against\n");
+        }
+        const struct snapshotHeader *last = header;
+        if (delta != NULL) {
+                last = checkHeader(delta, scene);
+                if (!last->delta || last->base != header->id) {
+                        bail("Delta not taken against the given snapshot\n");
+                }
+        }
+
+        const size_t nobjects = last->nobjects;
+        if (nobjects == 0) {
+                bail("Malformatted snapshot\n");
+        }
+        struct snapshotObject *const objects = smallocarray(
+                nobjects, sizeof(*objects));
+        const char **const names = smallocarray(nobjects, sizeof(*names));
+        memset(objects, 0, nobjects * sizeof(*objects));
+        for (size_t i=0; i<nobjects; i++) {
+                names[i] = NULL;
+        }
+
+        readObjects(snapshot, objects, names, nobjects);
+        readComponents(scene, snapshot);
+        if (delta != NULL) {
+                readObjects(delta, objects, names, nobjects);
+                readComponents(scene, delta);
+        }
+        rebuildObjects(scene, objects, names, nobjects);
+
+        free(names);
+        free(objects);
+}
@@ -0,0 +1,504 @@
+#include <thirty/streaming.h>
+#include <thirty/scene.h>
+#include <thirty/asyncLoader.h>
+#include <thirty/util.h>
+
+#define STREAMING_INITIAL_CELLS 16
+#define STREAMING_INITIAL_GEOMETRIES 64
+
+// A geometry used by at least one cell
+struct streamingGeometry {
+        size_t component;
+        size_t size;
+        size_t refs;  // loaded or loading cells using it
+        size_t lastCell;  // last cell it was gathered for, plus one
+};
+
+void streaming_init(struct streaming *const streaming) {
+        growingArray_init(&streaming->cells, sizeof(struct cell),
+                          STREAMING_INITIAL_CELLS);
+        growingArray_init(&streaming->geometries,
+                          sizeof(struct streamingGeometry),
+                          STREAMING_INITIAL_GEOMETRIES);
+        growingArray_init(&streaming->cellGeometries, sizeof(size_t),
+                          STREAMING_INITIAL_GEOMETRIES);
+        growingArray_init(&streaming->candidates, sizeof(size_t),
+                          STREAMING_INITIAL_CELLS);
+
+        streaming->loadRadius = STREAMING_DEFAULT_LOAD_RADIUS;
+        streaming->unloadRadius = STREAMING_DEFAULT_UNLOAD_RADIUS;
+        streaming->memoryBudget = STREAMING_DEFAULT_MEMORY_BUDGET;
+        streaming->residentSize = 0;
+        streaming->camera = 0;
+        streaming->reading = false;
+}
+
+void streaming_configure(struct streaming *const streaming,
+                         const float loadRadius, const float unloadRadius,
+                         const size_t memoryBudget) {
+        assert(loadRadius <= unloadRadius);
+        streaming->loadRadius = loadRadius;
+        streaming->unloadRadius = unloadRadius;
+        streaming->memoryBudget = memoryBudget;
+}
+
+void streaming_addCell(struct streaming *const streaming,
+                       const vec3s min, const vec3s max,
+                       const size_t firstObject, const size_t nobjects) {
+        struct cell *const cell = growingArray_append(&streaming->cells);
+        cell->min = min;
+        cell->max = max;
+        cell->firstObject = firstObject;
+        cell->nobjects = nobjects;
+        cell->firstGeometry = 0;
+        cell->ngeometries = 0;
+        cell->size = 0;
+        cell->state = CELL_UNLOADED;
+        cell->distance = 0;
+}
+
+// Only geometries with a file behind them can be loaded again
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static const struct geometry *streamableGeometry(
+        const struct object *const object) {
+        const struct geometry *const geo = object_getGeometry(object);
+        if (geo == NULL || geo->path == NULL) {
+                return NULL;
+        }
+        return geo;
+}
+
+void streaming_prepare(struct scene *const scene) {
+        struct streaming *const streaming = &scene->streaming;
+        if (streaming->cells.length == 0) {
+                return;
+        }
+
+        // Which components are used by cells, as their position in the
+        // geometries list plus one. Built in component order so that the
+        // list ends up sorted.
+        const size_t ncomponents = scene->components.offsets.length;
+        size_t *const slots = smallocarray(ncomponents, sizeof(size_t));
+        memset(slots, 0, ncomponents * sizeof(size_t));
+
+        growingArray_foreach_START(&streaming->cells, struct cell *, cell)
+                for (size_t i=0; i<cell->nobjects; i++) {
+                        const struct object *const object =
+                                scene_getObjectFromIdxConst(
+                                        scene, cell->firstObject + i);
+                        const struct geometry *const geo =
+                                streamableGeometry(object);
+                        if (geo != NULL) {
+                                slots[geo->base.idx] = 1;
+                        }
+                }
+        growingArray_foreach_END;
+
+        for (size_t i=0; i<ncomponents; i++) {
+                if (slots[i] == 0) {
+                        continue;
+                }
+                const struct geometry *const geo =
+                        componentCollection_compByIdx(&scene->components, i);
+                struct streamingGeometry *const sg =
+                        growingArray_append(&streaming->geometries);
+                sg->component = i;
+                sg->size = sfilesize(geo->path);
+                sg->refs = 0;
+                sg->lastCell = 0;
+                slots[i] = streaming->geometries.length;
+        }
+
+        // Each cell's geometries, without repeating those used by many of
+        // its objects
+        for (size_t c=0; c<streaming->cells.length; c++) {
+                struct cell *const cell = growingArray_get(
+                        &streaming->cells, c);
+                cell->firstGeometry = streaming->cellGeometries.length;
+
+                for (size_t i=0; i<cell->nobjects; i++) {
+                        const struct object *const object =
+                                scene_getObjectFromIdxConst(
+                                        scene, cell->firstObject + i);
+                        const struct geometry *const geo =
+                                streamableGeometry(object);
+                        if (geo == NULL) {
+                                continue;
+                        }
+
+                        const size_t n = slots[geo->base.idx] - 1;
+                        struct streamingGeometry *const sg =
+                                growingArray_get(&streaming->geometries, n);
+                        if (sg->lastCell == c + 1) {
+                                continue;
+                        }
+                        sg->lastCell = c + 1;
+
+                        size_t *const idx = growingArray_append(
+                                &streaming->cellGeometries);
+                        *idx = n;
+                        cell->size += sg->size;
+                }
+
+                cell->ngeometries = streaming->cellGeometries.length -
+                        cell->firstGeometry;
+        }
+
+        free(slots);
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static struct streamingGeometry *findGeometry(
+        const struct streaming *const streaming, const size_t component) {
+        // The list is sorted by component
+        size_t lo = 0;
+        size_t hi = streaming->geometries.length;
+        while (lo < hi) {
+                const size_t mid = lo + (hi - lo) / 2;
+                struct streamingGeometry *const sg = growingArray_get(
+                        &streaming->geometries, mid);
+                if (sg->component == component) {
+                        return sg;
+                }
+                if (sg->component < component) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        return NULL;
+}
+
+bool streaming_isStreamed(const struct streaming *const streaming,
+                          const size_t component) {
+        return findGeometry(streaming, component) != NULL;
+}
+
+void streaming_moveObject(struct streaming *const streaming,
+                          const size_t from, const size_t to) {
+        assert(to < from);
+        if (streaming->camera == from) {
+                streaming->camera = to;
+        }
+
+        growingArray_foreach_START(&streaming->cells, struct cell *, cell)
+                const size_t end = cell->firstObject + cell->nobjects;
+                if (cell->firstObject <= from && from < end) {
+                        // Take in the free idxs before it
+                        if (cell->firstObject > to) {
+                                cell->firstObject = to;
+                                cell->nobjects = end - to;
+                        }
+                } else if (cell->firstObject < from && end > to) {
+                        // An earlier cell, whose objects were all moved
+                        // before 'to' already, only free idxs are left
+                        if (cell->firstObject >= to) {
+                                cell->firstObject = to;
+                                cell->nobjects = 0;
+                        } else {
+                                cell->nobjects = to - cell->firstObject;
+                        }
+                }
+        growingArray_foreach_END;
+}
+
+void streaming_trimCells(struct streaming *const streaming,
+                         const size_t nobjects) {
+        // Idx 0 is root
+        const size_t last = nobjects + 1;
+        growingArray_foreach_START(&streaming->cells, struct cell *, cell)
+                if (cell->firstObject > last) {
+                        cell->firstObject = last;
+                }
+                if (cell->firstObject + cell->nobjects > last) {
+                        cell->nobjects = last - cell->firstObject;
+                }
+        growingArray_foreach_END;
+}
+
+void streaming_moveComponent(struct streaming *const streaming,
+                             const size_t from, const size_t to) {
+        assert(!streaming->reading);
+        struct streamingGeometry *const sg = findGeometry(streaming, from);
+        if (sg != NULL) {
+                sg->component = to;
+        }
+}
+
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static float distanceToCell(const struct cell *const cell,
+                            const vec3s position) {
+        const vec3s below = glms_vec3_sub(cell->min, position);
+        const vec3s above = glms_vec3_sub(position, cell->max);
+        const vec3s outside = glms_vec3_maxv(glms_vec3_maxv(below, above),
+                                             GLMS_VEC3_ZERO);
+        return glms_vec3_norm(outside);
+}
+
+// Find the main camera, return whether there is one
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static bool findCamera(struct scene *const scene) {
+        struct streaming *const streaming = &scene->streaming;
+        if (streaming->camera != 0) {
+                return true;
+        }
+
+        growingArray_foreach_START(&scene->objects, struct object *, object)
+                const struct camera *const camera = object_getCamera(object);
+                if (camera != NULL && camera->main) {
+                        streaming->camera = object->idx;
+                        return true;
+                }
+        growingArray_foreach_END;
+
+        return false;
+}
+
+// Bytes that loading the cell would add, geometries already in use by other
+// cells are free
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static size_t cellCost(const struct streaming *const streaming,
+                       const struct cell *const cell) {
+        size_t cost = 0;
+        for (size_t i=0; i<cell->ngeometries; i++) {
+                const size_t *const n = growingArray_get(
+                        &streaming->cellGeometries, cell->firstGeometry + i);
+                const struct streamingGeometry *const sg = growingArray_get(
+                        &streaming->geometries, *n);
+                if (sg->refs == 0) {
+                        cost += sg->size;
+                }
+        }
+        return cost;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((nonnull))
+static void loadCell(struct scene *const scene, struct cell *const cell,
+                     const bool manageLoader) {
+        struct streaming *const streaming = &scene->streaming;
+        for (size_t i=0; i<cell->ngeometries; i++) {
+                const size_t *const n = growingArray_get(
+                        &streaming->cellGeometries, cell->firstGeometry + i);
+                struct streamingGeometry *const sg = growingArray_get(
+                        &streaming->geometries, *n);
+                if (sg->refs++ > 0) {
+                        continue;
+                }
+
+                if (manageLoader && !streaming->reading) {
+                        asyncLoader_init();
+                        streaming->reading = true;
+                }
+                geometry_loadFile(componentCollection_compByIdx(
+                                          &scene->components, sg->component),
+                                  &scene->components);
+                streaming->residentSize += sg->size;
+        }
+        cell->state = CELL_LOADING;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_write, 2)))
+__attribute__((nonnull))
+static void unloadCell(struct scene *const scene, struct cell *const cell) {
+        struct streaming *const streaming = &scene->streaming;
+        // Loading cells can't be unloaded, their reads are in flight
+        assert(cell->state == CELL_LOADED);
+
+        for (size_t i=0; i<cell->ngeometries; i++) {
+                const size_t *const n = growingArray_get(
+                        &streaming->cellGeometries, cell->firstGeometry + i);
+                struct streamingGeometry *const sg = growingArray_get(
+                        &streaming->geometries, *n);
+                assert(sg->refs > 0);
+                if (--sg->refs > 0) {
+                        continue;
+                }
+
+                geometry_unload(componentCollection_compByIdx(
+                                        &scene->components, sg->component));
+                assert(streaming->residentSize >= sg->size);
+                streaming->residentSize -= sg->size;
+        }
+        cell->state = CELL_UNLOADED;
+}
+
+// Unload the farthest loaded cell that's outside of the load radius. Return
+// false if there's none.
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static bool evictCell(struct scene *const scene) {
+        struct streaming *const streaming = &scene->streaming;
+        struct cell *farthest = NULL;
+        growingArray_foreach_START(&streaming->cells, struct cell *, cell)
+                if (cell->state == CELL_LOADED &&
+                    cell->distance > streaming->loadRadius &&
+                    (farthest == NULL ||
+                     cell->distance > farthest->distance)) {
+                        farthest = cell;
+                }
+        growingArray_foreach_END;
+
+        if (farthest == NULL) {
+                return false;
+        }
+        unloadCell(scene, farthest);
+        return true;
+}
+
+static int cmpCandidates(const void *const item1, const void *const item2,
+                         void *const args) {
+        const struct growingArray *const cells = args;
+        const struct cell *const cell1 = growingArray_get(
+                cells, *(const size_t*)item1);
+        const struct cell *const cell2 = growingArray_get(
+                cells, *(const size_t*)item2);
+
+        if (cell1->distance < cell2->distance) {
+                return -1;
+        }
+        if (cell1->distance > cell2->distance) {
+                return 1;
+        }
+        return 0;
+}
+
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void selectCells(struct scene *const scene, const bool manageLoader) {
+        struct streaming *const streaming = &scene->streaming;
+        if (streaming->cells.length == 0 || !findCamera(scene)) {
+                return;
+        }
+
+        const struct object *const camera = scene_getObjectFromIdx(
+                scene, streaming->camera);
+        const vec3s position = glms_vec3(
+                scene_getObjectAbsoluteTransform(scene, camera).col[3]);
+
+        // Drop what's too far away, gather what's close enough
+        growingArray_clear(&streaming->candidates);
+        for (size_t i=0; i<streaming->cells.length; i++) {
+                struct cell *const cell = growingArray_get(
+                        &streaming->cells, i);
+                cell->distance = distanceToCell(cell, position);
+
+                if (cell->state == CELL_LOADED &&
+                    cell->distance > streaming->unloadRadius) {
+                        unloadCell(scene, cell);
+                } else if (cell->state == CELL_UNLOADED &&
+                           cell->distance <= streaming->loadRadius) {
+                        size_t *const idx = growingArray_append(
+                                &streaming->candidates);
+                        *idx = i;
+                }
+        }
+
+        // Closest first, making room within the budget if needed
+        growingArray_sort(&streaming->candidates, cmpCandidates,
+                          &streaming->cells);
+        growingArray_foreach_START(&streaming->candidates, size_t *, idx)
+                struct cell *const cell = growingArray_get(
+                        &streaming->cells, *idx);
+
+                bool fits = true;
+                while (streaming->residentSize + cellCost(streaming, cell) >
+                       streaming->memoryBudget) {
+                        if (!evictCell(scene)) {
+                                fits = false;
+                                break;
+                        }
+                }
+                if (fits) {
+                        loadCell(scene, cell, manageLoader);
+                }
+        growingArray_foreach_END;
+}
+
+// A cell's objects are points in the scene's BVH until their geometries are
+// first loaded, give them their actual bounds
+__attribute__((access (read_write, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void refreshBounds(struct scene *const scene,
+                          const struct cell *const cell) {
+        for (size_t i=0; i<cell->nobjects; i++) {
+                const size_t idx = cell->firstObject + i;
+                // Removed objects aren't in it
+                if (bvh_contains(&scene->bvh, idx)) {
+                        bvh_refresh(&scene->bvh, scene_getObjectFromIdxConst(
+                                            scene, idx));
+                }
+        }
+}
+
+void streaming_request(struct scene *const scene) {
+        selectCells(scene, false);
+}
+
+void streaming_update(struct scene *const scene, const unsigned long micros) {
+        struct streaming *const streaming = &scene->streaming;
+        if (streaming->cells.length == 0) {
+                return;
+        }
+
+        const uint64_t deadline = time_micros() + micros;
+        selectCells(scene, true);
+
+        // Upload finished reads while there's time left
+        while (streaming->reading) {
+                size_t size;
+                if (!asyncLoader_await(&size)) {
+                        asyncLoader_destroy();
+                        streaming->reading = false;
+                } else if (size == 0 || time_micros() >= deadline) {
+                        break;
+                }
+        }
+
+        growingArray_foreach_START(&streaming->cells, struct cell *, cell)
+                if (cell->state != CELL_LOADING) {
+                        continue;
+                }
+
+                bool loaded = true;
+                for (size_t i=0; i<cell->ngeometries && loaded; i++) {
+                        const size_t *const n = growingArray_get(
+                                &streaming->cellGeometries,
+                                cell->firstGeometry + i);
+                        const struct streamingGeometry *const sg =
+                                growingArray_get(&streaming->geometries, *n);
+                        const struct geometry *const geo =
+                                componentCollection_compByIdx(
+                                        &scene->components, sg->component);
+                        loaded = geo->loaded;
+                }
+                if (loaded) {
+                        cell->state = CELL_LOADED;
+                        refreshBounds(scene, cell);
+                }
+        growingArray_foreach_END;
+}
+
+void streaming_free(struct streaming *const streaming) {
+        if (streaming->reading) {
+                // The reads' callbacks upload into the scene's geometries, let
+                // them finish before those go away.
+                asyncLoader_finish();
+                asyncLoader_destroy();
+                streaming->reading = false;
+        }
+
+        growingArray_destroy(&streaming->cells);
+        growingArray_destroy(&streaming->geometries);
+        growingArray_destroy(&streaming->cellGeometries);
+        growingArray_destroy(&streaming->candidates);
+}
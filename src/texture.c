@@ -85,6 +85,87 @@ void texture_loadCubeMap(struct texture *const tex, void *buf[6], size_t sizes[6
         tex->loaded = true;
 }
 
+// Number of images making up a texture of the given type
+static inline int textureFaces(const GLenum type) {
+        return type == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+}
+
+// Target for each image making up a texture of the given type
+static inline GLenum textureFaceTarget(const GLenum type, const int face) {
+        if (type == GL_TEXTURE_CUBE_MAP) {
+                return GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)face;
+        }
+        return type;
+}
+
+void *texture_readPixels(const struct texture *const tex,
+                         int *const width, int *const height,
+                         size_t *const size) {
+        assert(tex->loaded);
+        texture_bind(tex);
+
+        const GLenum firstTarget = textureFaceTarget(tex->type, 0);
+        glGetTexLevelParameteriv(firstTarget, 0, GL_TEXTURE_WIDTH, width);
+        glGetTexLevelParameteriv(firstTarget, 0, GL_TEXTURE_HEIGHT, height);
+        assert(*width >= 0 && *height >= 0);
+
+        const int faces = textureFaces(tex->type);
+        const size_t faceSize = (size_t)*width * (size_t)*height * 4;
+        *size = faceSize * (size_t)faces;
+
+        unsigned char *const pixels = smalloc(*size);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int i=0; i<faces; i++) {
+                glGetTexImage(textureFaceTarget(tex->type, i), 0,
+                              GL_RGBA, GL_UNSIGNED_BYTE,
+                              pixels + faceSize * (size_t)i);
+        }
+        return pixels;
+}
+
+bool texture_pixelsSize(const struct texture *const tex,
+                        const int width, const int height,
+                        size_t *const size) {
+        if (width <= 0 || height <= 0) {
+                return false;
+        }
+        const size_t faces = (size_t)textureFaces(tex->type);
+        const size_t w = (size_t)width;
+        const size_t h = (size_t)height;
+        if (!is_safe_multiply(w, h) || !is_safe_multiply(w * h, 4) ||
+            !is_safe_multiply(w * h * 4, faces)) {
+                return false;
+        }
+        *size = w * h * 4 * faces;
+        return true;
+}
+
+void texture_loadPixels(struct texture *const tex,
+                        const int width, const int height,
+                        const void *const pixels) {
+        texture_free(tex);
+        genGLtexture(tex);
+
+        const int faces = textureFaces(tex->type);
+        const size_t faceSize = (size_t)width * (size_t)height * 4;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int i=0; i<faces; i++) {
+                glTexImage2D(textureFaceTarget(tex->type, i), 0, GL_RGBA,
+                             width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                             (const unsigned char*)pixels +
+                             faceSize * (size_t)i);
+        }
+
+        setGLtextureParams(tex);
+        if (tex->type == GL_TEXTURE_CUBE_MAP) {
+                glTexParameteri(tex->type, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        } else {
+                glGenerateMipmap(tex->type);
+        }
+
+        tex->loaded = true;
+}
+
 void texture_bind(const struct texture *const tex) {
         if (tex->loaded) {
                 glActiveTexture(tex->slot);
@@ -0,0 +1,144 @@
+#define _DEFAULT_SOURCE  // _SC_NPROCESSORS_ONLN
+
+#include <thirty/threadPool.h>
+#include <thirty/util.h>
+#include <pthread.h>
+#include <unistd.h>
+
+static pthread_mutex_t mutex;
+static pthread_cond_t workReady;  // a new loop started, or stopping
+static pthread_cond_t workDone;  // the last busy thread finished
+static pthread_t *threads;
+static size_t nthreads;  // 0 while not running
+static bool stopping;
+
+// The current loop. Everything is protected by the mutex.
+static uint64_t generation;  // incremented for each loop
+static threadPool_job job;
+static void *jobArgs;
+static size_t count;
+static size_t chunkSize;
+static size_t next;  // first iteration no one has taken yet
+static size_t busy;  // threads working on the loop
+static bool inLoop;
+
+// Take chunks of the current loop and run them until there are none left.
+// Called and returns with the mutex locked.
+static void work(void) {
+        busy++;
+        while (next < count) {
+                const size_t first = next;
+                const size_t last = count - first < chunkSize ?
+                        count : first + chunkSize;
+                next = last;
+                const threadPool_job currentJob = job;
+                void *const args = jobArgs;
+
+                pthread_mutex_unlock(&mutex);
+                currentJob(args, first, last);
+                pthread_mutex_lock(&mutex);
+        }
+        busy--;
+        if (busy == 0) {
+                pthread_cond_signal(&workDone);
+        }
+}
+
+static void *worker(void *args) {
+        (void)args;
+        uint64_t seen = 0;
+        pthread_mutex_lock(&mutex);
+        for (;;) {
+                while (generation == seen && !stopping) {
+                        pthread_cond_wait(&workReady, &mutex);
+                }
+                if (stopping) {
+                        break;
+                }
+                // Waking up late is fine, there'll be nothing left to take
+                seen = generation;
+                work();
+        }
+        pthread_mutex_unlock(&mutex);
+        return NULL;
+}
+
+void threadPool_init(size_t threadCount) {
+        if (nthreads > 0) {
+                return;
+        }
+        if (threadCount == 0) {
+                const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                threadCount = cpus > 1 ? (size_t)cpus - 1 : 1;
+        }
+
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&workReady, NULL);
+        pthread_cond_init(&workDone, NULL);
+        stopping = false;
+        generation = 0;
+        next = 0;
+        count = 0;
+        busy = 0;
+        inLoop = false;
+
+        threads = smallocarray(threadCount, sizeof(*threads));
+        for (size_t i=0; i<threadCount; i++) {
+                if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+                        die("Failed to create thread pool worker\n");
+                }
+        }
+        nthreads = threadCount;
+}
+
+size_t threadPool_threads(void) {
+        return nthreads;
+}
+
+void threadPool_parallelFor(const threadPool_job loopJob, void *const args,
+                            const size_t loopCount,
+                            const size_t loopChunkSize) {
+        assert(loopChunkSize > 0);
+        if (nthreads == 0) {
+                loopJob(args, 0, loopCount);
+                return;
+        }
+
+        pthread_mutex_lock(&mutex);
+        assert(!inLoop);
+        inLoop = true;
+        job = loopJob;
+        jobArgs = args;
+        count = loopCount;
+        chunkSize = loopChunkSize;
+        next = 0;
+        generation++;
+        pthread_cond_broadcast(&workReady);
+
+        work();
+        while (busy > 0) {
+                pthread_cond_wait(&workDone, &mutex);
+        }
+        inLoop = false;
+        pthread_mutex_unlock(&mutex);
+}
+
+void threadPool_destroy(void) {
+        if (nthreads == 0) {
+                return;
+        }
+
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        pthread_cond_broadcast(&workReady);
+        pthread_mutex_unlock(&mutex);
+        for (size_t i=0; i<nthreads; i++) {
+                pthread_join(threads[i], NULL);
+        }
+
+        free(threads);
+        nthreads = 0;
+        pthread_cond_destroy(&workDone);
+        pthread_cond_destroy(&workReady);
+        pthread_mutex_destroy(&mutex);
+}
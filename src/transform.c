@@ -1,10 +1,25 @@
 #include <thirty/transform.h>
+#include <thirty/scene.h>
 #include <thirty/util.h>
 
+// Flag the transform as changed, letting its scene know the first time
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void markDirty(struct transform *const trans) {
+        if (trans->scene != NULL && !trans->dirty) {
+                scene_queueTransform(trans->scene, trans->base.object);
+        }
+        trans->dirty = true;
+}
+
 void transform_init(struct transform *trans, mat4s model) {
         assert(trans->base.type == COMPONENT_TRANSFORM);
         component_init(&trans->base, "transform");
-        trans->model = model;
+        trans->scene = NULL;
+        transform_setMatrix(trans, model);
+        // Without a parent yet, linking it to one makes it dirty again
+        trans->world = model;
+        trans->dirty = false;
 }
 
 void transform_initFromFile(struct transform *trans, FILE *f,
@@ -16,80 +31,104 @@ void transform_initFromFile(struct transform *trans, FILE *f,
 }
 
 void transform_reset(struct transform *trans) {
-        trans->model = GLMS_MAT4_IDENTITY;
+        trans->position = GLMS_VEC3_ZERO;
+        trans->rotation = GLMS_QUAT_IDENTITY;
+        trans->scale = GLMS_VEC3_ONE;
+        markDirty(trans);
+}
+
+void transform_setMatrix(struct transform *const trans, const mat4s model) {
+        vec4s position;
+        mat4s rotation;
+        glms_decompose(model, &position, &rotation, &trans->scale);
+        trans->position = glms_vec3(position);
+        trans->rotation = glms_mat4_quat(rotation);
+        trans->model = model;
+        markDirty(trans);
 }
 
 void transform_translate(struct transform *const trans, const vec3s delta) {
         assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model = glms_translate(trans->model, delta);
+        // In the object's own space, like translating the model matrix
+        trans->position = glms_vec3_add(
+                trans->position,
+                glms_quat_rotatev(trans->rotation,
+                                  glms_vec3_mul(trans->scale, delta)));
+        markDirty(trans);
 }
 
 void transform_translateX(struct transform *const trans, const float delta) {
-        assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model = glms_translate_x(trans->model, delta);
+        transform_translate(trans, (vec3s){{delta, 0, 0}});
 }
 
 void transform_translateY(struct transform *const trans, const float delta) {
-        assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model = glms_translate_y(trans->model, delta);
+        transform_translate(trans, (vec3s){{0, delta, 0}});
 }
 
 void transform_translateZ(struct transform *const trans, const float delta) {
-        assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model = glms_translate_z(trans->model, delta);
+        transform_translate(trans, (vec3s){{0, 0, delta}});
 }
 
 void transform_set(struct transform *trans, vec3s value) {
         assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model.col[3].x = value.x;
-        trans->model.col[3].y = value.y;
-        trans->model.col[3].z = value.z;
+        trans->position = value;
+        markDirty(trans);
 }
 
 void transform_setX(struct transform *trans, float value) {
         assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model.col[3].x = value;
+        trans->position.x = value;
+        markDirty(trans);
 }
 
 void transform_setY(struct transform *trans, float value) {
         assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model.col[3].y = value;
+        trans->position.y = value;
+        markDirty(trans);
 }
 
 void transform_setZ(struct transform *trans, float value) {
         assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model.col[3].z = value;
+        trans->position.z = value;
+        markDirty(trans);
+}
+
+// Apply a rotation after the current one, renormalizing so that errors don't
+// pile up
+__attribute__((access (read_write, 1)))
+__attribute__((nonnull))
+static void rotateBy(struct transform *const trans, const versors rotation) {
+        assert(trans->base.type == COMPONENT_TRANSFORM);
+        trans->rotation = glms_quat_normalize(
+                glms_quat_mul(trans->rotation, rotation));
+        markDirty(trans);
 }
 
 void transform_rotate(struct transform *const trans, const float angle,
                    const vec3s axis) {
-        assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model = glms_rotate(trans->model, angle, axis);
+        rotateBy(trans, glms_quatv(angle, axis));
 }
 
 void transform_rotateX(struct transform *trans, float angle) {
-        assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model = glms_rotate_x(trans->model, angle);
+        rotateBy(trans, glms_quatv(angle, (vec3s){{1, 0, 0}}));
 }
 
 void transform_rotateY(struct transform *trans, float angle) {
-        assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model = glms_rotate_y(trans->model, angle);
+        rotateBy(trans, glms_quatv(angle, (vec3s){{0, 1, 0}}));
 }
 
 void transform_rotateZ(struct transform *trans, float angle) {
-        assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model = glms_rotate_z(trans->model, angle);
+        rotateBy(trans, glms_quatv(angle, (vec3s){{0, 0, 1}}));
 }
 
 void transform_rotateMat(struct transform *trans, mat4s rotation) {
-        assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model = glms_mat4_mul(trans->model, rotation);
+        rotateBy(trans, glms_mat4_quat(rotation));
 }
 
 void transform_scale(struct transform *const trans, const vec3s scale) {
         assert(trans->base.type == COMPONENT_TRANSFORM);
-        trans->model = glms_scale(trans->model, scale);
+        trans->scale = glms_vec3_mul(trans->scale, scale);
+        markDirty(trans);
 }
 
 void transform_free(struct transform *trans) {
@@ -13,6 +13,8 @@
 #include <limits.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #define BUFFER_SIZE 256
 
@@ -37,6 +39,12 @@ float clamp_angle(float angle, float minVal, float maxVal) {
         return glm_clamp(angle, minVal, maxVal);
 }
 
+uint64_t time_micros(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
 void bail(const char *const msg, ...) {
         if (msg != NULL) {
                 va_list ap;
@@ -206,6 +214,15 @@ void sfclose(FILE *const stream) {
         }
 }
 
+size_t sfilesize(const char *const pathname) {
+        struct stat st;
+        if (stat(pathname, &st) != 0) {
+                perror(pathname);
+                die("Failed to stat file.");
+        }
+        return (size_t)st.st_size;
+}
+
 // TODO: Unittest this
 bool accessible(const char *filepath, const bool read, const bool write,
                 const bool execute) {
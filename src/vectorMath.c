@@ -0,0 +1,1006 @@
+#include <thirty/vectorMath.h>
+#include <thirty/util.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VECTORMATH_X86
+#include <immintrin.h>
+#endif
+
+#define TRS_MEMBERS 10
+
+void trsArrays_init(struct trsArrays *const trs, const size_t capacity) {
+        // All members in one allocation, px points to its start
+        float *const data = smallocarray(capacity * TRS_MEMBERS, sizeof(float));
+        trs->px = data;
+        trs->py = data + capacity;
+        trs->pz = data + capacity * 2;
+        trs->rx = data + capacity * 3;
+        trs->ry = data + capacity * 4;
+        trs->rz = data + capacity * 5;
+        trs->rw = data + capacity * 6;
+        trs->sx = data + capacity * 7;
+        trs->sy = data + capacity * 8;
+        trs->sz = data + capacity * 9;
+        trs->capacity = capacity;
+}
+
+void trsArrays_reserve(struct trsArrays *const trs, const size_t capacity) {
+        if (capacity <= trs->capacity) {
+                return;
+        }
+        size_t newCapacity = trs->capacity;
+        while (newCapacity < capacity) {
+                newCapacity *= 2;
+        }
+        trsArrays_free(trs);
+        trsArrays_init(trs, newCapacity);
+}
+
+void trsArrays_set(struct trsArrays *const trs, const size_t i,
+                   const vec3s position, const versors rotation,
+                   const vec3s scale) {
+        assert(i < trs->capacity);
+        trs->px[i] = position.x;
+        trs->py[i] = position.y;
+        trs->pz[i] = position.z;
+        trs->rx[i] = rotation.x;
+        trs->ry[i] = rotation.y;
+        trs->rz[i] = rotation.z;
+        trs->rw[i] = rotation.w;
+        trs->sx[i] = scale.x;
+        trs->sy[i] = scale.y;
+        trs->sz[i] = scale.z;
+}
+
+void trsArrays_free(struct trsArrays *const trs) {
+        free(trs->px);
+        trs->capacity = 0;
+}
+
+#define BOUNDS_MEMBERS 7
+
+void boundsArrays_init(struct boundsArrays *const bounds,
+                       const size_t capacity) {
+        // All members in one allocation, cx points to its start
+        float *const data = smallocarray(capacity * BOUNDS_MEMBERS,
+                                         sizeof(float));
+        bounds->cx = data;
+        bounds->cy = data + capacity;
+        bounds->cz = data + capacity * 2;
+        bounds->ex = data + capacity * 3;
+        bounds->ey = data + capacity * 4;
+        bounds->ez = data + capacity * 5;
+        bounds->r = data + capacity * 6;
+        bounds->capacity = capacity;
+}
+
+void boundsArrays_reserve(struct boundsArrays *const bounds,
+                          const size_t capacity) {
+        if (capacity <= bounds->capacity) {
+                return;
+        }
+        size_t newCapacity = bounds->capacity;
+        while (newCapacity < capacity) {
+                newCapacity *= 2;
+        }
+        boundsArrays_free(bounds);
+        boundsArrays_init(bounds, newCapacity);
+}
+
+void boundsArrays_set(struct boundsArrays *const bounds, const size_t i,
+                      const vec3s center, const vec3s extents,
+                      const float radius) {
+        assert(i < bounds->capacity);
+        bounds->cx[i] = center.x;
+        bounds->cy[i] = center.y;
+        bounds->cz[i] = center.z;
+        bounds->ex[i] = extents.x;
+        bounds->ey[i] = extents.y;
+        bounds->ez[i] = extents.z;
+        bounds->r[i] = radius;
+}
+
+void boundsArrays_free(struct boundsArrays *const bounds) {
+        free(bounds->cx);
+        bounds->capacity = 0;
+}
+
+static enum vectorMathLevel maxLevel = VECTORMATH_AVX512;
+
+enum vectorMathLevel vectorMath_level(void) {
+#ifdef VECTORMATH_X86
+        static bool detected = false;
+        static enum vectorMathLevel level = VECTORMATH_SCALAR;
+        if (!detected) {
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx512f")) {
+                        level = VECTORMATH_AVX512;
+                } else if (__builtin_cpu_supports("avx2")) {
+                        level = VECTORMATH_AVX2;
+                } else if (__builtin_cpu_supports("sse4.1")) {
+                        level = VECTORMATH_SSE4;
+                }
+                detected = true;
+        }
+        return level < maxLevel ? level : maxLevel;
+#else
+        return VECTORMATH_SCALAR;
+#endif
+}
+
+void vectorMath_setMaxLevel(const enum vectorMathLevel level) {
+        maxLevel = level;
+}
+
+
+/// Compose TRS ///
+
+// The SIMD versions compute the same 16 values per matrix as this one, a
+// lane per transform, then transpose them into place. They return how many
+// they did, the scalar version does the rest.
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static void composeTRSScalar(const struct trsArrays *const trs,
+                             mat4s *const out,
+                             const size_t first, const size_t n) {
+        for (size_t i=first; i<n; i++) {
+                const float x = trs->rx[i];
+                const float y = trs->ry[i];
+                const float z = trs->rz[i];
+                const float w = trs->rw[i];
+                const float xx = x * (x + x);
+                const float yy = y * (y + y);
+                const float zz = z * (z + z);
+                const float xy = x * (y + y);
+                const float xz = x * (z + z);
+                const float yz = y * (z + z);
+                const float wx = w * (x + x);
+                const float wy = w * (y + y);
+                const float wz = w * (z + z);
+
+                float *const m = (float*)out[i].raw;
+                m[0] = (1 - (yy + zz)) * trs->sx[i];
+                m[1] = (xy + wz) * trs->sx[i];
+                m[2] = (xz - wy) * trs->sx[i];
+                m[3] = 0;
+                m[4] = (xy - wz) * trs->sy[i];
+                m[5] = (1 - (xx + zz)) * trs->sy[i];
+                m[6] = (yz + wx) * trs->sy[i];
+                m[7] = 0;
+                m[8] = (xz + wy) * trs->sz[i];
+                m[9] = (yz - wx) * trs->sz[i];
+                m[10] = (1 - (xx + yy)) * trs->sz[i];
+                m[11] = 0;
+                m[12] = trs->px[i];
+                m[13] = trs->py[i];
+                m[14] = trs->pz[i];
+                m[15] = 1;
+        }
+}
+
+#ifdef VECTORMATH_X86
+
+__attribute__((target ("sse4.1")))
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static size_t composeTRSSSE4(const struct trsArrays *const trs,
+                             mat4s *const out, const size_t n) {
+        const __m128 one = _mm_set1_ps(1);
+        const __m128 zero = _mm_setzero_ps();
+
+        size_t i = 0;
+        for (; i+4 <= n; i+=4) {
+                const __m128 x = _mm_loadu_ps(trs->rx + i);
+                const __m128 y = _mm_loadu_ps(trs->ry + i);
+                const __m128 z = _mm_loadu_ps(trs->rz + i);
+                const __m128 w = _mm_loadu_ps(trs->rw + i);
+                const __m128 sx = _mm_loadu_ps(trs->sx + i);
+                const __m128 sy = _mm_loadu_ps(trs->sy + i);
+                const __m128 sz = _mm_loadu_ps(trs->sz + i);
+                const __m128 x2 = _mm_add_ps(x, x);
+                const __m128 y2 = _mm_add_ps(y, y);
+                const __m128 z2 = _mm_add_ps(z, z);
+                const __m128 xx = _mm_mul_ps(x, x2);
+                const __m128 yy = _mm_mul_ps(y, y2);
+                const __m128 zz = _mm_mul_ps(z, z2);
+                const __m128 xy = _mm_mul_ps(x, y2);
+                const __m128 xz = _mm_mul_ps(x, z2);
+                const __m128 yz = _mm_mul_ps(y, z2);
+                const __m128 wx = _mm_mul_ps(w, x2);
+                const __m128 wy = _mm_mul_ps(w, y2);
+                const __m128 wz = _mm_mul_ps(w, z2);
+
+                __m128 c[16] = {
+                        _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+                        _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+                        _mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+                        zero,
+                        _mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+                        _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+                        _mm_mul_ps(_mm_add_ps(yz, wx), sy),
+                        zero,
+                        _mm_mul_ps(_mm_add_ps(xz, wy), sz),
+                        _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+                        _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz),
+                        zero,
+                        _mm_loadu_ps(trs->px + i),
+                        _mm_loadu_ps(trs->py + i),
+                        _mm_loadu_ps(trs->pz + i),
+                        one,
+                };
+
+                // Each group of four becomes a column of each matrix
+                for (size_t col=0; col<4; col++) {
+                        __m128 *const v = c + col * 4;
+                        _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+                        for (size_t k=0; k<4; k++) {
+                                _mm_storeu_ps((float*)out[i+k].raw + col * 4,
+                                              v[k]);
+                        }
+                }
+        }
+        return i;
+}
+
+// Transpose eight rows of eight floats
+__attribute__((target ("avx2")))
+static inline void transpose8(__m256 *const r) {
+        const __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+        const __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+        const __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+        const __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+        const __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+        const __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+        const __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+        const __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+        const __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+        r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+        r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+        r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+        r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+        r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+        r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+        r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+        r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+
+__attribute__((target ("avx2")))
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static size_t composeTRSAVX2(const struct trsArrays *const trs,
+                             mat4s *const out, const size_t n) {
+        const __m256 one = _mm256_set1_ps(1);
+        const __m256 zero = _mm256_setzero_ps();
+
+        size_t i = 0;
+        for (; i+8 <= n; i+=8) {
+                const __m256 x = _mm256_loadu_ps(trs->rx + i);
+                const __m256 y = _mm256_loadu_ps(trs->ry + i);
+                const __m256 z = _mm256_loadu_ps(trs->rz + i);
+                const __m256 w = _mm256_loadu_ps(trs->rw + i);
+                const __m256 sx = _mm256_loadu_ps(trs->sx + i);
+                const __m256 sy = _mm256_loadu_ps(trs->sy + i);
+                const __m256 sz = _mm256_loadu_ps(trs->sz + i);
+                const __m256 x2 = _mm256_add_ps(x, x);
+                const __m256 y2 = _mm256_add_ps(y, y);
+                const __m256 z2 = _mm256_add_ps(z, z);
+                const __m256 xx = _mm256_mul_ps(x, x2);
+                const __m256 yy = _mm256_mul_ps(y, y2);
+                const __m256 zz = _mm256_mul_ps(z, z2);
+                const __m256 xy = _mm256_mul_ps(x, y2);
+                const __m256 xz = _mm256_mul_ps(x, z2);
+                const __m256 yz = _mm256_mul_ps(y, z2);
+                const __m256 wx = _mm256_mul_ps(w, x2);
+                const __m256 wy = _mm256_mul_ps(w, y2);
+                const __m256 wz = _mm256_mul_ps(w, z2);
+
+                __m256 c[16] = {
+                        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx),
+                        _mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+                        _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx),
+                        zero,
+                        _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+                        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+                        _mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+                        zero,
+                        _mm256_mul_ps(_mm256_add_ps(xz, wy), sz),
+                        _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+                        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz),
+                        zero,
+                        _mm256_loadu_ps(trs->px + i),
+                        _mm256_loadu_ps(trs->py + i),
+                        _mm256_loadu_ps(trs->pz + i),
+                        one,
+                };
+
+                // Each half becomes the first or last eight floats of each
+                // matrix
+                for (size_t half=0; half<2; half++) {
+                        __m256 *const v = c + half * 8;
+                        transpose8(v);
+                        for (size_t k=0; k<8; k++) {
+                                _mm256_storeu_ps((float*)out[i+k].raw + half * 8,
+                                                 v[k]);
+                        }
+                }
+        }
+        return i;
+}
+
+#endif /* VECTORMATH_X86 */
+
+void vectorMath_composeTRS(const struct trsArrays *const trs,
+                           mat4s *const out, const size_t n) {
+        assert(n <= trs->capacity);
+        size_t done = 0;
+        switch (vectorMath_level()) {
+#ifdef VECTORMATH_X86
+        case VECTORMATH_AVX512:
+        case VECTORMATH_AVX2:
+                done = composeTRSAVX2(trs, out, n);
+                break;
+        case VECTORMATH_SSE4:
+                done = composeTRSSSE4(trs, out, n);
+                break;
+#else
+        case VECTORMATH_AVX512:
+        case VECTORMATH_AVX2:
+        case VECTORMATH_SSE4:
+#endif
+        case VECTORMATH_SCALAR:
+        default:
+                break;
+        }
+        composeTRSScalar(trs, out, done, n);
+}
+
+
+/// Multiply ///
+
+// One product per call, matrices as 16 column major floats. Every version
+// loads both operands whole before storing anything, so that out may be
+// either of them, and adds the four terms of each element in the same order.
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static inline void mulScalar(const float *const a, const float *const b,
+                             float *const out) {
+        float r[16];
+        for (size_t col=0; col<4; col++) {
+                for (size_t row=0; row<4; row++) {
+                        r[col*4 + row] = a[row] * b[col*4] +
+                                a[4 + row] * b[col*4 + 1] +
+                                a[8 + row] * b[col*4 + 2] +
+                                a[12 + row] * b[col*4 + 3];
+                }
+        }
+        memcpy(out, r, sizeof(r));
+}
+
+#ifdef VECTORMATH_X86
+
+// A column of a at a time, times each element of the columns of b
+__attribute__((target ("sse4.1")))
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static inline void mulSSE4(const float *const a, const float *const b,
+                           float *const out) {
+        const __m128 a0 = _mm_loadu_ps(a);
+        const __m128 a1 = _mm_loadu_ps(a + 4);
+        const __m128 a2 = _mm_loadu_ps(a + 8);
+        const __m128 a3 = _mm_loadu_ps(a + 12);
+        __m128 r[4];
+        for (size_t col=0; col<4; col++) {
+                const __m128 bc = _mm_loadu_ps(b + col*4);
+                r[col] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, 0x00)),
+                        _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, 0x55))),
+                        _mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, 0xaa))),
+                        _mm_mul_ps(a3, _mm_shuffle_ps(bc, bc, 0xff)));
+        }
+        for (size_t col=0; col<4; col++) {
+                _mm_storeu_ps(out + col*4, r[col]);
+        }
+}
+
+// Two columns of the result at a time, each half of a register holding the
+// same column of a
+__attribute__((target ("avx2")))
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static inline void mulAVX2(const float *const a, const float *const b,
+                           float *const out) {
+        const __m256 a0 = _mm256_broadcast_ps((const __m128*)a);
+        const __m256 a1 = _mm256_broadcast_ps((const __m128*)(a + 4));
+        const __m256 a2 = _mm256_broadcast_ps((const __m128*)(a + 8));
+        const __m256 a3 = _mm256_broadcast_ps((const __m128*)(a + 12));
+        __m256 r[2];
+        for (size_t half=0; half<2; half++) {
+                const __m256 bc = _mm256_loadu_ps(b + half*8);
+                r[half] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(a0, _mm256_permute_ps(bc, 0x00)),
+                        _mm256_mul_ps(a1, _mm256_permute_ps(bc, 0x55))),
+                        _mm256_mul_ps(a2, _mm256_permute_ps(bc, 0xaa))),
+                        _mm256_mul_ps(a3, _mm256_permute_ps(bc, 0xff)));
+        }
+        _mm256_storeu_ps(out, r[0]);
+        _mm256_storeu_ps(out + 8, r[1]);
+}
+
+// AVX-512 brings FMA along, which the compiler would otherwise fuse the
+// multiplies and adds into, rounding differently from the other versions
+#define AVX512_TARGET \
+        __attribute__((target ("avx512f"), optimize ("fp-contract=off")))
+
+// The whole result at once, each quarter of a register holding the same
+// column of a
+AVX512_TARGET
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static inline void mulAVX512(const float *const a, const float *const b,
+                             float *const out) {
+        const __m512 a0 = _mm512_broadcast_f32x4(_mm_loadu_ps(a));
+        const __m512 a1 = _mm512_broadcast_f32x4(_mm_loadu_ps(a + 4));
+        const __m512 a2 = _mm512_broadcast_f32x4(_mm_loadu_ps(a + 8));
+        const __m512 a3 = _mm512_broadcast_f32x4(_mm_loadu_ps(a + 12));
+        const __m512 bc = _mm512_loadu_ps(b);
+        const __m512 r = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(
+                _mm512_mul_ps(a0, _mm512_permute_ps(bc, 0x00)),
+                _mm512_mul_ps(a1, _mm512_permute_ps(bc, 0x55))),
+                _mm512_mul_ps(a2, _mm512_permute_ps(bc, 0xaa))),
+                _mm512_mul_ps(a3, _mm512_permute_ps(bc, 0xff)));
+        _mm512_storeu_ps(out, r);
+}
+
+#endif /* VECTORMATH_X86 */
+
+// The loops live in functions with the same target as the product they call,
+// so that it gets inlined
+#define MUL_LOOPS(name, target)                                         \
+        target                                                          \
+        static void name##Batch(const mat4s *const a,                   \
+                                const mat4s *const b,                   \
+                                mat4s *const out, const size_t n) {     \
+                for (size_t i=0; i<n; i++) {                            \
+                        name(a[i].raw[0], b[i].raw[0], out[i].raw[0]);  \
+                }                                                       \
+        }                                                               \
+        target                                                          \
+        static void name##Indirect(const mat4s *const *const a,         \
+                                   const mat4s *const *const b,         \
+                                   mat4s *const *const out,             \
+                                   const size_t n) {                    \
+                for (size_t i=0; i<n; i++) {                            \
+                        name(a[i]->raw[0], b[i]->raw[0], out[i]->raw[0]); \
+                }                                                       \
+        }
+
+MUL_LOOPS(mulScalar, )
+#ifdef VECTORMATH_X86
+MUL_LOOPS(mulSSE4, __attribute__((target ("sse4.1"))))
+MUL_LOOPS(mulAVX2, __attribute__((target ("avx2"))))
+MUL_LOOPS(mulAVX512, AVX512_TARGET)
+#endif
+
+void vectorMath_mul(const mat4s *const a, const mat4s *const b,
+                    mat4s *const out, const size_t n) {
+        switch (vectorMath_level()) {
+#ifdef VECTORMATH_X86
+        case VECTORMATH_AVX512:
+                mulAVX512Batch(a, b, out, n);
+                break;
+        case VECTORMATH_AVX2:
+                mulAVX2Batch(a, b, out, n);
+                break;
+        case VECTORMATH_SSE4:
+                mulSSE4Batch(a, b, out, n);
+                break;
+#else
+        case VECTORMATH_AVX512:
+        case VECTORMATH_AVX2:
+        case VECTORMATH_SSE4:
+#endif
+        case VECTORMATH_SCALAR:
+        default:
+                mulScalarBatch(a, b, out, n);
+                break;
+        }
+}
+
+void vectorMath_mulIndirect(const mat4s *const *const a,
+                            const mat4s *const *const b,
+                            mat4s *const *const out, const size_t n) {
+        switch (vectorMath_level()) {
+#ifdef VECTORMATH_X86
+        case VECTORMATH_AVX512:
+                mulAVX512Indirect(a, b, out, n);
+                break;
+        case VECTORMATH_AVX2:
+                mulAVX2Indirect(a, b, out, n);
+                break;
+        case VECTORMATH_SSE4:
+                mulSSE4Indirect(a, b, out, n);
+                break;
+#else
+        case VECTORMATH_AVX512:
+        case VECTORMATH_AVX2:
+        case VECTORMATH_SSE4:
+#endif
+        case VECTORMATH_SCALAR:
+        default:
+                mulScalarIndirect(a, b, out, n);
+                break;
+        }
+}
+
+
+/// Affine inverse ///
+
+// With c0, c1 and c2 the first three columns, the rows of the inverse of the
+// upper 3x3 are c1 x c2, c2 x c0 and c0 x c1 over the determinant, and the
+// last column is minus those rows times the translation. Like composeTRS,
+// the SIMD versions do a matrix per lane, with the same operations as this.
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static void invAffineScalar(const mat4s *const m, mat4s *const out,
+                            const size_t first, const size_t n) {
+        for (size_t i=first; i<n; i++) {
+                const float *const c = m[i].raw[0];
+                float r0x = c[5] * c[10] - c[6] * c[9];
+                float r0y = c[6] * c[8] - c[4] * c[10];
+                float r0z = c[4] * c[9] - c[5] * c[8];
+                float r1x = c[9] * c[2] - c[10] * c[1];
+                float r1y = c[10] * c[0] - c[8] * c[2];
+                float r1z = c[8] * c[1] - c[9] * c[0];
+                float r2x = c[1] * c[6] - c[2] * c[5];
+                float r2y = c[2] * c[4] - c[0] * c[6];
+                float r2z = c[0] * c[5] - c[1] * c[4];
+                const float invDet = 1 / (c[0] * r0x + c[1] * r0y + c[2] * r0z);
+                r0x *= invDet; r0y *= invDet; r0z *= invDet;
+                r1x *= invDet; r1y *= invDet; r1z *= invDet;
+                r2x *= invDet; r2y *= invDet; r2z *= invDet;
+                const float tx = c[12];
+                const float ty = c[13];
+                const float tz = c[14];
+
+                const float r[16] = {
+                        r0x, r1x, r2x, 0,
+                        r0y, r1y, r2y, 0,
+                        r0z, r1z, r2z, 0,
+                        -(r0x * tx + r0y * ty + r0z * tz),
+                        -(r1x * tx + r1y * ty + r1z * tz),
+                        -(r2x * tx + r2y * ty + r2z * tz),
+                        1,
+                };
+                memcpy(out[i].raw, r, sizeof(r));
+        }
+}
+
+#ifdef VECTORMATH_X86
+
+__attribute__((target ("sse4.1")))
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static size_t invAffineSSE4(const mat4s *const m, mat4s *const out,
+                            const size_t n) {
+        const __m128 one = _mm_set1_ps(1);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 sign = _mm_set1_ps(-0.0f);
+
+        size_t i = 0;
+        for (; i+4 <= n; i+=4) {
+                // c[col*4 + row], each group of four a column of each matrix
+                __m128 c[16];
+                for (size_t col=0; col<4; col++) {
+                        __m128 *const v = c + col * 4;
+                        for (size_t k=0; k<4; k++) {
+                                v[k] = _mm_loadu_ps(m[i+k].raw[col]);
+                        }
+                        _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+                }
+
+                __m128 r0x = _mm_sub_ps(_mm_mul_ps(c[5], c[10]), _mm_mul_ps(c[6], c[9]));
+                __m128 r0y = _mm_sub_ps(_mm_mul_ps(c[6], c[8]), _mm_mul_ps(c[4], c[10]));
+                __m128 r0z = _mm_sub_ps(_mm_mul_ps(c[4], c[9]), _mm_mul_ps(c[5], c[8]));
+                __m128 r1x = _mm_sub_ps(_mm_mul_ps(c[9], c[2]), _mm_mul_ps(c[10], c[1]));
+                __m128 r1y = _mm_sub_ps(_mm_mul_ps(c[10], c[0]), _mm_mul_ps(c[8], c[2]));
+                __m128 r1z = _mm_sub_ps(_mm_mul_ps(c[8], c[1]), _mm_mul_ps(c[9], c[0]));
+                __m128 r2x = _mm_sub_ps(_mm_mul_ps(c[1], c[6]), _mm_mul_ps(c[2], c[5]));
+                __m128 r2y = _mm_sub_ps(_mm_mul_ps(c[2], c[4]), _mm_mul_ps(c[0], c[6]));
+                __m128 r2z = _mm_sub_ps(_mm_mul_ps(c[0], c[5]), _mm_mul_ps(c[1], c[4]));
+                const __m128 invDet = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(c[0], r0x), _mm_mul_ps(c[1], r0y)),
+                        _mm_mul_ps(c[2], r0z)));
+                r0x = _mm_mul_ps(r0x, invDet);
+                r0y = _mm_mul_ps(r0y, invDet);
+                r0z = _mm_mul_ps(r0z, invDet);
+                r1x = _mm_mul_ps(r1x, invDet);
+                r1y = _mm_mul_ps(r1y, invDet);
+                r1z = _mm_mul_ps(r1z, invDet);
+                r2x = _mm_mul_ps(r2x, invDet);
+                r2y = _mm_mul_ps(r2y, invDet);
+                r2z = _mm_mul_ps(r2z, invDet);
+                const __m128 tx = c[12];
+                const __m128 ty = c[13];
+                const __m128 tz = c[14];
+
+                __m128 r[16] = {
+                        r0x, r1x, r2x, zero,
+                        r0y, r1y, r2y, zero,
+                        r0z, r1z, r2z, zero,
+                        _mm_xor_ps(sign, _mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(r0x, tx), _mm_mul_ps(r0y, ty)),
+                                _mm_mul_ps(r0z, tz))),
+                        _mm_xor_ps(sign, _mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(r1x, tx), _mm_mul_ps(r1y, ty)),
+                                _mm_mul_ps(r1z, tz))),
+                        _mm_xor_ps(sign, _mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(r2x, tx), _mm_mul_ps(r2y, ty)),
+                                _mm_mul_ps(r2z, tz))),
+                        one,
+                };
+
+                for (size_t col=0; col<4; col++) {
+                        __m128 *const v = r + col * 4;
+                        _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+                        for (size_t k=0; k<4; k++) {
+                                _mm_storeu_ps(out[i+k].raw[col], v[k]);
+                        }
+                }
+        }
+        return i;
+}
+
+__attribute__((target ("avx2")))
+__attribute__((access (read_only, 1)))
+__attribute__((nonnull))
+static size_t invAffineAVX2(const mat4s *const m, mat4s *const out,
+                            const size_t n) {
+        const __m256 one = _mm256_set1_ps(1);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+
+        size_t i = 0;
+        for (; i+8 <= n; i+=8) {
+                // c[col*4 + row], each half the first or last eight floats
+                // of each matrix
+                __m256 c[16];
+                for (size_t half=0; half<2; half++) {
+                        __m256 *const v = c + half * 8;
+                        for (size_t k=0; k<8; k++) {
+                                v[k] = _mm256_loadu_ps(m[i+k].raw[half*2]);
+                        }
+                        transpose8(v);
+                }
+
+                __m256 r0x = _mm256_sub_ps(_mm256_mul_ps(c[5], c[10]), _mm256_mul_ps(c[6], c[9]));
+                __m256 r0y = _mm256_sub_ps(_mm256_mul_ps(c[6], c[8]), _mm256_mul_ps(c[4], c[10]));
+                __m256 r0z = _mm256_sub_ps(_mm256_mul_ps(c[4], c[9]), _mm256_mul_ps(c[5], c[8]));
+                __m256 r1x = _mm256_sub_ps(_mm256_mul_ps(c[9], c[2]), _mm256_mul_ps(c[10], c[1]));
+                __m256 r1y = _mm256_sub_ps(_mm256_mul_ps(c[10], c[0]), _mm256_mul_ps(c[8], c[2]));
+                __m256 r1z = _mm256_sub_ps(_mm256_mul_ps(c[8], c[1]), _mm256_mul_ps(c[9], c[0]));
+                __m256 r2x = _mm256_sub_ps(_mm256_mul_ps(c[1], c[6]), _mm256_mul_ps(c[2], c[5]));
+                __m256 r2y = _mm256_sub_ps(_mm256_mul_ps(c[2], c[4]), _mm256_mul_ps(c[0], c[6]));
+                __m256 r2z = _mm256_sub_ps(_mm256_mul_ps(c[0], c[5]), _mm256_mul_ps(c[1], c[4]));
+                const __m256 invDet = _mm256_div_ps(one, _mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(c[0], r0x), _mm256_mul_ps(c[1], r0y)),
+                        _mm256_mul_ps(c[2], r0z)));
+                r0x = _mm256_mul_ps(r0x, invDet);
+                r0y = _mm256_mul_ps(r0y, invDet);
+                r0z = _mm256_mul_ps(r0z, invDet);
+                r1x = _mm256_mul_ps(r1x, invDet);
+                r1y = _mm256_mul_ps(r1y, invDet);
+                r1z = _mm256_mul_ps(r1z, invDet);
+                r2x = _mm256_mul_ps(r2x, invDet);
+                r2y = _mm256_mul_ps(r2y, invDet);
+                r2z = _mm256_mul_ps(r2z, invDet);
+                const __m256 tx = c[12];
+                const __m256 ty = c[13];
+                const __m256 tz = c[14];
+
+                __m256 r[16] = {
+                        r0x, r1x, r2x, zero,
+                        r0y, r1y, r2y, zero,
+                        r0z, r1z, r2z, zero,
+                        _mm256_xor_ps(sign, _mm256_add_ps(_mm256_add_ps(
+                                _mm256_mul_ps(r0x, tx), _mm256_mul_ps(r0y, ty)),
+                                _mm256_mul_ps(r0z, tz))),
+                        _mm256_xor_ps(sign, _mm256_add_ps(_mm256_add_ps(
+                                _mm256_mul_ps(r1x, tx), _mm256_mul_ps(r1y, ty)),
+                                _mm256_mul_ps(r1z, tz))),
+                        _mm256_xor_ps(sign, _mm256_add_ps(_mm256_add_ps(
+                                _mm256_mul_ps(r2x, tx), _mm256_mul_ps(r2y, ty)),
+                                _mm256_mul_ps(r2z, tz))),
+                        one,
+                };
+
+                for (size_t half=0; half<2; half++) {
+                        __m256 *const v = r + half * 8;
+                        transpose8(v);
+                        for (size_t k=0; k<8; k++) {
+                                _mm256_storeu_ps(out[i+k].raw[half*2], v[k]);
+                        }
+                }
+        }
+        return i;
+}
+
+#endif /* VECTORMATH_X86 */
+
+void vectorMath_invAffine(const mat4s *const m, mat4s *const out,
+                          const size_t n) {
+        size_t done = 0;
+        switch (vectorMath_level()) {
+#ifdef VECTORMATH_X86
+        case VECTORMATH_AVX512:
+        case VECTORMATH_AVX2:
+                done = invAffineAVX2(m, out, n);
+                break;
+        case VECTORMATH_SSE4:
+                done = invAffineSSE4(m, out, n);
+                break;
+#else
+        case VECTORMATH_AVX512:
+        case VECTORMATH_AVX2:
+        case VECTORMATH_SSE4:
+#endif
+        case VECTORMATH_SCALAR:
+        default:
+                break;
+        }
+        invAffineScalar(m, out, done, n);
+}
+
+
+/// Transform points ///
+
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void transformPointsScalar(const mat4s m, const vec3s *const points,
+                                  vec3s *const out, const size_t n) {
+        for (size_t i=0; i<n; i++) {
+                const float x = points[i].x;
+                const float y = points[i].y;
+                const float z = points[i].z;
+                for (size_t row=0; row<3; row++) {
+                        out[i].raw[row] = m.raw[0][row] * x +
+                                m.raw[1][row] * y + m.raw[2][row] * z +
+                                m.raw[3][row];
+                }
+        }
+}
+
+#ifdef VECTORMATH_X86
+
+// A point per iteration, there's only one matrix so wider registers don't
+// help much. Stores exactly three floats so as not to touch the next point.
+__attribute__((target ("sse4.1")))
+__attribute__((access (read_only, 2)))
+__attribute__((nonnull))
+static void transformPointsSSE4(const mat4s m, const vec3s *const points,
+                                vec3s *const out, const size_t n) {
+        const __m128 c0 = _mm_loadu_ps(m.raw[0]);
+        const __m128 c1 = _mm_loadu_ps(m.raw[1]);
+        const __m128 c2 = _mm_loadu_ps(m.raw[2]);
+        const __m128 c3 = _mm_loadu_ps(m.raw[3]);
+        for (size_t i=0; i<n; i++) {
+                const __m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(c0, _mm_set1_ps(points[i].x)),
+                        _mm_mul_ps(c1, _mm_set1_ps(points[i].y))),
+                        _mm_mul_ps(c2, _mm_set1_ps(points[i].z))),
+                        c3);
+                _mm_storel_pi((__m64*)out[i].raw, r);
+                _mm_store_ss(out[i].raw + 2, _mm_movehl_ps(r, r));
+        }
+}
+
+#endif /* VECTORMATH_X86 */
+
+void vectorMath_transformPoints(const mat4s m, const vec3s *const points,
+                                vec3s *const out, const size_t n) {
+        switch (vectorMath_level()) {
+#ifdef VECTORMATH_X86
+        case VECTORMATH_AVX512:
+        case VECTORMATH_AVX2:
+        case VECTORMATH_SSE4:
+                transformPointsSSE4(m, points, out, n);
+                break;
+#else
+        case VECTORMATH_AVX512:
+        case VECTORMATH_AVX2:
+        case VECTORMATH_SSE4:
+#endif
+        case VECTORMATH_SCALAR:
+        default:
+                transformPointsScalar(m, points, out, n);
+                break;
+        }
+}
+
+
+/// Frustum culling ///
+
+// Per plane, the signed distance of the center plus how far the bounds reach
+// towards the plane's normal, which is the smaller of the box's and the
+// sphere's. Negative means outside. The SIMD versions do the same operations
+// in the same order, a lane per object, and return how many they did.
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((access (write_only, 3)))
+__attribute__((nonnull))
+static void cullFrustumScalar(const vec4s planes[6],
+                              const struct boundsArrays *const bounds,
+                              bool *const visible,
+                              const size_t first, const size_t n) {
+        for (size_t i=first; i<n; i++) {
+                bool inside = true;
+                for (size_t p=0; p<6; p++) {
+                        const float distance =
+                                planes[p].x * bounds->cx[i] +
+                                planes[p].y * bounds->cy[i] +
+                                planes[p].z * bounds->cz[i] +
+                                planes[p].w;
+                        const float box =
+                                fabsf(planes[p].x) * bounds->ex[i] +
+                                fabsf(planes[p].y) * bounds->ey[i] +
+                                fabsf(planes[p].z) * bounds->ez[i];
+                        const float reach = box < bounds->r[i] ?
+                                box : bounds->r[i];
+                        inside = inside && distance + reach >= 0;
+                }
+                visible[i] = inside;
+        }
+}
+
+#ifdef VECTORMATH_X86
+
+__attribute__((target ("sse4.1")))
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((access (write_only, 3)))
+__attribute__((nonnull))
+static size_t cullFrustumSSE4(const vec4s planes[6],
+                              const struct boundsArrays *const bounds,
+                              bool *const visible, const size_t n) {
+        const __m128 zero = _mm_setzero_ps();
+
+        size_t i = 0;
+        for (; i+4 <= n; i+=4) {
+                const __m128 cx = _mm_loadu_ps(bounds->cx + i);
+                const __m128 cy = _mm_loadu_ps(bounds->cy + i);
+                const __m128 cz = _mm_loadu_ps(bounds->cz + i);
+                const __m128 ex = _mm_loadu_ps(bounds->ex + i);
+                const __m128 ey = _mm_loadu_ps(bounds->ey + i);
+                const __m128 ez = _mm_loadu_ps(bounds->ez + i);
+                const __m128 r = _mm_loadu_ps(bounds->r + i);
+
+                __m128 inside = _mm_cmpeq_ps(zero, zero);
+                for (size_t p=0; p<6; p++) {
+                        const __m128 distance = _mm_add_ps(_mm_add_ps(
+                                _mm_add_ps(
+                                        _mm_mul_ps(_mm_set1_ps(planes[p].x),
+                                                   cx),
+                                        _mm_mul_ps(_mm_set1_ps(planes[p].y),
+                                                   cy)),
+                                _mm_mul_ps(_mm_set1_ps(planes[p].z), cz)),
+                                _mm_set1_ps(planes[p].w));
+                        const __m128 box = _mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(_mm_set1_ps(fabsf(planes[p].x)),
+                                           ex),
+                                _mm_mul_ps(_mm_set1_ps(fabsf(planes[p].y)),
+                                           ey)),
+                                _mm_mul_ps(_mm_set1_ps(fabsf(planes[p].z)),
+                                           ez));
+                        const __m128 reach = _mm_min_ps(box, r);
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(
+                                _mm_add_ps(distance, reach), zero));
+                }
+
+                const int mask = _mm_movemask_ps(inside);
+                for (size_t k=0; k<4; k++) {
+                        visible[i+k] = (mask >> k) & 1;
+                }
+        }
+        return i;
+}
+
+__attribute__((target ("avx2")))
+__attribute__((access (read_only, 1)))
+__attribute__((access (read_only, 2)))
+__attribute__((access (write_only, 3)))
+__attribute__((nonnull))
+static size_t cullFrustumAVX2(const vec4s planes[6],
+                              const struct boundsArrays *const bounds,
+                              bool *const visible, const size_t n) {
+        const __m256 zero = _mm256_setzero_ps();
+
+        size_t i = 0;
+        for (; i+8 <= n; i+=8) {
+                const __m256 cx = _mm256_loadu_ps(bounds->cx + i);
+                const __m256 cy = _mm256_loadu_ps(bounds->cy + i);
+                const __m256 cz = _mm256_loadu_ps(bounds->cz + i);
+                const __m256 ex = _mm256_loadu_ps(bounds->ex + i);
+                const __m256 ey = _mm256_loadu_ps(bounds->ey + i);
+                const __m256 ez = _mm256_loadu_ps(bounds->ez + i);
+                const __m256 r = _mm256_loadu_ps(bounds->r + i);
+
+                __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+                for (size_t p=0; p<6; p++) {
+                        const __m256 distance = _mm256_add_ps(_mm256_add_ps(
+                                _mm256_add_ps(
+                                        _mm256_mul_ps(
+                                                _mm256_set1_ps(planes[p].x),
+                                                cx),
+                                        _mm256_mul_ps(
+                                                _mm256_set1_ps(planes[p].y),
+                                                cy)),
+                                _mm256_mul_ps(_mm256_set1_ps(planes[p].z),
+                                              cz)),
+                                _mm256_set1_ps(planes[p].w));
+                        const __m256 box = _mm256_add_ps(_mm256_add_ps(
+                                _mm256_mul_ps(
+                                        _mm256_set1_ps(fabsf(planes[p].x)),
+                                        ex),
+                                _mm256_mul_ps(
+                                        _mm256_set1_ps(fabsf(planes[p].y)),
+                                        ey)),
+                                _mm256_mul_ps(
+                                        _mm256_set1_ps(fabsf(planes[p].z)),
+                                        ez));
+                        const __m256 reach = _mm256_min_ps(box, r);
+                        inside = _mm256_and_ps(inside, _mm256_cmp_ps(
+                                _mm256_add_ps(distance, reach), zero,
+                                _CMP_GE_OQ));
+                }
+
+                const int mask = _mm256_movemask_ps(inside);
+                for (size_t k=0; k<8; k++) {
+                        visible[i+k] = (mask >> k) & 1;
+                }
+        }
+        return i;
+}
+
+#endif /* VECTORMATH_X86 */
+
+size_t vectorMath_cullFrustum(const vec4s planes[6],
+                              const struct boundsArrays *const bounds,
+                              bool *const visible, const size_t n) {
+        assert(n <= bounds->capacity);
+        size_t done = 0;
+        switch (vectorMath_level()) {
+#ifdef VECTORMATH_X86
+        case VECTORMATH_AVX512:
+        case VECTORMATH_AVX2:
+                done = cullFrustumAVX2(planes, bounds, visible, n);
+                break;
+        case VECTORMATH_SSE4:
+                done = cullFrustumSSE4(planes, bounds, visible, n);
+                break;
+#else
+        case VECTORMATH_AVX512:
+        case VECTORMATH_AVX2:
+        case VECTORMATH_SSE4:
+#endif
+        case VECTORMATH_SCALAR:
+        default:
+                break;
+        }
+        cullFrustumScalar(planes, bounds, visible, done, n);
+
+        size_t count = 0;
+        for (size_t i=0; i<n; i++) {
+                count += visible[i];
+        }
+        return count;
+}